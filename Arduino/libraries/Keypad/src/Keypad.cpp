@@ -46,6 +46,11 @@ Keypad::Keypad(char *userKeymap, byte *row, byte *col, byte numRows, byte numCol
 
 	startTime = 0;
 	single_key = false;
+
+	directPorts = true;
+#if defined(__AVR__)
+	mapPorts();
+#endif
 }
 
 // Let the user define a keymap - assume the same row/column count as defined in constructor
@@ -81,6 +86,12 @@ bool Keypad::getKeys() {
 
 // Private : Hardware scan
 void Keypad::scanKeys() {
+#if defined(__AVR__)
+	if (directPorts) {
+		scanPorts();
+		return;
+	}
+#endif
 	// Re-intialize the row pins. Allows sharing these pins with other hardware.
 	for (byte r=0; r<sizeKpd.rows; r++) {
 		pin_mode(rowPins[r],INPUT_PULLUP);
@@ -99,6 +110,63 @@ void Keypad::scanKeys() {
 	}
 }
 
+#if defined(__AVR__)
+// Time for a row line to settle after a column is driven, before it is read.
+// The pull-ups are weak; digitalRead() used to provide this delay by accident.
+#define KEYPAD_SETTLE_US 5
+
+// Private : Look up each pin's port registers once, not on every read.
+void Keypad::mapPorts() {
+	for (byte r=0; r<sizeKpd.rows && r<MAPSIZE; r++) {
+		byte port = digitalPinToPort(rowPins[r]);
+		rowIn[r] = portInputRegister(port);
+		rowMode[r] = portModeRegister(port);
+		rowOut[r] = portOutputRegister(port);
+		rowMask[r] = digitalPinToBitMask(rowPins[r]);
+	}
+	for (byte c=0; c<sizeKpd.columns && c<16; c++) {
+		byte port = digitalPinToPort(columnPins[c]);
+		colMode[c] = portModeRegister(port);
+		colOut[c] = portOutputRegister(port);
+		colMask[c] = digitalPinToBitMask(columnPins[c]);
+	}
+}
+
+// Private : scanKeys() on port registers -- the same pulses, in the same
+// order, without the pin lookups. Each read-modify-write is done with
+// interrupts off, as digitalWrite() does, since the ports are shared.
+void Keypad::scanPorts() {
+	uint8_t oldSREG;
+
+	for (byte r=0; r<sizeKpd.rows; r++) {
+		oldSREG = SREG;
+		cli();
+		*rowMode[r] &= ~rowMask[r];		// INPUT_PULLUP
+		*rowOut[r] |= rowMask[r];
+		SREG = oldSREG;
+	}
+
+	for (byte c=0; c<sizeKpd.columns; c++) {
+		oldSREG = SREG;
+		cli();
+		*colOut[c] &= ~colMask[c];		// Begin column pulse output.
+		*colMode[c] |= colMask[c];
+		SREG = oldSREG;
+		delayMicroseconds(KEYPAD_SETTLE_US);
+		for (byte r=0; r<sizeKpd.rows; r++) {
+			bitWrite(bitMap[r], c, !(*rowIn[r] & rowMask[r]));  // keypress is active low so invert to high.
+		}
+		// Set pin to high impedance input. Effectively ends column pulse.
+		oldSREG = SREG;
+		cli();
+		*colOut[c] |= colMask[c];
+		*colMode[c] &= ~colMask[c];
+		*colOut[c] &= ~colMask[c];		// pull-up off, as pinMode(INPUT) leaves it
+		SREG = oldSREG;
+	}
+}
+#endif
+
 // Manage the list without rearranging the keys. Returns true if any keys on the list changed state.
 bool Keypad::updateList() {
 
@@ -99,6 +99,12 @@ public:
 	bool keyStateChanged();
 	byte numKeys();
 
+protected:
+	// On AVR, scanKeys() drives and reads the matrix through cached port
+	// registers instead of pin_mode()/pin_write()/pin_read(). A subclass that
+	// overrides those (an I2C port expander, say) must clear this.
+	bool directPorts;
+
 private:
 	unsigned long startTime;
 	char *keymap;
@@ -110,6 +116,19 @@ private:
 	bool single_key;
 
 	void scanKeys();
+#if defined(__AVR__)
+	// Port registers and bit for each row and column pin, from mapPorts().
+	volatile uint8_t *rowIn[MAPSIZE];
+	volatile uint8_t *rowMode[MAPSIZE];
+	volatile uint8_t *rowOut[MAPSIZE];
+	uint8_t rowMask[MAPSIZE];
+	volatile uint8_t *colMode[16];
+	volatile uint8_t *colOut[16];
+	uint8_t colMask[16];
+
+	void mapPorts();
+	void scanPorts();
+#endif
 	bool updateList();
 	void nextKeyState(byte n, boolean button);
 	void transitionTo(byte n, KeyState nextState);
@@ -120,6 +139,8 @@ private:
 
 /*
 || @changelog
+|| | 3.1 (local)                       : scanKeys() reads AVR ports directly (directPorts), so a
+|| |                                          scan is cheap enough to run from a timer interrupt.
 || | 3.1 2013-01-15 - Mark Stanley     : Fixed missing RELEASED & IDLE status when using a single key.
 || | 3.0 2012-07-12 - Mark Stanley     : Made library multi-keypress by default. (Backwards compatible)
 || | 3.0 2012-07-12 - Mark Stanley     : Modified pin functions to support Keypad_I2C
@@ -5,6 +5,7 @@
  */
 #include <SoftwareSerial.h>
 #include <Wire.h>
+#include <avr/pgmspace.h>
 #include <avr/wdt.h>
 
 #define I2C_DISPLAY_ADDR 8
@@ -15,6 +16,15 @@
 #define CMD_COIN_PROGRAM  0x04
 #define CMD_COIN_VERIFY   0x05
 #define CMD_KEEPALIVE     0x06  /* Pi->Arduino: no-op, resets serial watchdog (#59) */
+#define CMD_DISPLAY_RUN   0x07  /* Pi->Arduino: cell, length, chars -- partial update */
+#define CMD_LINK_RATE     0x08  /* Pi->Arduino: 4-byte big-endian baud; echoed, then switched to */
+
+/* VFD geometry and the controller's cursor command: VFD_SET_POSITION followed
+ * by a cell number 0..VFD_CELLS-1 (row-major, 20 per row) moves the write
+ * position there; the characters that follow overwrite from that cell. */
+#define VFD_COLS          20
+#define VFD_CELLS         40
+#define VFD_SET_POSITION  0x10
 
 /* I2C event prefixes (keypad -> display -> Pi) */
 #define EVT_KEY        'K'
@@ -23,13 +33,91 @@
 #define EVT_CARD       'C'
 #define EVT_COIN_DATA  'V'
 #define EVT_DIAG       'G'   /* (#230) diagnostics: 'G' + 'B' + 3 ASCII digits.
-                                * Not 'X' -- that is this sketch's own serial
-                                * timeout response, and a marker collision makes
-                                * the host eat the events behind it (#259). */
+                                * Not 'X' -- the bare-marker firmware echoed
+                                * that on a serial timeout, and a marker
+                                * collision made the host eat the events behind
+                                * it (#259). */
 #define EVT_HEARTBEAT  'P'
 
 #define HEARTBEAT_INTERVAL_MS 10000UL
 
+/*
+ * Link framing to the Pi (host/serial_link.h has the full description; keep
+ * the two in step). Every message either way is
+ *
+ *   0x00  COBS( ver|flags  seq  type  payload...  crc_hi crc_lo )  0x00
+ *
+ * with a CRC-16/CCITT-FALSE over everything before it. `type` is the event
+ * letter going up and the CMD_* opcode coming down; the payload is what used
+ * to follow it on the wire. A bad frame is dropped and the next 0x00 starts
+ * afresh, so nothing here waits on the Pi for the rest of a command any more.
+ * Each bad frame from the Pi is answered with a LINK_TYPE_REJECT: the Pi's
+ * display runs are diffs, and after losing one it has to repaint in full.
+ *
+ * Events a person or a coin produced (keypad, hook, card, coin, coin-EEPROM
+ * progress) are sent LINK_FLAG_ACK_REQ and kept in linkWindow until the Pi
+ * acknowledges them; after LINK_RTO_MS without an ACK everything still held
+ * is sent again in order. Heartbeats and diagnostics are fire-and-forget.
+ * Until the first ACK after a reset, frames carry LINK_FLAG_SYN so the Pi
+ * knows to start counting again.
+ *
+ * Those same events carry LINK_FLAG_STAMP and end with their age -- ms since
+ * capture, worked out afresh every time the frame goes out -- so the Pi can
+ * tell when the key was really pressed.
+ */
+#define LINK_VERSION      1
+#define LINK_FLAG_ACK_REQ 0x01
+#define LINK_FLAG_ACK     0x02
+#define LINK_FLAG_SYN     0x04
+#define LINK_FLAG_STAMP   0x08  /* payload ends with the event's age: ms, big-endian */
+#define LINK_TYPE_ACK     0x00
+#define LINK_TYPE_ECHO    0x01  /* sent straight back: the Pi's rate probe */
+#define LINK_TYPE_REJECT  0x7F  /* to the Pi: a frame of yours arrived damaged */
+#define LINK_HEADER       3
+#define LINK_CRC          2
+#define LINK_STAMP        2
+#define LINK_MAX_PAYLOAD  104  /* CMD_DISPLAY_TEXT: length byte + 100 chars */
+#define LINK_RX_MAX       (LINK_HEADER + LINK_MAX_PAYLOAD + LINK_CRC + 1)
+#define LINK_EVENT_MAX    16   /* longest event payload: a card PAN */
+#define LINK_WINDOW       8    /* reliable events in flight */
+#define LINK_RTO_MS       200UL
+
+struct LinkPending {
+  byte seq;
+  byte type;
+  byte len;
+  bool stamped;
+  unsigned long at;   /* capture time on our millis() clock */
+  byte payload[LINK_EVENT_MAX];
+};
+
+static LinkPending linkWindow[LINK_WINDOW];
+static byte linkWinHead = 0, linkWinCount = 0;
+static byte linkNextSeq = 0;
+static bool linkAcked = false;        /* the Pi has ACKed since this reset */
+static unsigned long linkLastSend = 0;
+
+/*
+ * Line rate. The Pi asks for a faster one with CMD_LINK_RATE at connect time
+ * (host/link_rate.h): we echo the request at the old rate, switch, and
+ * expect the Pi's test pattern at the new one. If no valid frame arrives
+ * within LINK_RATE_CONFIRM_MS the new rate is not working and we go back to
+ * the base rate, where the Pi will be too. On the native USB port the rate is
+ * nominal, but the same handshake holds for a real UART.
+ */
+#define LINK_BASE_RATE        9600UL
+#define LINK_RATE_CONFIRM_MS  300UL
+
+static unsigned long linkRate = LINK_BASE_RATE;
+static bool linkRatePending = false;  /* switched; no valid frame since */
+static unsigned long linkRateSince = 0;
+
+/* Encoded bytes of the Pi's frame in progress, decoded in place on 0x00. */
+static byte linkRx[LINK_RX_MAX];
+static byte linkRxLen = 0;
+static bool linkRxOverflow = false;
+static bool linkRejectPending = false;  /* a damaged frame is not yet reported */
+
 #define d0 5
 #define d1 6
 #define d2 7
@@ -69,8 +157,11 @@ SoftwareSerial coinSerialDevice(14, 23);
  * diameter, thickness, and metal composition as measured by the validator's
  * inductive sensors.  The values were captured from a known-good validator
  * and are specific to the TRC-6500 hardware revision.
+ *
+ * Kept in flash (read with pgm_read_byte) -- it is never written, and the
+ * 256 bytes of SRAM it used to occupy now hold the VFD queue.
  */
-byte coinEeprom[] = {
+const byte coinEeprom[] PROGMEM = {
     3,   217, 5,   255, 0,   248, 1,   110, 10,  0,   5,   8,   7,   4,   0,
     3,   240, 5,   204, 40,  0,   192, 0,   12,  40,  180, 18,  50,  128, 100,
     255, 0,   45,  89,  62,  236, 40,  200, 80,  111, 37,  75,  35,  72,  50,
@@ -90,26 +181,31 @@ byte coinEeprom[] = {
     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   49,  48,  50,
     48};
 
-/* I2C rx buffer: 64 bytes. Wire lib on AVR uses 32-byte hw buffer.
- * Host must keep commands under this limit (#134). */
-/* (#230 item 3) Sized against the worst case a blocked main loop can face.
+/* Alpha prefixes each message with EVT_STAMP and the milliseconds it spent
+ * queued on Alpha (its capture-to-send age), big-endian. Messages without it
+ * -- Alpha's diagnostics, older Alpha firmware -- are taken as captured on
+ * arrival. */
+#define EVT_STAMP 'T'
+
+/* (#230 item 3) Sized against the worst case a stalled main loop can face.
  *
- * A VFD repaint blocks this loop for ~192 ms (vfdreset 12 ms + delay(100) +
- * ~2 ms per character), and the coin-validator reset for ~2 s. The TWI ISR
- * keeps running throughout -- nothing here disables interrupts, and AVR
- * delay() does not either -- so Alpha's messages are still ACKed and still
- * land in this ring. What stops for that window is the drain into USB, so the
- * ring is the only thing standing between a long repaint and a lost message.
+ * loop() no longer blocks on the VFD or the coin validator (see vfdService()
+ * and coinService()), but the drain into USB still stops whenever the link
+ * window is full and the Pi is slow to ACK. The TWI ISR keeps running
+ * throughout, so Alpha's messages are still ACKed and still land in this
+ * ring; the ring is what stands between a stalled drain and a lost message.
  *
- * Alpha sends at most 17 bytes per message (a card PAN); keypresses and hook
- * changes are 2. At 256 the ring absorbs ~15 card swipes or 128 keypresses
- * inside a single repaint, which is far past anything a person can produce.
- * At the previous 64 it was ~3 swipes -- still ample, but the margin was
- * reasoned rather than generous, and 192 bytes of SRAM is cheap insurance on a
- * board sitting at 30% usage.
+ * Each message is stored behind a length byte and the low 16 bits of millis()
+ * when it arrived (I2C_MSG_HEADER). Alpha sends at most 20 bytes per message
+ * (a stamped card PAN); stamped keypresses and hook changes are 5. At 256 the
+ * ring absorbs ~11 card swipes or 31 keypresses while the drain is stalled,
+ * which is far past anything a person can produce. At the previous 64 it was
+ * ~2 swipes -- the margin was reasoned rather than generous, and 192 bytes of
+ * SRAM is cheap insurance.
  *
  * Keep this <= 256: i2cHead/i2cTail are bytes. */
 #define I2C_BUF_SIZE 256
+#define I2C_MSG_HEADER 3
 static volatile byte i2cBuf[I2C_BUF_SIZE];
 static volatile byte i2cHead = 0, i2cTail = 0;
 
@@ -132,14 +228,475 @@ static unsigned long lastHeartbeat = 0;
 
 const unsigned long SERIAL_TIMEOUT_MS = 2000;
 
-static bool waitForSerial() {
-  unsigned long start = millis();
-  while (!SerialUSB.available()) {
-    if (millis() - start > SERIAL_TIMEOUT_MS) return false;
+static uint16_t linkCrc16(const byte *p, byte n) {
+  uint16_t crc = 0xFFFF;
+  for (byte i = 0; i < n; i++) {
+    crc ^= (uint16_t)p[i] << 8;
+    for (byte bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+/* Frame and write one message. Event payloads are at most LINK_EVENT_MAX, so
+ * the encoded frame always fits `enc` in a single COBS block. With
+ * LINK_FLAG_STAMP the age of an event captured at `at` is appended. */
+static void linkSend(byte flags, byte seq, byte type, const byte *payload, byte len,
+                     unsigned long at) {
+  byte raw[LINK_HEADER + LINK_EVENT_MAX + LINK_STAMP + LINK_CRC];
+  byte enc[sizeof(raw) + 1];
+  byte n = 0, code_at = 0, o = 1, code = 1;
+
+  if (len > LINK_EVENT_MAX) len = LINK_EVENT_MAX;
+  raw[n++] = (LINK_VERSION << 4) | (flags & 0x0F);
+  raw[n++] = seq;
+  raw[n++] = type;
+  for (byte i = 0; i < len; i++) raw[n++] = payload[i];
+  if (flags & LINK_FLAG_STAMP) {
+    unsigned long age = millis() - at;
+    if (age > 0xFFFF) age = 0xFFFF;
+    raw[n++] = age >> 8;
+    raw[n++] = age & 0xFF;
+  }
+  uint16_t crc = linkCrc16(raw, n);
+  raw[n++] = crc >> 8;
+  raw[n++] = crc & 0xFF;
+
+  for (byte i = 0; i < n; i++) {
+    if (raw[i] == 0) {
+      enc[code_at] = code;
+      code_at = o++;
+      code = 1;
+    } else {
+      enc[o++] = raw[i];
+      code++;
+    }
+  }
+  enc[code_at] = code;
+
+  SerialUSB.write((byte)0);
+  SerialUSB.write(enc, o);
+  SerialUSB.write((byte)0);
+}
+
+/* Unacknowledged: heartbeats and diagnostics, which are restated anyway. */
+static void linkSendUnreliable(byte type, const byte *payload, byte len) {
+  linkSend(0, 0, type, payload, len, 0);
+}
+
+static bool linkWindowFull() {
+  return linkWinCount == LINK_WINDOW;
+}
+
+static byte linkReliableFlags() {
+  return LINK_FLAG_ACK_REQ | (linkAcked ? 0 : LINK_FLAG_SYN);
+}
+
+static void linkSendPending(const LinkPending *p) {
+  linkSend(linkReliableFlags() | (p->stamped ? LINK_FLAG_STAMP : 0),
+           p->seq, p->type, p->payload, p->len, p->at);
+}
+
+static bool linkQueueReliable(byte type, const byte *payload, byte len,
+                              bool stamped, unsigned long at) {
+  if (linkWindowFull()) return false;
+  if (len > LINK_EVENT_MAX) len = LINK_EVENT_MAX;
+
+  LinkPending *p = &linkWindow[(linkWinHead + linkWinCount) % LINK_WINDOW];
+  p->seq = linkNextSeq++;
+  p->type = type;
+  p->len = len;
+  p->stamped = stamped;
+  p->at = at;
+  if (len > 0) memcpy(p->payload, payload, len);
+  if (linkWinCount++ == 0) linkLastSend = millis();
+
+  linkSendPending(p);
+  return true;
+}
+
+/* Send an event the Pi must acknowledge. Returns false, sending nothing, if
+ * the window is full; callers leave the event where it came from (the I2C
+ * ring, the coin validator's UART) and try again next loop. */
+static bool linkSendReliable(byte type, const byte *payload, byte len) {
+  return linkQueueReliable(type, payload, len, false, 0);
+}
+
+/* The same for an event captured at `at` (millis()), which goes out stamped
+ * with its age. */
+static bool linkSendStamped(byte type, const byte *payload, byte len, unsigned long at) {
+  return linkQueueReliable(type, payload, len, true, at);
+}
+
+/* The Pi has everything up to and including `seq`. */
+static void linkOnAck(byte seq) {
+  bool progressed = false;
+  while (linkWinCount > 0 &&
+         (int8_t)(seq - linkWindow[linkWinHead].seq) >= 0) {
+    linkWinHead = (linkWinHead + 1) % LINK_WINDOW;
+    linkWinCount--;
+    progressed = true;
+  }
+  linkAcked = true;
+  if (progressed) linkLastSend = millis();
+}
+
+/* Go-back-N: nothing acknowledged for LINK_RTO_MS, so resend all of it. */
+static void linkRetransmit() {
+  if (linkWinCount == 0 || millis() - linkLastSend < LINK_RTO_MS) return;
+  for (byte i = 0; i < linkWinCount; i++) {
+    linkSendPending(&linkWindow[(linkWinHead + i) % LINK_WINDOW]);
+  }
+  linkLastSend = millis();
+}
+
+/* Decode the frame in linkRx in place. Returns the decoded length, or 0 if it
+ * is not valid COBS. */
+static byte linkDecode() {
+  byte i = 0, o = 0;
+  while (i < linkRxLen) {
+    byte code = linkRx[i++];
+    for (byte k = 1; k < code; k++) {
+      if (i >= linkRxLen) return 0;
+      linkRx[o++] = linkRx[i++];
+    }
+    if (code < 0xFF && i < linkRxLen) linkRx[o++] = 0;
+  }
+  return o;
+}
+
+static bool handleCommand(byte cmd, const byte *payload, byte len);
+
+/* Decoded length of a command frame left in linkRx because handleCommand()
+ * had no room for it yet; 0 when none is held. While one is held nothing more
+ * is read from the Pi, so USB flow control pushes back on it instead. */
+static byte linkHeldLen = 0;
+
+static bool linkRateSupported(unsigned long rate) {
+  return rate == LINK_BASE_RATE || rate == 115200UL || rate == 230400UL ||
+         rate == 500000UL || rate == 1000000UL;
+}
+
+static void linkSetRate(unsigned long rate) {
+  SerialUSB.flush();   /* what was written at the old rate goes out at it */
+  SerialUSB.begin(rate);
+  linkRate = rate;
+}
+
+/* Take one byte from the Pi. Returns true when it completed a command frame
+ * and the command has been carried out. */
+static bool linkReceive(byte b) {
+  if (b != 0) {
+    if (linkRxLen < sizeof(linkRx)) {
+      linkRx[linkRxLen++] = b;
+    } else {
+      linkRxOverflow = true;
+    }
+    return false;
+  }
+
+  /* Back-to-back delimiters are no frame at all, not a damaged one. */
+  bool empty = (linkRxLen == 0 && !linkRxOverflow);
+  byte n = linkRxOverflow ? 0 : linkDecode();
+  linkRxLen = 0;
+  linkRxOverflow = false;
+  if (empty) return false;
+  if (n < LINK_HEADER + LINK_CRC ||
+      linkCrc16(linkRx, n - LINK_CRC) != (((uint16_t)linkRx[n - 2] << 8) | linkRx[n - 1]) ||
+      (linkRx[0] >> 4) != LINK_VERSION) {
+    linkRejectPending = true;
+    return false;
+  }
+
+  linkRatePending = false;   /* the Pi got through: the rate works */
+
+  byte flags = linkRx[0] & 0x0F;
+  if (flags & LINK_FLAG_ACK) {
+    linkOnAck(linkRx[1]);
+    return false;
+  }
+  if (!handleCommand(linkRx[2], linkRx + LINK_HEADER, n - LINK_HEADER - LINK_CRC)) {
+    linkHeldLen = n;
   }
   return true;
 }
 
+/* Offer a held command again. Returns true once nothing is held. */
+static bool linkRetryHeld() {
+  if (linkHeldLen == 0) return true;
+  if (!handleCommand(linkRx[2], linkRx + LINK_HEADER, linkHeldLen - LINK_HEADER - LINK_CRC)) {
+    return false;
+  }
+  linkHeldLen = 0;
+  return true;
+}
+
+/*
+ * VFD output. The controller takes a byte per WR strobe -- WR low for 1 ms,
+ * then 1 ms before the next -- and a repaint starts with a reset pulse and a
+ * 100 ms settle. Done with delay() that held this loop for ~192 ms per
+ * repaint; instead commands queue their bytes in vfdOps and vfdService()
+ * carries out one step per loop() pass, returning at once while a step's time
+ * has not yet passed.
+ *
+ * vfdOps is a byte stream: characters as themselves, and VFD_ESC followed by
+ * VFD_OP_RESET, by VFD_OP_WAIT and a count of milliseconds, or by VFD_ESC
+ * again for a literal 0xFF. A repaint takes ~107 bytes (never more than 207),
+ * leaving room for the runs queued behind it. Keep this <= 256: the indices are bytes.
+ */
+#define VFD_OPS_SIZE  256
+#define VFD_ESC       0xFF
+#define VFD_OP_RESET  0x00
+#define VFD_OP_WAIT   0x01
+#define VFD_SETTLE_MS 100
+
+static byte vfdOps[VFD_OPS_SIZE];
+static byte vfdOpsHead = 0, vfdOpsTail = 0;
+
+enum { VFD_IDLE, VFD_STROBE, VFD_RESET_PULSE, VFD_WAIT };
+static byte vfdPhase = VFD_IDLE;
+static unsigned long vfdSince = 0, vfdWaitUs = 0;
+
+static unsigned int vfdOpsFree() {
+  return VFD_OPS_SIZE - 1 - (vfdOpsHead + VFD_OPS_SIZE - vfdOpsTail) % VFD_OPS_SIZE;
+}
+
+static void vfdPut(byte b) {
+  vfdOps[vfdOpsHead] = b;
+  vfdOpsHead = (vfdOpsHead + 1) % VFD_OPS_SIZE;
+}
+
+/* Queue a character; up to 2 bytes of vfdOps. */
+static void vfdPutChar(byte v) {
+  if (v == VFD_ESC) vfdPut(VFD_ESC);
+  vfdPut(v);
+}
+
+/* Queue a reset pulse and the settle after it. Throws away whatever was
+ * queued and not yet started: the repaint that follows replaces all of it. */
+static void vfdPutReset() {
+  vfdOpsTail = vfdOpsHead;
+  vfdPut(VFD_ESC);
+  vfdPut(VFD_OP_RESET);
+  vfdPut(VFD_ESC);
+  vfdPut(VFD_OP_WAIT);
+  vfdPut(VFD_SETTLE_MS);
+}
+
+static byte vfdTake() {
+  byte b = vfdOps[vfdOpsTail];
+  vfdOpsTail = (vfdOpsTail + 1) % VFD_OPS_SIZE;
+  return b;
+}
+
+static void vfdWait(byte phase, unsigned long us) {
+  vfdPhase = phase;
+  vfdSince = micros();
+  vfdWaitUs = us;
+}
+
+/* Present one character to the controller and start its strobe. */
+static void vfdStrobe(byte v) {
+  digitalWrite(AD, LOW);
+  digitalWrite(WR, HIGH);
+  digitalWrite(CS, LOW);
+  digitalWrite(d0, bitRead(v, 0));
+  digitalWrite(d1, bitRead(v, 1));
+  digitalWrite(d2, bitRead(v, 2));
+  digitalWrite(d3, bitRead(v, 3));
+  digitalWrite(d4, bitRead(v, 4));
+  digitalWrite(d5, bitRead(v, 5));
+  digitalWrite(d6, bitRead(v, 6));
+  digitalWrite(d7, bitRead(v, 7));
+  digitalWrite(WR, LOW);
+  vfdWait(VFD_STROBE, 1000);
+}
+
+static void vfdService() {
+  if (vfdPhase != VFD_IDLE) {
+    if (micros() - vfdSince < vfdWaitUs) return;
+    if (vfdPhase == VFD_STROBE) {
+      digitalWrite(WR, HIGH);
+      digitalWrite(CS, HIGH);
+      vfdWait(VFD_WAIT, 1000);
+      return;
+    }
+    if (vfdPhase == VFD_RESET_PULSE) {
+      digitalWrite(RESET, LOW);
+      vfdWait(VFD_WAIT, 10000);
+      return;
+    }
+    vfdPhase = VFD_IDLE;
+  }
+
+  if (vfdOpsTail == vfdOpsHead) return;
+  byte b = vfdTake();
+  if (b != VFD_ESC) {
+    vfdStrobe(b);
+    return;
+  }
+  b = vfdTake();
+  if (b == VFD_OP_RESET) {
+    digitalWrite(RESET, HIGH);
+    vfdWait(VFD_RESET_PULSE, 2000);
+  } else if (b == VFD_OP_WAIT) {
+    vfdWait(VFD_WAIT, vfdTake() * 1000UL);
+  } else {
+    vfdStrobe(b);   /* escaped 0xFF */
+  }
+}
+
+/*
+ * Coin validator. A reset holds its reset line low for a second and then
+ * gives it a second to come up; a control byte wants 100 ms before the next;
+ * programming or verifying the EEPROM paces every byte 20 ms apart across
+ * 256 addresses -- half a minute of delay() for a program run, during which
+ * nothing reached the Pi. coinService() now takes one step per loop() pass.
+ *
+ * CMD_COIN_CTRL bytes queue in coinQueue and are carried out in order. A
+ * program or verify run waits for the queue to empty and then runs alone;
+ * its 'A'/'B' and 'D'/'E'/'F' reports wait for room in the link window, so
+ * none of them is sent unacknowledged.
+ *
+ * Each byte to the validator is still bit-banged by SoftwareSerial with
+ * interrupts off, ~17 ms at 600 baud: the longest loop() now goes without
+ * looking at the Pi.
+ */
+#define COIN_QUEUE_SIZE  8
+#define COIN_RESET_MS    1000UL
+#define COIN_CTRL_MS     100UL
+#define COIN_BYTE_MS     20UL
+#define COIN_EEPROM_SIZE 256
+
+static byte coinQueue[COIN_QUEUE_SIZE];
+static byte coinQueueHead = 0, coinQueueCount = 0;
+
+enum { COIN_IDLE, COIN_RESETTING, COIN_PROGRAMMING, COIN_VERIFYING };
+static byte coinJob = COIN_IDLE;
+static byte coinStep = 0;
+static unsigned int coinAddr = 0;
+static unsigned long coinSince = 0, coinWaitMs = 0;
+static byte coinReport[3];
+
+static void coinWait(unsigned long ms) {
+  coinSince = millis();
+  coinWaitMs = ms;
+}
+
+/* Step 0 reports the start; 1-6 write one address (E A P w, address, value);
+ * 7 reports the end. */
+static void coinProgramStep() {
+  static const byte preamble[4] = { 'E', 'A', 'P', 'w' };
+
+  if (coinStep == 0) {
+    if (!linkSendReliable('A', NULL, 0)) return;
+    coinAddr = 0;
+    coinStep = 1;
+  } else if (coinStep <= 4) {
+    coinSerialDevice.write(preamble[coinStep - 1]);
+    coinStep++;
+    coinWait(COIN_BYTE_MS);
+  } else if (coinStep == 5) {
+    coinSerialDevice.write(lowByte(coinAddr));
+    coinStep++;
+    coinWait(COIN_BYTE_MS);
+  } else if (coinStep == 6) {
+    coinSerialDevice.write(pgm_read_byte(&coinEeprom[coinAddr]));
+    coinWait(COIN_BYTE_MS);
+    coinStep = (++coinAddr < COIN_EEPROM_SIZE) ? 1 : 7;
+  } else {
+    if (!linkSendReliable('B', NULL, 0)) return;
+    coinJob = COIN_IDLE;
+  }
+}
+
+/* Step 0 reports the start; 1-3 ask for one address (q, 0x01, address); 4
+ * waits up to SERIAL_TIMEOUT_MS for the answer; 5 reports a mismatch; 6
+ * reports the end. */
+static void coinVerifyStep() {
+  switch (coinStep) {
+  case 0:
+    if (!linkSendReliable('D', NULL, 0)) return;
+    coinAddr = 0;
+    coinStep = 1;
+    break;
+  case 1:
+    while (coinSerialDevice.available()) {
+      coinSerialDevice.read();
+    }
+    coinSerialDevice.write('q');
+    coinStep = 2;
+    coinWait(COIN_BYTE_MS);
+    break;
+  case 2:
+    coinSerialDevice.write(0x01);
+    coinStep = 3;
+    coinWait(COIN_BYTE_MS);
+    break;
+  case 3:
+    coinSerialDevice.write(lowByte(coinAddr));
+    coinStep = 4;
+    coinWait(COIN_BYTE_MS);
+    break;
+  case 4:
+    /* coinSince is still when the address went out. No answer in time is
+     * not reported, as before; the address is simply passed over. */
+    if (!coinSerialDevice.available()) {
+      if (millis() - coinSince <= COIN_BYTE_MS + SERIAL_TIMEOUT_MS) return;
+    } else {
+      byte val = coinSerialDevice.read();
+      byte expected = pgm_read_byte(&coinEeprom[coinAddr]);
+      if (val != expected) {
+        coinReport[0] = lowByte(coinAddr);
+        coinReport[1] = val;
+        coinReport[2] = expected;
+        coinStep = 5;
+        return;
+      }
+    }
+    coinStep = (++coinAddr < COIN_EEPROM_SIZE) ? 1 : 6;
+    break;
+  case 5:
+    if (!linkSendReliable('E', coinReport, sizeof(coinReport))) return;
+    coinStep = (++coinAddr < COIN_EEPROM_SIZE) ? 1 : 6;
+    break;
+  default:
+    if (!linkSendReliable('F', NULL, 0)) return;
+    coinJob = COIN_IDLE;
+    break;
+  }
+}
+
+static void coinService() {
+  if (coinWaitMs != 0) {
+    if (millis() - coinSince < coinWaitMs) return;
+    coinWaitMs = 0;
+  }
+
+  if (coinJob == COIN_RESETTING) {
+    digitalWrite(coinResetPin, HIGH);
+    coinJob = COIN_IDLE;
+    coinWait(COIN_RESET_MS);
+  } else if (coinJob == COIN_PROGRAMMING) {
+    coinProgramStep();
+  } else if (coinJob == COIN_VERIFYING) {
+    coinVerifyStep();
+  } else if (coinQueueCount > 0) {
+    byte data = coinQueue[coinQueueHead];
+    coinQueueHead = (coinQueueHead + 1) % COIN_QUEUE_SIZE;
+    coinQueueCount--;
+    if (data == '@') {
+      digitalWrite(coinResetPin, LOW);
+      coinJob = COIN_RESETTING;
+      coinWait(COIN_RESET_MS);
+    } else {
+      coinSerialDevice.write(data);
+      coinWait(COIN_CTRL_MS);
+    }
+  }
+}
+
 void setup() {
   SerialUSB.begin(9600);
 
@@ -182,51 +739,78 @@ void setup() {
   digitalWrite(TEST, HIGH);
   digitalWrite(RESET, LOW);
 
-  vfdreset();
-  delay(100);
-  writeCharacter(20u);
-  writeCharacter(21);
+  vfdPutReset();
+  vfdPutChar(20u);
+  vfdPutChar(21);
 
   wdt_enable(WDTO_4S);
 }
 
+/* One Wire transmission is one of Alpha's messages. Store it length-first so
+ * loop() can frame it whole -- and drop it whole if it does not fit, rather
+ * than hand the Pi a truncated PAN -- with the time it arrived. */
 void receiveEvent(int howMany) {
+  byte used = (i2cHead + I2C_BUF_SIZE - i2cTail) % I2C_BUF_SIZE;
+  if (howMany <= 0 || howMany + I2C_MSG_HEADER > I2C_BUF_SIZE - 1 - used) {
+    while (Wire.available()) Wire.read();
+    if (howMany > 0) i2cOverflow += howMany;   /* (#230) ring full; message gone */
+    return;
+  }
+  unsigned int arrived = (unsigned int)millis();
+  i2cBuf[i2cHead] = (byte)howMany;
+  i2cHead = (i2cHead + 1) % I2C_BUF_SIZE;
+  i2cBuf[i2cHead] = arrived >> 8;
+  i2cHead = (i2cHead + 1) % I2C_BUF_SIZE;
+  i2cBuf[i2cHead] = arrived & 0xFF;
+  i2cHead = (i2cHead + 1) % I2C_BUF_SIZE;
   while (Wire.available()) {
-    byte b = Wire.read();
-    byte next = (i2cHead + 1) % I2C_BUF_SIZE;
-    if (next != i2cTail) {
-      i2cBuf[i2cHead] = b;
-      i2cHead = next;
-    } else {
-      i2cOverflow++;   /* (#230) ring full; this byte is gone */
-    }
+    i2cBuf[i2cHead] = Wire.read();
+    i2cHead = (i2cHead + 1) % I2C_BUF_SIZE;
   }
 }
 
-void vfdreset() {
-  digitalWrite(RESET, HIGH);
-  delay(2);
-  digitalWrite(RESET, LOW);
-  delay(10);
-}
-
 void loop() {
   wdt_reset();
 
-  noInterrupts();
-  byte head = i2cHead;
-  interrupts();
-  while (i2cTail != head) {
-    SerialUSB.write(i2cBuf[i2cTail]);
-    i2cTail = (i2cTail + 1) % I2C_BUF_SIZE;
+  /* Frame each of Alpha's messages whole. A full window stops the drain; the
+   * ring holds the rest until the Pi's ACKs catch up. Alpha's own drop report
+   * is a diagnostic like ours and goes unacknowledged. */
+  for (;;) {
+    noInterrupts();
+    byte head = i2cHead;
+    interrupts();
+    if (i2cTail == head || linkWindowFull()) break;
+
+    byte len = i2cBuf[i2cTail];
+    unsigned int arrived = ((unsigned int)i2cBuf[(i2cTail + 1) % I2C_BUF_SIZE] << 8) |
+                           i2cBuf[(i2cTail + 2) % I2C_BUF_SIZE];
+    byte msg[32];
+    if (len > sizeof(msg)) len = sizeof(msg);
+    for (byte i = 0; i < len; i++) {
+      msg[i] = i2cBuf[(i2cTail + I2C_MSG_HEADER + i) % I2C_BUF_SIZE];
+    }
+    i2cTail = (i2cTail + I2C_MSG_HEADER + i2cBuf[i2cTail]) % I2C_BUF_SIZE;
+
+    /* Age on Alpha, if it said, plus time in our ring. */
+    unsigned long nowMs = millis();
+    unsigned long age = (unsigned int)((unsigned int)nowMs - arrived);
+    byte *body = msg;
+    if (len >= 4 && msg[0] == EVT_STAMP) {
+      age += ((unsigned int)msg[1] << 8) | msg[2];
+      body += 3;
+      len -= 3;
+    }
+
+    if (body[0] == EVT_DIAG) {
+      linkSendUnreliable(body[0], body + 1, len - 1);
+    } else {
+      linkSendStamped(body[0], body + 1, len - 1, nowMs - age);
+    }
   }
 
-  /* (#230 item 2) Report ring overflows. Emitted only here, after the drain has
-   * finished, so it can never land in the middle of one of Alpha's messages:
-   * Wire delivers a whole transmission per ISR call, so at this point the
-   * stream sits on an event boundary. Beta talks to the Pi directly, so unlike
-   * Alpha's report this always gets through. ASCII digits, because the host
-   * consumes the payload with strlen() and a zero byte would desync it. */
+  /* (#230 item 2) Report ring overflows. Beta talks to the Pi directly, so
+   * unlike Alpha's report this always gets through. ASCII digits, as the host
+   * hands the payload on as a string. */
   {
     unsigned int ov;
     noInterrupts();
@@ -237,152 +821,107 @@ void loop() {
         lastOverflowReport == 0 ||
         nowMs - lastOverflowReport >= OVERFLOW_REPORT_INTERVAL_MS) {
       unsigned int n = (ov > 999) ? 999 : ov;
-      SerialUSB.write(EVT_DIAG);
-      SerialUSB.write('B');
-      SerialUSB.write('0' + (n / 100) % 10);
-      SerialUSB.write('0' + (n / 10) % 10);
-      SerialUSB.write('0' + n % 10);
+      byte diag[4];
+      diag[0] = 'B';
+      diag[1] = '0' + (n / 100) % 10;
+      diag[2] = '0' + (n / 10) % 10;
+      diag[3] = '0' + n % 10;
+      linkSendUnreliable(EVT_DIAG, diag, sizeof(diag));
       i2cOverflowReported = ov;
       lastOverflowReport = nowMs;
     }
   }
 
-  byte buf[100];
-  if (SerialUSB.available()) {
-    byte data = SerialUSB.read();
-    if (data == CMD_DISPLAY_TEXT) {
-      SerialUSB.write('Y');
-      if (!waitForSerial()) { SerialUSB.write('X'); return; }
-      byte num_bytes = SerialUSB.read();
-      SerialUSB.write('L'); SerialUSB.write(num_bytes);
-      if (num_bytes > sizeof(buf)) { SerialUSB.write('Z'); return; }
-      for (int i = 0; i < num_bytes; ++i) {
-        if (!waitForSerial()) { SerialUSB.write('X'); return; }
-        buf[i] = SerialUSB.read();
-      }
-      SerialUSB.write('R');
-      vfdreset();
-      delay(100);
-      writeCharacter(20u); /* display on */
-      writeCharacter(18);  /* scroll off */
-      for (int i = 0; i < num_bytes; ++i) {
-        writeCharacter(buf[i] == 0x0A ? 13 : buf[i]);
-      }
-      SerialUSB.write('W');
-    } else if (data == CMD_COIN_CTRL) {
-      if (!waitForSerial()) return;
-      char data = SerialUSB.read();
-
-      if (data == '@') {
-        digitalWrite(coinResetPin, LOW);
-        delay(1000);
-        digitalWrite(coinResetPin, HIGH);
-        delay(1000);
-      } else {
-        coinSerialDevice.write(data);
-        delay(100);
-      }
-    } else if (data == CMD_COIN_PROGRAM) {
-      SerialUSB.write("A");
-      for (int i = 0; i < 256; ++i) {
-        wdt_reset();
-        coinSerialDevice.write('E');
-        delay(20);
-        coinSerialDevice.write('A');
-        delay(20);
-        coinSerialDevice.write('P');
-        delay(20);
-        coinSerialDevice.write('w');
-        delay(20);
-        coinSerialDevice.write(lowByte(i));
-        delay(20);
-        coinSerialDevice.write(coinEeprom[i]);
-        delay(20);
-      }
-      SerialUSB.write('B');
-    } else if (data == CMD_COIN_VERIFY) {
-      SerialUSB.write('D');
-      for (int i = 0; i < 256; ++i) {
-        wdt_reset();
-        while (coinSerialDevice.available()) {
-          coinSerialDevice.read();
-        }
-        coinSerialDevice.write('q');
-        delay(20);
-        coinSerialDevice.write(0x01);
-        delay(20);
-        coinSerialDevice.write(lowByte(i));
-        delay(20);
-        unsigned long start = millis();
-        while (!coinSerialDevice.available()) {
-          if (millis() - start > SERIAL_TIMEOUT_MS) break;
-        }
-        if (coinSerialDevice.available()) {
-          byte val = coinSerialDevice.read();
-          if (val != coinEeprom[i]) {
-            SerialUSB.write('E');
-            SerialUSB.write(lowByte(i));
-            SerialUSB.write(val);
-            SerialUSB.write(coinEeprom[i]);
-          }
-        }
-      }
-      SerialUSB.write('F');
-    } else if (data == CMD_KEEPALIVE) {
-      /* No-op: Pi sends this when idle to keep serial watchdog from false-triggering */
-    } else {
-      /* Unknown command byte — report it for debugging */
-      SerialUSB.write('?');
-      SerialUSB.write(data);
+  /* At most one command per pass, so a burst from the Pi cannot keep the
+   * I2C ring from draining -- and none at all while one is held. */
+  if (linkRetryHeld()) {
+    while (SerialUSB.available()) {
+      if (linkReceive(SerialUSB.read())) break;
     }
   }
-  if (coinSerialDevice.available()) {
-    char data = coinSerialDevice.read();
-    SerialUSB.write(EVT_COIN_DATA);
-    SerialUSB.write(data);
+  /* One report however many frames were lost since: the Pi only needs to
+   * know that it must repaint. */
+  if (linkRejectPending) {
+    linkSendUnreliable(LINK_TYPE_REJECT, NULL, 0);
+    linkRejectPending = false;
+  }
+
+  vfdService();
+  coinService();
+
+  /* A verify run reads the validator's answers itself. */
+  if (coinJob != COIN_VERIFYING && !linkWindowFull() && coinSerialDevice.available()) {
+    byte data = coinSerialDevice.read();
+    linkSendStamped(EVT_COIN_DATA, &data, 1, millis());
+  }
+
+  linkRetransmit();
+
+  if (linkRatePending && millis() - linkRateSince >= LINK_RATE_CONFIRM_MS) {
+    linkSetRate(LINK_BASE_RATE);
+    linkRatePending = false;
   }
 
   unsigned long now = millis();
   if (now - lastHeartbeat >= HEARTBEAT_INTERVAL_MS) {
-    SerialUSB.write(EVT_HEARTBEAT);
+    linkSendUnreliable(EVT_HEARTBEAT, NULL, 0);
     lastHeartbeat = now;
   }
 }
 
-void writeCommand(byte v) {
-  digitalWrite(AD, HIGH);
-  digitalWrite(WR, HIGH);
-  digitalWrite(CS, LOW);
-  digitalWrite(d0, bitRead(v, 0));
-  digitalWrite(d1, bitRead(v, 1));
-  digitalWrite(d2, bitRead(v, 2));
-  digitalWrite(d3, bitRead(v, 3));
-  digitalWrite(d4, bitRead(v, 4));
-  digitalWrite(d5, bitRead(v, 5));
-  digitalWrite(d6, bitRead(v, 6));
-  digitalWrite(d7, bitRead(v, 7));
-  digitalWrite(WR, LOW);
-  delay(1);
-  digitalWrite(WR, HIGH);
-  digitalWrite(CS, HIGH);
-  delay(1);
-}
-
-void writeCharacter(byte v) {
-  digitalWrite(AD, LOW);
-  digitalWrite(WR, HIGH);
-  digitalWrite(CS, LOW);
-  digitalWrite(d0, bitRead(v, 0));
-  digitalWrite(d1, bitRead(v, 1));
-  digitalWrite(d2, bitRead(v, 2));
-  digitalWrite(d3, bitRead(v, 3));
-  digitalWrite(d4, bitRead(v, 4));
-  digitalWrite(d5, bitRead(v, 5));
-  digitalWrite(d6, bitRead(v, 6));
-  digitalWrite(d7, bitRead(v, 7));
-  digitalWrite(WR, LOW);
-  delay(1);
-  digitalWrite(WR, HIGH);
-  digitalWrite(CS, HIGH);
-  delay(1);
+/* Carry out one command from the Pi. Returns false, having changed nothing,
+ * when the command has to wait for room in the VFD or coin queue; the caller
+ * holds the frame and offers it again on a later pass. */
+static bool handleCommand(byte cmd, const byte *payload, byte len) {
+  if (cmd == CMD_DISPLAY_TEXT) {
+    if (len < 1) return true;
+    byte num_bytes = payload[0];
+    if (num_bytes > 100 || num_bytes != len - 1) return true;
+    vfdPutReset();
+    vfdPutChar(20u); /* display on */
+    vfdPutChar(18);  /* scroll off */
+    for (int i = 0; i < num_bytes; ++i) {
+      vfdPutChar(payload[1 + i] == 0x0A ? 13 : payload[1 + i]);
+    }
+  } else if (cmd == CMD_DISPLAY_RUN) {
+    /* Overwrite `num_bytes` cells starting at `cell`, in place. No reset and
+     * no settle delay: the host diffs each frame against the last one and
+     * sends only the spans that changed, so a scroll step costs a few ms of
+     * strobes instead of the ~192 ms repaint above. The host never sends a
+     * run that crosses a row. */
+    if (len < 2) return true;
+    byte cell = payload[0];
+    byte num_bytes = payload[1];
+    if (cell >= VFD_CELLS || num_bytes > VFD_CELLS - cell || num_bytes != len - 2) return true;
+    if (vfdOpsFree() < 2u * (2 + num_bytes)) return false;
+    vfdPutChar(VFD_SET_POSITION);
+    vfdPutChar(cell);
+    for (int i = 0; i < num_bytes; ++i) {
+      vfdPutChar(payload[2 + i]);
+    }
+  } else if (cmd == CMD_COIN_CTRL) {
+    if (len != 1) return true;
+    if (coinQueueCount == COIN_QUEUE_SIZE) return false;
+    coinQueue[(coinQueueHead + coinQueueCount) % COIN_QUEUE_SIZE] = payload[0];
+    coinQueueCount++;
+  } else if (cmd == CMD_COIN_PROGRAM || cmd == CMD_COIN_VERIFY) {
+    if (coinJob != COIN_IDLE || coinQueueCount > 0) return false;
+    coinJob = (cmd == CMD_COIN_PROGRAM) ? COIN_PROGRAMMING : COIN_VERIFYING;
+    coinStep = 0;
+  } else if (cmd == LINK_TYPE_ECHO) {
+    linkSendUnreliable(LINK_TYPE_ECHO, payload, len);
+  } else if (cmd == CMD_LINK_RATE) {
+    if (len != 4) return true;
+    unsigned long rate = ((unsigned long)payload[0] << 24) | ((unsigned long)payload[1] << 16) |
+                         ((unsigned long)payload[2] << 8) | payload[3];
+    if (!linkRateSupported(rate)) return true;   /* no reply: the Pi moves on */
+    linkSendUnreliable(CMD_LINK_RATE, payload, len);
+    linkSetRate(rate);
+    linkRatePending = (rate != LINK_BASE_RATE);
+    linkRateSince = millis();
+  }
+  /* CMD_KEEPALIVE is a no-op: the Pi sends it when idle to keep its serial
+   * watchdog from false-triggering. Unknown opcodes are ignored; the frame
+   * was intact, so they come from a newer host. */
+  return true;
 }
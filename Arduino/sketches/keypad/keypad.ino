@@ -7,6 +7,7 @@
 #include <MagStripe.h>
 #include <Wire.h>
 #include <avr/wdt.h>
+#include <util/atomic.h>
 
 #define I2C_DISPLAY_ADDR 8
 
@@ -19,28 +20,65 @@
                                 * Not 'X' -- display.ino uses that for a serial
                                 * timeout, and a marker collision makes the host
                                 * eat the events behind it (#259). */
+#define EVT_STAMP      'T'   /* prefix: 'T' + age (ms, big-endian) + event */
 
 const int hookUpPin = 5;
 const int hookDownPin = 4;
 const int hookCommonPin = 21;
 
-bool hookUpState = true;
+/* Written by the scan tick, read by loop() and the status query. */
+volatile bool hookUpState = true;
 unsigned long lastHookChange = 0;
 const unsigned long DEBOUNCE_MS = 50;
 
-/* (#230) Retry budget for an I2C message to Beta.  Deliberately short: it
- * comfortably covers a VFD repaint (~180 ms, display.ino:199-207) but NOT the
- * ~2 s coin-validator reset (display.ino:213-216).  Blocking the keypad scan
- * for two seconds would lose more keypresses than it saved, and the watchdog
- * is only 4 s. */
-const uint8_t I2C_SEND_ATTEMPTS = 8;
+/*
+ * Events waiting for Beta.
+ *
+ * The keypad and the hook are scanned from a 1 kHz timer interrupt
+ * (scanTick()), and the card from loop(); each event goes into this ring with
+ * the millis() it was captured at, and loop() hands the oldest to Beta when
+ * the bus is free. An I2C retry used to hold the whole scan -- up to
+ * 8 x 25 ms per message, long enough for a quick second keypress to come and
+ * go unseen -- whereas now it only holds the ring, which keeps filling.
+ *
+ * Each message goes out as EVT_STAMP, the event's age in ms, then the event:
+ * Beta adds its own queueing time and the Pi gets the capture time on its
+ * clock (host/serial_link.h, SERIAL_LINK_FLAG_STAMP).
+ *
+ * 16 events is a card swipe and a burst of fast dialling behind a Beta that
+ * is not answering; past that the newest event is dropped and counted.
+ */
+#define EVENT_RING_SIZE 16
+#define EVENT_MSG_MAX   (1 + 16)   /* 'C' + a clamped PAN */
+
+struct PendingEvent {
+  unsigned long at;
+  uint8_t len;
+  uint8_t msg[EVENT_MSG_MAX];
+};
+
+static PendingEvent eventRing[EVENT_RING_SIZE];
+static volatile uint8_t eventHead = 0;   /* next free slot; producers only */
+static volatile uint8_t eventTail = 0;   /* oldest event; loop() only */
+
+/* (#230) Retry budget for one event. A NACK means Beta is busy for a moment
+ * -- a SoftwareSerial byte to the coin validator runs ~17 ms with interrupts
+ * off -- or not running at all. Retries no longer stall the scan, so the
+ * budget can cover a Beta that is still booting: 40 x 25 ms is a second
+ * before the event is given up and counted. */
+const uint8_t I2C_SEND_ATTEMPTS = 40;
 const unsigned long I2C_RETRY_DELAY_MS = 25;
 
-/* Messages Beta never acknowledged, even after the retries above, and the last
- * value we managed to report to the host. */
-unsigned int i2cDropped = 0;
+static uint8_t sendAttempts = 0;
+static unsigned long lastSendAttempt = 0;
+
+/* Events lost -- Beta never acknowledged them, or the ring was full -- and the
+ * last value we managed to report to the host. Counted from the scan
+ * interrupt as well as loop(), so touched only with interrupts off. */
+volatile unsigned int i2cDropped = 0;
 unsigned int i2cDroppedReported = 0;
 unsigned long lastDropReport = 0;
+unsigned long lastDropReportAttempt = 0;
 
 /* Re-announce the drop count this often, zero included.
  *
@@ -58,9 +96,12 @@ const unsigned long DROP_REPORT_INTERVAL_MS = 30000;
 
 /* (#232) What the hook read as during setup(), kept for the status query.
  * Printing it at boot would be useless: an external reset re-enumerates the
- * USB CDC port, so anything written before a host attaches is discarded. */
+ * USB CDC port, so anything written before a host attaches is discarded.
+ * The boot report is the first event in the ring; bootHookPending stays set
+ * until it has been delivered or given up. */
 bool bootHookUp = false;
 bool bootHookReported = false;
+bool bootHookPending = false;
 
 const byte ROWS = 4;
 const byte COLS = 7;
@@ -77,37 +118,83 @@ Keypad keypad = Keypad(makeKeymap(keys), rowPins, colPins, ROWS, COLS);
 
 MagStripe card(22, 0, 1);
 
+static unsigned int droppedSoFar() {
+  unsigned int n;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    n = i2cDropped;
+  }
+  return n;
+}
+
 /*
- * (#230) Send one I2C message to Beta, retrying while it NACKs.
- *
- * Wire.endTransmission() returns 0 only when Beta acknowledged every byte; 2
- * and 3 are NACKs, which is exactly what happens while Beta sits in a delay()
- * or repaints the VFD.  Every call site used to discard that status, so a
- * keypress lost to a busy Beta was indistinguishable from one delivered --
- * which is why "every keypress eventually reaches the Pi" did not hold.
- *
- * Returns true if the message landed.
+ * Queue an event, stamped with the time now. Called from the scan interrupt
+ * and from loop(), so the slot is claimed with interrupts off; only the
+ * producer side moves eventHead.
  */
-bool i2cTrySend(const uint8_t *payload, uint8_t len) {
-  for (uint8_t attempt = 0; attempt < I2C_SEND_ATTEMPTS; attempt++) {
-    Wire.beginTransmission(I2C_DISPLAY_ADDR);
-    Wire.write(payload, len);
-    if (Wire.endTransmission() == 0) {
-      return true;
+void eventPush(const uint8_t *msg, uint8_t len) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    uint8_t next = (eventHead + 1) % EVENT_RING_SIZE;
+    if (next == eventTail) {
+      i2cDropped++;   /* full: the newest event is the one lost */
+    } else {
+      PendingEvent *e = &eventRing[eventHead];
+      if (len > EVENT_MSG_MAX) len = EVENT_MSG_MAX;
+      e->at = millis();
+      e->len = len;
+      memcpy(e->msg, msg, len);
+      eventHead = next;
     }
-    wdt_reset();
-    delay(I2C_RETRY_DELAY_MS);
   }
-  return false;
 }
 
-/* As above, but tallies a failure. Use this for real phone events; the drop
- * report itself uses i2cTrySend so a failed report cannot inflate the very
- * number it is trying to report. */
-bool i2cSend(const uint8_t *payload, uint8_t len) {
-  if (i2cTrySend(payload, len)) return true;
-  i2cDropped++;
-  return false;
+/*
+ * (#230) One I2C transmission to Beta. Wire.endTransmission() returns 0 only
+ * when Beta acknowledged every byte; 2 and 3 are NACKs. Every call site used
+ * to discard that status, so a keypress lost to a busy Beta was
+ * indistinguishable from one delivered -- which is why "every keypress
+ * eventually reaches the Pi" did not hold.
+ */
+bool i2cWrite(const uint8_t *payload, uint8_t len) {
+  Wire.beginTransmission(I2C_DISPLAY_ADDR);
+  Wire.write(payload, len);
+  return Wire.endTransmission() == 0;
+}
+
+/*
+ * Hand the oldest queued event to Beta: one attempt per call, and after a
+ * NACK nothing until I2C_RETRY_DELAY_MS has passed, so loop() never waits on
+ * the bus. Returns true when it delivered one and the next may follow.
+ */
+bool serviceEventRing() {
+  if (eventTail == eventHead) return false;
+  if (sendAttempts > 0 && millis() - lastSendAttempt < I2C_RETRY_DELAY_MS) return false;
+
+  const PendingEvent *e = &eventRing[eventTail];
+  uint8_t buf[3 + EVENT_MSG_MAX];
+  unsigned long age = millis() - e->at;
+  if (age > 0xFFFF) age = 0xFFFF;
+  buf[0] = EVT_STAMP;
+  buf[1] = age >> 8;
+  buf[2] = age & 0xFF;
+  memcpy(buf + 3, e->msg, e->len);
+
+  bool delivered = i2cWrite(buf, 3 + e->len);
+  if (!delivered && ++sendAttempts < I2C_SEND_ATTEMPTS) {
+    lastSendAttempt = millis();
+    return false;
+  }
+  if (!delivered) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      i2cDropped++;
+    }
+  }
+  if (bootHookPending) {
+    bootHookReported = delivered;
+    bootHookPending = false;
+  }
+  sendAttempts = 0;
+  eventTail = (eventTail + 1) % EVENT_RING_SIZE;
+  return delivered;
 }
 
 /*
@@ -118,33 +205,41 @@ bool i2cSend(const uint8_t *payload, uint8_t len) {
  * cumulative and the host publishes it as a gauge, so a late report is still
  * correct. Encoded as ASCII digits because the host consumes the payload with
  * strlen(), and a raw zero byte would truncate the event and desync the stream.
+ *
+ * Sent directly rather than through the ring, unstamped, and only while the
+ * ring is empty, so it never queues ahead of a real event; a failure is not
+ * counted, or the report would inflate the very number it carries.
  */
 void reportDropsIfChanged() {
   uint8_t msg[5];
+  unsigned int dropped = droppedSoFar();
   unsigned int n;
   unsigned long now = millis();
-  bool changed = (i2cDropped != i2cDroppedReported);
+  bool changed = (dropped != i2cDroppedReported);
   bool due = (lastDropReport == 0) ||
              (now - lastDropReport >= DROP_REPORT_INTERVAL_MS);
 
   if (!changed && !due) return;
+  if (eventTail != eventHead) return;
+  if (lastDropReportAttempt != 0 && now - lastDropReportAttempt < I2C_RETRY_DELAY_MS) return;
+  lastDropReportAttempt = now;
 
-  n = (i2cDropped > 999) ? 999 : i2cDropped;
+  n = (dropped > 999) ? 999 : dropped;
   msg[0] = EVT_DIAG;
   msg[1] = 'A';
   msg[2] = '0' + (n / 100) % 10;
   msg[3] = '0' + (n / 10) % 10;
   msg[4] = '0' + n % 10;
 
-  if (i2cTrySend(msg, sizeof(msg))) {
-    i2cDroppedReported = i2cDropped;
+  if (i2cWrite(msg, sizeof(msg))) {
+    i2cDroppedReported = dropped;
     lastDropReport = now;
   }
 }
 
 /*
  * Sample the hook switch.  hookCommonPin is driven low only for the read, the
- * same way loop() does it, so the two pull-ups can be told apart.
+ * same way scanTick() does it, so the two pull-ups can be told apart.
  */
 bool readHookUp() {
   bool up;
@@ -181,24 +276,74 @@ void setup() {
    * safe state beats agreeing on nothing.
    *
    * Beta may still be inside its own setup() when we first try, so this leans
-   * on i2cSend()'s retry (#230); a bare fire-and-forget write would vanish.
-   * The extra outer attempts are affordable here because the keypad scan has
-   * not started yet.
+   * on the event ring's retry (#230); a bare fire-and-forget write would
+   * vanish.
    */
   hookUpState = readHookUp();
   bootHookUp = hookUpState;
   bootHookReported = false;
   lastHookChange = millis();
-  {
-    const uint8_t *msg = (const uint8_t *)(hookUpState ? EVT_HOOK_UP : EVT_HOOK_DOWN);
-    uint8_t attempt;
-    for (attempt = 0; attempt < 3; attempt++) {
-      if (i2cSend(msg, 2)) { bootHookReported = true; break; }
-      delay(100);
+  eventPush((const uint8_t *)(hookUpState ? EVT_HOOK_UP : EVT_HOOK_DOWN), 2);
+  bootHookPending = true;
+
+  /* Start the scan tick. Timer0 already runs at 1 kHz for millis() on its
+   * overflow interrupt; compare-match A on the same timer is spare and fires
+   * once per period, half-way between overflows. */
+  OCR0A = 0x80;
+  TIMSK0 |= _BV(OCIE0A);
+
+  wdt_enable(WDTO_4S);
+}
+
+/*
+ * Keypad and hook scan, every millisecond from the timer interrupt below.
+ *
+ * Pin-change interrupts would wake us only on an edge, but the ATmega32U4 has
+ * them on port B alone: keypad rows 2 and 3 (PE6, PD7) and both hook senses
+ * (PD4, PC6) could not raise one. A fixed tick sees every pin, and is cheap:
+ * Keypad::getKey() only scans every setDebounceTime() ms (10 by default), on
+ * port registers, and otherwise returns at once.
+ */
+static void scanTick() {
+  char key = keypad.getKey();
+  if (key != NO_KEY) {
+    uint8_t msg[2];
+    msg[0] = EVT_KEY;
+    msg[1] = (uint8_t)key;
+    eventPush(msg, sizeof(msg));
+  }
+
+  unsigned long now = millis();
+  if (now - lastHookChange < DEBOUNCE_MS) return;
+  digitalWrite(hookCommonPin, LOW);
+  if (hookUpState) {
+    bool hookDownNow = digitalRead(hookUpPin) && !digitalRead(hookDownPin);
+    if (hookDownNow) {
+      hookUpState = false;
+      lastHookChange = now;
+      eventPush((const uint8_t *)EVT_HOOK_DOWN, 2);
+    }
+  } else {
+    bool hookUpNow = !digitalRead(hookUpPin) && digitalRead(hookDownPin);
+    if (hookUpNow) {
+      hookUpState = true;
+      lastHookChange = now;
+      eventPush((const uint8_t *)EVT_HOOK_UP, 2);
     }
   }
+  digitalWrite(hookCommonPin, HIGH);
+}
 
-  wdt_enable(WDTO_4S);
+/* Interrupts go back on for the scan itself: the card reader clocks bits in
+ * on its own pin interrupts, and they must not wait behind a keypad scan. */
+ISR(TIMER0_COMPA_vect) {
+  static volatile bool scanning = false;
+  if (scanning) return;
+  scanning = true;
+  sei();
+  scanTick();
+  cli();
+  scanning = false;
 }
 
 struct MagstripeData {
@@ -300,7 +445,7 @@ void serviceStatusQuery() {
   Serial.print(F(" hook="));
   Serial.print(hookUpState ? F("UP") : F("DOWN"));
   Serial.print(F(" i2c_drops="));
-  Serial.print(i2cDropped);
+  Serial.print(droppedSoFar());
   Serial.print(F(" reported="));
   Serial.println(i2cDroppedReported);
 }
@@ -309,17 +454,8 @@ void loop() {
   wdt_reset();
 
   serviceStatusQuery();
-  reportDropsIfChanged();
-
-  char key = keypad.getKey();
-
-  if (key != NO_KEY) {
-    uint8_t msg[2];
-    msg[0] = EVT_KEY;
-    msg[1] = (uint8_t)key;
-    i2cSend(msg, sizeof(msg));
-  }
 
+  /* Keys and the hook arrive through scanTick(); only the card is read here. */
   if (card.available()) {
     card.prime();
   }
@@ -329,37 +465,23 @@ void loop() {
     if (chars > 0) {
       MagstripeData parsedData = parseTrack2(data, chars);
       if (parsedData.valid && parsedData.pan_len > 0) {
-        /* Wire's TX buffer is 32 bytes on AVR, and a longer write is silently
-         * truncated -- clamp explicitly so the limit is visible here rather
-         * than being discovered as a mangled PAN. */
+        /* Beta frames each I2C message whole as one link event, and the
+         * Pi takes at most 16 PAN digits -- the legacy fixed width, which
+         * Beta's event window is sized for. Clamp here so a long PAN is
+         * visibly cut rather than rejected as malformed further on. */
         uint8_t pan_len = parsedData.pan_len;
-        uint8_t msg[1 + 31];
+        uint8_t msg[EVENT_MSG_MAX];
         if (pan_len > sizeof(msg) - 1) pan_len = sizeof(msg) - 1;
         msg[0] = EVT_CARD;
         memcpy(msg + 1, parsedData.pan, pan_len);
-        i2cSend(msg, 1 + pan_len);
+        eventPush(msg, 1 + pan_len);
       }
     }
   }
 
-  unsigned long now = millis();
-  digitalWrite(hookCommonPin, LOW);
-  if (now - lastHookChange >= DEBOUNCE_MS) {
-    if (hookUpState) {
-      bool hookDownNow = digitalRead(hookUpPin) && !digitalRead(hookDownPin);
-      if (hookDownNow) {
-        hookUpState = false;
-        lastHookChange = now;
-        i2cSend((const uint8_t *)EVT_HOOK_DOWN, 2);
-      }
-    } else {
-      bool hookUpNow = !digitalRead(hookUpPin) && digitalRead(hookDownPin);
-      if (hookUpNow) {
-        hookUpState = true;
-        lastHookChange = now;
-        i2cSend((const uint8_t *)EVT_HOOK_UP, 2);
-      }
-    }
+  /* Drain while Beta keeps taking them; a NACK waits for a later pass. */
+  for (uint8_t i = 0; i < EVENT_RING_SIZE; i++) {
+    if (!serviceEventRing()) break;
   }
-  digitalWrite(hookCommonPin, HIGH);
+  reportDropsIfChanged();
 }
@@ -38,7 +38,7 @@ void call_metrics_ended(void) {
         elapsed = 0.0;
     }
 
-    metrics_observe_histogram(CALL_DURATION_HISTOGRAM, elapsed);
+    METRICS_HISTOGRAM_OBSERVE(CALL_DURATION_HISTOGRAM, elapsed);
 
     g_call_in_progress = 0;
     g_call_start = 0;
@@ -67,7 +67,7 @@ static int call_metrics_ringing_observe(void) {
         elapsed = 0.0;
     }
 
-    metrics_observe_histogram(CALL_RING_HISTOGRAM, elapsed);
+    METRICS_HISTOGRAM_OBSERVE(CALL_RING_HISTOGRAM, elapsed);
 
     g_ring_in_progress = 0;
     g_ring_start = 0;
@@ -84,12 +84,12 @@ void call_metrics_incoming_ended(void) {
      * in progress: */
     if (call_metrics_ringing_observe()) {
         /* A real inbound ring went unanswered — the caller gave up. */
-        metrics_increment_counter(CALLS_MISSED_COUNTER, 1);
+        METRICS_COUNTER_ADD(CALLS_MISSED_COUNTER, 1);
     } else {
         /* No ring was ever armed, so the phone was placing an OUTBOUND call
          * that never connected (callee busy, no answer, rejected, or a SIP /
          * network error). This is the #91 "Call failed during dial" path. */
-        metrics_increment_counter(CALLS_FAILED_COUNTER, 1);
+        METRICS_COUNTER_ADD(CALLS_FAILED_COUNTER, 1);
     }
 }
 
@@ -244,6 +244,38 @@ int config_validate_ex(const config_data_t* config, char* err, size_t err_size)
                     "VERBOSE/DEBUG/INFO/WARN/ERROR",
                     config_get_log_level(config));
     }
+    if (strcmp(config_get_log_format(config), "text") != 0 &&
+        strcmp(config_get_log_format(config), "binary") != 0) {
+        CONFIG_FAIL("logging.format '%s' is not one of text/binary",
+                    config_get_log_format(config));
+    }
+    if (strcmp(config_get_log_sync(config), "none") != 0 &&
+        strcmp(config_get_log_sync(config), "batch") != 0 &&
+        strcmp(config_get_log_sync(config), "interval") != 0 &&
+        strcmp(config_get_log_sync(config), "error") != 0) {
+        CONFIG_FAIL("logging.sync '%s' is not one of none/batch/interval/error",
+                    config_get_log_sync(config));
+    }
+    if (config_get_log_sync_interval_ms(config) <= 0) {
+        CONFIG_FAIL("logging.sync_interval_ms must be > 0 (got %d)",
+                    config_get_log_sync_interval_ms(config));
+    }
+    {
+        /* Per-category overrides: logging.level.<category>=<level> */
+        int i;
+        for (i = 0; i < config->count; i++) {
+            if (strncmp(config->keys[i], "logging.level.", 14) == 0 &&
+                !config_is_valid_log_level(config->values[i])) {
+                CONFIG_FAIL("%s '%s' is not one of "
+                            "VERBOSE/DEBUG/INFO/WARN/ERROR",
+                            config->keys[i], config->values[i]);
+            }
+        }
+    }
+    if (config_get_log_memory_bytes(config) < 4096) {
+        CONFIG_FAIL("logging.memory_bytes must be >= 4096 (got %d)",
+                    config_get_log_memory_bytes(config));
+    }
     if (config_get_log_max_size_bytes(config) <= 0) {
         CONFIG_FAIL("logging.max_size_bytes must be > 0 (got %d)",
                     config_get_log_max_size_bytes(config));
@@ -508,6 +540,23 @@ int config_get_log_to_file(const config_data_t* config) {
     return config_get_bool(config, "logging.to_file", 0);
 }
 
+const char* config_get_log_format(const config_data_t* config) {
+    return config_get_string(config, "logging.format", "text");
+}
+
+const char* config_get_log_sync(const config_data_t* config) {
+    return config_get_string(config, "logging.sync", "error");
+}
+
+int config_get_log_sync_interval_ms(const config_data_t* config) {
+    return config_get_int(config, "logging.sync_interval_ms", 1000);
+}
+
+/* Size of the in-memory log behind /api/logs */
+int config_get_log_memory_bytes(const config_data_t* config) {
+    return config_get_int(config, "logging.memory_bytes", 131072);
+}
+
 int config_get_log_max_size_bytes(const config_data_t* config) {
     return config_get_int(config, "logging.max_size_bytes", 1048576);
 }
@@ -521,6 +570,12 @@ const char* config_get_state_file(const config_data_t* config) {
     return config_get_string(config, "persistence.state_file", "/var/lib/millennium/state");
 }
 
+/* Metrics history (tsdb.h); empty keeps history in memory only */
+const char* config_get_metrics_history_file(const config_data_t* config) {
+    return config_get_string(config, "persistence.metrics_history_file",
+                             "/var/lib/millennium/metrics.tsdb");
+}
+
 /* System Configuration */
 int config_get_update_interval_ms(const config_data_t* config) {
     return config_get_int(config, "system.update_interval_ms", 33);
@@ -50,11 +50,18 @@ int config_is_admin_card(const config_data_t* config, const char* card_number);
 const char* config_get_log_level(const config_data_t* config);
 const char* config_get_log_file(const config_data_t* config);
 int config_get_log_to_file(const config_data_t* config);
+/* "text" (default) or "binary"; see logger_set_log_format() */
+const char* config_get_log_format(const config_data_t* config);
+/* "none", "batch", "interval" or "error" (default); see logger_set_sync_policy() */
+const char* config_get_log_sync(const config_data_t* config);
+int config_get_log_sync_interval_ms(const config_data_t* config);
+int config_get_log_memory_bytes(const config_data_t* config);
 int config_get_log_max_size_bytes(const config_data_t* config);
 int config_get_log_max_files(const config_data_t* config);
 
 /* State Persistence Configuration */
 const char* config_get_state_file(const config_data_t* config);
+const char* config_get_metrics_history_file(const config_data_t* config);
 
 /* System Configuration */
 int config_get_update_interval_ms(const config_data_t* config);
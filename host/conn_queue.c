@@ -88,6 +88,20 @@ int conn_queue_pop(struct conn_queue* q) {
     return fd;
 }
 
+int conn_queue_try_pop(struct conn_queue* q) {
+    int fd = -1;
+    if (!q) return -1;
+
+    pthread_mutex_lock(&q->mutex);
+    if (q->count > 0) {
+        fd = q->fds[q->head];
+        q->head = (q->head + 1) % q->capacity;
+        q->count--;
+    }
+    pthread_mutex_unlock(&q->mutex);
+    return fd;
+}
+
 void conn_queue_close(struct conn_queue* q) {
     if (!q) return;
     pthread_mutex_lock(&q->mutex);
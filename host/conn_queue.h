@@ -8,16 +8,18 @@ extern "C" {
 #endif
 
 /*
- * conn_queue: a small bounded, thread-safe FIFO of file descriptors.
+ * conn_queue: a small bounded, thread-safe FIFO of file descriptors (or any
+ * non-negative ints).
  *
- * The web server's accept loop pushes accepted client fds onto the queue; a
- * pool of worker threads pops and services them. This decouples accepting a
- * connection from handling it, so one slow request no longer stalls every
- * other client (see issue #125).
+ * The web server's event loop pushes the connections whose requests may block
+ * onto one queue; a pool of worker threads pops and services them, and pushes
+ * them back on a second queue when the response is ready. This decouples
+ * reading a request from handling it, so one slow request no longer stalls
+ * every other client (see issue #125).
  *
  * Push is non-blocking and reports back-pressure (queue full) to the caller so
- * the accept loop can shed load rather than grow unboundedly. Pop blocks until
- * an fd is available or the queue is closed.
+ * the event loop can shed load rather than grow unboundedly. Pop blocks until
+ * an fd is available or the queue is closed; try_pop never blocks.
  */
 struct conn_queue {
     int* fds;
@@ -63,6 +65,10 @@ int conn_queue_try_push(struct conn_queue* q, int fd);
  * -1 once the queue is both closed and empty. */
 int conn_queue_pop(struct conn_queue* q);
 
+/* Dequeue an fd if there is one. Returns the fd, or -1 if the queue is
+ * empty. */
+int conn_queue_try_pop(struct conn_queue* q);
+
 /* Mark the queue closed and wake every blocked popper. After this, pop drains
  * any remaining fds and then returns -1; try_push returns -1. */
 void conn_queue_close(struct conn_queue* q);
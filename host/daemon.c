@@ -4,6 +4,7 @@
 #include "logger.h"
 #include "metrics.h"
 #include "metrics_server.h"
+#include "tsdb.h"
 #include "call_metrics.h"
 #include "health_monitor.h"
 #include "web_server.h"
@@ -17,6 +18,7 @@
 #include "audio_tones.h"
 #include "cli.h"
 #include "version.h"
+#include "engine_loop.h"
 #include <signal.h>
 #include <string.h>
 #include <stdio.h>
@@ -24,8 +26,6 @@
 #include <time.h>
 #include <ctype.h>
 #include <unistd.h>
-#include <sys/select.h>
-#include <sys/time.h>
 #include <fcntl.h>
 #include <pthread.h>
 #include <stdarg.h>
@@ -60,7 +60,7 @@ pthread_mutex_t daemon_state_mutex = PTHREAD_MUTEX_INITIALIZER;
 /* Serializes one whole engine step (serial read + event dispatch + plugin ticks
  * + display writes) in the main loop against web-thread control commands, which
  * run the same paths via send_control_command. Held only around the work, never
- * across the idle sleep.
+ * across the engine_loop_wait() block.
  *
  * LOCK ORDER (#231). Acquire only in increasing rank, never the reverse:
  *
@@ -69,7 +69,7 @@ pthread_mutex_t daemon_state_mutex = PTHREAD_MUTEX_INITIALIZER;
  *   3. daemon_state_mutex
  *   4. plugins_mutex
  *   5. leaves, never held while taking anything else:
- *        metrics_mutex, logger_mutex, g_queue_mutex, g_sip_mutex,
+ *        metrics_mutex, logger_mutex, g_sip_mutex,
  *        tone_mutex, server->state_mutex, conn_queue.mutex
  *      plus logger_file_mutex -> log_queue.lock, which is ordered only
  *      against each other.
@@ -326,20 +326,29 @@ static void daemon_broadcast_state(const char *event_type) {
     web_server_broadcast_to_websockets(web_server, msg);
 }
 
-/* Prometheus counter name for a coin of the given cent value. Used to tally
- * the coin-box denomination mix. Falls back to a catch-all bucket for any
- * future/unknown coin so no accepted coin goes uncounted. */
-static const char *coin_denomination_metric(int coin_value) {
+/* Prometheus counter family tallying the coin-box denomination mix, one
+ * series per denomination label, as cached refs (metrics.h) so a coin costs
+ * no name lookup. */
+static metrics_ref_t coin_denomination_refs[] = {
+    METRICS_LABELED_REF_INIT("coins_by_denomination", "denomination", "5c"),
+    METRICS_LABELED_REF_INIT("coins_by_denomination", "denomination", "10c"),
+    METRICS_LABELED_REF_INIT("coins_by_denomination", "denomination", "25c"),
+    METRICS_LABELED_REF_INIT("coins_by_denomination", "denomination", "other")
+};
+
+/* Counter for a coin of the given cent value. Falls back to a catch-all
+ * bucket for any future/unknown coin so no accepted coin goes uncounted. */
+static metrics_counter_t *coin_denomination_counter(int coin_value) {
     switch (coin_value) {
-        case 5:  return "coins_5c";
-        case 10: return "coins_10c";
-        case 25: return "coins_25c";
-        default: return "coins_other";
+        case 5:  return metrics_counter_ref(&coin_denomination_refs[0]);
+        case 10: return metrics_counter_ref(&coin_denomination_refs[1]);
+        case 25: return metrics_counter_ref(&coin_denomination_refs[2]);
+        default: return metrics_counter_ref(&coin_denomination_refs[3]);
     }
 }
 
 void handle_coin_event(coin_event_t *coin_event) {
-    char *coin_code_str;
+    const char *coin_code_str;
     int coin_value = 0;
     if (!coin_event) {
         logger_error_with_category("Coin", "Received null coin event");
@@ -347,11 +356,7 @@ void handle_coin_event(coin_event_t *coin_event) {
     }
     VALIDATE_BASICS();
 
-    coin_code_str = coin_event_get_coin_code(coin_event);
-    if (!coin_code_str) {
-        logger_error_with_category("Coin", "Failed to get coin code");
-        return;
-    }
+    coin_code_str = coin_event_get_coin_name(coin_event);
 
 
     if (strcmp(coin_code_str, "COIN_6") == 0) {
@@ -369,13 +374,13 @@ void handle_coin_event(coin_event_t *coin_event) {
             daemon_state->inserted_cents += coin_value;
             daemon_state_update_activity(daemon_state);
             
-            metrics_increment_counter("coins_inserted", 1);
-            metrics_increment_counter("coins_value_cents", coin_value);
+            METRICS_COUNTER_ADD("coins_inserted", 1);
+            METRICS_COUNTER_ADD("coins_value_cents", coin_value);
             /* Per-denomination tally so the coin box can be reconciled by coin
              * (capacity is per-coin, not per-dollar): a $5.00 take is 20
              * quarters or 100 nickels, and only this breakdown tells them
              * apart. coins_inserted/coins_value_cents stay the aggregate view. */
-            metrics_increment_counter(coin_denomination_metric(coin_value), 1);
+            metrics_counter_add(coin_denomination_counter(coin_value), 1);
 
             logger_infof_with_category("Coin",
                     "Coin inserted: %s, value: %d cents, total: %d cents",
@@ -392,8 +397,6 @@ void handle_coin_event(coin_event_t *coin_event) {
             daemon_broadcast_state("coin");
         }
     }
-    
-    free(coin_code_str);
 }
 
 void handle_call_state_event(call_state_event_t *call_state_event) {
@@ -417,7 +420,7 @@ void handle_call_state_event(call_state_event_t *call_state_event) {
     if (is_incoming && (phone_down || phone_up)) {
         
         logger_info_with_category("Call", "Incoming call received");
-        metrics_increment_counter("calls_incoming", 1);
+        METRICS_COUNTER_ADD("calls_incoming", 1);
         call_metrics_ringing_started();
 
         update_display_with_content("Call incoming...", line2);
@@ -439,7 +442,7 @@ void handle_call_state_event(call_state_event_t *call_state_event) {
          * tests/EventOrdering.tla; see docs/EVENT_ORDERING.md. */
         if (daemon_state->handset_up) {
             logger_info_with_category("Call", "Call established - audio should be working");
-            metrics_increment_counter("calls_established", 1);
+            METRICS_COUNTER_ADD("calls_established", 1);
 
             update_display_with_content("Call active", "Audio connected");
 
@@ -452,13 +455,13 @@ void handle_call_state_event(call_state_event_t *call_state_event) {
         } else {
             logger_warn_with_category("Call",
                     "Ignoring CALL_ESTABLISHED received with handset on hook");
-            metrics_increment_counter("calls_established_ignored_onhook", 1);
+            METRICS_COUNTER_ADD("calls_established_ignored_onhook", 1);
         }
     } else if (call_state_event_get_state(call_state_event) == EVENT_CALL_STATE_INVALID) {
         /* #90/#91: Call ended - remote hung up or call failed during dial */
         if (daemon_state->current_state == DAEMON_STATE_CALL_ACTIVE) {
             logger_info_with_category("Call", "Call ended by remote party");
-            metrics_increment_counter("calls_ended", 1);
+            METRICS_COUNTER_ADD("calls_ended", 1);
             call_metrics_ended();
             daemon_state_clear_keypad(daemon_state);
             daemon_state->inserted_cents = 0;
@@ -548,7 +551,7 @@ void handle_hook_event(hook_state_change_event_t *hook_event) {
         
         if (call_incoming) {
             logger_info_with_category("Call", "Call answered");
-            metrics_increment_counter("calls_answered", 1);
+            METRICS_COUNTER_ADD("calls_answered", 1);
 
             daemon_state->current_state = DAEMON_STATE_CALL_ACTIVE;
             daemon_state_update_activity(daemon_state);
@@ -557,7 +560,7 @@ void handle_hook_event(hook_state_change_event_t *hook_event) {
 
         } else if (phone_down) {
             logger_info_with_category("Hook", "Hook lifted, transitioning to IDLE_UP");
-            metrics_increment_counter("hook_lifted", 1);
+            METRICS_COUNTER_ADD("hook_lifted", 1);
             
             daemon_state->current_state = DAEMON_STATE_IDLE_UP;
             daemon_state_update_activity(daemon_state);
@@ -569,10 +572,10 @@ void handle_hook_event(hook_state_change_event_t *hook_event) {
         }
     } else if (hook_down) {
         logger_info_with_category("Hook", "Hook down, call ended");
-        metrics_increment_counter("hook_down", 1);
+        METRICS_COUNTER_ADD("hook_down", 1);
         
         if (daemon_state->current_state == DAEMON_STATE_CALL_ACTIVE) {
-            metrics_increment_counter("calls_ended", 1);
+            METRICS_COUNTER_ADD("calls_ended", 1);
             call_metrics_ended();
         }
 
@@ -634,7 +637,7 @@ void handle_keypad_event(keypad_event_t *keypad_event) {
      * active plugin in every state, so plugins can use the full keypad
      * (games, menus, IVR/DTMF during calls). Plugins ignore keys they don't
      * care about. */
-    metrics_increment_counter("keypad_presses", 1);
+    METRICS_COUNTER_ADD("keypad_presses", 1);
     plugins_handle_keypad(key);
     /* Persist after the plugin runs: a keypress is how money gets SPENT (the
      * dial that charges call_cost_cents, a game that charges to start), and
@@ -654,7 +657,7 @@ void handle_card_event(card_event_t *card_event) {
     VALIDATE_BASICS();
 
     logger_infof_with_category("Card", "Card swiped: %.4s...", card_event->card_number);
-    metrics_increment_counter("card_swipes", 1);
+    METRICS_COUNTER_ADD("card_swipes", 1);
 
     plugins_handle_card(card_event->card_number);
     daemon_save_state();
@@ -719,8 +722,8 @@ static int dispatch_control_command(const char* action) {
         pthread_mutex_lock(&daemon_state_mutex);
         daemon_state->current_state = DAEMON_STATE_CALL_INCOMING;
         daemon_state_update_activity(daemon_state);
-        metrics_set_gauge("current_state", (double)daemon_state->current_state);
-        metrics_increment_counter("calls_initiated", 1);
+        METRICS_GAUGE_SET("current_state", (double)daemon_state->current_state);
+        METRICS_COUNTER_ADD("calls_initiated", 1);
         pthread_mutex_unlock(&daemon_state_mutex);
         logger_info_with_category("Control", "Call initiation requested via web portal");
         return 1;
@@ -729,9 +732,9 @@ static int dispatch_control_command(const char* action) {
         /* Reset the system state */
         pthread_mutex_lock(&daemon_state_mutex);
         daemon_state_reset(daemon_state);
-        metrics_set_gauge("current_state", (double)daemon_state->current_state);
-        metrics_set_gauge("inserted_cents", 0.0);
-        metrics_increment_counter("system_resets", 1);
+        METRICS_GAUGE_SET("current_state", (double)daemon_state->current_state);
+        METRICS_GAUGE_SET("inserted_cents", 0.0);
+        METRICS_COUNTER_ADD("system_resets", 1);
         pthread_mutex_unlock(&daemon_state_mutex);
         logger_info_with_category("Control", "System reset requested via web portal");
         return 1;
@@ -741,8 +744,8 @@ static int dispatch_control_command(const char* action) {
         pthread_mutex_lock(&daemon_state_mutex);
         daemon_state->current_state = DAEMON_STATE_INVALID;
         daemon_state_update_activity(daemon_state);
-        metrics_set_gauge("current_state", (double)daemon_state->current_state);
-        metrics_increment_counter("emergency_stops", 1);
+        METRICS_GAUGE_SET("current_state", (double)daemon_state->current_state);
+        METRICS_COUNTER_ADD("emergency_stops", 1);
         pthread_mutex_unlock(&daemon_state_mutex);
         logger_warn_with_category("Control", "Emergency stop activated via web portal");
         /* Note: We don't actually stop the daemon, just set it to invalid state */
@@ -773,7 +776,7 @@ static int dispatch_control_command(const char* action) {
         if (is_phone_ready_for_operation()) {
             daemon_state_clear_keypad(daemon_state);
             daemon_state_update_activity(daemon_state);
-            metrics_increment_counter("keypad_clears", 1);
+            METRICS_COUNTER_ADD("keypad_clears", 1);
             logger_info_with_category("Control", "Keypad cleared via web portal");
 
             /* Let plugins handle display updates */
@@ -794,7 +797,7 @@ static int dispatch_control_command(const char* action) {
         if (is_phone_ready_for_operation() && buffer_not_empty) {
             daemon_state_remove_last_key(daemon_state);
             daemon_state_update_activity(daemon_state);
-            metrics_increment_counter("keypad_backspaces", 1);
+            METRICS_COUNTER_ADD("keypad_backspaces", 1);
             logger_info_with_category("Control", "Keypad backspace via web portal");
 
             /* Let plugins handle display updates */
@@ -852,12 +855,12 @@ static int dispatch_control_command(const char* action) {
         returned_cents = daemon_state->inserted_cents;
         daemon_state->inserted_cents = 0;
         daemon_state_update_activity(daemon_state);
-        metrics_set_gauge("inserted_cents", 0.0);
-        metrics_increment_counter("coin_returns", 1);
+        METRICS_GAUGE_SET("inserted_cents", 0.0);
+        METRICS_COUNTER_ADD("coin_returns", 1);
         /* Track the value handed back so net revenue is observable:
          * net = coins_value_cents - coins_returned_cents */
         if (returned_cents > 0) {
-            metrics_increment_counter("coins_returned_cents",
+            METRICS_COUNTER_ADD("coins_returned_cents",
                                       (uint64_t)returned_cents);
         }
         logger_infof_with_category("Control",
@@ -927,7 +930,11 @@ health_status_t check_serial_connection(char *message, size_t message_len) {
         return HEALTH_STATUS_UNKNOWN;
     }
     if (millennium_client_serial_is_healthy(client)) {
-        snprintf(message, message_len, "Serial link healthy");
+        /* The negotiated line rate rides along: /api/health shows this
+         * message verbatim, and a link that fell back to 9600 is healthy
+         * but worth knowing about. */
+        snprintf(message, message_len, "Serial link healthy at %ld baud",
+                 millennium_client_get_link_rate(client));
         return HEALTH_STATUS_HEALTHY;
     }
     snprintf(message, message_len, "Serial link down: no recent data from Arduino");
@@ -988,6 +995,48 @@ health_status_t check_daemon_activity(char *message, size_t message_len) {
     return HEALTH_STATUS_HEALTHY;
 }
 
+/* Metrics kept in the on-device history (tsdb.h) for the dashboard's trend
+ * graphs. Counters are stored as running totals: the difference between two
+ * points is the count in between, e.g. coins per hour. */
+static const struct {
+    const char *name;
+    int kind;
+} history_series[] = {
+    { "coins_inserted",             TSDB_COUNTER },
+    { "coins_value_cents",          TSDB_COUNTER },
+    { "coins_returned_cents",       TSDB_COUNTER },
+    { "calls_initiated",            TSDB_COUNTER },
+    { "calls_incoming",             TSDB_COUNTER },
+    { "inserted_cents",             TSDB_GAUGE },
+    { "event_queue_depth",          TSDB_GAUGE },
+    { "log_queue_depth",            TSDB_GAUGE },
+    { "serial_tx_queue_bytes",      TSDB_GAUGE },
+    { "serial_tx_bytes_per_second", TSDB_GAUGE },
+    { "web_conn_queue_depth",       TSDB_GAUGE },
+    { "health_overall_status",      TSDB_GAUGE }
+};
+
+static void history_open(const config_data_t *config) {
+    const char *path = config_get_metrics_history_file(config);
+    size_t i;
+
+    if (tsdb_open(path) == 1 && path[0]) {
+        logger_warnf_with_category("Metrics",
+            "Metrics history at %s unavailable; keeping it in memory only", path);
+    }
+    for (i = 0; i < sizeof(history_series) / sizeof(history_series[0]); i++) {
+        tsdb_track(history_series[i].name, history_series[i].kind);
+    }
+}
+
+/* Logger writer batches (logger_set_batch_observer), on the writer thread:
+ * how many lines each write carried and how long it took */
+static void observe_log_batch(unsigned long lines, size_t bytes, double milliseconds) {
+    (void)bytes;
+    METRICS_HISTOGRAM_OBSERVE("log_write_batch_lines", (double)lines);
+    METRICS_HISTOGRAM_OBSERVE("log_write_ms", milliseconds);
+}
+
 /* Helper function to update metrics - consolidated from thread */
 static void update_metrics(void) {
     time_t uptime;
@@ -998,7 +1047,7 @@ static void update_metrics(void) {
 
     /* Update system metrics */
     uptime = time(NULL) - daemon_start_time;
-    metrics_set_gauge("daemon_uptime_seconds", (double)uptime);
+    METRICS_GAUGE_SET("daemon_uptime_seconds", (double)uptime);
 
     /* Quick snapshot of state without holding mutex too long */
     pthread_mutex_lock(&daemon_state_mutex);
@@ -1008,9 +1057,9 @@ static void update_metrics(void) {
     pthread_mutex_unlock(&daemon_state_mutex);
     
     /* Update metrics outside of mutex */
-    metrics_set_gauge("current_state", current_state);
-    metrics_set_gauge("inserted_cents", inserted_cents);
-    metrics_set_gauge("keypad_buffer_size", keypad_size);
+    METRICS_GAUGE_SET("current_state", current_state);
+    METRICS_GAUGE_SET("inserted_cents", inserted_cents);
+    METRICS_GAUGE_SET("keypad_buffer_size", keypad_size);
 
     /* Async logger health (issue #123 follow-up). Publishes queue depth, the
      * high-water mark (capacity headroom), and a true counter of dropped log
@@ -1020,18 +1069,93 @@ static void update_metrics(void) {
     {
         logger_queue_stats_t lstats;
         static unsigned long long last_dropped = 0;
+        static unsigned long long last_syncs = 0;
 
         logger_get_queue_stats(&lstats);
-        metrics_set_gauge("log_queue_depth", (double)lstats.depth);
-        metrics_set_gauge("log_queue_high_water", (double)lstats.high_water);
+        METRICS_GAUGE_SET("log_queue_depth", (double)lstats.depth);
+        METRICS_GAUGE_SET("log_queue_high_water", (double)lstats.high_water);
         if (lstats.dropped_total > last_dropped) {
-            metrics_increment_counter("log_lines_dropped",
+            METRICS_COUNTER_ADD("log_lines_dropped",
                 (uint64_t)(lstats.dropped_total - last_dropped));
             last_dropped = lstats.dropped_total;
         }
+        if (lstats.syncs_total > last_syncs) {
+            METRICS_COUNTER_ADD("log_syncs", (uint64_t)(lstats.syncs_total - last_syncs));
+            last_syncs = lstats.syncs_total;
+        }
+    }
+
+    /* SDK event queue health. The queue is a bounded ring that drops the
+     * newest event when full, so a stalled main loop now loses events instead
+     * of growing without limit; these make that visible. dropped is published
+     * as a gauge of the lifetime total (the SDK already counts it atomically),
+     * so alert on it changing rather than on its value. */
+    if (client) {
+        struct event_ring_stats qstats;
+
+        millennium_client_get_event_queue_stats(client, &qstats);
+        METRICS_GAUGE_SET("event_queue_depth", (double)qstats.depth);
+        METRICS_GAUGE_SET("event_queue_high_water", (double)qstats.high_water);
+        METRICS_GAUGE_SET("event_queue_dropped", (double)qstats.dropped_total);
+    }
+
+    /* Serial output health. queue_bytes that stays up means the Arduino has
+     * stopped draining the link; bytes_per_second is the actual UART load
+     * (9600 baud tops out near 960; see serial_link_rate_baud). coalesced
+     * counts repaints skipped under back-pressure, dropped counts commands
+     * lost to a full lane or a reconnect. */
+    if (client) {
+        struct serial_tx_stats tstats;
+        static unsigned long long last_tx_bytes = 0;
+        static struct timespec last_tx_ts = {0, 0};
+        struct timespec now_ts;
+        double secs;
+
+        millennium_client_get_serial_tx_stats(client, &tstats);
+        clock_gettime(CLOCK_MONOTONIC, &now_ts);
+        secs = (double)(now_ts.tv_sec - last_tx_ts.tv_sec) +
+               (double)(now_ts.tv_nsec - last_tx_ts.tv_nsec) / 1e9;
+        if (last_tx_ts.tv_sec != 0 && secs > 0) {
+            METRICS_GAUGE_SET("serial_tx_bytes_per_second",
+                (double)(tstats.bytes_written_total - last_tx_bytes) / secs);
+        }
+        last_tx_bytes = tstats.bytes_written_total;
+        last_tx_ts = now_ts;
+
+        METRICS_GAUGE_SET("serial_tx_queue_bytes", (double)tstats.queued_bytes);
+        METRICS_GAUGE_SET("serial_tx_queue_frames", (double)tstats.queued_frames);
+        METRICS_GAUGE_SET("serial_tx_queue_high_water", (double)tstats.high_water_bytes);
+        METRICS_GAUGE_SET("serial_tx_frames_coalesced", (double)tstats.frames_coalesced_total);
+        METRICS_GAUGE_SET("serial_tx_frames_dropped", (double)tstats.frames_dropped_total);
+    }
+
+    /* Framed link receive side. crc/framing errors are line noise or a Beta
+     * reset mid-frame, each one a frame Beta will resend; duplicates are
+     * resends of frames whose ACK was lost. Lifetime totals, like the above. */
+    if (client) {
+        struct serial_link_stats lstats;
+
+        millennium_client_get_serial_link_stats(client, &lstats);
+        METRICS_GAUGE_SET("serial_link_rate_baud", (double)millennium_client_get_link_rate(client));
+        METRICS_GAUGE_SET("serial_link_frames", (double)lstats.frames_ok);
+        METRICS_GAUGE_SET("serial_link_crc_errors", (double)lstats.crc_errors);
+        METRICS_GAUGE_SET("serial_link_framing_errors", (double)lstats.framing_errors);
+        METRICS_GAUGE_SET("serial_link_duplicates", (double)lstats.duplicates);
+        METRICS_GAUGE_SET("serial_link_out_of_order", (double)lstats.out_of_order);
     }
 
-    /* Web server worker-pool health (#125 follow-up). The accept thread sheds
+    /* Event pool health. in_use climbing with an idle queue is a leaked
+     * event; exhausted moving means events are coming from the heap again. */
+    {
+        event_pool_stats_t pstats;
+
+        event_pool_get_stats(&pstats);
+        METRICS_GAUGE_SET("event_pool_in_use", (double)pstats.in_use);
+        METRICS_GAUGE_SET("event_pool_high_water", (double)pstats.high_water);
+        METRICS_GAUGE_SET("event_pool_exhausted", (double)pstats.exhausted_total);
+    }
+
+    /* Web server worker-pool health (#125 follow-up). The event loop sheds
      * load with a 503 when the connection queue saturates; that rejection was
      * only visible as a warning line in the log. Publish queue depth, the
      * high-water mark (capacity headroom), and a true counter of shed
@@ -1042,25 +1166,55 @@ static void update_metrics(void) {
         static unsigned long long last_rejected = 0;
 
         web_server_get_conn_stats(web_server, &wstats);
-        metrics_set_gauge("web_conn_queue_depth", (double)wstats.depth);
-        metrics_set_gauge("web_conn_queue_high_water", (double)wstats.high_water);
+        METRICS_GAUGE_SET("web_conn_queue_depth", (double)wstats.depth);
+        METRICS_GAUGE_SET("web_conn_queue_high_water", (double)wstats.high_water);
         if (wstats.rejected_total > last_rejected) {
-            metrics_increment_counter("web_conn_rejected",
+            METRICS_COUNTER_ADD("web_conn_rejected",
                 (uint64_t)(wstats.rejected_total - last_rejected));
             last_rejected = wstats.rejected_total;
         }
     }
 
+    /* Keep-alive effectiveness: the share of requests that came in on a
+     * connection already open. Near 0 means every dashboard poll is paying
+     * for a new TCP handshake again. */
+    {
+        struct web_server_traffic traffic;
+        static unsigned long long last_connections = 0;
+        static unsigned long long last_requests = 0;
+
+        web_server_get_traffic(web_server, &traffic);
+        if (traffic.connections > last_connections) {
+            METRICS_COUNTER_ADD("web_connections_accepted",
+                (uint64_t)(traffic.connections - last_connections));
+            last_connections = traffic.connections;
+        }
+        if (traffic.requests > last_requests) {
+            METRICS_COUNTER_ADD("web_requests_served",
+                (uint64_t)(traffic.requests - last_requests));
+            last_requests = traffic.requests;
+        }
+        METRICS_GAUGE_SET("web_conn_reuse_ratio", traffic.requests > traffic.connections ?
+            (double)(traffic.requests - traffic.connections) / (double)traffic.requests : 0.0);
+    }
+
     /* Surface the background health checks (serial link, SIP registration,
      * daemon activity) as gauges so subsystem failures are alertable via the
      * metrics endpoint, not just the web dashboard. */
     health_monitor_publish_metrics();
+
+    /* Last, so the history samples this tick's values. Runs every tick but
+     * records once a second. */
+    tsdb_record(time(NULL));
 }
 
 int main(int argc, char *argv[]) {
     config_data_t* config;
     char config_file[MAX_STRING_LEN];
     cli_options_t cli;
+    engine_loop_t *engine;
+    int had_event = 0;
+    int want_write = 0;
 
     /* Parse the command line before touching any hardware or state: --help and
      * --version must work cheaply and side-effect-free even on the dev box. */
@@ -1127,9 +1281,38 @@ int main(int argc, char *argv[]) {
     
     /* Setup logging */
     logger_set_level(logger_parse_level(config_get_log_level(config)));
+    {
+        /* logging.level.<category>=<level> overrides the level for one
+         * category, e.g. logging.level.SDK=DEBUG */
+        int i;
+        for (i = 0; i < config->count; i++) {
+            const char* category = config->keys[i] + 14;
+            if (strncmp(config->keys[i], "logging.level.", 14) != 0) {
+                continue;
+            }
+            if (logger_set_category_level(category,
+                    logger_parse_level(config->values[i])) != 0) {
+                fprintf(stderr, "Ignoring %s: too many category levels\n",
+                        config->keys[i]);
+            }
+        }
+    }
     logger_set_rotation(
         (long)config_get_log_max_size_bytes(config),
         config_get_log_max_files(config));
+    logger_set_memory_size((size_t)config_get_log_memory_bytes(config));
+    if (strcmp(config_get_log_format(config), "binary") == 0) {
+        logger_set_log_format(LOG_FORMAT_BINARY);
+    }
+    {
+        const char* sync = config_get_log_sync(config);
+        logger_set_sync_policy(
+            strcmp(sync, "none") == 0 ? LOG_SYNC_NONE :
+            strcmp(sync, "batch") == 0 ? LOG_SYNC_BATCH :
+            strcmp(sync, "interval") == 0 ? LOG_SYNC_INTERVAL : LOG_SYNC_ERROR,
+            config_get_log_sync_interval_ms(config));
+    }
+    logger_set_batch_observer(observe_log_batch);
     if (config_get_log_to_file(config) && strlen(config_get_log_file(config)) > 0) {
         fprintf(stderr, "Logging to %s\n", config_get_log_file(config));
         logger_set_log_file(config_get_log_file(config));
@@ -1153,6 +1336,7 @@ int main(int argc, char *argv[]) {
         logger_error_with_category("Daemon", "Failed to initialize metrics");
         return 1;
     }
+    history_open(config);
     
     /* Initialize client */
     client = millennium_client_create();
@@ -1252,7 +1436,7 @@ int main(int argc, char *argv[]) {
                 ps.last_state == (int)DAEMON_STATE_CALL_INCOMING) {
                 logger_warn_with_category("Daemon",
                     "Unclean shutdown detected: resetting to IDLE_DOWN (#96)");
-                metrics_increment_counter("unclean_shutdowns", 1);
+                METRICS_COUNTER_ADD("unclean_shutdowns", 1);
                 /* No SIP call exists after restart; ensure state is IDLE_DOWN */
                 pthread_mutex_lock(&daemon_state_mutex);
                 daemon_state->current_state = DAEMON_STATE_IDLE_DOWN;
@@ -1264,16 +1448,28 @@ int main(int argc, char *argv[]) {
             logger_warnf_with_category("Daemon",
                 "Ignoring corrupt state file %s: %s (starting fresh)",
                 state_file_path, load_err);
-            metrics_increment_counter("corrupt_state_loads", 1);
+            METRICS_COUNTER_ADD("corrupt_state_loads", 1);
         }
     }
 
     logger_info_with_category("Daemon", "Daemon initialized successfully");
-    
-    /* Main event loop */
+
+    /* Main event loop. Blocks in engine_loop_wait() until the Arduino sends
+     * bytes, the SDK signals queued work (a PJSUA call-state event, or a
+     * display update from a web control command), the periodic tick fires, or
+     * a rate-limited display write comes due -- instead of polling every 10 ms.
+     * See engine_loop.h. */
+    engine = engine_loop_create(ENGINE_TICK_MS);
+    if (!engine) {
+        logger_error_with_category("Daemon", "Failed to create engine loop");
+        return 1;
+    }
+    engine_loop_set_notify_fd(engine, millennium_client_get_notify_fd(client));
+
     while (1) {
         event_t *event;
-        int had_event;
+        unsigned wake;
+        int timeout_ms;
         pthread_mutex_lock(&running_mutex);
         if (!running) {
             pthread_mutex_unlock(&running_mutex);
@@ -1281,77 +1477,90 @@ int main(int argc, char *argv[]) {
         }
         pthread_mutex_unlock(&running_mutex);
 
+        /* The serial fd changes under us on reconnect; re-point the loop at
+         * the current one. Read without engine_mutex: only this thread's own
+         * engine step (check_serial, on the tick) ever reopens the port. */
+        engine_loop_set_serial_fd(engine, client ? client->display_fd : -1,
+                                  client ? client->serial_generation : 0);
+        /* Likewise sampled at the end of the previous step, under the lock.
+         * A web thread that leaves output queued after that signals the
+         * notify fd, so the next pass re-arms. */
+        engine_loop_set_serial_want_write(engine, want_write);
+
+        /* Don't block while events are still queued; otherwise sleep no later
+         * than the next deferred display write. */
+        timeout_ms = had_event ? 0 : millennium_client_next_timeout_ms(client);
+        wake = engine_loop_wait(engine, timeout_ms);
+
         pthread_mutex_lock(&engine_mutex);
 
-        millennium_client_update(client);
+        if (wake & ENGINE_WAKE_NOTIFY) {
+            millennium_client_drain_notify(client);
+        }
+
+        /* Serial output the tty would not take earlier. Never blocks. */
+        if (wake & ENGINE_WAKE_WRITABLE) {
+            millennium_client_flush_serial(client);
+        }
+
+        if (client) {
+            millennium_client_update(client);
+        }
 
-        event = (event_t *)millennium_client_next_event(client);
+        /* One event per engine step, releasing engine_mutex in between so a
+         * burst cannot starve web-thread control commands. had_event makes
+         * the next wait non-blocking until the queue is drained. */
+        event = client ? (event_t *)millennium_client_next_event(client) : NULL;
         had_event = (event != NULL);
         if (event) {
             event_processor_process_event(event_processor, event);
             event_destroy(event);
         }
         
-        /* Periodic work on a wall-clock schedule. The loop now idles at ~10ms
-         * (and runs faster when events flow), so we can't count iterations —
-         * gate on elapsed time instead. ~300ms keeps display scrolling/game
-         * animation smooth while leaving the CPU free for call audio. */
-        {
-            static struct timespec last_tick = {0, 0};
+        /* Periodic work, driven by the engine loop's tick timer. */
+        if (wake & ENGINE_WAKE_TICK) {
             static struct timespec last_summary = {0, 0};
             static char last_display[128] = "";
             struct timespec now_ts;
-            long tick_ms;
+            char cur1[64], cur2[64], cur[128];
+            long summary_ms;
 
             clock_gettime(CLOCK_MONOTONIC, &now_ts);
-            tick_ms = (now_ts.tv_sec - last_tick.tv_sec) * 1000L +
-                      (now_ts.tv_nsec - last_tick.tv_nsec) / 1000000L;
-            if (tick_ms >= 300) {
-                char cur1[64], cur2[64], cur[128];
-                long summary_ms;
-                last_tick = now_ts;
-
-                update_metrics();
-                plugins_tick();
-                display_manager_tick();
-                millennium_client_check_serial(client);
-
-                /* Broadcast tick-driven display changes (game animations,
-                 * fortune reveals) so the dashboard VFD stays live without a
-                 * user event. Compares full text, so scrolling won't spam. */
-                display_manager_get_text(cur1, sizeof(cur1), cur2, sizeof(cur2));
-                snprintf(cur, sizeof(cur), "%s\n%s", cur1, cur2);
-                if (strcmp(cur, last_display) != 0) {
-                    safe_strcpy(last_display, cur, sizeof(last_display));
-                    daemon_broadcast_state("display");
-                }
 
-                summary_ms = (now_ts.tv_sec - last_summary.tv_sec) * 1000L +
-                             (now_ts.tv_nsec - last_summary.tv_nsec) / 1000000L;
-                if (summary_ms >= 10000) {
-                    last_summary = now_ts;
-                    logger_debug_with_category("Metrics", "=== Metrics Summary ===");
-                    {
-                        double current_state = metrics_get_gauge("current_state");
-                        logger_debugf_with_category("Metrics", "Current state: %.0f", current_state);
-                    }
+            update_metrics();
+            plugins_tick();
+            display_manager_tick();
+            millennium_client_check_serial(client);
+
+            /* Broadcast tick-driven display changes (game animations,
+             * fortune reveals) so the dashboard VFD stays live without a
+             * user event. Compares full text, so scrolling won't spam. */
+            display_manager_get_text(cur1, sizeof(cur1), cur2, sizeof(cur2));
+            snprintf(cur, sizeof(cur), "%s\n%s", cur1, cur2);
+            if (strcmp(cur, last_display) != 0) {
+                safe_strcpy(last_display, cur, sizeof(last_display));
+                daemon_broadcast_state("display");
+            }
+
+            summary_ms = (now_ts.tv_sec - last_summary.tv_sec) * 1000L +
+                         (now_ts.tv_nsec - last_summary.tv_nsec) / 1000000L;
+            if (summary_ms >= 10000) {
+                last_summary = now_ts;
+                logger_debug_with_category("Metrics", "=== Metrics Summary ===");
+                {
+                    double current_state = metrics_get_gauge("current_state");
+                    logger_debugf_with_category("Metrics", "Current state: %.0f", current_state);
                 }
             }
         }
 
+        want_write = client ? millennium_client_serial_tx_pending(client) : 0;
         pthread_mutex_unlock(&engine_mutex);
-
-        if (!had_event) {
-            /* No event: yield ~10ms OUTSIDE the engine lock to keep idle CPU low
-             * without blocking web-thread control commands. The OS buffers
-             * serial, so input latency stays imperceptible (#115). */
-            struct timeval tv;
-            tv.tv_sec = 0;
-            tv.tv_usec = 10000;
-            select(0, NULL, NULL, NULL, &tv);
-        }
     }
 
+    engine_loop_destroy(engine);
+    engine = NULL;
+
     /* Cleanup */
     logger_info_with_category("Daemon", "Shutting down daemon");
     
@@ -1382,6 +1591,7 @@ int main(int argc, char *argv[]) {
     client = NULL;
     
     /* Cleanup metrics */
+    tsdb_close();
     metrics_cleanup();
     
     /* Cleanup event processor */
@@ -0,0 +1,309 @@
+#define _POSIX_C_SOURCE 200809L
+#include "engine_loop.h"
+#include "logger.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#define HAVE_EPOLL 1
+#else
+#include <poll.h>
+#define HAVE_EPOLL 0
+#endif
+
+/* epoll user data: which of the three sources a readiness event belongs to. */
+#define TAG_SERIAL 1
+#define TAG_NOTIFY 2
+#define TAG_TICK   3
+
+struct engine_loop {
+    long tick_ms;
+    int serial_fd;           /* fd as last handed in; -1 = none */
+    unsigned serial_gen;     /* generation that fd belongs to */
+    int serial_armed;        /* serial_fd is in the interest set */
+    int serial_want_write;   /* ...for POLLOUT as well as POLLIN */
+    int notify_fd;
+#if HAVE_EPOLL
+    int epoll_fd;
+    int timer_fd;
+#else
+    struct timespec next_tick;
+#endif
+};
+
+#if HAVE_EPOLL
+
+static int loop_ctl(struct engine_loop *loop, int op, int fd, int tag) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    if (tag == TAG_SERIAL && loop->serial_want_write) ev.events |= EPOLLOUT;
+    ev.data.u32 = (uint32_t)tag;
+    if (epoll_ctl(loop->epoll_fd, op, fd, &ev) == -1) {
+        logger_errorf_with_category("Engine", "epoll_ctl(%s, fd %d) failed: %s",
+                                    op == EPOLL_CTL_ADD ? "ADD" : "MOD",
+                                    fd, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static int loop_add(struct engine_loop *loop, int fd, int tag) {
+    return loop_ctl(loop, EPOLL_CTL_ADD, fd, tag);
+}
+
+static void loop_del(struct engine_loop *loop, int fd) {
+    /* ENOENT/EBADF are expected: closing an fd already removes it from the
+     * set, and the SDK closes the serial fd before we hear about the new one. */
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+engine_loop_t *engine_loop_create(long tick_ms) {
+    struct engine_loop *loop;
+    struct itimerspec its;
+
+    if (tick_ms <= 0) return NULL;
+
+    loop = calloc(1, sizeof(*loop));
+    if (!loop) {
+        logger_error_with_category("Engine", "Failed to allocate engine loop");
+        return NULL;
+    }
+    loop->tick_ms = tick_ms;
+    loop->serial_fd = -1;
+    loop->notify_fd = -1;
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd == -1) {
+        logger_errorf_with_category("Engine", "epoll_create1 failed: %s", strerror(errno));
+        free(loop);
+        return NULL;
+    }
+
+    loop->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (loop->timer_fd == -1) {
+        logger_errorf_with_category("Engine", "timerfd_create failed: %s", strerror(errno));
+        close(loop->epoll_fd);
+        free(loop);
+        return NULL;
+    }
+
+    its.it_interval.tv_sec = tick_ms / 1000;
+    its.it_interval.tv_nsec = (tick_ms % 1000) * 1000000L;
+    its.it_value = its.it_interval;
+    if (timerfd_settime(loop->timer_fd, 0, &its, NULL) == -1 ||
+        loop_add(loop, loop->timer_fd, TAG_TICK) != 0) {
+        logger_errorf_with_category("Engine", "Failed to arm tick timer: %s", strerror(errno));
+        close(loop->timer_fd);
+        close(loop->epoll_fd);
+        free(loop);
+        return NULL;
+    }
+
+    return loop;
+}
+
+void engine_loop_destroy(engine_loop_t *loop) {
+    if (!loop) return;
+    close(loop->timer_fd);
+    close(loop->epoll_fd);
+    free(loop);
+}
+
+void engine_loop_set_serial_fd(engine_loop_t *loop, int fd, unsigned generation) {
+    if (!loop) return;
+    if (fd == loop->serial_fd && generation == loop->serial_gen) return;
+
+    if (loop->serial_armed) {
+        loop_del(loop, loop->serial_fd);
+        loop->serial_armed = 0;
+    }
+    loop->serial_fd = fd;
+    loop->serial_gen = generation;
+    if (fd >= 0 && loop_add(loop, fd, TAG_SERIAL) == 0) {
+        loop->serial_armed = 1;
+    }
+}
+
+void engine_loop_set_serial_want_write(engine_loop_t *loop, int want) {
+    if (!loop) return;
+    want = want ? 1 : 0;
+    if (want == loop->serial_want_write) return;
+    loop->serial_want_write = want;
+    if (loop->serial_armed) {
+        loop_ctl(loop, EPOLL_CTL_MOD, loop->serial_fd, TAG_SERIAL);
+    }
+}
+
+void engine_loop_set_notify_fd(engine_loop_t *loop, int fd) {
+    if (!loop || fd == loop->notify_fd) return;
+    if (loop->notify_fd >= 0) loop_del(loop, loop->notify_fd);
+    loop->notify_fd = -1;
+    if (fd >= 0 && loop_add(loop, fd, TAG_NOTIFY) == 0) {
+        loop->notify_fd = fd;
+    }
+}
+
+unsigned engine_loop_wait(engine_loop_t *loop, int timeout_ms) {
+    struct epoll_event evs[3];
+    unsigned wake = 0;
+    int n, i;
+
+    if (!loop) return 0;
+
+    n = epoll_wait(loop->epoll_fd, evs, 3, timeout_ms);
+    if (n == -1) {
+        if (errno != EINTR) {
+            logger_errorf_with_category("Engine", "epoll_wait failed: %s", strerror(errno));
+        }
+        return 0;
+    }
+
+    for (i = 0; i < n; i++) {
+        switch (evs[i].data.u32) {
+        case TAG_SERIAL:
+            if (evs[i].events & EPOLLOUT) wake |= ENGINE_WAKE_WRITABLE;
+            if (evs[i].events & ~(uint32_t)EPOLLOUT) wake |= ENGINE_WAKE_SERIAL;
+            /* A USB unplug leaves the tty permanently readable-at-EOF. Level-
+             * triggered, that would spin this loop flat out until the watchdog
+             * noticed a minute later, so stop watching it; the SDK's read sees
+             * the error, and a reopen arrives as a new generation. */
+            if (evs[i].events & (EPOLLHUP | EPOLLERR)) {
+                logger_warn_with_category("Engine", "Serial fd hung up; unwatching until reopened");
+                loop_del(loop, loop->serial_fd);
+                loop->serial_armed = 0;
+            }
+            break;
+        case TAG_NOTIFY:
+            wake |= ENGINE_WAKE_NOTIFY;
+            break;
+        case TAG_TICK: {
+            uint64_t expirations;
+            /* Consume the expiry count. Ticks missed while the engine was busy
+             * collapse into one, like the elapsed-time gate this replaces. */
+            if (read(loop->timer_fd, &expirations, sizeof(expirations)) ==
+                (ssize_t)sizeof(expirations)) {
+                wake |= ENGINE_WAKE_TICK;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    return wake;
+}
+
+#else /* !HAVE_EPOLL: poll() fallback for non-Linux dev builds */
+
+static long ms_until(const struct timespec *deadline) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (deadline->tv_sec - now.tv_sec) * 1000L +
+           (deadline->tv_nsec - now.tv_nsec) / 1000000L;
+}
+
+static void advance_tick(struct engine_loop *loop) {
+    clock_gettime(CLOCK_MONOTONIC, &loop->next_tick);
+    loop->next_tick.tv_sec += loop->tick_ms / 1000;
+    loop->next_tick.tv_nsec += (loop->tick_ms % 1000) * 1000000L;
+    if (loop->next_tick.tv_nsec >= 1000000000L) {
+        loop->next_tick.tv_sec++;
+        loop->next_tick.tv_nsec -= 1000000000L;
+    }
+}
+
+engine_loop_t *engine_loop_create(long tick_ms) {
+    struct engine_loop *loop;
+    if (tick_ms <= 0) return NULL;
+    loop = calloc(1, sizeof(*loop));
+    if (!loop) {
+        logger_error_with_category("Engine", "Failed to allocate engine loop");
+        return NULL;
+    }
+    loop->tick_ms = tick_ms;
+    loop->serial_fd = -1;
+    loop->notify_fd = -1;
+    advance_tick(loop);
+    return loop;
+}
+
+void engine_loop_destroy(engine_loop_t *loop) {
+    free(loop);
+}
+
+void engine_loop_set_serial_fd(engine_loop_t *loop, int fd, unsigned generation) {
+    if (!loop) return;
+    if (fd == loop->serial_fd && generation == loop->serial_gen) return;
+    loop->serial_fd = fd;
+    loop->serial_gen = generation;
+    loop->serial_armed = (fd >= 0);
+}
+
+void engine_loop_set_serial_want_write(engine_loop_t *loop, int want) {
+    if (loop) loop->serial_want_write = want ? 1 : 0;
+}
+
+void engine_loop_set_notify_fd(engine_loop_t *loop, int fd) {
+    if (loop) loop->notify_fd = fd;
+}
+
+unsigned engine_loop_wait(engine_loop_t *loop, int timeout_ms) {
+    struct pollfd pfds[2];
+    int serial_idx = -1, notify_idx = -1;
+    int nfds = 0, n;
+    long tick_left;
+    unsigned wake = 0;
+
+    if (!loop) return 0;
+
+    if (loop->serial_armed) {
+        serial_idx = nfds;
+        pfds[nfds].fd = loop->serial_fd;
+        pfds[nfds].events = POLLIN;
+        if (loop->serial_want_write) pfds[nfds].events |= POLLOUT;
+        pfds[nfds].revents = 0;
+        nfds++;
+    }
+    if (loop->notify_fd >= 0) {
+        notify_idx = nfds;
+        pfds[nfds].fd = loop->notify_fd;
+        pfds[nfds].events = POLLIN;
+        pfds[nfds].revents = 0;
+        nfds++;
+    }
+
+    tick_left = ms_until(&loop->next_tick);
+    if (tick_left < 0) tick_left = 0;
+    if (timeout_ms < 0 || tick_left < timeout_ms) timeout_ms = (int)tick_left;
+
+    n = poll(pfds, (nfds_t)nfds, timeout_ms);
+    if (n == -1 && errno != EINTR) {
+        logger_errorf_with_category("Engine", "poll failed: %s", strerror(errno));
+    }
+    if (n > 0) {
+        if (serial_idx >= 0 && pfds[serial_idx].revents) {
+            if (pfds[serial_idx].revents & POLLOUT) wake |= ENGINE_WAKE_WRITABLE;
+            if (pfds[serial_idx].revents & ~POLLOUT) wake |= ENGINE_WAKE_SERIAL;
+            if (pfds[serial_idx].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+                loop->serial_armed = 0;
+            }
+        }
+        if (notify_idx >= 0 && (pfds[notify_idx].revents & POLLIN)) {
+            wake |= ENGINE_WAKE_NOTIFY;
+        }
+    }
+    if (ms_until(&loop->next_tick) <= 0) {
+        advance_tick(loop);
+        wake |= ENGINE_WAKE_TICK;
+    }
+    return wake;
+}
+
+#endif /* HAVE_EPOLL */
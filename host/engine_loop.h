@@ -0,0 +1,70 @@
+/* Event-driven wait for the daemon's main loop.
+ *
+ * The engine used to poll: pop one event, and if there was none, sleep 10 ms
+ * in select() and try again, with periodic work gated on a clock_gettime()
+ * delta. That capped keypress latency at the sleep and woke an idle Pi Zero a
+ * hundred times a second to find nothing to do.
+ *
+ * engine_loop blocks instead, until one of three things is ready:
+ *
+ *   - the serial fd has bytes from the Arduino        (ENGINE_WAKE_SERIAL)
+ *   - the SDK's notify fd was signalled -- a PJSUA
+ *     call-state event was queued, or the display
+ *     went dirty from a web-thread control command    (ENGINE_WAKE_NOTIFY)
+ *   - the periodic tick timer expired                 (ENGINE_WAKE_TICK)
+ *   - the serial fd can take more output, while the
+ *     caller has asked to hear about it               (ENGINE_WAKE_WRITABLE)
+ *
+ * On Linux that is one epoll set holding the serial fd, the notify eventfd and
+ * a timerfd. Elsewhere (the macOS dev box runs `make compile-check`) it falls
+ * back to poll() with the tick folded into the timeout, which behaves the same
+ * minus the timerfd.
+ *
+ * The loop owns only the timer. It does not own the fds it watches: the SDK
+ * closes and reopens the serial port on reconnect, so the caller hands the
+ * current fd in before every wait and the loop re-registers when it changes.
+ */
+#ifndef ENGINE_LOOP_H
+#define ENGINE_LOOP_H
+
+/* Bits returned by engine_loop_wait(). */
+#define ENGINE_WAKE_SERIAL 0x01
+#define ENGINE_WAKE_NOTIFY 0x02
+#define ENGINE_WAKE_TICK   0x04
+#define ENGINE_WAKE_WRITABLE 0x08
+
+/* Period of plugins_tick/display_manager_tick and the other periodic work.
+ * ~300 ms keeps display scrolling and game animation smooth while leaving the
+ * CPU free for call audio. */
+#define ENGINE_TICK_MS 300
+
+typedef struct engine_loop engine_loop_t;
+
+/* Create a loop whose tick fires every `tick_ms` (> 0). Returns NULL on
+ * failure; the reason is logged. */
+engine_loop_t *engine_loop_create(long tick_ms);
+void engine_loop_destroy(engine_loop_t *loop);
+
+/* Watch `fd` (or nothing, for -1) as the serial fd. `generation` must change
+ * whenever the fd is reopened, even if the kernel hands back the same number:
+ * a hung-up fd is dropped from the set so it cannot spin the loop, and only a
+ * new generation re-arms it. Cheap when nothing changed -- call every pass. */
+void engine_loop_set_serial_fd(engine_loop_t *loop, int fd, unsigned generation);
+
+/* Also watch the serial fd for writability (POLLOUT) while `want` is set --
+ * i.e. while the SDK has output queued that the tty would not take. Leave it
+ * clear otherwise: a tty is writable nearly all the time, and level-triggered
+ * interest in that would spin the loop. Survives a change of serial fd. */
+void engine_loop_set_serial_want_write(engine_loop_t *loop, int want);
+
+/* Watch `fd` for readability as the notify fd. The loop never reads it; the
+ * owner drains it after a NOTIFY wake. */
+void engine_loop_set_notify_fd(engine_loop_t *loop, int fd);
+
+/* Block until something is ready or `timeout_ms` elapses (-1 = no timeout
+ * beyond the next tick; 0 = poll). Returns a mask of ENGINE_WAKE_* bits, 0 on
+ * timeout or EINTR -- the caller rechecks its running flag either way. A TICK
+ * bit consumes the expiry, so each tick is reported once. */
+unsigned engine_loop_wait(engine_loop_t *loop, int timeout_ms);
+
+#endif /* ENGINE_LOOP_H */
@@ -0,0 +1,135 @@
+#include "event_ring.h"
+
+#include <stdlib.h>
+
+/* GCC/clang __atomic builtins: available under -std=gnu89, unlike
+ * <stdatomic.h>, and lock-free for a word on both x86-64 and the Pi's ARM. */
+#define LOAD_RELAXED(p)     __atomic_load_n((p), __ATOMIC_RELAXED)
+#define LOAD_ACQUIRE(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define ADD_RELAXED(p, v)   __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+
+int event_ring_init(struct event_ring *r, unsigned long capacity) {
+    unsigned long i;
+    if (!r || capacity < 2 || (capacity & (capacity - 1)) != 0) return -1;
+
+    r->slots = (struct event_ring_slot *)malloc(capacity * sizeof(*r->slots));
+    if (!r->slots) return -1;
+
+    for (i = 0; i < capacity; i++) {
+        r->slots[i].seq = i;
+        r->slots[i].item = NULL;
+    }
+    r->mask = capacity - 1;
+    r->head = 0;
+    r->tail = 0;
+    r->high_water = 0;
+    r->pushed_total = 0;
+    r->dropped_total = 0;
+    return 0;
+}
+
+void event_ring_destroy(struct event_ring *r) {
+    if (!r) return;
+    free(r->slots);
+    r->slots = NULL;
+    r->mask = 0;
+    r->head = 0;
+    r->tail = 0;
+}
+
+/* Record `depth` as the new high-water mark if it is one. Racing producers
+ * may each observe a different depth; the CAS loop keeps the largest. */
+static void note_depth(struct event_ring *r, unsigned long depth) {
+    unsigned long hw = LOAD_RELAXED(&r->high_water);
+    while (depth > hw) {
+        if (__atomic_compare_exchange_n(&r->high_water, &hw, depth, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+}
+
+int event_ring_push(struct event_ring *r, void *item) {
+    struct event_ring_slot *slot;
+    unsigned long pos, seq;
+    long dif;
+
+    if (!r || !r->slots || !item) return -1;
+
+    pos = LOAD_RELAXED(&r->tail);
+    for (;;) {
+        slot = &r->slots[pos & r->mask];
+        seq = LOAD_ACQUIRE(&slot->seq);
+        /* Signed difference so the comparison survives position wraparound
+         * (unsigned long is 32 bits on the Pi). */
+        dif = (long)(seq - pos);
+        if (dif == 0) {
+            /* Slot is free for this position: claim it. On failure `pos` is
+             * reloaded with the tail another producer just advanced to. */
+            if (__atomic_compare_exchange_n(&r->tail, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (dif < 0) {
+            /* Slot still holds the item from one lap ago: full. */
+            ADD_RELAXED(&r->dropped_total, 1UL);
+            return -1;
+        } else {
+            /* Another producer claimed this position; catch up. */
+            pos = LOAD_RELAXED(&r->tail);
+        }
+    }
+
+    slot->item = item;
+    STORE_RELEASE(&slot->seq, pos + 1);
+
+    ADD_RELAXED(&r->pushed_total, 1UL);
+    note_depth(r, pos + 1 - LOAD_RELAXED(&r->head));
+    return 0;
+}
+
+void *event_ring_pop(struct event_ring *r) {
+    struct event_ring_slot *slot;
+    unsigned long pos;
+    void *item;
+
+    if (!r || !r->slots) return NULL;
+
+    pos = r->head;  /* only the consumer writes head */
+    slot = &r->slots[pos & r->mask];
+    if ((long)(LOAD_ACQUIRE(&slot->seq) - (pos + 1)) < 0) {
+        return NULL;  /* empty, or the producer has not published yet */
+    }
+
+    item = slot->item;
+    slot->item = NULL;
+    /* Hand the slot back to producers for the next lap. */
+    STORE_RELEASE(&slot->seq, pos + r->mask + 1);
+    STORE_RELEASE(&r->head, pos + 1);
+    return item;
+}
+
+void event_ring_get_stats(struct event_ring *r, struct event_ring_stats *out) {
+    unsigned long head, tail;
+    if (!out) return;
+    if (!r || !r->slots) {
+        out->capacity = 0;
+        out->depth = 0;
+        out->high_water = 0;
+        out->pushed_total = 0;
+        out->dropped_total = 0;
+        return;
+    }
+    head = LOAD_ACQUIRE(&r->head);
+    tail = LOAD_ACQUIRE(&r->tail);
+    out->capacity = r->mask + 1;
+    /* tail counts claimed-but-unpublished slots too; close enough for a gauge,
+     * but clamp so a torn read can never report more than capacity. */
+    out->depth = tail - head;
+    if ((long)out->depth < 0) out->depth = 0;
+    if (out->depth > out->capacity) out->depth = out->capacity;
+    out->high_water = LOAD_RELAXED(&r->high_water);
+    out->pushed_total = LOAD_RELAXED(&r->pushed_total);
+    out->dropped_total = LOAD_RELAXED(&r->dropped_total);
+}
@@ -0,0 +1,96 @@
+#ifndef EVENT_RING_H
+#define EVENT_RING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * event_ring: a fixed-capacity, lock-free multi-producer/single-consumer FIFO
+ * of pointers.
+ *
+ * This is the SDK's event queue. Two producers push into it -- the main loop
+ * (serial events from the Arduino) and PJSUA worker threads (SIP call-state
+ * events, via sip_event_cb) -- and only the main loop pops. It replaces a
+ * malloc'd linked list behind g_queue_mutex, which had two problems: every
+ * push allocated, and nothing bounded the list, so a main loop stalled on a
+ * slow plugin or a wedged display write let PJSUA grow it without limit.
+ *
+ * The algorithm is the bounded sequence-number ring (Vyukov): each slot
+ * carries a sequence that says whether it is free for the producer at a given
+ * position or holds an item for the consumer at that position. Producers claim
+ * a position with one compare-and-swap on `tail` and then publish the slot
+ * with a release store, so no producer ever waits on the consumer or on
+ * another producer that has already claimed its slot.
+ *
+ * OVERFLOW POLICY: reject the newest. A push onto a full ring fails without
+ * touching it, counts a drop, and leaves the item with the caller to free.
+ * Dropping the oldest instead would need producers to pop, which breaks the
+ * single-consumer contract; and the oldest events (a hook-up, a coin) are the
+ * ones whose loss would desync the daemon from the hardware anyway. A full
+ * ring means the main loop has stopped draining, which is the thing to alert
+ * on -- see dropped_total.
+ *
+ * Memory is allocated once in event_ring_init(); push and pop never allocate.
+ */
+
+/* Default capacity of the SDK's event queue. The main loop drains one event
+ * per wake, and a busy call produces a handful per second, so 256 is minutes
+ * of backlog -- far past the point the watchdog would have restarted us. */
+#define EVENT_RING_CAPACITY 256
+
+struct event_ring_slot {
+    unsigned long seq;
+    void *item;
+};
+
+struct event_ring {
+    struct event_ring_slot *slots;
+    unsigned long mask;     /* capacity - 1; capacity is a power of two */
+    unsigned long head;     /* next position to pop; written by the consumer */
+    unsigned long tail;     /* next position to claim; CAS'd by producers */
+    /* Lifetime health counters (see event_ring_get_stats). Updated with
+     * relaxed atomics: they are for metrics, not for synchronization. */
+    unsigned long high_water;
+    unsigned long pushed_total;
+    unsigned long dropped_total;
+};
+
+/* Read-only snapshot of a ring's health. depth is instantaneous and may be
+ * momentarily stale under concurrent pushes; the totals are monotonic so a
+ * metrics scraper can rate() over them. */
+struct event_ring_stats {
+    unsigned long capacity;
+    unsigned long depth;
+    unsigned long high_water;
+    unsigned long pushed_total;
+    unsigned long dropped_total;
+};
+
+/* Initialize a ring with room for `capacity` items, which must be a power of
+ * two >= 2. Returns 0 on success, -1 on bad argument or allocation failure. */
+int event_ring_init(struct event_ring *r, unsigned long capacity);
+
+/* Free the slot array. The ring must not be in use by other threads, and
+ * should be drained first: items still queued are not freed. */
+void event_ring_destroy(struct event_ring *r);
+
+/* Enqueue `item` (non-NULL) without blocking. Safe from any number of
+ * threads. Returns 0 on success, -1 if the ring is full -- a drop is counted
+ * and the caller still owns `item`. */
+int event_ring_push(struct event_ring *r, void *item);
+
+/* Dequeue the oldest item, or NULL if the ring is empty. Single consumer
+ * only. May return NULL while a producer is between claiming a slot and
+ * publishing it; that producer signals the consumer afterwards, so the item
+ * is picked up on the next wake. */
+void *event_ring_pop(struct event_ring *r);
+
+/* Snapshot the health counters. NULL-safe (zeroes the output). */
+void event_ring_get_stats(struct event_ring *r, struct event_ring_stats *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EVENT_RING_H */
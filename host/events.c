@@ -19,36 +19,99 @@ static char *strdup_safe(const char *src) {
     return dst;
 }
 
-/* Keypad event functions */
-static void keypad_event_destroy(void *event) {
-    free(event);
+/* ── Event pool ──────────────────────────────────────────────────── */
+
+/* One slot fits any event. */
+typedef union {
+    event_t base;
+    keypad_event_t keypad;
+    card_event_t card;
+    coin_event_t coin;
+    hook_state_change_event_t hook;
+    coin_eeprom_validation_error_t eeprom_error;
+    call_state_event_t call_state;
+} event_slot_t;
+
+#define POOL_WORD_BITS 32
+#define POOL_WORDS ((EVENT_POOL_SIZE + POOL_WORD_BITS - 1) / POOL_WORD_BITS)
+
+static event_slot_t pool_slots[EVENT_POOL_SIZE];
+/* Bit i set = pool_slots[i] in use. A bitmap rather than a free list because
+ * a lock-free free list needs ABA protection; a bit has no history to confuse. */
+static uint32_t pool_used[POOL_WORDS];
+
+static unsigned long pool_in_use;
+static unsigned long pool_high_water;
+static unsigned long pool_allocated_total;
+static unsigned long pool_exhausted_total;
+
+static void pool_note_in_use(unsigned long n) {
+    unsigned long hw = __atomic_load_n(&pool_high_water, __ATOMIC_RELAXED);
+    while (n > hw) {
+        if (__atomic_compare_exchange_n(&pool_high_water, &hw, n, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
 }
 
-static const char *keypad_event_get_name(void *event) {
-    (void)event;
-    return "KeypadEvent";
-}
+static event_t *event_alloc(event_type_t type) {
+    event_slot_t *slot = NULL;
+    size_t w;
+
+    for (w = 0; w < POOL_WORDS && !slot; w++) {
+        uint32_t used = __atomic_load_n(&pool_used[w], __ATOMIC_RELAXED);
+        while (used != 0xFFFFFFFFu) {
+            uint32_t bit = 0;
+            size_t idx;
+            while (used & ((uint32_t)1 << bit)) bit++;
+            idx = w * POOL_WORD_BITS + bit;
+            if (idx >= EVENT_POOL_SIZE) break;  /* tail bits of the last word */
+            /* Acquire pairs with the release in event_destroy: the previous
+             * owner's writes to the slot are done before we reuse it. */
+            if (__atomic_compare_exchange_n(&pool_used[w], &used,
+                                            used | ((uint32_t)1 << bit), 1,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                slot = &pool_slots[idx];
+                break;
+            }
+            /* Lost the race; `used` was reloaded, scan it again. */
+        }
+    }
 
-static char *keypad_event_get_repr(void *event) {
-    keypad_event_t *ke = (keypad_event_t *)event;
-    char *repr = malloc(2);
-    if (repr) {
-        repr[0] = ke->key;
-        repr[1] = '\0';
+    __atomic_fetch_add(&pool_allocated_total, 1UL, __ATOMIC_RELAXED);
+    if (slot) {
+        pool_note_in_use(__atomic_add_fetch(&pool_in_use, 1UL, __ATOMIC_RELAXED));
+    } else {
+        unsigned long n = __atomic_add_fetch(&pool_exhausted_total, 1UL, __ATOMIC_RELAXED);
+        /* 1st, 2nd, 4th... so a leak is reported without flooding the log. */
+        if ((n & (n - 1)) == 0) {
+            logger_warnf_with_category("Events",
+                "Event pool exhausted (%d slots); using heap (%lu times)",
+                EVENT_POOL_SIZE, n);
+        }
+        slot = malloc(sizeof(event_slot_t));
+        if (!slot) return NULL;
     }
-    return repr;
+    slot->base.type = type;
+    return &slot->base;
+}
+
+void event_pool_get_stats(event_pool_stats_t *out) {
+    if (!out) return;
+    out->capacity = EVENT_POOL_SIZE;
+    out->in_use = __atomic_load_n(&pool_in_use, __ATOMIC_RELAXED);
+    out->high_water = __atomic_load_n(&pool_high_water, __ATOMIC_RELAXED);
+    out->allocated_total = __atomic_load_n(&pool_allocated_total, __ATOMIC_RELAXED);
+    out->exhausted_total = __atomic_load_n(&pool_exhausted_total, __ATOMIC_RELAXED);
 }
 
+/* ── Event constructors ────────────────────────────────────────────── */
+
 keypad_event_t *keypad_event_create(char key) {
-    keypad_event_t *event = malloc(sizeof(keypad_event_t));
+    keypad_event_t *event = (keypad_event_t *)event_alloc(EVENT_KEYPAD);
     if (!event) return NULL;
-    
-    event->base.type = EVENT_KEYPAD;
-    event->base.destroy = keypad_event_destroy;
-    event->base.get_name = keypad_event_get_name;
-    event->base.get_repr = keypad_event_get_repr;
     event->key = key;
-    
     return event;
 }
 
@@ -56,119 +119,53 @@ char keypad_event_get_key(keypad_event_t *event) {
     return event ? event->key : 0;
 }
 
-/* Card event functions */
-static void card_event_destroy(void *event) {
-    free(event);
-}
-
-static const char *card_event_get_name(void *event) {
-    (void)event;
-    return "CardEvent";
-}
-
-static char *card_event_get_repr(void *event) {
-    card_event_t *ce = (card_event_t *)event;
-    return strdup_safe(ce->card_number);
-}
-
 card_event_t *card_event_create(const char *card_number) {
-    card_event_t *event = malloc(sizeof(card_event_t));
+    card_event_t *event = (card_event_t *)event_alloc(EVENT_CARD);
     if (!event) return NULL;
-    
-    event->base.type = EVENT_CARD;
-    event->base.destroy = card_event_destroy;
-    event->base.get_name = card_event_get_name;
-    event->base.get_repr = card_event_get_repr;
-    
+
     if (card_number) {
         strncpy(event->card_number, card_number, sizeof(event->card_number) - 1);
         event->card_number[sizeof(event->card_number) - 1] = '\0';
     } else {
         event->card_number[0] = '\0';
     }
-    
-    return event;
-}
 
-/* Coin event functions */
-static void coin_event_destroy(void *event) {
-    free(event);
+    return event;
 }
 
-static const char *coin_event_get_name(void *event) {
-    (void)event;
-    return "CoinEvent";
-}
+const char *coin_event_get_coin_name(coin_event_t *event) {
+    if (!event) return NULL;
 
-static char *coin_event_get_repr(void *event) {
-    return coin_event_get_coin_code((coin_event_t *)event);
+    switch (event->code) {
+    case 0x30: return "INVALID_COIN";
+    case 0x31: return "COIN_1";
+    case 0x32: return "COIN_2";
+    case 0x33: return "COIN_3";
+    case 0x34: return "COIN_4";
+    case 0x35: return "COIN_5";
+    case 0x36: return "COIN_6";
+    case 0x37: return "COIN_7";
+    case 0x38: return "COIN_8";
+    default:   return "UNKNOWN_COIN";
+    }
 }
 
 char *coin_event_get_coin_code(coin_event_t *event) {
-    if (!event) return NULL;
-    
-    switch (event->code) {
-    case 0x30:
-        return strdup_safe("INVALID_COIN");
-    case 0x31:
-        return strdup_safe("COIN_1");
-    case 0x32:
-        return strdup_safe("COIN_2");
-    case 0x33:
-        return strdup_safe("COIN_3");
-    case 0x34:
-        return strdup_safe("COIN_4");
-    case 0x35:
-        return strdup_safe("COIN_5");
-    case 0x36:
-        return strdup_safe("COIN_6");
-    case 0x37:
-        return strdup_safe("COIN_7");
-    case 0x38:
-        return strdup_safe("COIN_8");
-    default:
-        return strdup_safe("UNKNOWN_COIN");
-    }
+    return strdup_safe(coin_event_get_coin_name(event));
 }
 
 coin_event_t *coin_event_create(uint8_t code) {
-    coin_event_t *event = malloc(sizeof(coin_event_t));
+    coin_event_t *event = (coin_event_t *)event_alloc(EVENT_COIN);
     if (!event) return NULL;
-    
-    event->base.type = EVENT_COIN;
-    event->base.destroy = coin_event_destroy;
-    event->base.get_name = coin_event_get_name;
-    event->base.get_repr = coin_event_get_repr;
     event->code = code;
-    
     return event;
 }
 
-/* Hook state change event functions */
-static void hook_state_change_event_destroy(void *event) {
-    free(event);
-}
-
-static const char *hook_state_change_event_get_name(void *event) {
-    (void)event;
-    return "HookStateChangeEvent";
-}
-
-static char *hook_state_change_event_get_repr(void *event) {
-    hook_state_change_event_t *he = (hook_state_change_event_t *)event;
-    return strdup_safe(he->state == 'U' ? "Up" : "Down");
-}
-
 hook_state_change_event_t *hook_state_change_event_create(char state) {
-    hook_state_change_event_t *event = malloc(sizeof(hook_state_change_event_t));
+    hook_state_change_event_t *event =
+        (hook_state_change_event_t *)event_alloc(EVENT_HOOK_STATE_CHANGE);
     if (!event) return NULL;
-    
-    event->base.type = EVENT_HOOK_STATE_CHANGE;
-    event->base.destroy = hook_state_change_event_destroy;
-    event->base.get_name = hook_state_change_event_get_name;
-    event->base.get_repr = hook_state_change_event_get_repr;
     event->state = state;
-    
     return event;
 }
 
@@ -176,183 +173,46 @@ char hook_state_change_event_get_direction(hook_state_change_event_t *event) {
     return event ? event->state : 0;
 }
 
-/* Coin EEPROM upload start event functions */
-static void coin_eeprom_upload_start_destroy(void *event) {
-    free(event);
-}
-
-static const char *coin_eeprom_upload_start_get_name(void *event) {
-    (void)event;
-    return "CoinEepromUploadStart";
-}
-
-static char *coin_eeprom_upload_start_get_repr(void *event) {
-    (void)event;
-    return strdup_safe("");
-}
-
 coin_eeprom_upload_start_t *coin_eeprom_upload_start_create(void) {
-    coin_eeprom_upload_start_t *event = malloc(sizeof(coin_eeprom_upload_start_t));
-    if (!event) return NULL;
-    
-    event->base.type = EVENT_COIN_EEPROM_UPLOAD_START;
-    event->base.destroy = coin_eeprom_upload_start_destroy;
-    event->base.get_name = coin_eeprom_upload_start_get_name;
-    event->base.get_repr = coin_eeprom_upload_start_get_repr;
-    
-    return event;
-}
-
-/* Coin EEPROM upload end event functions */
-static void coin_eeprom_upload_end_destroy(void *event) {
-    free(event);
-}
-
-static const char *coin_eeprom_upload_end_get_name(void *event) {
-    (void)event;
-    return "CoinEepromUploadEnd";
-}
-
-static char *coin_eeprom_upload_end_get_repr(void *event) {
-    (void)event;
-    return strdup_safe("");
+    return (coin_eeprom_upload_start_t *)event_alloc(EVENT_COIN_EEPROM_UPLOAD_START);
 }
 
 coin_eeprom_upload_end_t *coin_eeprom_upload_end_create(void) {
-    coin_eeprom_upload_end_t *event = malloc(sizeof(coin_eeprom_upload_end_t));
-    if (!event) return NULL;
-    
-    event->base.type = EVENT_COIN_EEPROM_UPLOAD_END;
-    event->base.destroy = coin_eeprom_upload_end_destroy;
-    event->base.get_name = coin_eeprom_upload_end_get_name;
-    event->base.get_repr = coin_eeprom_upload_end_get_repr;
-    
-    return event;
-}
-
-/* Coin EEPROM validation start event functions */
-static void coin_eeprom_validation_start_destroy(void *event) {
-    free(event);
-}
-
-static const char *coin_eeprom_validation_start_get_name(void *event) {
-    (void)event;
-    return "CoinEepromValidationStart";
-}
-
-static char *coin_eeprom_validation_start_get_repr(void *event) {
-    (void)event;
-    return strdup_safe("");
+    return (coin_eeprom_upload_end_t *)event_alloc(EVENT_COIN_EEPROM_UPLOAD_END);
 }
 
 coin_eeprom_validation_start_t *coin_eeprom_validation_start_create(void) {
-    coin_eeprom_validation_start_t *event = malloc(sizeof(coin_eeprom_validation_start_t));
-    if (!event) return NULL;
-    
-    event->base.type = EVENT_COIN_EEPROM_VALIDATION_START;
-    event->base.destroy = coin_eeprom_validation_start_destroy;
-    event->base.get_name = coin_eeprom_validation_start_get_name;
-    event->base.get_repr = coin_eeprom_validation_start_get_repr;
-    
-    return event;
-}
-
-/* Coin EEPROM validation end event functions */
-static void coin_eeprom_validation_end_destroy(void *event) {
-    free(event);
-}
-
-static const char *coin_eeprom_validation_end_get_name(void *event) {
-    (void)event;
-    return "CoinEepromValidationEnd";
-}
-
-static char *coin_eeprom_validation_end_get_repr(void *event) {
-    (void)event;
-    return strdup_safe("");
+    return (coin_eeprom_validation_start_t *)event_alloc(EVENT_COIN_EEPROM_VALIDATION_START);
 }
 
 coin_eeprom_validation_end_t *coin_eeprom_validation_end_create(void) {
-    coin_eeprom_validation_end_t *event = malloc(sizeof(coin_eeprom_validation_end_t));
-    if (!event) return NULL;
-    
-    event->base.type = EVENT_COIN_EEPROM_VALIDATION_END;
-    event->base.destroy = coin_eeprom_validation_end_destroy;
-    event->base.get_name = coin_eeprom_validation_end_get_name;
-    event->base.get_repr = coin_eeprom_validation_end_get_repr;
-    
-    return event;
-}
-
-/* Coin EEPROM validation error event functions */
-static void coin_eeprom_validation_error_destroy(void *event) {
-    free(event);
-}
-
-static const char *coin_eeprom_validation_error_get_name(void *event) {
-    (void)event;
-    return "CoinEepromValidationError";
-}
-
-static char *coin_eeprom_validation_error_get_repr(void *event) {
-    coin_eeprom_validation_error_t *ee = (coin_eeprom_validation_error_t *)event;
-    char *repr = malloc(64);
-    if (repr) {
-        snprintf(repr, 64, "Addr: %d, Expected: %d, Actual: %d", 
-                ee->addr, ee->expected, ee->actual);
-    }
-    return repr;
+    return (coin_eeprom_validation_end_t *)event_alloc(EVENT_COIN_EEPROM_VALIDATION_END);
 }
 
 coin_eeprom_validation_error_t *coin_eeprom_validation_error_create(uint8_t addr, uint8_t expected, uint8_t actual) {
-    coin_eeprom_validation_error_t *event = malloc(sizeof(coin_eeprom_validation_error_t));
+    coin_eeprom_validation_error_t *event =
+        (coin_eeprom_validation_error_t *)event_alloc(EVENT_COIN_EEPROM_VALIDATION_ERROR);
     if (!event) return NULL;
-    
-    event->base.type = EVENT_COIN_EEPROM_VALIDATION_ERROR;
-    event->base.destroy = coin_eeprom_validation_error_destroy;
-    event->base.get_name = coin_eeprom_validation_error_get_name;
-    event->base.get_repr = coin_eeprom_validation_error_get_repr;
     event->addr = addr;
     event->expected = expected;
     event->actual = actual;
-    
     return event;
 }
 
-/* Call state event functions */
-static void call_state_event_destroy(void *event) {
-    free(event);
-}
-
-static const char *call_state_event_get_name(void *event) {
-    (void)event;
-    return "CallStateEvent";
-}
-
-static char *call_state_event_get_repr(void *event) {
-    call_state_event_t *ce = (call_state_event_t *)event;
-    return strdup_safe(ce->state);
-}
-
 call_state_event_t *call_state_event_create(const char *state, struct call *call, call_state_t state_value) {
-    call_state_event_t *event = malloc(sizeof(call_state_event_t));
+    call_state_event_t *event = (call_state_event_t *)event_alloc(EVENT_CALL_STATE);
     if (!event) return NULL;
-    
-    event->base.type = EVENT_CALL_STATE;
-    event->base.destroy = call_state_event_destroy;
-    event->base.get_name = call_state_event_get_name;
-    event->base.get_repr = call_state_event_get_repr;
-    
+
     if (state) {
         strncpy(event->state, state, sizeof(event->state) - 1);
         event->state[sizeof(event->state) - 1] = '\0';
     } else {
         event->state[0] = '\0';
     }
-    
+
     event->call = call;
     event->state_value = state_value;
-    
+
     return event;
 }
 
@@ -364,31 +224,93 @@ struct call *call_state_event_get_call(call_state_event_t *event) {
     return event ? event->call : NULL;
 }
 
-/* Generic event functions */
+/* ── Generic event functions ───────────────────────────────────────── */
+
 void event_destroy(event_t *event) {
-    if (event && event->destroy) {
-        event->destroy(event);
+    event_slot_t *slot = (event_slot_t *)event;
+    if (!event) return;
+
+    if (slot >= pool_slots && slot < pool_slots + EVENT_POOL_SIZE) {
+        size_t idx = (size_t)(slot - pool_slots);
+        __atomic_fetch_sub(&pool_in_use, 1UL, __ATOMIC_RELAXED);
+        __atomic_fetch_and(&pool_used[idx / POOL_WORD_BITS],
+                           ~((uint32_t)1 << (idx % POOL_WORD_BITS)),
+                           __ATOMIC_RELEASE);
+    } else {
+        free(event);  /* heap fallback from an exhausted pool */
     }
 }
 
 const char *event_get_name(event_t *event) {
-    if (event && event->get_name) {
-        return event->get_name(event);
+    if (!event) return "UnknownEvent";
+
+    switch (event->type) {
+    case EVENT_KEYPAD:                       return "KeypadEvent";
+    case EVENT_CARD:                         return "CardEvent";
+    case EVENT_COIN:                         return "CoinEvent";
+    case EVENT_HOOK_STATE_CHANGE:            return "HookStateChangeEvent";
+    case EVENT_COIN_EEPROM_UPLOAD_START:     return "CoinEepromUploadStart";
+    case EVENT_COIN_EEPROM_UPLOAD_END:       return "CoinEepromUploadEnd";
+    case EVENT_COIN_EEPROM_VALIDATION_START: return "CoinEepromValidationStart";
+    case EVENT_COIN_EEPROM_VALIDATION_END:   return "CoinEepromValidationEnd";
+    case EVENT_COIN_EEPROM_VALIDATION_ERROR: return "CoinEepromValidationError";
+    case EVENT_CALL_STATE:                   return "CallStateEvent";
+    default:                                 return "UnknownEvent";
     }
-    return "UnknownEvent";
 }
 
-char *event_get_repr(event_t *event) {
-    if (event && event->get_repr) {
-        return event->get_repr(event);
+char *event_format_repr(event_t *event, char *buf, size_t size) {
+    if (!buf || size == 0) return buf;
+    if (!event) {
+        snprintf(buf, size, "Unknown");
+        return buf;
+    }
+
+    switch (event->type) {
+    case EVENT_KEYPAD:
+        snprintf(buf, size, "%c", ((keypad_event_t *)event)->key);
+        break;
+    case EVENT_CARD:
+        snprintf(buf, size, "%s", ((card_event_t *)event)->card_number);
+        break;
+    case EVENT_COIN:
+        snprintf(buf, size, "%s", coin_event_get_coin_name((coin_event_t *)event));
+        break;
+    case EVENT_HOOK_STATE_CHANGE:
+        snprintf(buf, size, "%s",
+                 ((hook_state_change_event_t *)event)->state == 'U' ? "Up" : "Down");
+        break;
+    case EVENT_COIN_EEPROM_VALIDATION_ERROR: {
+        coin_eeprom_validation_error_t *ee = (coin_eeprom_validation_error_t *)event;
+        snprintf(buf, size, "Addr: %d, Expected: %d, Actual: %d",
+                 ee->addr, ee->expected, ee->actual);
+        break;
     }
-    return strdup_safe("Unknown");
+    case EVENT_CALL_STATE:
+        snprintf(buf, size, "%s", ((call_state_event_t *)event)->state);
+        break;
+    case EVENT_COIN_EEPROM_UPLOAD_START:
+    case EVENT_COIN_EEPROM_UPLOAD_END:
+    case EVENT_COIN_EEPROM_VALIDATION_START:
+    case EVENT_COIN_EEPROM_VALIDATION_END:
+        buf[0] = '\0';
+        break;
+    default:
+        snprintf(buf, size, "Unknown");
+        break;
+    }
+    return buf;
+}
+
+char *event_get_repr(event_t *event) {
+    char buf[64];
+    return strdup_safe(event_format_repr(event, buf, sizeof(buf)));
 }
 
 /* (#230) Decode an Arduino diagnostic payload: source letter + 3 ASCII digits.
  *
  * Strict about the digits on purpose. This rides the same serial stream as
- * keypresses and coins, and process_event_buffer() consumes a fixed width, so
+ * keypresses and coins, and serial_parser.c consumes a fixed width, so
  * a malformed payload means the stream is already misaligned -- inventing a
  * number from it would turn a parsing bug into a bogus metric. */
 int event_diag_parse(const char *payload, const char **source, long *count) {
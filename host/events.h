@@ -20,9 +20,10 @@ struct call;
 #define EVENT_TYPE_HEARTBEAT 'P'
 /* (#230) Arduino diagnostics: 'G' + source ('A'=Alpha I2C send drops,
  * 'B'=Beta I2C receive-ring overflows) + a 3-digit ASCII count.
- * ASCII rather than a raw byte on purpose: process_event_buffer() computes how
- * much to consume with strlen(), so a payload byte of 0 would truncate the
- * event and desync the stream.
+ * ASCII rather than a raw byte on purpose: the event layer reads payloads as C
+ * strings, so a payload byte of 0 would truncate the count. (The old buffer
+ * parser also consumed strlen() bytes, so a 0 desynced the whole stream;
+ * serial_parser.c consumes the fixed width from its table instead.)
  *
  * (#259) 'G' and not 'X': display.ino spends 'X' on a display-timeout debug
  * response. Any letter registered here is a marker that consumes a fixed-width
@@ -63,12 +64,12 @@ typedef enum {
     EVENT_CALL_STATE_ACTIVE
 } call_state_t;
 
-/* Base event structure */
+/* Base event structure. Every event struct below starts with one, so any event
+ * pointer can be passed as an event_t *. There is no per-object vtable: name,
+ * repr and destroy switch on `type`, which keeps every event inside one pool
+ * slot (see EVENT_POOL_SIZE) and off the heap. */
 typedef struct {
     event_type_t type;
-    void (*destroy)(void *event);
-    const char *(*get_name)(void *event);
-    char *(*get_repr)(void *event);
 } event_t;
 
 /* Keypad event structure */
@@ -146,7 +147,40 @@ call_state_event_t *call_state_event_create(const char *state, struct call *call
 /* Function declarations for event operations */
 void event_destroy(event_t *event);
 const char *event_get_name(event_t *event);
+/* Heap-allocated repr; the caller frees it. Prefer event_format_repr on hot
+ * paths. */
 char *event_get_repr(event_t *event);
+/* Write the repr into buf (always NUL-terminated when size > 0) and return
+ * buf. No allocation. */
+char *event_format_repr(event_t *event, char *buf, size_t size);
+
+/* Event pool.
+ *
+ * Events are created by the serial path and PJSUA threads and destroyed by the
+ * main loop after event_processor_process_event(), several per keypress. They
+ * used to be malloc'd and freed one by one, which on the Pi Zero meant taking
+ * the allocator lock against the web workers on every key and fragmenting the
+ * small heap over months of uptime. They now come from a fixed pool of
+ * EVENT_POOL_SIZE slots, each big enough for any event type, claimed and
+ * released through an atomic bitmap: no lock, no heap.
+ *
+ * Sized above EVENT_RING_CAPACITY (256, event_ring.h) so a full event queue
+ * plus the events in flight on either side of it still fit. If the pool is
+ * exhausted anyway -- a leak, or a new producer that holds events -- creation
+ * falls back to malloc rather than losing the event, and counts it in
+ * exhausted_total so it shows up in metrics. */
+#define EVENT_POOL_SIZE 320
+
+typedef struct {
+    unsigned long capacity;
+    unsigned long in_use;           /* pool slots currently held */
+    unsigned long high_water;       /* max in_use since start */
+    unsigned long allocated_total;  /* events created, pool or heap */
+    unsigned long exhausted_total;  /* creations that fell back to malloc */
+} event_pool_stats_t;
+
+/* Snapshot the pool counters. Lock-free, callable from any thread. */
+void event_pool_get_stats(event_pool_stats_t *out);
 
 /* Specific getter functions */
 char keypad_event_get_key(keypad_event_t *event);
@@ -154,7 +188,10 @@ char hook_state_change_event_get_direction(hook_state_change_event_t *event);
 call_state_t call_state_event_get_state(call_state_event_t *event);
 struct call *call_state_event_get_call(call_state_event_t *event);
 
-/* Coin event specific function */
+/* Coin event specific functions. get_coin_name returns a static string
+ * ("COIN_6", "INVALID_COIN", ...), or NULL for a NULL event; get_coin_code is
+ * the same name heap-allocated, for callers that want to own it. */
+const char *coin_event_get_coin_name(coin_event_t *event);
 char *coin_event_get_coin_code(coin_event_t *event);
 
 #endif /* EVENTS_H */
@@ -295,24 +295,20 @@ void health_monitor_publish_metrics(void) {
      * out-of-band from the web dashboard. */
     count = health_monitor_get_all_checks(checks, 32);
     for (i = 0; i < count; i++) {
-        char metric_name[128];
-        /* Bound the %s to the check name's field capacity (name[64]) so gcc's
-         * -Werror=format-truncation can see the output fits — the buffer holds
-         * "health_check_" (13) + 63 + "_status" (7) + NUL = 84 <= 128. */
-        snprintf(metric_name, sizeof(metric_name),
-                 "health_check_%.63s_status", checks[i].name);
-        metrics_set_gauge(metric_name, (double)checks[i].last_status);
+        metrics_gauge_set(metrics_gauge_with_labels("health_check_status",
+                                                    "check", checks[i].name, NULL),
+                          (double)checks[i].last_status);
     }
 
     /* Worst status across all checks: a single rollup to alert on. */
-    metrics_set_gauge("health_overall_status",
+    METRICS_GAUGE_SET("health_overall_status",
                       (double)health_monitor_get_overall_status());
 
     /* Cumulative check tallies (running totals the monitor maintains). */
     if (health_monitor_get_statistics(&stats)) {
-        metrics_set_gauge("health_checks_total", (double)stats.total_checks);
-        metrics_set_gauge("health_checks_failed", (double)stats.failed_checks);
-        metrics_set_gauge("health_checks_warning", (double)stats.warning_checks);
+        METRICS_GAUGE_SET("health_checks_total", (double)stats.total_checks);
+        METRICS_GAUGE_SET("health_checks_failed", (double)stats.failed_checks);
+        METRICS_GAUGE_SET("health_checks_warning", (double)stats.warning_checks);
     }
 }
 
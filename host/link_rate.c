@@ -0,0 +1,66 @@
+#include "link_rate.h"
+
+const long link_rate_candidates[LINK_RATE_CANDIDATES] = {
+    1000000L, 500000L, 230400L, 115200L
+};
+
+int link_rate_index(long rate) {
+    int i;
+    for (i = 0; i < LINK_RATE_CANDIDATES; i++) {
+        if (link_rate_candidates[i] == rate) return i;
+    }
+    return -1;
+}
+
+int link_rate_plan(long max_rate, long base_rate, unsigned failed_mask,
+                   long *out, int max) {
+    int i, n = 0;
+    if (!out) return 0;
+    for (i = 0; i < LINK_RATE_CANDIDATES && n < max; i++) {
+        long rate = link_rate_candidates[i];
+        if (rate > max_rate || rate <= base_rate) continue;
+        if (failed_mask & (1u << i)) continue;
+        out[n++] = rate;
+    }
+    return n;
+}
+
+void link_rate_put(unsigned char out[LINK_RATE_PAYLOAD], long rate) {
+    out[0] = (unsigned char)((rate >> 24) & 0xFF);
+    out[1] = (unsigned char)((rate >> 16) & 0xFF);
+    out[2] = (unsigned char)((rate >> 8) & 0xFF);
+    out[3] = (unsigned char)(rate & 0xFF);
+}
+
+long link_rate_get(const unsigned char in[LINK_RATE_PAYLOAD]) {
+    return ((long)in[0] << 24) | ((long)in[1] << 16) | ((long)in[2] << 8) | (long)in[3];
+}
+
+void link_rate_test_pattern(unsigned char *buf, size_t len, unsigned seed) {
+    static const unsigned char fixed[] = { 0x00, 0xFF, 0x55, 0xAA, 0x01, 0x80, 0x7F, 0xFE };
+    size_t i;
+    if (!buf) return;
+    for (i = 0; i < len; i++) {
+        if (i < sizeof(fixed)) {
+            buf[i] = fixed[i];
+        } else {
+            buf[i] = (unsigned char)((seed * 31u + i * 97u) & 0xFF);
+        }
+    }
+}
+
+void link_rate_monitor_reset(link_rate_monitor_t *m, unsigned long errors_total, long now_ms) {
+    if (!m) return;
+    m->window_errors = errors_total;
+    m->window_start_ms = now_ms;
+    m->started = 1;
+}
+
+int link_rate_monitor_check(link_rate_monitor_t *m, unsigned long errors_total, long now_ms) {
+    if (!m) return 0;
+    if (!m->started || now_ms - m->window_start_ms >= LINK_RATE_ERROR_WINDOW_MS) {
+        link_rate_monitor_reset(m, errors_total, now_ms);
+        return 0;
+    }
+    return errors_total - m->window_errors >= LINK_RATE_ERROR_LIMIT;
+}
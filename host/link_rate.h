@@ -0,0 +1,91 @@
+/* Serial line-rate negotiation policy for the Pi <-> Beta link.
+ *
+ * The link used to run at a hard-coded 9600 baud, about 960 bytes a second
+ * for every repaint, run and card swipe. open_serial_port() now opens at the
+ * base rate (hardware.baud_rate), asks Beta to move to each faster candidate
+ * in turn with a framed CMD_LINK_RATE, and keeps the first rate at which a
+ * test pattern comes back intact. Beta falls back to the base rate by itself
+ * if nothing valid reaches it shortly after a switch, so a rate the wiring
+ * cannot carry costs one probe and not the link.
+ *
+ * Once the rate is set, link errors are the signal that it is marginal: too
+ * many CRC or framing errors in a short window and the SDK reopens the port,
+ * with that rate struck off the candidate list for the rest of the run. A
+ * link that cannot hold any faster rate ends up back at the base rate.
+ *
+ * On the Beta's native USB port (ATmega32U4 CDC) the line rate is only
+ * nominal and every candidate passes; the handshake is what makes the same
+ * firmware safe behind a real UART.
+ *
+ * The policy is pure (no I/O) so it can be unit-tested; millennium_sdk.c
+ * carries it out, as with serial_recovery.h.
+ */
+#ifndef LINK_RATE_H
+#define LINK_RATE_H
+
+#include <stddef.h>
+
+#define LINK_RATE_BASE 9600L
+
+/* Faster rates tried at connect time, fastest first. */
+#define LINK_RATE_CANDIDATES 4
+extern const long link_rate_candidates[LINK_RATE_CANDIDATES];
+
+/* Bytes in the CMD_LINK_RATE payload (big-endian rate) and in the round-trip
+ * test pattern (one Beta event's worth). */
+#define LINK_RATE_PAYLOAD 4
+#define LINK_RATE_PATTERN_LEN 16
+
+/* Handshake timing. Beta reverts to the base rate when no valid frame has
+ * arrived LINK_RATE_CONFIRM_MS after it switched; the host waits a little
+ * longer than that before carrying on at the base rate. */
+#define LINK_RATE_REPLY_MS 100
+#define LINK_RATE_PROBES 3
+#define LINK_RATE_CONFIRM_MS 300
+#define LINK_RATE_REVERT_WAIT_MS (LINK_RATE_CONFIRM_MS + 100)
+
+/* The handshake runs on the engine thread as the port opens, so it is held
+ * to LINK_RATE_HANDSHAKE_MS in all (see negotiate_link_rate() for why it
+ * blocks). LINK_RATE_TRY_MS is the longest one candidate can take (request,
+ * probes, and the revert wait when they all fail); a candidate is only
+ * started if that much time is left, and the rest wait for the next
+ * reconnect. */
+#define LINK_RATE_TRY_MS (2 * LINK_RATE_REPLY_MS * (1 + LINK_RATE_PROBES) + LINK_RATE_REVERT_WAIT_MS)
+#define LINK_RATE_HANDSHAKE_MS 2000
+
+/* Runtime fallback: this many CRC + framing errors within the window. */
+#define LINK_RATE_ERROR_LIMIT 5
+#define LINK_RATE_ERROR_WINDOW_MS 10000L
+
+/* Index of `rate` in link_rate_candidates, or -1. */
+int link_rate_index(long rate);
+
+/* Candidates worth trying, fastest first, into `out` (room for `max`): at
+ * most `max_rate`, faster than `base_rate`, and not in `failed_mask` (bit i
+ * is link_rate_candidates[i]). Returns how many. */
+int link_rate_plan(long max_rate, long base_rate, unsigned failed_mask,
+                   long *out, int max);
+
+void link_rate_put(unsigned char out[LINK_RATE_PAYLOAD], long rate);
+long link_rate_get(const unsigned char in[LINK_RATE_PAYLOAD]);
+
+/* Fill `buf` with a test pattern that exercises the bit patterns a marginal
+ * line garbles first (0x00, 0xFF, 0x55, 0xAA, lone bits), varied by `seed`
+ * so a stale echo from an earlier probe never matches. */
+void link_rate_test_pattern(unsigned char *buf, size_t len, unsigned seed);
+
+/* Error-rate watch for the negotiated rate. */
+typedef struct {
+    unsigned long window_errors;  /* error total when the window opened */
+    long window_start_ms;
+    int started;
+} link_rate_monitor_t;
+
+/* Start watching from `errors_total` at `now_ms`. */
+void link_rate_monitor_reset(link_rate_monitor_t *m, unsigned long errors_total, long now_ms);
+
+/* Feed the running error total. Returns 1 when LINK_RATE_ERROR_LIMIT errors
+ * have piled up within LINK_RATE_ERROR_WINDOW_MS: time to fall back. */
+int link_rate_monitor_check(link_rate_monitor_t *m, unsigned long errors_total, long now_ms);
+
+#endif /* LINK_RATE_H */
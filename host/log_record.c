@@ -0,0 +1,795 @@
+#define _POSIX_C_SOURCE 200112L
+#include "log_record.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define RECORD_HEAD 3           /* type byte + u16 body length */
+#define STRING_NULL 0xffffu
+
+/* ── Little-endian fields ───────────────────────────────────────────── */
+
+static void put_u16(unsigned char *p, unsigned v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_u32(unsigned char *p, uint32_t v) {
+    put_u16(p, (unsigned)(v & 0xffff));
+    put_u16(p + 2, (unsigned)(v >> 16));
+}
+
+static void put_u64(unsigned char *p, uint64_t v) {
+    put_u32(p, (uint32_t)v);
+    put_u32(p + 4, (uint32_t)(v >> 32));
+}
+
+static unsigned get_u16(const unsigned char *p) {
+    return (unsigned)p[0] | ((unsigned)p[1] << 8);
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    return (uint32_t)get_u16(p) | ((uint32_t)get_u16(p + 2) << 16);
+}
+
+static uint64_t get_u64(const unsigned char *p) {
+    return (uint64_t)get_u32(p) | ((uint64_t)get_u32(p + 4) << 32);
+}
+
+static void put_head(unsigned char *buf, int type, size_t total) {
+    buf[0] = (unsigned char)type;
+    put_u16(buf + 1, (unsigned)(total - RECORD_HEAD));
+}
+
+/* ── Format strings ─────────────────────────────────────────────────── */
+
+/* One printf conversion, as found in a format string */
+struct conversion {
+    const char *flags;
+    int flags_len;
+    int width_star;
+    const char *width;
+    int width_len;
+    int has_precision;
+    int precision_star;
+    const char *precision;
+    int precision_len;
+    char length[3];     /* "", "hh", "h", "l", "ll", "z", "j", "t", "L" */
+    char conv;
+};
+
+/* Parse the conversion starting at p (just past the '%'). Returns the
+ * character after it. */
+static const char *parse_conversion(const char *p, struct conversion *c) {
+    memset(c, 0, sizeof(*c));
+
+    c->flags = p;
+    while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0' ||
+           *p == '\'') {
+        p++;
+    }
+    c->flags_len = (int)(p - c->flags);
+
+    if (*p == '*') {
+        c->width_star = 1;
+        p++;
+    } else {
+        c->width = p;
+        while (*p >= '0' && *p <= '9') p++;
+        c->width_len = (int)(p - c->width);
+    }
+
+    if (*p == '.') {
+        c->has_precision = 1;
+        p++;
+        if (*p == '*') {
+            c->precision_star = 1;
+            p++;
+        } else {
+            c->precision = p;
+            while (*p >= '0' && *p <= '9') p++;
+            c->precision_len = (int)(p - c->precision);
+        }
+    }
+
+    if (p[0] == 'h' && p[1] == 'h') {
+        strcpy(c->length, "hh");
+        p += 2;
+    } else if (p[0] == 'l' && p[1] == 'l') {
+        strcpy(c->length, "ll");
+        p += 2;
+    } else if (*p == 'q') {
+        strcpy(c->length, "ll");
+        p++;
+    } else if (*p == 'h' || *p == 'l' || *p == 'z' || *p == 'j' ||
+               *p == 't' || *p == 'L') {
+        c->length[0] = *p;
+        p++;
+    }
+
+    c->conv = *p;
+    return *p != '\0' ? p + 1 : p;
+}
+
+static int signed_type(const char *length) {
+    if (length[0] == '\0') return LOG_ARG_INT;
+    if (strcmp(length, "hh") == 0) return LOG_ARG_SCHAR;
+    if (strcmp(length, "h") == 0) return LOG_ARG_SHORT;
+    if (strcmp(length, "l") == 0) return LOG_ARG_LONG;
+    if (strcmp(length, "ll") == 0) return LOG_ARG_LLONG;
+    if (strcmp(length, "z") == 0) return LOG_ARG_SSIZE;
+    if (strcmp(length, "j") == 0) return LOG_ARG_INTMAX;
+    if (strcmp(length, "t") == 0) return LOG_ARG_PTRDIFF;
+    return -1;
+}
+
+static int unsigned_type(const char *length) {
+    if (length[0] == '\0') return LOG_ARG_UINT;
+    if (strcmp(length, "hh") == 0) return LOG_ARG_UCHAR;
+    if (strcmp(length, "h") == 0) return LOG_ARG_USHORT;
+    if (strcmp(length, "l") == 0) return LOG_ARG_ULONG;
+    if (strcmp(length, "ll") == 0) return LOG_ARG_ULLONG;
+    if (strcmp(length, "z") == 0) return LOG_ARG_SIZE;
+    if (strcmp(length, "j") == 0) return LOG_ARG_UINTMAX;
+    if (strcmp(length, "t") == 0) return LOG_ARG_PTRDIFF;
+    return -1;
+}
+
+int log_format_parse(const char *format, unsigned char *types, int max_types) {
+    const char *p = format;
+    int n = 0;
+
+    if (format == NULL) {
+        return -1;
+    }
+
+    while (*p != '\0') {
+        struct conversion c;
+        int type;
+
+        if (*p != '%') {
+            p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            p += 2;
+            continue;
+        }
+        p = parse_conversion(p + 1, &c);
+
+        if (c.width_star) {
+            if (n >= max_types) return -1;
+            types[n++] = LOG_ARG_INT;
+        }
+        if (c.precision_star) {
+            if (n >= max_types) return -1;
+            types[n++] = LOG_ARG_INT;
+        }
+
+        switch (c.conv) {
+            case 'd': case 'i':
+                type = signed_type(c.length);
+                break;
+            case 'u': case 'o': case 'x': case 'X':
+                type = unsigned_type(c.length);
+                break;
+            case 'c':
+                type = c.length[0] == '\0' ? LOG_ARG_INT : -1;
+                break;
+            case 'e': case 'E': case 'f': case 'F':
+            case 'g': case 'G': case 'a': case 'A':
+                type = (c.length[0] == '\0' || strcmp(c.length, "l") == 0)
+                    ? LOG_ARG_DOUBLE : -1;
+                break;
+            case 's':
+                type = c.length[0] == '\0' ? LOG_ARG_STRING : -1;
+                break;
+            case 'p':
+                type = LOG_ARG_POINTER;
+                break;
+            default:
+                type = -1;   /* %n, %m, %ls, a stray '%' at the end... */
+                break;
+        }
+        if (type < 0 || n >= max_types) {
+            return -1;
+        }
+        types[n++] = (unsigned char)type;
+    }
+    return n;
+}
+
+/* ── Encoding ───────────────────────────────────────────────────────── */
+
+size_t log_record_header(unsigned char *buf, size_t size) {
+    size_t total = RECORD_HEAD + 5;
+
+    if (size < total) {
+        return 0;
+    }
+    memcpy(buf + RECORD_HEAD, "MLOG", 4);
+    buf[RECORD_HEAD + 4] = LOG_RECORD_VERSION;
+    put_head(buf, LOG_RECORD_HEADER, total);
+    return total;
+}
+
+size_t log_record_format(unsigned char *buf, size_t size, uint32_t id,
+                         const char *category, const char *format) {
+    size_t cat_len = category != NULL ? strlen(category) : 0;
+    size_t fmt_len = strlen(format);
+    size_t total = RECORD_HEAD + 4 + 1 + cat_len + 2 + fmt_len;
+    unsigned char *p = buf + RECORD_HEAD;
+
+    if (cat_len > 255 || total > LOG_RECORD_MAX || total > size) {
+        return 0;
+    }
+    put_u32(p, id);
+    p += 4;
+    *p++ = (unsigned char)cat_len;
+    memcpy(p, category, cat_len);
+    p += cat_len;
+    put_u16(p, (unsigned)fmt_len);
+    p += 2;
+    memcpy(p, format, fmt_len);
+    put_head(buf, LOG_RECORD_FORMAT, total);
+    return total;
+}
+
+/* Bytes the arguments after types[i] need at least: a string can shrink to
+ * its length field, nothing else can */
+static size_t reserve_after(const unsigned char *types, int i, int nargs) {
+    size_t need = 0;
+    for (i++; i < nargs; i++) {
+        need += types[i] == LOG_ARG_STRING ? 2 : 8;
+    }
+    return need;
+}
+
+size_t log_record_event(unsigned char *buf, size_t size, uint32_t id,
+                        int level, uint64_t time_ns,
+                        const unsigned char *types, int nargs, va_list args) {
+    unsigned char *p = buf + RECORD_HEAD;
+    unsigned char *end;
+    int i;
+
+    if (size > LOG_RECORD_MAX) {
+        size = LOG_RECORD_MAX;
+    }
+    if (size < RECORD_HEAD + 13 + reserve_after(types, -1, nargs)) {
+        return 0;
+    }
+    end = buf + size;
+
+    put_u32(p, id);
+    p[4] = (unsigned char)level;
+    put_u64(p + 5, time_ns);
+    p += 13;
+
+    for (i = 0; i < nargs; i++) {
+        uint64_t v = 0;
+
+        switch (types[i]) {
+            case LOG_ARG_INT:     v = (uint64_t)(int64_t)va_arg(args, int); break;
+            case LOG_ARG_UINT:    v = va_arg(args, unsigned int); break;
+            case LOG_ARG_SHORT:   v = (uint64_t)(int64_t)(short)va_arg(args, int); break;
+            case LOG_ARG_USHORT:  v = (unsigned short)va_arg(args, int); break;
+            case LOG_ARG_SCHAR:   v = (uint64_t)(int64_t)(signed char)va_arg(args, int); break;
+            case LOG_ARG_UCHAR:   v = (unsigned char)va_arg(args, int); break;
+            case LOG_ARG_LONG:    v = (uint64_t)(int64_t)va_arg(args, long); break;
+            case LOG_ARG_ULONG:   v = va_arg(args, unsigned long); break;
+            case LOG_ARG_LLONG:   v = (uint64_t)va_arg(args, long long); break;
+            case LOG_ARG_ULLONG:  v = va_arg(args, unsigned long long); break;
+            case LOG_ARG_SIZE:    v = va_arg(args, size_t); break;
+            case LOG_ARG_SSIZE:   v = (uint64_t)(int64_t)va_arg(args, ptrdiff_t); break;
+            case LOG_ARG_INTMAX:  v = (uint64_t)va_arg(args, intmax_t); break;
+            case LOG_ARG_UINTMAX: v = va_arg(args, uintmax_t); break;
+            case LOG_ARG_PTRDIFF: v = (uint64_t)(int64_t)va_arg(args, ptrdiff_t); break;
+            case LOG_ARG_POINTER: v = (uint64_t)(uintptr_t)va_arg(args, void *); break;
+            case LOG_ARG_DOUBLE: {
+                double d = va_arg(args, double);
+                memcpy(&v, &d, sizeof(v));
+                break;
+            }
+            case LOG_ARG_STRING: {
+                const char *s = va_arg(args, const char *);
+                size_t room = (size_t)(end - p) - 2 - reserve_after(types, i, nargs);
+                size_t n;
+
+                if (s == NULL) {
+                    put_u16(p, STRING_NULL);
+                    p += 2;
+                    continue;
+                }
+                n = strlen(s);
+                if (n > room) {
+                    n = room;
+                }
+                put_u16(p, (unsigned)n);
+                memcpy(p + 2, s, n);
+                p += 2 + n;
+                continue;
+            }
+            default:
+                return 0;
+        }
+        put_u64(p, v);
+        p += 8;
+    }
+
+    put_head(buf, LOG_RECORD_EVENT, (size_t)(p - buf));
+    return (size_t)(p - buf);
+}
+
+size_t log_record_text(unsigned char *buf, size_t size, int level,
+                       uint64_t time_ns, const char *category,
+                       const char *message) {
+    size_t cat_len = category != NULL ? strlen(category) : 0;
+    size_t msg_len = message != NULL ? strlen(message) : 0;
+    unsigned char *p = buf + RECORD_HEAD;
+    size_t fixed;
+
+    if (size > LOG_RECORD_MAX) {
+        size = LOG_RECORD_MAX;
+    }
+    if (cat_len > 255) {
+        cat_len = 255;
+    }
+    fixed = RECORD_HEAD + 1 + 8 + 1 + cat_len + 2;
+    if (size < fixed) {
+        return 0;
+    }
+    if (msg_len > size - fixed) {
+        msg_len = size - fixed;
+    }
+
+    p[0] = (unsigned char)level;
+    put_u64(p + 1, time_ns);
+    p += 9;
+    *p++ = (unsigned char)cat_len;
+    memcpy(p, category, cat_len);
+    p += cat_len;
+    put_u16(p, (unsigned)msg_len);
+    memcpy(p + 2, message, msg_len);
+    put_head(buf, LOG_RECORD_TEXT, fixed + msg_len);
+    return fixed + msg_len;
+}
+
+/* ── Decoding ───────────────────────────────────────────────────────── */
+
+size_t log_record_length(const unsigned char *buf, size_t len) {
+    size_t total;
+
+    if (len < RECORD_HEAD || buf[0] < LOG_RECORD_HEADER ||
+        buf[0] > LOG_RECORD_TEXT) {
+        return 0;
+    }
+    total = RECORD_HEAD + get_u16(buf + 1);
+    if (total > LOG_RECORD_MAX || total > len) {
+        return 0;
+    }
+    return total;
+}
+
+int log_record_level(const unsigned char *buf, size_t len) {
+    if (log_record_length(buf, len) == 0) {
+        return -1;
+    }
+    if (buf[0] == LOG_RECORD_EVENT && len >= RECORD_HEAD + 5) {
+        return buf[RECORD_HEAD + 4];
+    }
+    if (buf[0] == LOG_RECORD_TEXT && len >= RECORD_HEAD + 1) {
+        return buf[RECORD_HEAD];
+    }
+    return -1;
+}
+
+/* Bounded output for rendering: appends truncate, len never passes size-1 */
+struct out {
+    char *buf;
+    size_t size;
+    size_t len;
+};
+
+static void out_bytes(struct out *o, const char *s, size_t n) {
+    if (o->len + n >= o->size) {
+        n = o->size - 1 - o->len;
+    }
+    memcpy(o->buf + o->len, s, n);
+    o->len += n;
+    o->buf[o->len] = '\0';
+}
+
+static void out_printed(struct out *o, int n) {
+    if (n < 0) {
+        return;
+    }
+    o->len += (size_t)n;
+    if (o->len >= o->size) {
+        o->len = o->size - 1;
+    }
+}
+
+static void out_time(struct out *o, uint64_t time_ns) {
+    time_t secs = (time_t)(time_ns / 1000000000u);
+    long millis = (long)((time_ns / 1000000u) % 1000u);
+    struct tm tm_info;
+
+    if (localtime_r(&secs, &tm_info) == NULL) {
+        memset(&tm_info, 0, sizeof(tm_info));
+    }
+    out_printed(o, snprintf(o->buf + o->len, o->size - o->len,
+        "[%04d-%02d-%02d %02d:%02d:%02d.%03ld] ",
+        tm_info.tm_year + 1900, tm_info.tm_mon + 1, tm_info.tm_mday,
+        tm_info.tm_hour, tm_info.tm_min, tm_info.tm_sec, millis));
+}
+
+/* Arguments of an EVENT, read in order */
+struct args {
+    const unsigned char *p;
+    const unsigned char *end;
+    int bad;
+};
+
+static uint64_t next_u64(struct args *a) {
+    uint64_t v;
+    if (a->end - a->p < 8) {
+        a->bad = 1;
+        return 0;
+    }
+    v = get_u64(a->p);
+    a->p += 8;
+    return v;
+}
+
+/* The message of an EVENT: `format` with the conversions rebuilt around the
+ * stored values. Integers were widened to 64 bits when encoded, so each is
+ * printed with "ll" in place of its original length modifier. */
+static int render_message(struct out *o, const char *format, struct args *a) {
+    const char *p = format;
+
+    while (*p != '\0' && !a->bad) {
+        const char *lit = p;
+        struct conversion c;
+        char spec[48];
+        size_t n = 0;
+
+        while (*p != '\0' && *p != '%') p++;
+        out_bytes(o, lit, (size_t)(p - lit));
+        if (*p == '\0') {
+            break;
+        }
+        if (p[1] == '%') {
+            out_bytes(o, "%", 1);
+            p += 2;
+            continue;
+        }
+        p = parse_conversion(p + 1, &c);
+
+        spec[n++] = '%';
+        memcpy(spec + n, c.flags, (size_t)c.flags_len);
+        n += (size_t)c.flags_len;
+        if (c.width_star) {
+            n += (size_t)sprintf(spec + n, "%d", (int)(int64_t)next_u64(a));
+        } else {
+            memcpy(spec + n, c.width, (size_t)c.width_len);
+            n += (size_t)c.width_len;
+        }
+        if (c.has_precision) {
+            spec[n++] = '.';
+            if (c.precision_star) {
+                n += (size_t)sprintf(spec + n, "%d", (int)(int64_t)next_u64(a));
+            } else {
+                memcpy(spec + n, c.precision, (size_t)c.precision_len);
+                n += (size_t)c.precision_len;
+            }
+        }
+
+        switch (c.conv) {
+            case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': {
+                uint64_t v = next_u64(a);
+                spec[n++] = 'l';
+                spec[n++] = 'l';
+                spec[n++] = c.conv;
+                spec[n] = '\0';
+                if (c.conv == 'd' || c.conv == 'i') {
+                    out_printed(o, snprintf(o->buf + o->len, o->size - o->len,
+                                            spec, (long long)(int64_t)v));
+                } else {
+                    out_printed(o, snprintf(o->buf + o->len, o->size - o->len,
+                                            spec, (unsigned long long)v));
+                }
+                break;
+            }
+            case 'c': {
+                uint64_t v = next_u64(a);
+                spec[n++] = 'c';
+                spec[n] = '\0';
+                out_printed(o, snprintf(o->buf + o->len, o->size - o->len,
+                                        spec, (int)(int64_t)v));
+                break;
+            }
+            case 'e': case 'E': case 'f': case 'F':
+            case 'g': case 'G': case 'a': case 'A': {
+                uint64_t v = next_u64(a);
+                double d;
+                memcpy(&d, &v, sizeof(d));
+                spec[n++] = c.conv;
+                spec[n] = '\0';
+                out_printed(o, snprintf(o->buf + o->len, o->size - o->len,
+                                        spec, d));
+                break;
+            }
+            case 'p': {
+                uint64_t v = next_u64(a);
+                spec[n++] = 'p';
+                spec[n] = '\0';
+                out_printed(o, snprintf(o->buf + o->len, o->size - o->len,
+                                        spec, (void *)(uintptr_t)v));
+                break;
+            }
+            case 's': {
+                char str[LOG_RECORD_MAX];
+                unsigned slen;
+
+                if (a->end - a->p < 2) {
+                    a->bad = 1;
+                    break;
+                }
+                slen = get_u16(a->p);
+                a->p += 2;
+                if (slen == STRING_NULL) {
+                    strcpy(str, "(null)");
+                } else if (slen >= sizeof(str) || a->end - a->p < (long)slen) {
+                    a->bad = 1;
+                    break;
+                } else {
+                    memcpy(str, a->p, slen);
+                    str[slen] = '\0';
+                    a->p += slen;
+                }
+                spec[n++] = 's';
+                spec[n] = '\0';
+                out_printed(o, snprintf(o->buf + o->len, o->size - o->len,
+                                        spec, str));
+                break;
+            }
+            default:
+                /* log_format_parse() never lets one of these be encoded */
+                a->bad = 1;
+                break;
+        }
+    }
+    return a->bad ? -1 : 0;
+}
+
+static void out_prefix(struct out *o, uint64_t time_ns, int level,
+                       const char *category, size_t cat_len) {
+    const char *name = logger_level_to_string((log_level_t)level);
+
+    out_time(o, time_ns);
+    out_bytes(o, "[", 1);
+    out_bytes(o, name, strlen(name));
+    out_bytes(o, "] ", 2);
+    if (cat_len > 0) {
+        out_bytes(o, "[", 1);
+        out_bytes(o, category, cat_len);
+        out_bytes(o, "] ", 2);
+    }
+}
+
+int log_record_render(const unsigned char *buf, size_t len,
+                      log_format_lookup_fn lookup, void *ctx,
+                      char *out, size_t out_size) {
+    size_t total = log_record_length(buf, len);
+    const unsigned char *body = buf + RECORD_HEAD;
+    const unsigned char *end = buf + total;
+    struct out o;
+
+    if (total == 0 || out == NULL || out_size == 0) {
+        return -1;
+    }
+    o.buf = out;
+    o.size = out_size;
+    o.len = 0;
+    out[0] = '\0';
+
+    if (buf[0] == LOG_RECORD_EVENT) {
+        const char *category;
+        const char *format;
+        struct args a;
+
+        if (end - body < 13 || lookup == NULL ||
+            lookup(ctx, get_u32(body), &category, &format) != 0) {
+            return -1;
+        }
+        out_prefix(&o, get_u64(body + 5), body[4], category,
+                   category != NULL ? strlen(category) : 0);
+        a.p = body + 13;
+        a.end = end;
+        a.bad = 0;
+        if (render_message(&o, format, &a) != 0) {
+            return -1;
+        }
+        return (int)o.len;
+    }
+
+    if (buf[0] == LOG_RECORD_TEXT) {
+        const unsigned char *p = body + 9;
+        size_t cat_len, msg_len;
+
+        if (end - body < 10) {
+            return -1;
+        }
+        cat_len = *p++;
+        if ((size_t)(end - p) < cat_len + 2) {
+            return -1;
+        }
+        msg_len = get_u16(p + cat_len);
+        if ((size_t)(end - p) < cat_len + 2 + msg_len) {
+            return -1;
+        }
+        out_prefix(&o, get_u64(body + 1), body[0], (const char *)p, cat_len);
+        out_bytes(&o, (const char *)p + cat_len + 2, msg_len);
+        return (int)o.len;
+    }
+
+    return -1;
+}
+
+/* ── Reading a stream ───────────────────────────────────────────────── */
+
+void log_reader_init(struct log_reader *reader) {
+    memset(reader, 0, sizeof(*reader));
+}
+
+static void reader_clear(struct log_reader *reader) {
+    uint32_t i;
+    for (i = 0; i < reader->capacity; i++) {
+        free(reader->categories[i]);
+        free(reader->formats[i]);
+        reader->categories[i] = NULL;
+        reader->formats[i] = NULL;
+    }
+}
+
+void log_reader_free(struct log_reader *reader) {
+    reader_clear(reader);
+    free(reader->categories);
+    free(reader->formats);
+    memset(reader, 0, sizeof(*reader));
+}
+
+static char *copy_field(const unsigned char *p, size_t n) {
+    char *s = (char *)malloc(n + 1);
+    if (s != NULL) {
+        memcpy(s, p, n);
+        s[n] = '\0';
+    }
+    return s;
+}
+
+/* Store a FORMAT record's entry. Returns -1 if the record is malformed. */
+static int reader_define(struct log_reader *reader, const unsigned char *body,
+                         size_t body_len) {
+    uint32_t id;
+    size_t cat_len, fmt_len;
+
+    if (body_len < 4 + 1 + 2) {
+        return -1;
+    }
+    id = get_u32(body);
+    cat_len = body[4];
+    if (body_len < 5 + cat_len + 2) {
+        return -1;
+    }
+    fmt_len = get_u16(body + 5 + cat_len);
+    if (body_len < 5 + cat_len + 2 + fmt_len || id > 0xffffu) {
+        return -1;
+    }
+
+    if (id >= reader->capacity) {
+        uint32_t capacity = reader->capacity > 0 ? reader->capacity : 64;
+        char **categories, **formats;
+
+        while (capacity <= id) capacity *= 2;
+        categories = (char **)realloc(reader->categories, capacity * sizeof(char *));
+        if (categories == NULL) {
+            return -1;
+        }
+        reader->categories = categories;
+        formats = (char **)realloc(reader->formats, capacity * sizeof(char *));
+        if (formats == NULL) {
+            return -1;
+        }
+        reader->formats = formats;
+        memset(categories + reader->capacity, 0,
+               (capacity - reader->capacity) * sizeof(char *));
+        memset(formats + reader->capacity, 0,
+               (capacity - reader->capacity) * sizeof(char *));
+        reader->capacity = capacity;
+    }
+
+    free(reader->categories[id]);
+    free(reader->formats[id]);
+    reader->categories[id] = copy_field(body + 5, cat_len);
+    reader->formats[id] = copy_field(body + 5 + cat_len + 2, fmt_len);
+    return 0;
+}
+
+static int reader_lookup(void *ctx, uint32_t id, const char **category,
+                         const char **format) {
+    struct log_reader *reader = (struct log_reader *)ctx;
+
+    if (id >= reader->capacity || reader->formats[id] == NULL) {
+        return -1;
+    }
+    *category = reader->categories[id];
+    *format = reader->formats[id];
+    return 0;
+}
+
+static int is_header(const unsigned char *p, size_t len) {
+    return len >= RECORD_HEAD + 5 && p[0] == LOG_RECORD_HEADER &&
+           get_u16(p + 1) == 5 && memcmp(p + RECORD_HEAD, "MLOG", 4) == 0;
+}
+
+int log_reader_next(struct log_reader *reader, const unsigned char *buf,
+                    size_t len, size_t *offset, int *level,
+                    char *out, size_t out_size) {
+    while (*offset < len) {
+        const unsigned char *p = buf + *offset;
+        size_t avail = len - *offset;
+        size_t total = log_record_length(p, avail);
+
+        if (total == 0) {
+            size_t skip;
+
+            /* A record cut off by the end of the data: wait for the rest */
+            if (avail < RECORD_HEAD ||
+                (p[0] >= LOG_RECORD_HEADER && p[0] <= LOG_RECORD_TEXT &&
+                 RECORD_HEAD + get_u16(p + 1) <= LOG_RECORD_MAX)) {
+                return 0;
+            }
+            /* Not a record: skip ahead to the next HEADER */
+            for (skip = 1; skip < avail; skip++) {
+                if (p[skip] == LOG_RECORD_HEADER &&
+                    (avail - skip < RECORD_HEAD + 5 || is_header(p + skip, avail - skip))) {
+                    break;
+                }
+            }
+            reader->skipped += skip;
+            *offset += skip;
+            continue;
+        }
+
+        *offset += total;
+        switch (p[0]) {
+            case LOG_RECORD_HEADER:
+                if (is_header(p, total)) {
+                    reader_clear(reader);
+                } else {
+                    reader->skipped += total;
+                }
+                break;
+            case LOG_RECORD_FORMAT:
+                if (reader_define(reader, p + RECORD_HEAD, total - RECORD_HEAD) != 0) {
+                    reader->skipped += total;
+                }
+                break;
+            default:
+                if (log_record_render(p, total, reader_lookup, reader,
+                                      out, out_size) < 0) {
+                    reader->skipped += total;
+                    break;
+                }
+                if (level != NULL) {
+                    *level = log_record_level(p, total);
+                }
+                return 1;
+        }
+    }
+    return 0;
+}
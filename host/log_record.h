@@ -0,0 +1,126 @@
+#ifndef LOG_RECORD_H
+#define LOG_RECORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdarg.h>
+
+/*
+ * Binary log records: what the logger writes instead of a formatted line
+ * when logging.format=binary, and what millennium-logcat and /api/logs turn
+ * back into text.
+ *
+ * A printf-style call site's format string is written once, as a FORMAT
+ * record giving it an id; each call is then an EVENT record holding only the
+ * id, level, time and the raw arguments. Formatting -- localtime(), the
+ * conversions, the category and level names -- happens when the log is read,
+ * not on the thread that logs. Calls with no format (logger_info(message))
+ * and formats the encoder cannot take apart are TEXT records.
+ *
+ * A stream is a sequence of records. Each is a type byte, a 16-bit body
+ * length and the body; integers are little-endian:
+ *
+ *     HEADER  "MLOG", version                     (starts a dictionary)
+ *     FORMAT  id u32, category u8+bytes, format u16+bytes
+ *     EVENT   id u32, level u8, time u64, arguments
+ *     TEXT    level u8, time u64, category u8+bytes, message u16+bytes
+ *
+ * time is nanoseconds since the epoch. An EVENT's arguments follow its
+ * format's conversions: integers, doubles and pointers as 8 bytes, strings
+ * as u16 length + bytes (0xffff for NULL). Ids are only meaningful after
+ * the HEADER that precedes them, so a process appending to an existing file
+ * starts with a new HEADER and re-sends its formats.
+ *
+ * The type bytes are all control characters, so a record is never mistaken
+ * for a text line, which starts with '['.
+ */
+
+#define LOG_RECORD_HEADER 1
+#define LOG_RECORD_FORMAT 2
+#define LOG_RECORD_EVENT  3
+#define LOG_RECORD_TEXT   4
+
+#define LOG_RECORD_VERSION 1
+
+/* Largest record, header included. Longer strings are truncated to fit. */
+#define LOG_RECORD_MAX 512
+
+/* Most conversions a format may have and still be encoded as an EVENT */
+#define LOG_RECORD_MAX_ARGS 16
+
+/* How log_record_event() reads each argument from the va_list */
+enum log_arg_type {
+    LOG_ARG_INT = 1, LOG_ARG_UINT,
+    LOG_ARG_SHORT, LOG_ARG_USHORT,
+    LOG_ARG_SCHAR, LOG_ARG_UCHAR,
+    LOG_ARG_LONG, LOG_ARG_ULONG,
+    LOG_ARG_LLONG, LOG_ARG_ULLONG,
+    LOG_ARG_SIZE, LOG_ARG_SSIZE,
+    LOG_ARG_INTMAX, LOG_ARG_UINTMAX,
+    LOG_ARG_PTRDIFF,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STRING,
+    LOG_ARG_POINTER
+};
+
+/* Argument types of `format`, in order, into types[]. Returns how many, or
+ * -1 if the format has a conversion the records do not carry (%n, %Lf, %m,
+ * more than max_types arguments). */
+int log_format_parse(const char *format, unsigned char *types, int max_types);
+
+/* Encoders. Each writes one record into buf and returns its length, or 0 if
+ * it does not fit in `size` bytes. */
+size_t log_record_header(unsigned char *buf, size_t size);
+size_t log_record_format(unsigned char *buf, size_t size, uint32_t id,
+                         const char *category, const char *format);
+size_t log_record_event(unsigned char *buf, size_t size, uint32_t id,
+                        int level, uint64_t time_ns,
+                        const unsigned char *types, int nargs, va_list args);
+size_t log_record_text(unsigned char *buf, size_t size, int level,
+                       uint64_t time_ns, const char *category,
+                       const char *message);
+
+/* Length of the whole record at buf, or 0 if `len` bytes do not hold a
+ * complete record of a known type. */
+size_t log_record_length(const unsigned char *buf, size_t len);
+
+/* Level of an EVENT or TEXT record, -1 for the other types. */
+int log_record_level(const unsigned char *buf, size_t len);
+
+/* Finds the category and format for an EVENT's id. Returns 0 if known. */
+typedef int (*log_format_lookup_fn)(void *ctx, uint32_t id,
+                                    const char **category,
+                                    const char **format);
+
+/* Render an EVENT or TEXT record as the line text logging would have
+ * written: "[2024-05-01 12:00:00.123] [INFO] [Category] message". Returns
+ * the line's length, or -1 for a record that is not a message or whose
+ * format is unknown. */
+int log_record_render(const unsigned char *buf, size_t len,
+                      log_format_lookup_fn lookup, void *ctx,
+                      char *out, size_t out_size);
+
+/*
+ * Reading a stream, as millennium-logcat does: feed it the bytes and it
+ * keeps the dictionary from the FORMAT records, starting over at each
+ * HEADER. Bytes that are not a valid record (a text log, a torn write at
+ * the end of a file) are skipped up to the next HEADER.
+ */
+struct log_reader {
+    char **categories;   /* by id; malloc'd copies */
+    char **formats;
+    uint32_t capacity;
+    unsigned long skipped;  /* bytes that did not parse */
+};
+
+void log_reader_init(struct log_reader *reader);
+void log_reader_free(struct log_reader *reader);
+
+/* Decode from buf[*offset] on, stopping at the next message: it is rendered
+ * into out, its level stored in *level, and 1 returned. Returns 0 at the end
+ * of the data, leaving *offset at any incomplete record. */
+int log_reader_next(struct log_reader *reader, const unsigned char *buf,
+                    size_t len, size_t *offset, int *level,
+                    char *out, size_t out_size);
+
+#endif /* LOG_RECORD_H */
@@ -0,0 +1,130 @@
+/*
+ * millennium-logcat: print the daemon's binary log (logging.format=binary)
+ * as the text lines text logging would have written.
+ *
+ *     millennium-logcat [-l LEVEL] [FILE...]
+ *
+ * With no FILE, or "-", reads standard input, so a live log can be followed
+ * with `tail -c +1 -f daemon.log | millennium-logcat`. Pass rotated files
+ * oldest first: daemon.log.2 daemon.log.1 daemon.log. Bytes that are not
+ * records -- text logged before the switch to binary, a write torn by a
+ * power cut -- are skipped and counted on stderr.
+ */
+#include "log_record.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define READ_CHUNK 65536
+
+static const char *base_name(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash != NULL ? slash + 1 : path;
+}
+
+static void print_usage(FILE *out, const char *argv0) {
+    fprintf(out,
+        "Usage: %s [-l LEVEL] [FILE...]\n"
+        "Print a binary Millennium daemon log as text.\n"
+        "\n"
+        "  -l LEVEL   only messages at LEVEL or above\n"
+        "             (VERBOSE, DEBUG, INFO, WARN, ERROR)\n"
+        "  -h         show this help\n"
+        "\n"
+        "With no FILE, or when FILE is -, read standard input.\n",
+        base_name(argv0));
+}
+
+/* Decode one stream to stdout. Returns the number of bytes skipped. */
+static unsigned long cat_stream(FILE *in, int min_level) {
+    struct log_reader reader;
+    unsigned char *buf;
+    size_t fill = 0;
+    char line[LOG_RECORD_MAX * 2];
+    unsigned long skipped;
+
+    buf = (unsigned char *)malloc(READ_CHUNK + LOG_RECORD_MAX);
+    if (buf == NULL) {
+        return 0;
+    }
+    log_reader_init(&reader);
+
+    for (;;) {
+        size_t got = fread(buf + fill, 1, READ_CHUNK + LOG_RECORD_MAX - fill, in);
+        size_t offset = 0;
+        int level;
+
+        fill += got;
+        while (log_reader_next(&reader, buf, fill, &offset, &level,
+                               line, sizeof(line))) {
+            if (level >= min_level) {
+                puts(line);
+            }
+        }
+        /* Keep a record cut off by the end of the chunk for the next read */
+        memmove(buf, buf + offset, fill - offset);
+        fill -= offset;
+        if (got == 0) {
+            break;
+        }
+    }
+
+    skipped = reader.skipped + (unsigned long)fill;
+    log_reader_free(&reader);
+    free(buf);
+    return skipped;
+}
+
+int main(int argc, char *argv[]) {
+    int min_level = LOG_LEVEL_VERBOSE;
+    int status = 0;
+    int i;
+
+    for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            print_usage(stdout, argv[0]);
+            return 0;
+        }
+        if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            min_level = logger_parse_level(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        print_usage(stderr, argv[0]);
+        return 2;
+    }
+
+    if (i == argc) {
+        unsigned long skipped = cat_stream(stdin, min_level);
+        if (skipped > 0) {
+            fprintf(stderr, "%s: skipped %lu bytes that were not log records\n",
+                    base_name(argv[0]), skipped);
+        }
+        return 0;
+    }
+
+    for (; i < argc; i++) {
+        FILE *in = strcmp(argv[i], "-") == 0 ? stdin : fopen(argv[i], "rb");
+        unsigned long skipped;
+
+        if (in == NULL) {
+            perror(argv[i]);
+            status = 1;
+            continue;
+        }
+        skipped = cat_stream(in, min_level);
+        if (in != stdin) {
+            fclose(in);
+        }
+        if (skipped > 0) {
+            fprintf(stderr, "%s: %s: skipped %lu bytes that were not log records\n",
+                    base_name(argv[0]), argv[i], skipped);
+        }
+    }
+    return status;
+}
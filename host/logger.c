@@ -1,5 +1,7 @@
 #define _POSIX_C_SOURCE 200112L
+#define LOGGER_IMPLEMENTATION
 #include "logger.h"
+#include "log_record.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,6 +9,9 @@
 #include <time.h>
 #include <stdarg.h>
 #include <pthread.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
 
 /* Global logger instance */
 logger_data_t* g_logger = NULL;
@@ -19,11 +24,67 @@ logger_data_t* g_logger = NULL;
 static pthread_mutex_t logger_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t logger_file_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/* Level gating (see logger.h). The override table is append-only: a
+ * category keeps its slot once it has one, and a slot's name is written
+ * before the count that publishes it, so logger_category_enabled() reads the
+ * table without a lock. Writers serialize on category_mutex. */
+struct category_level {
+    char name[32];
+    int level;      /* -1: no override, follow the global level */
+};
+
+int logger_floor = LOG_LEVEL_INFO;
+static struct category_level category_levels[LOGGER_MAX_CATEGORY_LEVELS];
+static int category_level_count = 0;
+static pthread_mutex_t category_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void logger_update_floor(void);
+
+/* Binary logging (see log_record.h). Each printf-style call site gets an
+ * entry in this dictionary the first time it logs in binary mode, and its
+ * logger_site remembers the id; the entries never move or go away, so the
+ * writer and the readers look them up without a lock once the count has
+ * published them. */
+#define LOGGER_MAX_FORMATS 4096
+#define LOGGER_SITE_TEXT   (~0u)   /* site logs as TEXT records */
+
+/* Records are encoded at most this long, no longer than a text line */
+#define LOGGER_RECORD_MAX  (LOG_RECORD_MAX - 1)
+
+struct logger_format {
+    const char* format;
+    const char* category;
+    int nargs;
+    unsigned char types[LOG_RECORD_MAX_ARGS];
+};
+
+static int logger_binary = 0;
+static struct logger_format* logger_formats[LOGGER_MAX_FORMATS];
+static unsigned logger_format_count = 0;
+static pthread_mutex_t logger_format_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* What the writer has put in the current file; guarded by logger_file_mutex
+ * and reset whenever the file is (re)opened, so every file -- and every run
+ * appending to one -- starts with a HEADER and carries its own formats. */
+static int log_file_header_written = 0;
+static unsigned log_file_formats_written = 0;
+
+/* Wall-clock time for a record */
+static uint64_t logger_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
 /* Forward declarations for the async writer machinery (defined below). */
 static void logger_check_rotation(logger_data_t* logger);
-static void logger_emit_to_file(const char* line);
 static void logger_writer_start(void);
-static void logger_enqueue(const char* line);
+static void logger_enqueue(int kind, int level, const void* data, size_t len);
+static long logger_write_all(int fd, const void* data, size_t len);
+static void logger_write_record(log_level_t level, const char* category,
+                                const unsigned char* record, size_t len);
+static void logger_add_bytes_to_memory(log_level_t level, const char* category,
+                                       const void* data, size_t len);
 
 /* ── Asynchronous file writer (issue #123) ───────────────────────────────
  * Previously logger_write_log held logger_mutex across fprintf() + fflush(),
@@ -37,17 +98,40 @@ static void logger_enqueue(const char* line);
  * logger_file_mutex. Disk latency is absorbed by the queue, never by a
  * producer. If the writer can't keep up the queue fills, the newest lines are
  * dropped and counted, and the writer emits a single notice line — memory is
- * bounded and the system never stalls. */
-#define LOG_QUEUE_CAP 1024
-#define LOG_LINE_MAX  512
+ * bounded and the system never stalls.
+ *
+ * The queue is a byte ring of variable-length entries -- a text line, or a
+ * binary record of a few dozen bytes -- each a 16-bit size (of the whole
+ * entry), a kind byte, its level and the data. An entry never wraps: one
+ * that does not fit before the end of the buffer goes at the start, and a
+ * zero length (or fewer than two bytes left) tells the writer to skip to
+ * the start too.
+ *
+ * The writer takes everything queued at once and writes it with one
+ * writev() per LOG_BATCH_IOVECS/2 entries, straight from the ring, so a
+ * burst costs a few syscalls rather than a write and an fflush per line,
+ * and the queue drains as fast as it fills. How often the file is also
+ * fdatasync'd is the sync policy (logger_set_sync_policy). */
+#define LOG_QUEUE_CAP   1024           /* entries */
+#define LOG_QUEUE_BYTES (128 * 1024)
+#define LOG_LINE_MAX    512
+
+#define LOG_ENTRY_LINE   0             /* text line, no newline */
+#define LOG_ENTRY_RECORD 1             /* binary record */
+#define LOG_ENTRY_HEAD   4             /* size, kind, level */
+
+#define LOG_BATCH_IOVECS 256
 
 static struct {
-    char lines[LOG_QUEUE_CAP][LOG_LINE_MAX];
-    int head;                  /* index of the next line to write */
-    int count;                 /* lines queued but not yet on disk */
+    unsigned char buf[LOG_QUEUE_BYTES];
+    size_t head;               /* offset of the next entry to write */
+    size_t used;               /* bytes queued, skipped space at the end included */
+    int count;                 /* entries queued but not yet on disk */
     unsigned long dropped;     /* lines discarded on overflow since last notice */
     unsigned long long dropped_total; /* cumulative drops since start (for metrics) */
     unsigned long high_water;  /* max depth observed since start (for metrics) */
+    unsigned long long batches_total; /* writes of a batch */
+    unsigned long long syncs_total;   /* fdatasync()s */
     int started;               /* writer thread is running */
     int shutting_down;         /* drain-and-exit requested */
     pthread_t thread;
@@ -55,75 +139,306 @@ static struct {
     pthread_cond_t not_empty;  /* a line was queued, or shutdown requested */
     pthread_cond_t drained;    /* queue emptied (count reached 0) */
 } log_queue = {
-    {{0}}, 0, 0, 0, 0, 0, 0, 0, 0,
+    {0}, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
     PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER
 };
 
-/* Write one already-formatted line to the log file. Holds logger_file_mutex
- * (so it may block on disk I/O) but NOT logger_mutex — producers run free. */
-static void logger_emit_to_file(const char* line) {
-    logger_data_t* logger = g_logger;
-    int written;
+static log_sync_t log_sync_policy = LOG_SYNC_ERROR;
+static long log_sync_interval_ms = 1000;
+static logger_batch_observer_t log_batch_observer = NULL;
 
-    if (logger == NULL || line == NULL) {
-        return;
+/* The dictionary lookup log_record_render() needs, over logger_formats */
+static int logger_lookup_format(void* ctx, uint32_t id, const char** category,
+                                const char** format) {
+    (void)ctx;
+    if (id >= __atomic_load_n(&logger_format_count, __ATOMIC_ACQUIRE)) {
+        return -1;
+    }
+    *category = logger_formats[id]->category;
+    *format = logger_formats[id]->format;
+    return 0;
+}
+
+/* writev() all of iov[0..n), resuming after short writes. Returns the bytes
+ * written, or -1 on error. */
+static long logger_writev_all(int fd, struct iovec* iov, int n) {
+    long total = 0;
+
+    while (n > 0) {
+        ssize_t w = writev(fd, iov, n);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        total += (long)w;
+        while (n > 0 && (size_t)w >= iov->iov_len) {
+            w -= (ssize_t)iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (char*)iov->iov_base + w;
+            iov->iov_len -= (size_t)w;
+        }
+    }
+    return total;
+}
+
+static long logger_write_all(int fd, const void* data, size_t len) {
+    struct iovec iov;
+    iov.iov_base = (void*)data;
+    iov.iov_len = len;
+    return logger_writev_all(fd, &iov, 1);
+}
+
+/* Everything the file still lacks of the HEADER and the dictionary up to
+ * the newest format, written ahead of a batch holding records. Caller holds
+ * logger_file_mutex. */
+static void logger_write_dictionary(logger_data_t* logger, int fd) {
+    unsigned char buf[4096];
+    size_t fill = 0;
+    unsigned count = __atomic_load_n(&logger_format_count, __ATOMIC_ACQUIRE);
+
+    if (!log_file_header_written) {
+        fill = log_record_header(buf, sizeof(buf));
+        log_file_header_written = 1;
+        log_file_formats_written = 0;
+    }
+    while (log_file_formats_written < count) {
+        const struct logger_format* f = logger_formats[log_file_formats_written];
+        size_t n;
+
+        if (sizeof(buf) - fill < LOG_RECORD_MAX) {
+            if (logger_write_all(fd, buf, fill) > 0) {
+                logger->current_file_size += (long)fill;
+            }
+            fill = 0;
+        }
+        n = log_record_format(buf + fill, sizeof(buf) - fill, log_file_formats_written,
+                              f->category, f->format);
+        fill += n;
+        log_file_formats_written++;
+    }
+    if (fill > 0 && logger_write_all(fd, buf, fill) > 0) {
+        logger->current_file_size += (long)fill;
+    }
+}
+
+static double logger_elapsed_ms(const struct timespec* since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - since->tv_sec) * 1000.0 +
+           (double)(now.tv_nsec - since->tv_nsec) / 1e6;
+}
+
+/* The writer thread's sync bookkeeping */
+struct log_writer_sync {
+    int dirty;                 /* written since the last fdatasync */
+    struct timespec last;      /* CLOCK_MONOTONIC of the last one */
+};
+
+/* fdatasync the log file. Caller holds logger_file_mutex. */
+static void logger_sync_file(logger_data_t* logger, struct log_writer_sync* sync) {
+    if (logger->file_stream != NULL) {
+        fdatasync(fileno(logger->file_stream));
+        pthread_mutex_lock(&log_queue.lock);
+        log_queue.syncs_total++;
+        pthread_mutex_unlock(&log_queue.lock);
     }
+    sync->dirty = 0;
+    clock_gettime(CLOCK_MONOTONIC, &sync->last);
+}
 
+/* Write `count` queued entries, starting at ring offset `head`, with as few
+ * writev() calls as the iovec array allows: each line is two iovecs (the
+ * line, then "\n" from a constant), each record one, all pointing into the
+ * ring. The entries stay queued -- producers only ever append after them --
+ * until the caller commits them. Returns the bytes written. */
+static long logger_write_batch(size_t head, int count, unsigned long dropped,
+                               struct log_writer_sync* sync) {
+    static const char newline = '\n';
+    logger_data_t* logger = g_logger;
+    struct iovec iov[LOG_BATCH_IOVECS];
+    char notice[LOG_LINE_MAX];
+    unsigned char record[LOGGER_RECORD_MAX];
+    int n = 0, i, fd, max_level = LOG_LEVEL_VERBOSE, dictionary = 0;
+    long written = 0, w;
+    log_sync_t policy;
+    size_t pos = head;
+
+    if (logger == NULL) {
+        return 0;
+    }
     pthread_mutex_lock(&logger_file_mutex);
-    if (logger->log_to_file && logger->file_stream != NULL) {
-        written = fprintf(logger->file_stream, "%s\n", line);
-        fflush(logger->file_stream);
-        if (written > 0) {
-            logger->current_file_size += written;
+    if (!logger->log_to_file || logger->file_stream == NULL) {
+        pthread_mutex_unlock(&logger_file_mutex);
+        return 0;
+    }
+    fd = fileno(logger->file_stream);
+
+    for (i = 0; i < count; i++) {
+        unsigned short size;
+        unsigned char kind;
+
+        if (LOG_QUEUE_BYTES - pos < 2) {
+            pos = 0;
+        }
+        memcpy(&size, log_queue.buf + pos, 2);
+        if (size == 0) {
+            pos = 0;
+            memcpy(&size, log_queue.buf, 2);
+        }
+        kind = log_queue.buf[pos + 2];
+        if (log_queue.buf[pos + 3] > max_level) {
+            max_level = log_queue.buf[pos + 3];
+        }
+
+        if (kind == LOG_ENTRY_RECORD && !dictionary) {
+            /* Formats first: records may use any registered so far */
+            logger_write_dictionary(logger, fd);
+            dictionary = 1;
+        }
+        if (i == 0 && dropped > 0) {
+            /* Say what was lost ahead of what was kept, in the batch's format */
+            if (kind == LOG_ENTRY_RECORD) {
+                size_t len;
+                snprintf(notice, sizeof(notice),
+                    "dropped %lu log line(s): writer fell behind", dropped);
+                len = log_record_text(record, sizeof(record), LOG_LEVEL_WARN,
+                                      logger_now_ns(), "logger", notice);
+                iov[n].iov_base = record;
+                iov[n++].iov_len = len;
+            } else {
+                iov[n].iov_base = notice;
+                iov[n++].iov_len = (size_t)snprintf(notice, sizeof(notice),
+                    "[logger] dropped %lu log line(s): writer fell behind\n", dropped);
+            }
+        }
+
+        iov[n].iov_base = log_queue.buf + pos + LOG_ENTRY_HEAD;
+        iov[n++].iov_len = size - LOG_ENTRY_HEAD;
+        if (kind == LOG_ENTRY_LINE) {
+            iov[n].iov_base = (void*)&newline;
+            iov[n++].iov_len = 1;
+        }
+        pos += size;
+
+        if (n > LOG_BATCH_IOVECS - 3 || i == count - 1) {
+            w = logger_writev_all(fd, iov, n);
+            if (w > 0) {
+                written += w;
+            }
+            n = 0;
         }
-        logger_check_rotation(logger);
     }
+
+    logger->current_file_size += written;
+    sync->dirty = 1;
+    policy = __atomic_load_n(&log_sync_policy, __ATOMIC_RELAXED);
+    if (policy == LOG_SYNC_BATCH ||
+        (policy == LOG_SYNC_ERROR && max_level >= LOG_LEVEL_ERROR) ||
+        (policy == LOG_SYNC_INTERVAL &&
+         logger_elapsed_ms(&sync->last) >=
+             (double)__atomic_load_n(&log_sync_interval_ms, __ATOMIC_RELAXED))) {
+        logger_sync_file(logger, sync);
+    }
+    logger_check_rotation(logger);
     pthread_mutex_unlock(&logger_file_mutex);
+    return written;
 }
 
-/* The writer thread: pop a line, write it to disk, repeat. The line is not
- * committed (head/count advanced) until AFTER the write completes, so
- * logger_flush() only observes count==0 once everything is actually on disk. */
+/* The writer thread: take every queued entry, write them as one batch,
+ * repeat. The entries are not committed (head/count advanced) until AFTER
+ * the write completes, so logger_flush() only observes count==0 once
+ * everything is actually on disk. */
 static void* logger_writer_main(void* arg) {
-    char line[LOG_LINE_MAX];
+    struct log_writer_sync sync;
+    struct timespec started;
+    size_t head, used;
+    int count;
     unsigned long dropped;
+    long written;
+    logger_batch_observer_t observer;
 
     (void)arg;
+    sync.dirty = 0;
+    clock_gettime(CLOCK_MONOTONIC, &sync.last);
 
     for (;;) {
         pthread_mutex_lock(&log_queue.lock);
         while (log_queue.count == 0 && !log_queue.shutting_down) {
             pthread_cond_broadcast(&log_queue.drained);
-            pthread_cond_wait(&log_queue.not_empty, &log_queue.lock);
+            if (sync.dirty &&
+                __atomic_load_n(&log_sync_policy, __ATOMIC_RELAXED) == LOG_SYNC_INTERVAL) {
+                /* Idle with unsynced lines: sync when the interval is up */
+                struct timespec deadline;
+                long wait_ms = __atomic_load_n(&log_sync_interval_ms, __ATOMIC_RELAXED) -
+                               (long)logger_elapsed_ms(&sync.last);
+
+                clock_gettime(CLOCK_REALTIME, &deadline);
+                if (wait_ms > 0) {
+                    deadline.tv_sec += wait_ms / 1000;
+                    deadline.tv_nsec += (wait_ms % 1000) * 1000000L;
+                    if (deadline.tv_nsec >= 1000000000L) {
+                        deadline.tv_sec++;
+                        deadline.tv_nsec -= 1000000000L;
+                    }
+                }
+                if (wait_ms <= 0 ||
+                    pthread_cond_timedwait(&log_queue.not_empty, &log_queue.lock,
+                                           &deadline) == ETIMEDOUT) {
+                    pthread_mutex_unlock(&log_queue.lock);
+                    pthread_mutex_lock(&logger_file_mutex);
+                    if (g_logger != NULL) {
+                        logger_sync_file(g_logger, &sync);
+                    }
+                    pthread_mutex_unlock(&logger_file_mutex);
+                    pthread_mutex_lock(&log_queue.lock);
+                }
+            } else {
+                pthread_cond_wait(&log_queue.not_empty, &log_queue.lock);
+            }
         }
         if (log_queue.count == 0 && log_queue.shutting_down) {
             pthread_cond_broadcast(&log_queue.drained);
             pthread_mutex_unlock(&log_queue.lock);
             break;
         }
-        /* Peek the head; commit it only after the write succeeds. */
-        memcpy(line, log_queue.lines[log_queue.head], LOG_LINE_MAX);
+        /* Take everything queued so far */
+        head = log_queue.head;
+        used = log_queue.used;
+        count = log_queue.count;
         dropped = log_queue.dropped;
         log_queue.dropped = 0;
         pthread_mutex_unlock(&log_queue.lock);
 
-        if (dropped > 0) {
-            char notice[LOG_LINE_MAX];
-            snprintf(notice, sizeof(notice),
-                "[logger] dropped %lu log line(s): writer fell behind", dropped);
-            logger_emit_to_file(notice);
+        clock_gettime(CLOCK_MONOTONIC, &started);
+        written = logger_write_batch(head, count, dropped, &sync);
+        observer = __atomic_load_n(&log_batch_observer, __ATOMIC_ACQUIRE);
+        if (observer != NULL) {
+            observer((unsigned long)count, (size_t)written, logger_elapsed_ms(&started));
         }
-        logger_emit_to_file(line);
 
         pthread_mutex_lock(&log_queue.lock);
-        log_queue.head = (log_queue.head + 1) % LOG_QUEUE_CAP;
-        log_queue.count--;
+        log_queue.head = (head + used) % LOG_QUEUE_BYTES;
+        log_queue.used -= used;
+        log_queue.count -= count;
+        log_queue.batches_total++;
         if (log_queue.count == 0) {
             pthread_cond_broadcast(&log_queue.drained);
         }
         pthread_mutex_unlock(&log_queue.lock);
     }
 
+    if (sync.dirty && __atomic_load_n(&log_sync_policy, __ATOMIC_RELAXED) != LOG_SYNC_NONE) {
+        pthread_mutex_lock(&logger_file_mutex);
+        if (g_logger != NULL) {
+            logger_sync_file(g_logger, &sync);
+        }
+        pthread_mutex_unlock(&logger_file_mutex);
+    }
     return NULL;
 }
 
@@ -138,6 +453,7 @@ static void logger_writer_start(void) {
     /* Reset the queue so a restart after logger_shutdown() is clean. */
     log_queue.shutting_down = 0;
     log_queue.head = 0;
+    log_queue.used = 0;
     log_queue.count = 0;
     log_queue.dropped = 0;
     if (pthread_create(&log_queue.thread, NULL, logger_writer_main, NULL) == 0) {
@@ -146,30 +462,52 @@ static void logger_writer_start(void) {
     pthread_mutex_unlock(&log_queue.lock);
 }
 
-/* Append a formatted line to the queue and wake the writer. Never blocks on
- * disk; drops (and counts) the line if the queue is full. */
-static void logger_enqueue(const char* line) {
-    int tail;
-    size_t n;
+/* Append an entry (a line of `len` bytes, or a record) to the queue and
+ * wake the writer. Never blocks on disk; drops (and counts) the entry if
+ * the queue is full. */
+static void logger_enqueue(int kind, int level, const void* data, size_t len) {
+    size_t tail, skip, need;
+    unsigned short size;
+
+    if (len > LOG_LINE_MAX) {
+        len = LOG_LINE_MAX;
+    }
+    need = LOG_ENTRY_HEAD + len;
 
     pthread_mutex_lock(&log_queue.lock);
     if (!log_queue.started || log_queue.shutting_down) {
         pthread_mutex_unlock(&log_queue.lock);
         return;
     }
-    if (log_queue.count >= LOG_QUEUE_CAP) {
+    if (log_queue.count == 0) {
+        log_queue.head = 0;        /* empty: start over at the front */
+        log_queue.used = 0;
+    }
+    tail = (log_queue.head + log_queue.used) % LOG_QUEUE_BYTES;
+    skip = 0;
+    if (tail >= log_queue.head && LOG_QUEUE_BYTES - tail < need) {
+        skip = LOG_QUEUE_BYTES - tail;   /* no room before the end: wrap */
+    }
+    if (log_queue.count >= LOG_QUEUE_CAP ||
+        log_queue.used + skip + need > LOG_QUEUE_BYTES) {
         log_queue.dropped++;           /* bounded memory: drop the newest line */
         log_queue.dropped_total++;     /* lifetime total for metrics/alerting */
         pthread_mutex_unlock(&log_queue.lock);
         return;
     }
-    tail = (log_queue.head + log_queue.count) % LOG_QUEUE_CAP;
-    n = strlen(line);
-    if (n >= LOG_LINE_MAX) {
-        n = LOG_LINE_MAX - 1;
+    if (skip > 0) {
+        if (skip >= 2) {
+            memset(log_queue.buf + tail, 0, 2);
+        }
+        log_queue.used += skip;
+        tail = 0;
     }
-    memcpy(log_queue.lines[tail], line, n);
-    log_queue.lines[tail][n] = '\0';
+    size = (unsigned short)need;
+    memcpy(log_queue.buf + tail, &size, 2);
+    log_queue.buf[tail + 2] = (unsigned char)kind;
+    log_queue.buf[tail + 3] = (unsigned char)level;
+    memcpy(log_queue.buf + tail + LOG_ENTRY_HEAD, data, len);
+    log_queue.used += need;
     log_queue.count++;
     if ((unsigned long)log_queue.count > log_queue.high_water) {
         log_queue.high_water = (unsigned long)log_queue.count;
@@ -202,6 +540,8 @@ void logger_get_queue_stats(logger_queue_stats_t* out) {
     out->high_water = log_queue.high_water;
     out->capacity = LOG_QUEUE_CAP;
     out->dropped_total = log_queue.dropped_total;
+    out->batches_total = log_queue.batches_total;
+    out->syncs_total = log_queue.syncs_total;
     pthread_mutex_unlock(&log_queue.lock);
 }
 
@@ -244,8 +584,6 @@ logger_data_t* logger_get_instance(void) {
             g_logger->max_file_size = 0;
             g_logger->max_rotated_files = 0;
             g_logger->current_file_size = 0;
-            g_logger->memory_logs_count = 0;
-            g_logger->memory_logs_start = 0;
         }
     }
     return g_logger;
@@ -256,6 +594,97 @@ void logger_set_level(log_level_t level) {
     if (logger != NULL) {
         logger->current_level = level;
     }
+    logger_update_floor();
+}
+
+/* Recompute logger_floor from the global level and the overrides. */
+static void logger_update_floor(void) {
+    logger_data_t* logger = logger_get_instance();
+    int floor = logger != NULL ? (int)logger->current_level : LOG_LEVEL_INFO;
+    int count = __atomic_load_n(&category_level_count, __ATOMIC_ACQUIRE);
+    int i;
+
+    for (i = 0; i < count; i++) {
+        int level = __atomic_load_n(&category_levels[i].level, __ATOMIC_RELAXED);
+        if (level >= 0 && level < floor) {
+            floor = level;
+        }
+    }
+    __atomic_store_n(&logger_floor, floor, __ATOMIC_RELAXED);
+}
+
+static struct category_level* logger_find_category(const char* category, int count) {
+    int i;
+    for (i = 0; i < count; i++) {
+        if (strcmp(category_levels[i].name, category) == 0) {
+            return &category_levels[i];
+        }
+    }
+    return NULL;
+}
+
+int logger_set_category_level(const char* category, log_level_t level) {
+    struct category_level* entry;
+    int count;
+
+    if (category == NULL || category[0] == '\0' ||
+        strlen(category) >= sizeof(category_levels[0].name)) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&category_mutex);
+    count = __atomic_load_n(&category_level_count, __ATOMIC_RELAXED);
+    entry = logger_find_category(category, count);
+    if (entry == NULL) {
+        if (count >= LOGGER_MAX_CATEGORY_LEVELS) {
+            pthread_mutex_unlock(&category_mutex);
+            return -1;
+        }
+        entry = &category_levels[count];
+        strcpy(entry->name, category);
+        entry->level = -1;
+        __atomic_store_n(&category_level_count, count + 1, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&entry->level, (int)level, __ATOMIC_RELAXED);
+    logger_update_floor();
+    pthread_mutex_unlock(&category_mutex);
+    return 0;
+}
+
+void logger_clear_category_level(const char* category) {
+    struct category_level* entry;
+
+    if (category == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&category_mutex);
+    entry = logger_find_category(category,
+                                 __atomic_load_n(&category_level_count, __ATOMIC_RELAXED));
+    if (entry != NULL) {
+        __atomic_store_n(&entry->level, -1, __ATOMIC_RELAXED);
+        logger_update_floor();
+    }
+    pthread_mutex_unlock(&category_mutex);
+}
+
+int logger_category_enabled(log_level_t level, const char* category) {
+    logger_data_t* logger = logger_get_instance();
+    int count = __atomic_load_n(&category_level_count, __ATOMIC_ACQUIRE);
+
+    if (logger == NULL) {
+        return 0;
+    }
+    /* Only look the category up when some override exists */
+    if (count > 0 && category != NULL && category[0] != '\0') {
+        struct category_level* entry = logger_find_category(category, count);
+        if (entry != NULL) {
+            int override = __atomic_load_n(&entry->level, __ATOMIC_RELAXED);
+            if (override >= 0) {
+                return (int)level >= override;
+            }
+        }
+    }
+    return level >= logger->current_level;
 }
 
 void logger_set_log_file(const char* filename) {
@@ -273,6 +702,7 @@ void logger_set_log_file(const char* filename) {
             fclose(logger->file_stream);
         }
         logger->file_stream = fopen(filename, "a");
+        log_file_header_written = 0;
         if (logger->file_stream == NULL) {
             logger->log_to_file = 0;
             logger->current_file_size = 0;
@@ -304,6 +734,7 @@ void logger_set_log_to_file(int enable) {
             fclose(logger->file_stream);
         }
         logger->file_stream = fopen(logger->log_file, "a");
+        log_file_header_written = 0;
         if (logger->file_stream == NULL) {
             logger->log_to_file = 0;
             logger->current_file_size = 0;
@@ -332,6 +763,20 @@ void logger_set_rotation(long max_file_size, int max_rotated_files) {
     pthread_mutex_unlock(&logger_file_mutex);
 }
 
+void logger_set_sync_policy(log_sync_t policy, long interval_ms) {
+    __atomic_store_n(&log_sync_interval_ms, interval_ms > 0 ? interval_ms : 1000,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&log_sync_policy, policy, __ATOMIC_RELAXED);
+}
+
+void logger_set_batch_observer(logger_batch_observer_t observer) {
+    __atomic_store_n(&log_batch_observer, observer, __ATOMIC_RELEASE);
+}
+
+void logger_set_log_format(log_format_t format) {
+    __atomic_store_n(&logger_binary, format == LOG_FORMAT_BINARY, __ATOMIC_RELAXED);
+}
+
 static void logger_rotate_files(logger_data_t* logger) {
     char src_path[512];
     char dst_path[512];
@@ -360,6 +805,7 @@ static void logger_rotate_files(logger_data_t* logger) {
     /* Reopen a fresh log file */
     logger->file_stream = fopen(logger->log_file, "a");
     logger->current_file_size = 0;
+    log_file_header_written = 0;
     if (logger->file_stream == NULL) {
         logger->log_to_file = 0;
     }
@@ -384,7 +830,7 @@ void logger_log_with_category(log_level_t level, const char* category, const cha
         return;
     }
     
-    if (level >= logger->current_level) {
+    if (LOGGER_ENABLED(level, category)) {
         logger_write_log(level, category, message);
     }
 }
@@ -434,6 +880,14 @@ void logger_write_log(log_level_t level, const char* category, const char* messa
         return;
     }
 
+    if (__atomic_load_n(&logger_binary, __ATOMIC_RELAXED)) {
+        unsigned char record[LOGGER_RECORD_MAX];
+        size_t len = log_record_text(record, sizeof(record), level,
+                                     logger_now_ns(), category, message);
+        logger_write_record(level, category, record, len);
+        return;
+    }
+
     pthread_mutex_lock(&logger_mutex);
 
     logger_format_timestamp(timestamp, sizeof(timestamp));
@@ -447,7 +901,7 @@ void logger_write_log(log_level_t level, const char* category, const char* messa
     }
 
     /* Store in memory */
-    logger_add_to_memory(formatted_message);
+    logger_add_to_memory(level, category, formatted_message);
 
     /* Output to console */
     if (logger->log_to_console) {
@@ -466,7 +920,37 @@ void logger_write_log(log_level_t level, const char* category, const char* messa
      * slow disk never blocks this producer. The writer drains the queue under
      * logger_file_mutex and performs the actual fprintf/fflush/rotation. */
     if (to_file) {
-        logger_enqueue(formatted_message);
+        logger_enqueue(LOG_ENTRY_LINE, level, formatted_message, strlen(formatted_message));
+    }
+}
+
+/* The binary counterpart of logger_write_log: keep the record in the memory
+ * ring as it is -- it is rendered when read -- and queue it for the file.
+ * Only WARN and above are rendered now, for the console. */
+static void logger_write_record(log_level_t level, const char* category,
+                                const unsigned char* record, size_t len) {
+    logger_data_t* logger = logger_get_instance();
+    int to_file, to_console;
+
+    if (logger == NULL || len == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&logger_mutex);
+    logger_add_bytes_to_memory(level, category, record, len);
+    to_console = logger->log_to_console && level >= LOG_LEVEL_WARN;
+    to_file = logger->log_to_file;
+    pthread_mutex_unlock(&logger_mutex);
+
+    if (to_console) {
+        char line[LOG_LINE_MAX];
+        if (log_record_render(record, len, logger_lookup_format, NULL,
+                              line, sizeof(line)) >= 0) {
+            fprintf(stderr, "%s\n", line);
+        }
+    }
+    if (to_file) {
+        logger_enqueue(LOG_ENTRY_RECORD, level, record, len);
     }
 }
 
@@ -500,107 +984,377 @@ const char* logger_format_level(log_level_t level) {
     return logger_level_to_string(level);
 }
 
-void logger_add_to_memory(const char* formatted_message) {
-    logger_data_t* logger = logger_get_instance();
-    int index;
-    size_t mlen, mcap;
+/* ── In-memory log ───────────────────────────────────────────────────────
+ * The messages behind /api/logs, packed end to end in a byte ring as they
+ * were logged: text lines as formatted, binary records as they are (they are
+ * rendered when read). A message never wraps; one that does not fit before
+ * the end of the ring goes at the start, and the oldest messages it lands on
+ * are dropped. The ring is allocated with the first message.
+ *
+ * Beside it, memory_log.index holds an entry per message, oldest first, in a
+ * ring of its own that doubles when it fills. Messages are numbered in order
+ * (seq, from 1); each entry links back to the previous message at the same
+ * level and the previous one in the same category, as a distance in seqs,
+ * 0 for none. A link or a head older than the oldest message left has gone
+ * with it. So a query walks only the messages it can return, and never
+ * looks at the messages themselves.
+ *
+ * All of it is guarded by logger_mutex. */
+#define LOG_MEMORY_MIN_BYTES  4096
+#define LOG_MEMORY_INDEX_MIN  256
+#define LOG_MEMORY_CATEGORIES 256      /* ids fit a byte; 0 is "none" */
+
+struct logger_memory_entry {
+    uint64_t time_ms;
+    uint32_t offset;            /* in memory_log.data */
+    uint32_t prev_level;        /* seqs back to the previous at this level */
+    uint32_t prev_category;     /* ... and in this category */
+    uint16_t length;
+    unsigned char level;
+    unsigned char category;
+};
 
-    if (logger == NULL || formatted_message == NULL) {
-        return;
-    }
+static struct {
+    unsigned char* data;
+    size_t size;                /* 0 until allocated */
+    size_t configured_size;     /* 0: LOGGER_MEMORY_BYTES_DEFAULT */
+    size_t tail;                /* where the next message goes */
+    struct logger_memory_entry* index;
+    size_t index_cap;
+    size_t index_start;         /* slot of the oldest message */
+    size_t count;
+    unsigned long long next_seq;
+    unsigned long long level_last[LOG_LEVEL_ERROR + 1];   /* newest seq, 0: none */
+    unsigned long long category_last[LOG_MEMORY_CATEGORIES];
+    char* categories[LOG_MEMORY_CATEGORIES];
+    int category_count;         /* ids handed out, "none" included */
+} memory_log;
+
+static unsigned long long logger_memory_first_seq(void) {
+    return memory_log.next_seq - memory_log.count;
+}
 
-    /* Use circular buffer */
-    index = (logger->memory_logs_start + logger->memory_logs_count) % 1000;
+static struct logger_memory_entry* logger_memory_entry(unsigned long long seq) {
+    size_t age = (size_t)(seq - logger_memory_first_seq());
+    return &memory_log.index[(memory_log.index_start + age) % memory_log.index_cap];
+}
 
-    /* Copy with intentional truncation, always null-terminated. (memcpy rather
-     * than strncpy so neither gcc -Wstringop-truncation nor clang complains.) */
-    mcap = sizeof(logger->memory_logs[index]) - 1;
-    mlen = strlen(formatted_message);
-    if (mlen > mcap) mlen = mcap;
-    memcpy(logger->memory_logs[index], formatted_message, mlen);
-    logger->memory_logs[index][mlen] = '\0';
+static int logger_memory_live(unsigned long long seq) {
+    return seq != 0 && seq >= logger_memory_first_seq() && seq < memory_log.next_seq;
+}
 
-    if (logger->memory_logs_count < 1000) {
-        logger->memory_logs_count++;
-    } else {
-        /* Buffer is full, move start pointer */
-        logger->memory_logs_start = (logger->memory_logs_start + 1) % 1000;
+static void logger_memory_drop_oldest(void) {
+    memory_log.index_start = (memory_log.index_start + 1) % memory_log.index_cap;
+    memory_log.count--;
+}
+
+/* Double the index, oldest entry to slot 0. Returns 0 on failure. */
+static int logger_memory_grow_index(void) {
+    size_t cap = memory_log.index_cap > 0 ? memory_log.index_cap * 2 : LOG_MEMORY_INDEX_MIN;
+    struct logger_memory_entry* index;
+    size_t i;
+
+    index = (struct logger_memory_entry*)malloc(cap * sizeof(*index));
+    if (index == NULL) {
+        return 0;
+    }
+    for (i = 0; i < memory_log.count; i++) {
+        index[i] = memory_log.index[(memory_log.index_start + i) % memory_log.index_cap];
     }
+    free(memory_log.index);
+    memory_log.index = index;
+    memory_log.index_cap = cap;
+    memory_log.index_start = 0;
+    return 1;
 }
 
-int logger_get_recent_logs(char logs[][512], int max_entries) {
-    logger_data_t* logger = logger_get_instance();
-    int i, j, count;
+/* Id of a category for the index, handing out a new one the first time.
+ * Past LOG_MEMORY_CATEGORIES categories the rest share "none". */
+static int logger_memory_category(const char* category, int add) {
+    char* copy;
+    int i;
 
-    if (logger == NULL || logs == NULL || max_entries <= 0) {
+    if (category == NULL || category[0] == '\0') {
         return 0;
     }
+    for (i = 1; i < memory_log.category_count; i++) {
+        if (strcmp(memory_log.categories[i], category) == 0) {
+            return i;
+        }
+    }
+    if (!add) {
+        return -1;
+    }
+    if (memory_log.category_count == 0) {
+        memory_log.category_count = 1;
+    }
+    if (memory_log.category_count >= LOG_MEMORY_CATEGORIES ||
+        (copy = (char*)malloc(strlen(category) + 1)) == NULL) {
+        return 0;
+    }
+    strcpy(copy, category);
+    memory_log.categories[memory_log.category_count] = copy;
+    return memory_log.category_count++;
+}
 
-    pthread_mutex_lock(&logger_mutex);
+/* Distance back from seq to last for a link, 0 if there is none */
+static uint32_t logger_memory_link(unsigned long long last, unsigned long long seq) {
+    if (last == 0 || seq - last > 0xffffffffu) {
+        return 0;
+    }
+    return (uint32_t)(seq - last);
+}
 
-    count = (max_entries < logger->memory_logs_count) ? max_entries : logger->memory_logs_count;
+/* Append a message, dropping the oldest ones it needs the room of */
+static void logger_memory_store(int level, int category, uint64_t time_ms,
+                                const void* data, size_t len) {
+    struct logger_memory_entry* e;
+    unsigned long long seq;
+
+    if (memory_log.data == NULL) {
+        size_t size = memory_log.configured_size > 0 ?
+            memory_log.configured_size : LOGGER_MEMORY_BYTES_DEFAULT;
+        memory_log.data = (unsigned char*)malloc(size);
+        if (memory_log.data == NULL) {
+            return;
+        }
+        memory_log.size = size;
+        memory_log.tail = 0;
+    }
+    if (len > LOG_LINE_MAX) {
+        len = LOG_LINE_MAX;
+    }
+    if (level < LOG_LEVEL_VERBOSE || level > LOG_LEVEL_ERROR) {
+        level = LOG_LEVEL_INFO;
+    }
 
-    for (i = 0, j = logger->memory_logs_start; i < count; i++) {
-        strncpy(logs[i], logger->memory_logs[j], sizeof(logs[i]) - 1);
-        logs[i][sizeof(logs[i]) - 1] = '\0';
-        j = (j + 1) % 1000;
+    if (memory_log.tail + len > memory_log.size) {
+        /* Start over at the beginning, giving up what is left of the last
+         * lap after the tail */
+        while (memory_log.count > 0 &&
+               logger_memory_entry(logger_memory_first_seq())->offset >= memory_log.tail) {
+            logger_memory_drop_oldest();
+        }
+        memory_log.tail = 0;
+    }
+    while (memory_log.count > 0) {
+        e = logger_memory_entry(logger_memory_first_seq());
+        if (e->offset < memory_log.tail || e->offset >= memory_log.tail + len) {
+            break;
+        }
+        logger_memory_drop_oldest();
+    }
+    if (memory_log.count == memory_log.index_cap && !logger_memory_grow_index()) {
+        if (memory_log.count == 0) {
+            return;
+        }
+        logger_memory_drop_oldest();
     }
 
-    pthread_mutex_unlock(&logger_mutex);
+    if (memory_log.next_seq == 0) {
+        memory_log.next_seq = 1;
+    }
+    seq = memory_log.next_seq++;
+    memory_log.count++;
+    e = logger_memory_entry(seq);
+    e->time_ms = time_ms;
+    e->offset = (uint32_t)memory_log.tail;
+    e->length = (uint16_t)len;
+    e->level = (unsigned char)level;
+    e->category = (unsigned char)category;
+    e->prev_level = logger_memory_link(memory_log.level_last[level], seq);
+    e->prev_category = logger_memory_link(memory_log.category_last[category], seq);
+    memory_log.level_last[level] = seq;
+    memory_log.category_last[category] = seq;
+
+    memcpy(memory_log.data + memory_log.tail, data, len);
+    memory_log.tail += len;
+}
 
-    return count;
+/* Caller holds logger_mutex */
+static void logger_add_bytes_to_memory(log_level_t level, const char* category,
+                                       const void* data, size_t len) {
+    if (data == NULL) {
+        return;
+    }
+    logger_memory_store((int)level, logger_memory_category(category, 1),
+                        logger_now_ns() / 1000000u, data, len);
 }
 
-/* Parse the severity out of a stored line: "[timestamp] [LEVEL] ..." */
-static log_level_t logger_parse_line_level(const char* line) {
-    const char* p;
-    if (line == NULL) return LOG_LEVEL_INFO;
-    p = strchr(line, ']');            /* end of [timestamp] */
-    if (p == NULL) return LOG_LEVEL_INFO;
-    p = strchr(p + 1, '[');           /* start of [LEVEL]   */
-    if (p == NULL) return LOG_LEVEL_INFO;
-    p++;
-    if (strncmp(p, "VERBOSE", 7) == 0) return LOG_LEVEL_VERBOSE;
-    if (strncmp(p, "DEBUG", 5) == 0)   return LOG_LEVEL_DEBUG;
-    if (strncmp(p, "INFO", 4) == 0)    return LOG_LEVEL_INFO;
-    if (strncmp(p, "WARN", 4) == 0)    return LOG_LEVEL_WARN;
-    if (strncmp(p, "ERROR", 5) == 0)   return LOG_LEVEL_ERROR;
-    return LOG_LEVEL_INFO;
+void logger_add_to_memory(log_level_t level, const char* category,
+                          const char* formatted_message) {
+    if (formatted_message != NULL) {
+        logger_add_bytes_to_memory(level, category, formatted_message,
+                                   strlen(formatted_message));
+    }
 }
 
-int logger_get_recent_logs_min_level(char logs[][512], int max_entries, log_level_t min_level) {
-    logger_data_t* logger = logger_get_instance();
-    int n, k, idx, collected, a, b;
-    char tmp[512];
+void logger_set_memory_size(size_t bytes) {
+    unsigned char* old_data;
+    struct logger_memory_entry* old_index;
+    size_t old_cap, old_start, old_count, i;
 
-    if (logger == NULL || logs == NULL || max_entries <= 0) {
-        return 0;
+    if (bytes < LOG_MEMORY_MIN_BYTES) {
+        bytes = LOG_MEMORY_MIN_BYTES;
     }
 
     pthread_mutex_lock(&logger_mutex);
+    memory_log.configured_size = bytes;
+    if (memory_log.data != NULL && memory_log.size != bytes) {
+        /* Store what there is again, oldest first, in a new ring; a smaller
+         * one drops the oldest as it goes */
+        old_data = memory_log.data;
+        old_index = memory_log.index;
+        old_cap = memory_log.index_cap;
+        old_start = memory_log.index_start;
+        old_count = memory_log.count;
+
+        memory_log.data = NULL;
+        memory_log.size = 0;
+        memory_log.index = NULL;
+        memory_log.index_cap = 0;
+        memory_log.index_start = 0;
+        memory_log.count = 0;
+        memset(memory_log.level_last, 0, sizeof(memory_log.level_last));
+        memset(memory_log.category_last, 0, sizeof(memory_log.category_last));
+
+        for (i = 0; i < old_count; i++) {
+            const struct logger_memory_entry* e = &old_index[(old_start + i) % old_cap];
+            logger_memory_store(e->level, e->category, e->time_ms,
+                                old_data + e->offset, e->length);
+        }
+        free(old_data);
+        free(old_index);
+    }
+    pthread_mutex_unlock(&logger_mutex);
+}
 
-    n = logger->memory_logs_count;
-    collected = 0;
-    /* Walk newest -> oldest across the whole ring, keep up to max_entries
-     * matching the minimum level. */
-    for (k = 1; k <= n && collected < max_entries; k++) {
-        idx = (logger->memory_logs_start + n - k) % 1000;
-        if (logger_parse_line_level(logger->memory_logs[idx]) >= min_level) {
-            strncpy(logs[collected], logger->memory_logs[idx], 511);
-            logs[collected][511] = '\0';
-            collected++;
+/* The seqs of the newest max messages at min_level or above, and in
+ * category unless that is -1, newest first. Following the category's links
+ * when there is one, otherwise merging the links of each level wanted. */
+static int logger_memory_select(int min_level, int category,
+                                unsigned long long* seqs, int max) {
+    unsigned long long cursor[LOG_LEVEL_ERROR + 1];
+    const struct logger_memory_entry* e;
+    unsigned long long seq;
+    int n = 0, level, newest;
+
+    if (category >= 0) {
+        seq = memory_log.category_last[category];
+        while (n < max && logger_memory_live(seq)) {
+            e = logger_memory_entry(seq);
+            if (e->level >= min_level) {
+                seqs[n++] = seq;
+            }
+            seq = e->prev_category != 0 ? seq - e->prev_category : 0;
         }
+        return n;
     }
-    /* Collected newest-first; reverse to oldest-first to match the other API. */
-    for (a = 0, b = collected - 1; a < b; a++, b--) {
-        memcpy(tmp, logs[a], 512);
-        memcpy(logs[a], logs[b], 512);
-        memcpy(logs[b], tmp, 512);
+
+    for (level = 0; level <= LOG_LEVEL_ERROR; level++) {
+        cursor[level] = level >= min_level && logger_memory_live(memory_log.level_last[level]) ?
+            memory_log.level_last[level] : 0;
     }
+    while (n < max) {
+        newest = -1;
+        for (level = min_level; level <= LOG_LEVEL_ERROR; level++) {
+            if (cursor[level] != 0 &&
+                (newest < 0 || cursor[level] > cursor[newest])) {
+                newest = level;
+            }
+        }
+        if (newest < 0) {
+            break;
+        }
+        seq = cursor[newest];
+        seqs[n++] = seq;
+        e = logger_memory_entry(seq);
+        seq = e->prev_level != 0 ? seq - e->prev_level : 0;
+        cursor[newest] = logger_memory_live(seq) ? seq : 0;
+    }
+    return n;
+}
 
+/* A stored message as text: binary records are rendered, lines copied */
+static void logger_memory_text(const struct logger_memory_entry* e,
+                               char* out, size_t out_size) {
+    const unsigned char* data = memory_log.data + e->offset;
+    size_t len = e->length;
+
+    if (log_record_length(data, len) > 0) {
+        if (log_record_render(data, len, logger_lookup_format, NULL,
+                              out, out_size) < 0) {
+            snprintf(out, out_size, "[unreadable log record]");
+        }
+        return;
+    }
+    if (len > out_size - 1) {
+        len = out_size - 1;
+    }
+    memcpy(out, data, len);
+    out[len] = '\0';
+}
+
+/* Copy out the newest max_entries messages matching, oldest first: into
+ * entries when it is not NULL, otherwise just their text into logs. */
+static int logger_memory_read(log_level_t min_level, const char* category,
+                              int max_entries, char logs[][512],
+                              logger_entry_t* entries) {
+    unsigned long long* seqs;
+    int i, n, category_id = -1;
+
+    if (max_entries <= 0 || (logs == NULL && entries == NULL)) {
+        return 0;
+    }
+    seqs = (unsigned long long*)malloc((size_t)max_entries * sizeof(*seqs));
+    if (seqs == NULL) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&logger_mutex);
+    n = 0;
+    if (category != NULL && category[0] != '\0') {
+        category_id = logger_memory_category(category, 0);
+    }
+    if (memory_log.count > 0 && (category == NULL || category[0] == '\0' || category_id >= 0)) {
+        if (min_level < LOG_LEVEL_VERBOSE) {
+            min_level = LOG_LEVEL_VERBOSE;
+        }
+        n = logger_memory_select((int)min_level, category_id, seqs, max_entries);
+    }
+    for (i = 0; i < n; i++) {
+        const struct logger_memory_entry* e = logger_memory_entry(seqs[n - 1 - i]);
+        if (entries != NULL) {
+            entries[i].level = (log_level_t)e->level;
+            entries[i].time_ms = (long long)e->time_ms;
+            entries[i].category[0] = '\0';
+            if (e->category != 0) {
+                strncat(entries[i].category, memory_log.categories[e->category],
+                        sizeof(entries[i].category) - 1);
+            }
+            logger_memory_text(e, entries[i].text, sizeof(entries[i].text));
+        } else {
+            logger_memory_text(e, logs[i], sizeof(logs[i]));
+        }
+    }
     pthread_mutex_unlock(&logger_mutex);
 
-    return collected;
+    free(seqs);
+    return n;
+}
+
+/* The newest max_entries messages, oldest first */
+int logger_get_recent_logs(char logs[][512], int max_entries) {
+    return logger_memory_read(LOG_LEVEL_VERBOSE, NULL, max_entries, logs, NULL);
+}
+
+int logger_get_recent_logs_min_level(char logs[][512], int max_entries, log_level_t min_level) {
+    return logger_memory_read(min_level, NULL, max_entries, logs, NULL);
+}
+
+int logger_get_recent_entries(logger_entry_t* entries, int max_entries,
+                              log_level_t min_level, const char* category) {
+    return logger_memory_read(min_level, category, max_entries, NULL, entries);
 }
 
 /* Convenience methods */
@@ -648,7 +1402,9 @@ void logger_error_with_category(const char* category, const char* message) {
 static void logger_vlogf(log_level_t level, const char* category, const char* format, va_list args) {
     char buffer[512];
     
-    if (format == NULL) {
+    /* Callers through the logger.h macros have checked already; this is for
+     * the ones that reach the functions directly */
+    if (format == NULL || !LOGGER_ENABLED(level, category)) {
         return;
     }
     
@@ -661,6 +1417,89 @@ static void logger_vlogf(log_level_t level, const char* category, const char* fo
     }
 }
 
+/* Give `site` its format's dictionary id, registering the format if this is
+ * the site's first message. A format the records cannot carry, or one past
+ * LOGGER_MAX_FORMATS, leaves the site logging TEXT. */
+static unsigned logger_register_site(struct logger_site* site,
+                                     const char* category, const char* format) {
+    unsigned char scratch[LOG_RECORD_MAX];
+    struct logger_format* f;
+    unsigned id, count;
+
+    pthread_mutex_lock(&logger_format_mutex);
+    id = site->id;
+    if (id == 0) {
+        id = LOGGER_SITE_TEXT;
+        count = logger_format_count;
+        f = (struct logger_format*)malloc(sizeof(*f));
+        if (f != NULL && count < LOGGER_MAX_FORMATS &&
+            (f->nargs = log_format_parse(format, f->types, LOG_RECORD_MAX_ARGS)) >= 0 &&
+            log_record_format(scratch, sizeof(scratch), count, category, format) > 0) {
+            f->format = format;
+            f->category = category;
+            logger_formats[count] = f;
+            __atomic_store_n(&logger_format_count, count + 1, __ATOMIC_RELEASE);
+            id = count + 1;
+        } else {
+            free(f);
+        }
+        __atomic_store_n(&site->id, id, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&logger_format_mutex);
+    return id;
+}
+
+/* Binary logging of a printf-style call: the site's format id and the raw
+ * arguments, no formatting. Falls back to formatting a TEXT record for a
+ * site that cannot be encoded, or one called with a different category than
+ * it was registered with. */
+static void logger_binary_vlogf(struct logger_site* site, log_level_t level,
+                                const char* category, const char* format,
+                                va_list args) {
+    unsigned id = __atomic_load_n(&site->id, __ATOMIC_ACQUIRE);
+
+    if (id == 0) {
+        id = logger_register_site(site, category, format);
+    }
+    if (id != LOGGER_SITE_TEXT) {
+        const struct logger_format* f = logger_formats[id - 1];
+        int same_category = f->category == category ||
+            (f->category != NULL && category != NULL &&
+             strcmp(f->category, category) == 0);
+
+        if (f->format == format && same_category) {
+            unsigned char record[LOGGER_RECORD_MAX];
+            size_t len;
+            va_list encode_args;
+
+            /* The encoder consumes what it reads; the TEXT fallback below
+             * must start from the untouched list */
+            va_copy(encode_args, args);
+            len = log_record_event(record, sizeof(record), id - 1, level,
+                                   logger_now_ns(), f->types, f->nargs, encode_args);
+            va_end(encode_args);
+            if (len > 0) {
+                logger_write_record(level, category, record, len);
+                return;
+            }
+        }
+    }
+    logger_vlogf(level, category, format, args);
+}
+
+void logger_site_logf(struct logger_site* site, log_level_t level,
+                      const char* category, const char* format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    if (__atomic_load_n(&logger_binary, __ATOMIC_RELAXED) && site != NULL) {
+        logger_binary_vlogf(site, level, category, format, args);
+    } else {
+        logger_vlogf(level, category, format, args);
+    }
+    va_end(args);
+}
+
 /* Printf-style logging methods */
 void logger_logf(log_level_t level, const char* format, ...) {
     va_list args;
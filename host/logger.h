@@ -27,11 +27,6 @@ typedef struct {
     long max_file_size;     /* Max bytes before rotation (0 = disabled) */
     int max_rotated_files;  /* Number of rotated files to keep */
     long current_file_size; /* Approximate bytes written to current file */
-
-    /* In-memory log storage */
-    char memory_logs[1000][512];  /* Fixed size array for C89 */
-    int memory_logs_count;
-    int memory_logs_start;  /* For circular buffer behavior */
 } logger_data_t;
 
 /* Global logger instance */
@@ -45,6 +40,19 @@ void logger_set_log_to_console(int enable);
 void logger_set_log_to_file(int enable);
 void logger_set_rotation(long max_file_size, int max_rotated_files);
 
+/* Text logging formats every message as it is logged. Binary logging
+ * (logging.format=binary) stores printf-style messages as a format id plus
+ * the raw arguments, and formats them only when they are read: by
+ * logger_get_recent_logs() for /api/logs, or by millennium-logcat from the
+ * file. Only WARN and above still go to the console. See log_record.h.
+ * Set it before logger_set_log_file(); the file is written in one format. */
+typedef enum {
+    LOG_FORMAT_TEXT = 0,
+    LOG_FORMAT_BINARY = 1
+} log_format_t;
+
+void logger_set_log_format(log_format_t format);
+
 /* Asynchronous file writer control (issue #123). File output is drained to
  * disk by a dedicated writer thread so a slow log target never blocks a thread
  * that logs. logger_flush() blocks until the queue is on disk; logger_shutdown()
@@ -63,10 +71,41 @@ typedef struct {
     unsigned long high_water;          /* max depth observed since start */
     unsigned long capacity;            /* queue size; drops begin at this depth */
     unsigned long long dropped_total;  /* cumulative lines dropped since start */
+    unsigned long long batches_total;  /* batched writes since start */
+    unsigned long long syncs_total;    /* fdatasync()s since start */
 } logger_queue_stats_t;
 
 void logger_get_queue_stats(logger_queue_stats_t* out);
 
+/* The writer takes every queued line at once and writes the batch with
+ * writev(). Whether it then fdatasync()s the file is the sync policy:
+ *
+ *     LOG_SYNC_NONE      never; the kernel writes back when it likes
+ *     LOG_SYNC_BATCH     after every batch
+ *     LOG_SYNC_INTERVAL  at most every interval_ms, and when the writer goes
+ *                        idle with unsynced lines older than that
+ *     LOG_SYNC_ERROR     after a batch holding an ERROR (the default), so
+ *                        the line that explains a crash survives the power
+ *                        cut. WARN does not count: a batch of WARN and
+ *                        lower lines is left to the kernel like any other.
+ *
+ * (logging.sync / logging.sync_interval_ms in the config). */
+typedef enum {
+    LOG_SYNC_NONE = 0,
+    LOG_SYNC_BATCH,
+    LOG_SYNC_INTERVAL,
+    LOG_SYNC_ERROR
+} log_sync_t;
+
+void logger_set_sync_policy(log_sync_t policy, long interval_ms);
+
+/* Called by the writer thread after each batch with its size and how long
+ * the write (and any sync) took, for the daemon to publish as histograms
+ * without the logger depending on metrics. NULL to stop. */
+typedef void (*logger_batch_observer_t)(unsigned long lines, size_t bytes,
+                                        double milliseconds);
+void logger_set_batch_observer(logger_batch_observer_t observer);
+
 /* Logging methods */
 void logger_log(log_level_t level, const char* message);
 void logger_log_with_category(log_level_t level, const char* category, const char* message);
@@ -105,18 +144,169 @@ void logger_errorf_with_category(const char* category, const char* format, ...);
 log_level_t logger_parse_level(const char* level_str);
 const char* logger_level_to_string(log_level_t level);
 
-/* In-memory log storage */
+/* In-memory log storage. The most recent messages are kept in a ring of
+ * logger_set_memory_size() bytes, packed end to end as they were logged (a
+ * text line, or a binary record), so how many it holds depends on their
+ * length. A side index of each one's level, category and time answers the
+ * filtered queries below without looking at the messages themselves. */
+#define LOGGER_MEMORY_BYTES_DEFAULT (128 * 1024)
+
+/* Resize the ring, keeping as many of the newest messages as fit
+ * (logging.memory_bytes). Smaller than a few KB is raised to that. */
+void logger_set_memory_size(size_t bytes);
+
 int logger_get_recent_logs(char logs[][512], int max_entries);
-/* Newest entries whose level is >= min_level, scanning the full ring buffer
- * (so INFO+ events surface even when DEBUG output floods the recent window).
- * Returns them oldest-first, like logger_get_recent_logs. */
+/* Newest entries whose level is >= min_level, from the whole ring (so INFO+
+ * events surface even when DEBUG output floods the recent window). Returns
+ * them oldest-first, like logger_get_recent_logs. */
 int logger_get_recent_logs_min_level(char logs[][512], int max_entries, log_level_t min_level);
 
+/* One message from the ring, as text, with what the index knows about it */
+typedef struct {
+    log_level_t level;
+    char category[32];        /* "" for none */
+    long long time_ms;        /* when it was logged, ms since the epoch */
+    char text[512];
+} logger_entry_t;
+
+/* Like logger_get_recent_logs_min_level, further limited to one category
+ * when `category` is not NULL. Costs the number of messages at those levels
+ * (or in that category), not the size of the ring. */
+int logger_get_recent_entries(logger_entry_t* entries, int max_entries,
+                              log_level_t min_level, const char* category);
+
 /* Internal functions */
 void logger_write_log(log_level_t level, const char* category, const char* message);
 void logger_format_timestamp(char* buffer, size_t buffer_size);
 const char* logger_format_level(log_level_t level);
-void logger_add_to_memory(const char* formatted_message);
+void logger_add_to_memory(log_level_t level, const char* category,
+                          const char* formatted_message);
+
+/* Per-category level overrides: log `category` at `level` whatever the
+ * global level, e.g. DEBUG for "SDK" alone while everything else stays at
+ * INFO. logger_clear_category_level() returns it to the global level. Up to
+ * LOGGER_MAX_CATEGORY_LEVELS categories; names are matched exactly. */
+#define LOGGER_MAX_CATEGORY_LEVELS 16
+int logger_set_category_level(const char* category, log_level_t level);
+void logger_clear_category_level(const char* category);
+
+/* Whether a message at `level` in `category` (NULL for none) would be
+ * logged. The LOGGER_ENABLED macro below is the cheap way to ask. */
+int logger_category_enabled(log_level_t level, const char* category);
+
+/* Lowest level that can be logged at all: the global level, or a lower
+ * category override. Kept up to date by the set_level calls. */
+extern int logger_floor;
+
+/*
+ * Level gating.
+ *
+ * A disabled message costs nothing but the check: the logging calls below
+ * are macros that test the level first and only then call the function, so
+ * neither the formatting nor the arguments -- an event_format_repr(), a
+ * metrics lookup -- are evaluated for a level that is off. The test is one
+ * load and compare against logger_floor; only a message at or above it goes
+ * on to look up its category.
+ *
+ * LOG_MIN_LEVEL is the compile-time floor: calls below it are constant-false
+ * and compile away entirely, e.g. for a release build of the daemon
+ *
+ *     make daemon LOG_MIN_LEVEL=LOG_LEVEL_INFO
+ *
+ * A category argument is evaluated twice, so pass a plain string.
+ */
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_VERBOSE
+#endif
+
+#define LOGGER_ENABLED(level, category) \
+    ((int)(level) >= (int)(LOG_MIN_LEVEL) && \
+     (int)(level) >= __atomic_load_n(&logger_floor, __ATOMIC_RELAXED) && \
+     logger_category_enabled((level), (category)))
+
+/* A printf-style call site: the id its format string was given in the
+ * binary log's dictionary, 0 until its first message in binary mode. The
+ * macros below give each call its own static one. Binary logging reads each
+ * argument as the type its conversion names, so the compiler checks them. */
+struct logger_site {
+    unsigned id;
+};
+
+void logger_site_logf(struct logger_site* site, log_level_t level,
+                      const char* category, const char* format, ...)
+    __attribute__((format(printf, 4, 5)));
+
+/* logger.c defines the functions themselves, so it does without the macros */
+#ifndef LOGGER_IMPLEMENTATION
+
+#define LOGGER_GATED(level, category, call) do { \
+    if (LOGGER_ENABLED((level), (category))) call; \
+} while (0)
+
+/* The printf-style calls go through the call site's logger_site. Pasting ""
+ * in front of the arguments makes a format that is not a string literal a
+ * compile error: the site's id stands for that one string. */
+#define LOGGER_GATED_F(level, category, ...) do { \
+    if (LOGGER_ENABLED((level), (category))) { \
+        static struct logger_site logger_site_; \
+        logger_site_logf(&logger_site_, (level), (category), "" __VA_ARGS__); \
+    } \
+} while (0)
+
+#define logger_log(level, message) \
+    LOGGER_GATED((level), NULL, (logger_log)((level), (message)))
+#define logger_log_with_category(level, category, message) \
+    LOGGER_GATED((level), (category), (logger_log_with_category)((level), (category), (message)))
+#define logger_logf(level, ...) \
+    LOGGER_GATED_F((level), NULL, __VA_ARGS__)
+#define logger_logf_with_category(level, category, ...) \
+    LOGGER_GATED_F((level), (category), __VA_ARGS__)
+
+#define logger_verbose(message) \
+    LOGGER_GATED(LOG_LEVEL_VERBOSE, NULL, (logger_verbose)(message))
+#define logger_debug(message) \
+    LOGGER_GATED(LOG_LEVEL_DEBUG, NULL, (logger_debug)(message))
+#define logger_info(message) \
+    LOGGER_GATED(LOG_LEVEL_INFO, NULL, (logger_info)(message))
+#define logger_warn(message) \
+    LOGGER_GATED(LOG_LEVEL_WARN, NULL, (logger_warn)(message))
+#define logger_error(message) \
+    LOGGER_GATED(LOG_LEVEL_ERROR, NULL, (logger_error)(message))
+
+#define logger_verbose_with_category(category, message) \
+    LOGGER_GATED(LOG_LEVEL_VERBOSE, (category), (logger_verbose_with_category)((category), (message)))
+#define logger_debug_with_category(category, message) \
+    LOGGER_GATED(LOG_LEVEL_DEBUG, (category), (logger_debug_with_category)((category), (message)))
+#define logger_info_with_category(category, message) \
+    LOGGER_GATED(LOG_LEVEL_INFO, (category), (logger_info_with_category)((category), (message)))
+#define logger_warn_with_category(category, message) \
+    LOGGER_GATED(LOG_LEVEL_WARN, (category), (logger_warn_with_category)((category), (message)))
+#define logger_error_with_category(category, message) \
+    LOGGER_GATED(LOG_LEVEL_ERROR, (category), (logger_error_with_category)((category), (message)))
+
+#define logger_verbosef(...) \
+    LOGGER_GATED_F(LOG_LEVEL_VERBOSE, NULL, __VA_ARGS__)
+#define logger_debugf(...) \
+    LOGGER_GATED_F(LOG_LEVEL_DEBUG, NULL, __VA_ARGS__)
+#define logger_infof(...) \
+    LOGGER_GATED_F(LOG_LEVEL_INFO, NULL, __VA_ARGS__)
+#define logger_warnf(...) \
+    LOGGER_GATED_F(LOG_LEVEL_WARN, NULL, __VA_ARGS__)
+#define logger_errorf(...) \
+    LOGGER_GATED_F(LOG_LEVEL_ERROR, NULL, __VA_ARGS__)
+
+#define logger_verbosef_with_category(category, ...) \
+    LOGGER_GATED_F(LOG_LEVEL_VERBOSE, (category), __VA_ARGS__)
+#define logger_debugf_with_category(category, ...) \
+    LOGGER_GATED_F(LOG_LEVEL_DEBUG, (category), __VA_ARGS__)
+#define logger_infof_with_category(category, ...) \
+    LOGGER_GATED_F(LOG_LEVEL_INFO, (category), __VA_ARGS__)
+#define logger_warnf_with_category(category, ...) \
+    LOGGER_GATED_F(LOG_LEVEL_WARN, (category), __VA_ARGS__)
+#define logger_errorf_with_category(category, ...) \
+    LOGGER_GATED_F(LOG_LEVEL_ERROR, (category), __VA_ARGS__)
+
+#endif /* LOGGER_IMPLEMENTATION */
 
 /* C89 compatible macros for structured logging */
 #define LOG_VERBOSE(...) logger_verbosef(__VA_ARGS__)
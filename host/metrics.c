@@ -14,8 +14,87 @@
 /* Global metrics instance */
 metrics_t *g_metrics = NULL;
 
+/* Guards the registry -- the metric arrays and the name index -- and
+ * nothing else. Metric values are all atomics, so an update never waits on
+ * a registration or a scrape. */
 static pthread_mutex_t metrics_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/* Counter shard of the calling thread; see METRICS_SHARDS. */
+static unsigned metrics_shard_next = 0;
+static __thread int metrics_shard = -1;
+
+static int my_shard(void) {
+    if (metrics_shard < 0) {
+        metrics_shard = (int)(__atomic_fetch_add(&metrics_shard_next, 1,
+                                                 __ATOMIC_RELAXED) % METRICS_SHARDS);
+    }
+    return metrics_shard;
+}
+
+static void counter_add(metrics_counter_t *counter, uint64_t amount) {
+    __atomic_fetch_add(&counter->shards[my_shard()].value, amount, __ATOMIC_RELAXED);
+}
+
+static uint64_t counter_sum(metrics_counter_t *counter) {
+    uint64_t sum = 0;
+    int i;
+    for (i = 0; i < METRICS_SHARDS; i++) {
+        sum += __atomic_load_n(&counter->shards[i].value, __ATOMIC_RELAXED);
+    }
+    return sum;
+}
+
+/* Not atomic across shards: an add racing a reset may survive it. */
+static void counter_zero(metrics_counter_t *counter) {
+    int i;
+    for (i = 0; i < METRICS_SHARDS; i++) {
+        __atomic_store_n(&counter->shards[i].value, 0, __ATOMIC_RELAXED);
+    }
+    counter->last_reset = time(NULL);
+}
+
+/* Doubles that are updated without a lock live in a uint64_t as their bit
+ * pattern, so they can be loaded, stored and compare-exchanged whole. */
+static double double_load(uint64_t *bits) {
+    uint64_t raw = __atomic_load_n(bits, __ATOMIC_RELAXED);
+    double value;
+    memcpy(&value, &raw, sizeof(value));
+    return value;
+}
+
+static void double_store(uint64_t *bits, double value) {
+    uint64_t raw;
+    memcpy(&raw, &value, sizeof(raw));
+    __atomic_store_n(bits, raw, __ATOMIC_RELAXED);
+}
+
+static void double_add(uint64_t *bits, double amount) {
+    uint64_t old_raw = __atomic_load_n(bits, __ATOMIC_RELAXED);
+    uint64_t new_raw;
+    double value;
+
+    do {
+        memcpy(&value, &old_raw, sizeof(value));
+        value += amount;
+        memcpy(&new_raw, &value, sizeof(new_raw));
+    } while (!__atomic_compare_exchange_n(bits, &old_raw, new_raw, 1,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/* Lower (sign < 0) or raise (sign > 0) *bits to value if that is further. */
+static void double_extend(uint64_t *bits, double value, int sign) {
+    uint64_t old_raw = __atomic_load_n(bits, __ATOMIC_RELAXED);
+    uint64_t new_raw;
+    double current;
+
+    memcpy(&new_raw, &value, sizeof(new_raw));
+    do {
+        memcpy(&current, &old_raw, sizeof(current));
+        if (sign < 0 ? !(value < current) : !(value > current)) return;
+    } while (!__atomic_compare_exchange_n(bits, &old_raw, new_raw, 1,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
 /* C89-compatible strdup implementation */
 static char *my_strdup(const char *s) {
     size_t len;
@@ -31,465 +110,775 @@ static char *my_strdup(const char *s) {
     return copy;
 }
 
-/* Helper function to find counter index by name */
-static int find_counter_index(const char *name) {
-    int i;
-    for (i = 0; i < (int)g_metrics->counter_count; i++) {
-        if (strcmp(g_metrics->counter_names[i], name) == 0) {
-            return i;
+#define METRICS_KIND_COUNTER   1
+#define METRICS_KIND_GAUGE     2
+#define METRICS_KIND_HISTOGRAM 3
+
+#define METRICS_INDEX_INITIAL_CAPACITY 64
+
+/* Which metrics_init() the live registry came from, so a metrics_ref_t
+ * resolved against an earlier one is looked up again: 0 while metrics are
+ * down, and never the same nonzero value twice. Written under metrics_mutex. */
+static unsigned metrics_generation = 0;
+static unsigned metrics_generation_last = 0;
+
+/* Bumped whenever the set of series changes -- a registration or a new
+ * registry -- so a cached exposition template knows it is stale. Never 0.
+ * Written under metrics_mutex, read without it. */
+static unsigned metrics_layout = 0;
+
+static void exposition_cleanup(void);
+
+static void layout_changed(void) {
+    unsigned next = metrics_layout + 1;
+    if (next == 0) next = 1;
+    __atomic_store_n(&metrics_layout, next, __ATOMIC_RELEASE);
+}
+
+/* FNV-1a over the name and, for a labelled series, '{' and the labels:
+ * short keys, no need for anything stronger. */
+static uint32_t metrics_hash(const char *name, const char *labels) {
+    uint32_t hash = 2166136261u;
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    if (labels) {
+        hash ^= (unsigned char)'{';
+        hash *= 16777619u;
+        while (*labels) {
+            hash ^= (unsigned char)*labels++;
+            hash *= 16777619u;
         }
     }
-    return -1;
+    return hash;
 }
 
-/* Helper function to find gauge index by name */
-static int find_gauge_index(const char *name) {
-    int i;
-    for (i = 0; i < (int)g_metrics->gauge_count; i++) {
-        if (strcmp(g_metrics->gauge_names[i], name) == 0) {
-            return i;
+static int labels_equal(const char *a, const char *b) {
+    if (!a || !b) return a == b;
+    return strcmp(a, b) == 0;
+}
+
+/* The slot holding (kind, name, labels), or the empty slot where it would
+ * go. The table is never full (see index_insert), so the probe always ends. */
+static struct metrics_slot *index_probe(struct metrics_slot *slots, size_t capacity,
+                                        int kind, const char *name, const char *labels,
+                                        uint32_t hash) {
+    size_t mask = capacity - 1;
+    size_t i = hash & mask;
+
+    while (slots[i].kind != 0) {
+        if (slots[i].hash == hash && slots[i].kind == kind &&
+            strcmp(slots[i].name, name) == 0 && labels_equal(slots[i].labels, labels)) {
+            return &slots[i];
         }
+        i = (i + 1) & mask;
     }
-    return -1;
+    return &slots[i];
 }
 
-/* Helper function to find histogram index by name */
-static int find_histogram_index(const char *name) {
-    int i;
-    for (i = 0; i < (int)g_metrics->histogram_count; i++) {
-        if (strcmp(g_metrics->histogram_names[i], name) == 0) {
-            return i;
+/* Helper function to find a series of the given kind by name and labels */
+static void *index_find(int kind, const char *name, const char *labels) {
+    struct metrics_slot *slot;
+
+    if (!g_metrics->index) return NULL;
+    slot = index_probe(g_metrics->index, g_metrics->index_capacity,
+                       kind, name, labels, metrics_hash(name, labels));
+    return slot->kind ? slot->metric : NULL;
+}
+
+/* Helper function to index a new series, doubling the table to keep it at
+ * most three-quarters full. `name` and `labels` must be the metric's own
+ * copies. */
+static int index_insert(int kind, const char *name, const char *labels, void *metric) {
+    struct metrics_slot *slot;
+    uint32_t hash;
+
+    if ((g_metrics->index_used + 1) * 4 > g_metrics->index_capacity * 3) {
+        size_t new_capacity = g_metrics->index_capacity * 2;
+        struct metrics_slot *new_slots;
+        size_t i;
+        if (new_capacity == 0) new_capacity = METRICS_INDEX_INITIAL_CAPACITY;
+
+        new_slots = calloc(new_capacity, sizeof(struct metrics_slot));
+        if (!new_slots) return -1;
+
+        for (i = 0; i < g_metrics->index_capacity; i++) {
+            struct metrics_slot *old = &g_metrics->index[i];
+            if (old->kind != 0) {
+                *index_probe(new_slots, new_capacity,
+                             old->kind, old->name, old->labels, old->hash) = *old;
+            }
         }
+        free(g_metrics->index);
+        g_metrics->index = new_slots;
+        g_metrics->index_capacity = new_capacity;
     }
-    return -1;
+
+    hash = metrics_hash(name, labels);
+    slot = index_probe(g_metrics->index, g_metrics->index_capacity, kind, name, labels, hash);
+    slot->hash = hash;
+    slot->kind = kind;
+    slot->name = name;
+    slot->labels = labels;
+    slot->metric = metric;
+    g_metrics->index_used++;
+    return 0;
+}
+
+static metrics_counter_t *find_counter(const char *name, const char *labels) {
+    return index_find(METRICS_KIND_COUNTER, name, labels);
+}
+
+static metrics_gauge_t *find_gauge(const char *name, const char *labels) {
+    return index_find(METRICS_KIND_GAUGE, name, labels);
+}
+
+static metrics_histogram_t *find_histogram(const char *name, const char *labels) {
+    return index_find(METRICS_KIND_HISTOGRAM, name, labels);
 }
 
 /* Helper function to add a counter */
-static int add_counter(const char *name) {
-    int index;
+static metrics_counter_t *add_counter(const char *name, const char *labels) {
+    metrics_counter_t *counter;
+    void *mem;
     if (g_metrics->counter_count >= g_metrics->counter_capacity) {
         size_t new_capacity = g_metrics->counter_capacity * 2;
-        metrics_counter_t *new_counters;
-        char **new_names;
+        metrics_counter_t **new_counters;
         if (new_capacity == 0) new_capacity = 16;
 
         new_counters = realloc(g_metrics->counters,
-            new_capacity * sizeof(metrics_counter_t));
-        if (!new_counters) return -1;
-
-        new_names = realloc(g_metrics->counter_names,
-            new_capacity * sizeof(char*));
-        if (!new_names) {
-            free(new_counters);
-            return -1;
-        }
+            new_capacity * sizeof(metrics_counter_t *));
+        if (!new_counters) return NULL;
 
         g_metrics->counters = new_counters;
-        g_metrics->counter_names = new_names;
         g_metrics->counter_capacity = new_capacity;
     }
 
-    index = (int)g_metrics->counter_count;
-    g_metrics->counter_names[index] = my_strdup(name);
-    if (!g_metrics->counter_names[index]) return -1;
+    if (posix_memalign(&mem, METRICS_CACHE_LINE, sizeof(metrics_counter_t)) != 0) return NULL;
+    counter = mem;
+    memset(counter, 0, sizeof(metrics_counter_t));
+    counter->name = my_strdup(name);
+    counter->labels = my_strdup(labels);
+    counter->sanitized = metrics_sanitize_name(name);
+    if (!counter->name || (labels && !counter->labels) || !counter->sanitized ||
+        index_insert(METRICS_KIND_COUNTER, counter->name, counter->labels, counter) != 0) {
+        free(counter->name);
+        free(counter->labels);
+        free(counter->sanitized);
+        free(counter);
+        return NULL;
+    }
     
-    g_metrics->counters[index].value = 0;
-    g_metrics->counters[index].last_reset = time(NULL);
+    counter->last_reset = time(NULL);
     
-    g_metrics->counter_count++;
-    return index;
+    g_metrics->counters[g_metrics->counter_count++] = counter;
+    layout_changed();
+    return counter;
 }
 
 /* Helper function to add a gauge */
-static int add_gauge(const char *name) {
-    int index;
+static metrics_gauge_t *add_gauge(const char *name, const char *labels) {
+    metrics_gauge_t *gauge;
+    void *mem;
     if (g_metrics->gauge_count >= g_metrics->gauge_capacity) {
         size_t new_capacity = g_metrics->gauge_capacity * 2;
-        metrics_gauge_t *new_gauges;
-        char **new_names;
+        metrics_gauge_t **new_gauges;
         if (new_capacity == 0) new_capacity = 16;
 
         new_gauges = realloc(g_metrics->gauges,
-            new_capacity * sizeof(metrics_gauge_t));
-        if (!new_gauges) return -1;
-
-        new_names = realloc(g_metrics->gauge_names,
-            new_capacity * sizeof(char*));
-        if (!new_names) {
-            free(new_gauges);
-            return -1;
-        }
+            new_capacity * sizeof(metrics_gauge_t *));
+        if (!new_gauges) return NULL;
 
         g_metrics->gauges = new_gauges;
-        g_metrics->gauge_names = new_names;
         g_metrics->gauge_capacity = new_capacity;
     }
 
-    index = (int)g_metrics->gauge_count;
-    g_metrics->gauge_names[index] = my_strdup(name);
-    if (!g_metrics->gauge_names[index]) return -1;
-    
-    g_metrics->gauges[index].value = 0.0;
-    g_metrics->gauges[index].last_update = time(NULL);
+    if (posix_memalign(&mem, METRICS_CACHE_LINE, sizeof(metrics_gauge_t)) != 0) return NULL;
+    gauge = mem;
+    memset(gauge, 0, sizeof(metrics_gauge_t));  /* all-zero bits are 0.0 */
+    gauge->name = my_strdup(name);
+    gauge->labels = my_strdup(labels);
+    gauge->sanitized = metrics_sanitize_name(name);
+    if (!gauge->name || (labels && !gauge->labels) || !gauge->sanitized ||
+        index_insert(METRICS_KIND_GAUGE, gauge->name, gauge->labels, gauge) != 0) {
+        free(gauge->name);
+        free(gauge->labels);
+        free(gauge->sanitized);
+        free(gauge);
+        return NULL;
+    }
     
-    g_metrics->gauge_count++;
-    return index;
+    g_metrics->gauges[g_metrics->gauge_count++] = gauge;
+    layout_changed();
+    return gauge;
+}
+
+/* Not atomic as a whole: an observation racing a reset may partly survive. */
+static void histogram_clear(metrics_histogram_t *hist) {
+    int i;
+    for (i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+        __atomic_store_n(&hist->buckets[i], 0, __ATOMIC_RELAXED);
+    }
+    double_store(&hist->sum_bits, 0.0);
+    double_store(&hist->min_bits, DBL_MAX);
+    double_store(&hist->max_bits, -DBL_MAX);
 }
 
 /* Helper function to add a histogram */
-static int add_histogram(const char *name) {
-    int index;
+static metrics_histogram_t *add_histogram(const char *name, const char *labels) {
+    metrics_histogram_t *hist;
     if (g_metrics->histogram_count >= g_metrics->histogram_capacity) {
         size_t new_capacity = g_metrics->histogram_capacity * 2;
-        metrics_histogram_t *new_histograms;
-        char **new_names;
+        metrics_histogram_t **new_histograms;
         if (new_capacity == 0) new_capacity = 16;
 
         new_histograms = realloc(g_metrics->histograms,
-            new_capacity * sizeof(metrics_histogram_t));
-        if (!new_histograms) return -1;
-
-        new_names = realloc(g_metrics->histogram_names,
-            new_capacity * sizeof(char*));
-        if (!new_names) {
-            free(new_histograms);
-            return -1;
-        }
+            new_capacity * sizeof(metrics_histogram_t *));
+        if (!new_histograms) return NULL;
 
         g_metrics->histograms = new_histograms;
-        g_metrics->histogram_names = new_names;
         g_metrics->histogram_capacity = new_capacity;
     }
 
-    index = (int)g_metrics->histogram_count;
-    g_metrics->histogram_names[index] = my_strdup(name);
-    if (!g_metrics->histogram_names[index]) return -1;
+    hist = malloc(sizeof(metrics_histogram_t));
+    if (!hist) return NULL;
+    hist->name = my_strdup(name);
+    hist->labels = my_strdup(labels);
+    hist->sanitized = metrics_sanitize_name(name);
+    if (!hist->name || (labels && !hist->labels) || !hist->sanitized ||
+        index_insert(METRICS_KIND_HISTOGRAM, hist->name, hist->labels, hist) != 0) {
+        free(hist->name);
+        free(hist->labels);
+        free(hist->sanitized);
+        free(hist);
+        return NULL;
+    }
     
-    g_metrics->histograms[index].values = NULL;
-    g_metrics->histograms[index].values_size = 0;
-    g_metrics->histograms[index].values_capacity = 0;
-    g_metrics->histograms[index].count = 0;
-    g_metrics->histograms[index].sum = 0.0;
-    g_metrics->histograms[index].min_value = DBL_MAX;
-    g_metrics->histograms[index].max_value = -DBL_MAX;
+    histogram_clear(hist);
     
-    g_metrics->histogram_count++;
-    return index;
+    g_metrics->histograms[g_metrics->histogram_count++] = hist;
+    layout_changed();
+    return hist;
 }
 
-/* Simple comparison function for qsort */
-static int compare_doubles(const void *a, const void *b) {
-    double da = *(const double*)a;
-    double db = *(const double*)b;
-    if (da < db) return -1;
-    if (da > db) return 1;
-    return 0;
+static metrics_counter_t *find_or_add_counter(const char *name, const char *labels) {
+    metrics_counter_t *counter = find_counter(name, labels);
+    return counter ? counter : add_counter(name, labels);
+}
+
+static metrics_gauge_t *find_or_add_gauge(const char *name, const char *labels) {
+    metrics_gauge_t *gauge = find_gauge(name, labels);
+    return gauge ? gauge : add_gauge(name, labels);
+}
+
+static metrics_histogram_t *find_or_add_histogram(const char *name, const char *labels) {
+    metrics_histogram_t *hist = find_histogram(name, labels);
+    return hist ? hist : add_histogram(name, labels);
 }
 
 int metrics_init(void) {
+    metrics_t *metrics;
+
     if (g_metrics) return 0; /* Already initialized */
     
-    g_metrics = malloc(sizeof(metrics_t));
-    if (!g_metrics) return -1;
+    metrics = malloc(sizeof(metrics_t));
+    if (!metrics) return -1;
     
-    memset(g_metrics, 0, sizeof(metrics_t));
-    g_metrics->start_time = time(NULL);
+    memset(metrics, 0, sizeof(metrics_t));
+    metrics->start_time = time(NULL);
+
+    pthread_mutex_lock(&metrics_mutex);
+    g_metrics = metrics;
+    if (++metrics_generation_last == 0) metrics_generation_last = 1;
+    __atomic_store_n(&metrics_generation, metrics_generation_last, __ATOMIC_RELEASE);
+    layout_changed();
+    pthread_mutex_unlock(&metrics_mutex);
     
     return 0;
 }
 
 void metrics_cleanup(void) {
+    metrics_t *metrics;
     int i;
     
     if (!g_metrics) return;
+
+    pthread_mutex_lock(&metrics_mutex);
+    metrics = g_metrics;
+    g_metrics = NULL;
+    __atomic_store_n(&metrics_generation, 0, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&metrics_mutex);
     
     /* Cleanup counters */
-    for (i = 0; i < (int)g_metrics->counter_count; i++) {
-        free(g_metrics->counter_names[i]);
+    for (i = 0; i < (int)metrics->counter_count; i++) {
+        free(metrics->counters[i]->name);
+        free(metrics->counters[i]->labels);
+        free(metrics->counters[i]->sanitized);
+        free(metrics->counters[i]);
     }
-    free(g_metrics->counters);
-    free(g_metrics->counter_names);
+    free(metrics->counters);
     
     /* Cleanup gauges */
-    for (i = 0; i < (int)g_metrics->gauge_count; i++) {
-        free(g_metrics->gauge_names[i]);
+    for (i = 0; i < (int)metrics->gauge_count; i++) {
+        free(metrics->gauges[i]->name);
+        free(metrics->gauges[i]->labels);
+        free(metrics->gauges[i]->sanitized);
+        free(metrics->gauges[i]);
     }
-    free(g_metrics->gauges);
-    free(g_metrics->gauge_names);
+    free(metrics->gauges);
     
     /* Cleanup histograms */
-    for (i = 0; i < (int)g_metrics->histogram_count; i++) {
-        free(g_metrics->histograms[i].values);
-        free(g_metrics->histogram_names[i]);
+    for (i = 0; i < (int)metrics->histogram_count; i++) {
+        free(metrics->histograms[i]->name);
+        free(metrics->histograms[i]->labels);
+        free(metrics->histograms[i]->sanitized);
+        free(metrics->histograms[i]);
     }
-    free(g_metrics->histograms);
-    free(g_metrics->histogram_names);
-    
-    free(g_metrics);
-    g_metrics = NULL;
+    free(metrics->histograms);
+
+    free(metrics->index);
+    free(metrics);
+
+    /* The cached templates point at the metrics just freed */
+    exposition_cleanup();
 }
 
 metrics_t *metrics_get_instance(void) {
     return g_metrics;
 }
 
+/* Registry lookup for the name-based API: registers the metric if `add`,
+ * and holds metrics_mutex only for the lookup itself. */
+static void *find_series(int kind, const char *name, const char *labels, int add) {
+    switch (kind) {
+        case METRICS_KIND_COUNTER:
+            return add ? find_or_add_counter(name, labels) : find_counter(name, labels);
+        case METRICS_KIND_GAUGE:
+            return add ? find_or_add_gauge(name, labels) : find_gauge(name, labels);
+        case METRICS_KIND_HISTOGRAM:
+            return add ? find_or_add_histogram(name, labels) : find_histogram(name, labels);
+    }
+    return NULL;
+}
+
+/* Registry lookup, registering the series if `add`; holds metrics_mutex
+ * only for the lookup itself. */
+static void *lookup_series(int kind, const char *name, const char *labels, int add) {
+    void *metric = NULL;
+
+    pthread_mutex_lock(&metrics_mutex);
+    if (g_metrics) metric = find_series(kind, name, labels, add);
+    pthread_mutex_unlock(&metrics_mutex);
+    return metric;
+}
+
+/* Lookup for the name-based API, whose names are series keys: a plain name,
+ * or "name{labels}" with the labels in canonical form. */
+static void *lookup_key(int kind, const char *key, int add) {
+    const char *brace = strchr(key, '{');
+    size_t len = strlen(key);
+    char *copy;
+    void *metric;
+
+    if (!brace || key[len - 1] != '}') {
+        return lookup_series(kind, key, NULL, add);
+    }
+
+    copy = my_strdup(key);
+    if (!copy) return NULL;
+    copy[brace - key] = '\0';
+    copy[len - 1] = '\0';
+    metric = lookup_series(kind, copy, copy[brace - key + 1] ? copy + (brace - key) + 1 : NULL, add);
+    free(copy);
+    return metric;
+}
+
+static metrics_counter_t *lookup_counter(const char *name, int add) {
+    return lookup_key(METRICS_KIND_COUNTER, name, add);
+}
+
+static metrics_gauge_t *lookup_gauge(const char *name, int add) {
+    return lookup_key(METRICS_KIND_GAUGE, name, add);
+}
+
+static metrics_histogram_t *lookup_histogram(const char *name, int add) {
+    return lookup_key(METRICS_KIND_HISTOGRAM, name, add);
+}
+
+/* Render label pairs in the canonical form (see metrics.h): sorted by label
+ * name, values escaped as the Prometheus text format requires. NULL for no
+ * pairs, and on allocation failure. */
+static char *render_labels(const char **keys, const char **values, int n) {
+    size_t len = 0;
+    char *out, *p;
+    int i, j;
+
+    /* Insertion sort: a handful of pairs at most. */
+    for (i = 1; i < n; i++) {
+        const char *k = keys[i], *v = values[i];
+        for (j = i; j > 0 && strcmp(keys[j - 1], k) > 0; j--) {
+            keys[j] = keys[j - 1];
+            values[j] = values[j - 1];
+        }
+        keys[j] = k;
+        values[j] = v;
+    }
+
+    if (n == 0) return NULL;
+    for (i = 0; i < n; i++) {
+        len += strlen(keys[i]) + 2 * strlen(values[i]) + 4;  /* k="v", */
+    }
+    out = malloc(len + 1);
+    if (!out) return NULL;
+
+    p = out;
+    for (i = 0; i < n; i++) {
+        const char *v;
+        if (i > 0) *p++ = ',';
+        strcpy(p, keys[i]);
+        p += strlen(keys[i]);
+        *p++ = '=';
+        *p++ = '"';
+        for (v = values[i]; *v; v++) {
+            if (*v == '\\' || *v == '"') {
+                *p++ = '\\';
+                *p++ = *v;
+            } else if (*v == '\n') {
+                *p++ = '\\';
+                *p++ = 'n';
+            } else {
+                *p++ = *v;
+            }
+        }
+        *p++ = '"';
+    }
+    *p = '\0';
+    return out;
+}
+
+/* Shared body of the *_with_labels calls. */
+static void *lookup_with_labels(int kind, const char *name, va_list ap) {
+    const char *keys[METRICS_MAX_LABELS];
+    const char *values[METRICS_MAX_LABELS];
+    const char *key;
+    char *labels;
+    void *metric;
+    int n = 0;
+
+    while ((key = va_arg(ap, const char *)) != NULL) {
+        if (n == METRICS_MAX_LABELS) return NULL;
+        keys[n] = key;
+        values[n] = va_arg(ap, const char *);
+        if (!values[n]) return NULL;
+        n++;
+    }
+
+    labels = render_labels(keys, values, n);
+    if (n > 0 && !labels) return NULL;
+    metric = lookup_series(kind, name, labels, 1);
+    free(labels);
+    return metric;
+}
+
 int metrics_increment_counter(const char *name, uint64_t amount) {
-    int index;
+    metrics_counter_t *counter;
     
     if (!g_metrics || !name) return -1;
     
-    pthread_mutex_lock(&metrics_mutex);
-    
-    index = find_counter_index(name);
-    if (index < 0) {
-        index = add_counter(name);
-        if (index < 0) {
-            pthread_mutex_unlock(&metrics_mutex);
-            return -1;
-        }
-    }
+    counter = lookup_counter(name, 1);
+    if (!counter) return -1;
     
-    g_metrics->counters[index].value += amount;
-    pthread_mutex_unlock(&metrics_mutex);
+    counter_add(counter, amount);
     return 0;
 }
 
 int metrics_reset_counter(const char *name) {
-    int index;
+    metrics_counter_t *counter;
     
     if (!g_metrics || !name) return -1;
     
-    pthread_mutex_lock(&metrics_mutex);
-    
-    index = find_counter_index(name);
-    if (index >= 0) {
-        g_metrics->counters[index].value = 0;
-        g_metrics->counters[index].last_reset = time(NULL);
+    counter = lookup_counter(name, 0);
+    if (counter) {
+        counter_zero(counter);
     }
-    
-    pthread_mutex_unlock(&metrics_mutex);
     return 0;
 }
 
 uint64_t metrics_get_counter(const char *name) {
-    int index;
-    uint64_t value;
+    metrics_counter_t *counter;
     
     if (!g_metrics || !name) return 0;
     
-    pthread_mutex_lock(&metrics_mutex);
-    
-    index = find_counter_index(name);
-    if (index >= 0) {
-        value = g_metrics->counters[index].value;
-        pthread_mutex_unlock(&metrics_mutex);
-        return value;
-    }
-    
-    pthread_mutex_unlock(&metrics_mutex);
-    return 0;
+    counter = lookup_counter(name, 0);
+    return counter ? counter_sum(counter) : 0;
 }
 
 int metrics_set_gauge(const char *name, double value) {
-    int index;
+    metrics_gauge_t *gauge;
     
     if (!g_metrics || !name) return -1;
     
-    pthread_mutex_lock(&metrics_mutex);
+    gauge = lookup_gauge(name, 1);
+    if (!gauge) return -1;
     
-    index = find_gauge_index(name);
-    if (index < 0) {
-        index = add_gauge(name);
-        if (index < 0) {
-            pthread_mutex_unlock(&metrics_mutex);
-            return -1;
-        }
-    }
-    
-    g_metrics->gauges[index].value = value;
-    g_metrics->gauges[index].last_update = time(NULL);
-    
-    pthread_mutex_unlock(&metrics_mutex);
+    double_store(&gauge->bits, value);
     return 0;
 }
 
 int metrics_increment_gauge(const char *name, double amount) {
-    int index;
+    metrics_gauge_t *gauge;
     
     if (!g_metrics || !name) return -1;
     
-    pthread_mutex_lock(&metrics_mutex);
-    
-    index = find_gauge_index(name);
-    if (index < 0) {
-        index = add_gauge(name);
-        if (index < 0) {
-            pthread_mutex_unlock(&metrics_mutex);
-            return -1;
-        }
-    }
-    
-    g_metrics->gauges[index].value += amount;
-    g_metrics->gauges[index].last_update = time(NULL);
+    gauge = lookup_gauge(name, 1);
+    if (!gauge) return -1;
     
-    pthread_mutex_unlock(&metrics_mutex);
+    double_add(&gauge->bits, amount);
     return 0;
 }
 
 int metrics_decrement_gauge(const char *name, double amount) {
-    int index;
-    
-    if (!g_metrics || !name) return -1;
-    
-    pthread_mutex_lock(&metrics_mutex);
-    
-    index = find_gauge_index(name);
-    if (index < 0) {
-        index = add_gauge(name);
-        if (index < 0) {
-            pthread_mutex_unlock(&metrics_mutex);
-            return -1;
-        }
-    }
-    
-    g_metrics->gauges[index].value -= amount;
-    g_metrics->gauges[index].last_update = time(NULL);
-    
-    pthread_mutex_unlock(&metrics_mutex);
-    return 0;
+    return metrics_increment_gauge(name, -amount);
 }
 
 double metrics_get_gauge(const char *name) {
-    int index;
-    double value;
+    metrics_gauge_t *gauge;
     
     if (!g_metrics || !name) return 0.0;
     
-    pthread_mutex_lock(&metrics_mutex);
-    
-    index = find_gauge_index(name);
-    if (index >= 0) {
-        value = g_metrics->gauges[index].value;
-        pthread_mutex_unlock(&metrics_mutex);
-        return value;
+    gauge = lookup_gauge(name, 0);
+    return gauge ? double_load(&gauge->bits) : 0.0;
+}
+
+double metrics_histogram_bucket_bound(int i) {
+    int j;
+
+    if (i <= 0) return ldexp(1.0, METRICS_HISTOGRAM_MIN_EXP);
+    if (i >= METRICS_HISTOGRAM_BUCKETS - 1) return HUGE_VAL;
+    j = i - 1;
+    return ldexp(1.0 + (double)(j % METRICS_HISTOGRAM_SUB_BUCKETS + 1) /
+                       METRICS_HISTOGRAM_SUB_BUCKETS,
+                 METRICS_HISTOGRAM_MIN_EXP + j / METRICS_HISTOGRAM_SUB_BUCKETS);
+}
+
+int metrics_histogram_bucket_index(double value) {
+    double mantissa;
+    int exp;
+    int octave, sub;
+
+    /* Written so NaN lands in bucket 0 too. */
+    if (!(value > ldexp(1.0, METRICS_HISTOGRAM_MIN_EXP))) return 0;
+    if (value > ldexp(1.0, METRICS_HISTOGRAM_MIN_EXP + METRICS_HISTOGRAM_OCTAVES)) {
+        return METRICS_HISTOGRAM_BUCKETS - 1;
     }
-    
-    pthread_mutex_unlock(&metrics_mutex);
-    return 0.0;
+
+    /* value = mantissa * 2^exp with mantissa in [0.5, 1): the octave is
+     * [2^(exp-1), 2^exp), and 2*mantissa - 1 is the position within it.
+     * Buckets close at the top, so a value on a bound (a position of a
+     * whole number of sub-buckets, computed exactly) takes the bucket
+     * below; a power of two is the last bucket of the octave before. */
+    mantissa = frexp(value, &exp);
+    octave = exp - 1 - METRICS_HISTOGRAM_MIN_EXP;
+    sub = (int)ceil((2.0 * mantissa - 1.0) * METRICS_HISTOGRAM_SUB_BUCKETS) - 1;
+    return 1 + octave * METRICS_HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+static void histogram_observe(metrics_histogram_t *hist, double value) {
+    __atomic_fetch_add(&hist->buckets[metrics_histogram_bucket_index(value)], 1,
+                       __ATOMIC_RELAXED);
+    double_add(&hist->sum_bits, value);
+    double_extend(&hist->min_bits, value, -1);
+    double_extend(&hist->max_bits, value, 1);
 }
 
 int metrics_observe_histogram(const char *name, double value) {
-    int index;
     metrics_histogram_t *hist;
     
     if (!g_metrics || !name) return -1;
     
-    pthread_mutex_lock(&metrics_mutex);
+    hist = lookup_histogram(name, 1);
+    if (!hist) return -1;
     
-    index = find_histogram_index(name);
-    if (index < 0) {
-        index = add_histogram(name);
-        if (index < 0) {
-            pthread_mutex_unlock(&metrics_mutex);
-            return -1;
-        }
-    }
-    hist = &g_metrics->histograms[index];
-    
-    /* Add value to the values array */
-    if (hist->values_size >= hist->values_capacity) {
-        size_t new_capacity = hist->values_capacity * 2;
-        double *new_values;
-        if (new_capacity == 0) new_capacity = 16;
+    histogram_observe(hist, value);
+    return 0;
+}
 
-        new_values = realloc(hist->values, new_capacity * sizeof(double));
-        if (!new_values) {
-            pthread_mutex_unlock(&metrics_mutex);
-            return -1;
+/* Value at quantile q, interpolated linearly within the bucket the rank
+ * falls in. The bucket is first narrowed to the observed min and max, so a
+ * single sample, or one bucket's worth, reads back exactly. */
+static double histogram_quantile(const uint64_t *buckets, uint64_t count,
+                                 double min, double max, double q) {
+    double rank = q * (double)count;
+    uint64_t seen = 0;
+    int i;
+
+    for (i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+        double lower, upper;
+
+        if (buckets[i] == 0) continue;
+        if ((double)(seen + buckets[i]) < rank) {
+            seen += buckets[i];
+            continue;
         }
-        
-        hist->values = new_values;
-        hist->values_capacity = new_capacity;
+        lower = (i == 0) ? min : metrics_histogram_bucket_bound(i - 1);
+        upper = metrics_histogram_bucket_bound(i);
+        if (lower < min) lower = min;
+        if (upper > max) upper = max;
+        return lower + (upper - lower) * (rank - (double)seen) / (double)buckets[i];
     }
-    
-    hist->values[hist->values_size++] = value;
-    
-    /* Keep only last 1000 values to prevent memory growth */
-    if (hist->values_size > 1000) {
-        memmove(hist->values, hist->values + 1, (hist->values_size - 1) * sizeof(double));
-        hist->values_size--;
-    }
-    
-    /* Update statistics */
-    hist->count++;
-    hist->sum += value;
-    if (value < hist->min_value) hist->min_value = value;
-    if (value > hist->max_value) hist->max_value = value;
-    
-    pthread_mutex_unlock(&metrics_mutex);
-    return 0;
+    return max;
 }
 
-static int metrics_get_histogram_stats_unlocked(const char *name, metrics_histogram_stats_t *stats) {
-    int index;
-    metrics_histogram_t *hist;
-    double *values_copy = NULL;
-    
-    if (!g_metrics || !name || !stats) return -1;
-    
-    index = find_histogram_index(name);
-    if (index < 0) return -1;
-    hist = &g_metrics->histograms[index];
-    
-    /* Copy current statistics */
-    stats->count = hist->count;
-    stats->sum = hist->sum;
-    stats->min = hist->min_value;
-    stats->max = hist->max_value;
+/* Reads the histogram without a lock, into `buckets` if the caller wants
+ * them. Concurrent observations may be half-seen; the count is always the
+ * sum of the buckets returned. */
+static void histogram_stats(metrics_histogram_t *hist, uint64_t *buckets,
+                            metrics_histogram_stats_t *stats) {
+    uint64_t local[METRICS_HISTOGRAM_BUCKETS];
+    int i;
+
+    if (!buckets) buckets = local;
+
+    stats->count = 0;
+    for (i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+        buckets[i] = __atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED);
+        stats->count += buckets[i];
+    }
+    stats->sum = double_load(&hist->sum_bits);
+    stats->min = double_load(&hist->min_bits);
+    stats->max = double_load(&hist->max_bits);
     
     if (stats->count > 0) {
         stats->mean = stats->sum / stats->count;
+        stats->median = histogram_quantile(buckets, stats->count, stats->min, stats->max, 0.50);
+        stats->p95 = histogram_quantile(buckets, stats->count, stats->min, stats->max, 0.95);
+        stats->p99 = histogram_quantile(buckets, stats->count, stats->min, stats->max, 0.99);
     } else {
         stats->mean = 0.0;
-    }
-    
-    /* Copy values for percentile calculations */
-    if (hist->values_size > 0) {
-        values_copy = malloc(hist->values_size * sizeof(double));
-        if (values_copy) {
-            memcpy(values_copy, hist->values, hist->values_size * sizeof(double));
-            qsort(values_copy, hist->values_size, sizeof(double), compare_doubles);
-            
-            if (hist->values_size % 2 == 0) {
-                stats->median = (values_copy[hist->values_size/2 - 1] + 
-                               values_copy[hist->values_size/2]) / 2.0;
-            } else {
-                stats->median = values_copy[hist->values_size/2];
-            }
-            
-            stats->p95 = values_copy[(size_t)(hist->values_size * 0.95)];
-            stats->p99 = values_copy[(size_t)(hist->values_size * 0.99)];
-        }
-    }
-    
-    if (!values_copy) {
         stats->median = stats->p95 = stats->p99 = 0.0;
-    } else {
-        free(values_copy);
     }
-    
-    return 0;
 }
 
 int metrics_get_histogram_stats(const char *name, metrics_histogram_stats_t *stats) {
-    int result;
+    metrics_histogram_t *hist;
     
     if (!g_metrics || !name || !stats) return -1;
     
+    hist = lookup_histogram(name, 0);
+    if (!hist) return -1;
+    histogram_stats(hist, NULL, stats);
+    return 0;
+}
+
+metrics_counter_t *metrics_counter_get(const char *name) {
+    if (!g_metrics || !name) return NULL;
+    return lookup_counter(name, 1);
+}
+
+metrics_gauge_t *metrics_gauge_get(const char *name) {
+    if (!g_metrics || !name) return NULL;
+    return lookup_gauge(name, 1);
+}
+
+metrics_histogram_t *metrics_histogram_get(const char *name) {
+    if (!g_metrics || !name) return NULL;
+    return lookup_histogram(name, 1);
+}
+
+metrics_counter_t *metrics_counter_with_labels(const char *name, ...) {
+    metrics_counter_t *counter;
+    va_list ap;
+
+    if (!g_metrics || !name) return NULL;
+    va_start(ap, name);
+    counter = lookup_with_labels(METRICS_KIND_COUNTER, name, ap);
+    va_end(ap);
+    return counter;
+}
+
+metrics_gauge_t *metrics_gauge_with_labels(const char *name, ...) {
+    metrics_gauge_t *gauge;
+    va_list ap;
+
+    if (!g_metrics || !name) return NULL;
+    va_start(ap, name);
+    gauge = lookup_with_labels(METRICS_KIND_GAUGE, name, ap);
+    va_end(ap);
+    return gauge;
+}
+
+metrics_histogram_t *metrics_histogram_with_labels(const char *name, ...) {
+    metrics_histogram_t *hist;
+    va_list ap;
+
+    if (!g_metrics || !name) return NULL;
+    va_start(ap, name);
+    hist = lookup_with_labels(METRICS_KIND_HISTOGRAM, name, ap);
+    va_end(ap);
+    return hist;
+}
+
+void metrics_counter_add(metrics_counter_t *counter, uint64_t amount) {
+    if (counter) counter_add(counter, amount);
+}
+
+void metrics_gauge_set(metrics_gauge_t *gauge, double value) {
+    if (gauge) double_store(&gauge->bits, value);
+}
+
+void metrics_gauge_add(metrics_gauge_t *gauge, double amount) {
+    if (gauge) double_add(&gauge->bits, amount);
+}
+
+void metrics_histogram_observe(metrics_histogram_t *hist, double value) {
+    if (hist) histogram_observe(hist, value);
+}
+
+/* Fast path: the ref already holds the handle for the live registry. The
+ * generation is published after the handle, so seeing it current means the
+ * handle beside it is too. Otherwise look the name up (registering it) and
+ * remember the result; a race between two threads resolving the same ref
+ * stores the same values twice. */
+static void *resolve_ref(metrics_ref_t *ref, int kind) {
+    unsigned generation = __atomic_load_n(&metrics_generation, __ATOMIC_ACQUIRE);
+    void *handle = NULL;
+    char *labels = NULL;
+
+    if (!ref) return NULL;
+    if (__atomic_load_n(&ref->generation, __ATOMIC_ACQUIRE) == generation) {
+        return __atomic_load_n(&ref->handle, __ATOMIC_RELAXED);
+    }
+
+    if (ref->label && ref->label_value) {
+        const char *key = ref->label, *value = ref->label_value;
+        labels = render_labels(&key, &value, 1);
+        if (!labels) return NULL;
+    }
+
     pthread_mutex_lock(&metrics_mutex);
-    result = metrics_get_histogram_stats_unlocked(name, stats);
+    if (g_metrics && ref->name) {
+        handle = find_series(kind, ref->name, labels, 1);
+    }
+    generation = metrics_generation;
     pthread_mutex_unlock(&metrics_mutex);
-    return result;
+    free(labels);
+
+    __atomic_store_n(&ref->handle, handle, __ATOMIC_RELAXED);
+    __atomic_store_n(&ref->generation, generation, __ATOMIC_RELEASE);
+    return handle;
+}
+
+metrics_counter_t *metrics_counter_ref(metrics_ref_t *ref) {
+    return resolve_ref(ref, METRICS_KIND_COUNTER);
+}
+
+metrics_gauge_t *metrics_gauge_ref(metrics_ref_t *ref) {
+    return resolve_ref(ref, METRICS_KIND_GAUGE);
+}
+
+metrics_histogram_t *metrics_histogram_ref(metrics_ref_t *ref) {
+    return resolve_ref(ref, METRICS_KIND_HISTOGRAM);
 }
 
 int metrics_reset_all(void) {
@@ -501,26 +890,17 @@ int metrics_reset_all(void) {
     
     /* Reset counters */
     for (i = 0; i < (int)g_metrics->counter_count; i++) {
-        g_metrics->counters[i].value = 0;
-        g_metrics->counters[i].last_reset = time(NULL);
+        counter_zero(g_metrics->counters[i]);
     }
     
     /* Reset gauges */
     for (i = 0; i < (int)g_metrics->gauge_count; i++) {
-        g_metrics->gauges[i].value = 0.0;
-        g_metrics->gauges[i].last_update = time(NULL);
+        double_store(&g_metrics->gauges[i]->bits, 0.0);
     }
     
-    /* Reset histograms */
+    /* Reset histograms; the metrics themselves stay, so handles remain valid */
     for (i = 0; i < (int)g_metrics->histogram_count; i++) {
-        free(g_metrics->histograms[i].values);
-        g_metrics->histograms[i].values = NULL;
-        g_metrics->histograms[i].values_size = 0;
-        g_metrics->histograms[i].values_capacity = 0;
-        g_metrics->histograms[i].count = 0;
-        g_metrics->histograms[i].sum = 0.0;
-        g_metrics->histograms[i].min_value = DBL_MAX;
-        g_metrics->histograms[i].max_value = -DBL_MAX;
+        histogram_clear(g_metrics->histograms[i]);
     }
     
     pthread_mutex_unlock(&metrics_mutex);
@@ -593,224 +973,557 @@ static int buf_appendf(char **buf, size_t *cap, size_t *pos,
     return 0;
 }
 
-char *metrics_export_prometheus(void) {
-    char *result = NULL;
-    int i;
-    size_t len = METRICS_EXPORT_INITIAL_SIZE;
-    size_t pos = 0;
+/* The registry as a scrape sees it: the metric pointers, copied under
+ * metrics_mutex so that formatting -- the slow part -- holds no lock at all.
+ * The metrics themselves stay put until metrics_cleanup(). */
+struct metrics_snapshot {
+    metrics_counter_t **counters;
+    size_t counter_count;
+    metrics_gauge_t **gauges;
+    size_t gauge_count;
+    metrics_histogram_t **histograms;
+    size_t histogram_count;
+    time_t start_time;
+    unsigned layout;
+};
+
+static void snapshot_free(struct metrics_snapshot *snap) {
+    free(snap->counters);
+    free(snap->gauges);
+    free(snap->histograms);
+}
 
-    if (!g_metrics) return NULL;
+/* Series order for exports: by name, then labels, unlabelled first. */
+static int compare_series(const char *name_a, const char *labels_a,
+                          const char *name_b, const char *labels_b) {
+    int c = strcmp(name_a, name_b);
+    if (c != 0) return c;
+    if (!labels_a || !labels_b) return (labels_a != NULL) - (labels_b != NULL);
+    return strcmp(labels_a, labels_b);
+}
 
-    pthread_mutex_lock(&metrics_mutex);
+static int compare_counters(const void *a, const void *b) {
+    const metrics_counter_t *x = *(metrics_counter_t * const *)a;
+    const metrics_counter_t *y = *(metrics_counter_t * const *)b;
+    return compare_series(x->name, x->labels, y->name, y->labels);
+}
+
+static int compare_gauges(const void *a, const void *b) {
+    const metrics_gauge_t *x = *(metrics_gauge_t * const *)a;
+    const metrics_gauge_t *y = *(metrics_gauge_t * const *)b;
+    return compare_series(x->name, x->labels, y->name, y->labels);
+}
+
+static int compare_histograms(const void *a, const void *b) {
+    const metrics_histogram_t *x = *(metrics_histogram_t * const *)a;
+    const metrics_histogram_t *y = *(metrics_histogram_t * const *)b;
+    return compare_series(x->name, x->labels, y->name, y->labels);
+}
+
+static int snapshot_take(struct metrics_snapshot *snap) {
+    memset(snap, 0, sizeof(*snap));
 
-    result = malloc(len);
-    if (!result) {
+    pthread_mutex_lock(&metrics_mutex);
+    if (!g_metrics) {
         pthread_mutex_unlock(&metrics_mutex);
-        return NULL;
+        return -1;
+    }
+    snap->counter_count = g_metrics->counter_count;
+    snap->gauge_count = g_metrics->gauge_count;
+    snap->histogram_count = g_metrics->histogram_count;
+    snap->start_time = g_metrics->start_time;
+    snap->layout = metrics_layout;
+    /* +1: never ask malloc for zero bytes, which may legitimately be NULL */
+    snap->counters = malloc((snap->counter_count + 1) * sizeof(metrics_counter_t *));
+    snap->gauges = malloc((snap->gauge_count + 1) * sizeof(metrics_gauge_t *));
+    snap->histograms = malloc((snap->histogram_count + 1) * sizeof(metrics_histogram_t *));
+    /* The registry arrays stay NULL until their first metric, and memcpy
+     * must not be handed NULL even for zero bytes. */
+    if (snap->counters && snap->gauges && snap->histograms) {
+        if (snap->counter_count)
+            memcpy(snap->counters, g_metrics->counters,
+                   snap->counter_count * sizeof(metrics_counter_t *));
+        if (snap->gauge_count)
+            memcpy(snap->gauges, g_metrics->gauges,
+                   snap->gauge_count * sizeof(metrics_gauge_t *));
+        if (snap->histogram_count)
+            memcpy(snap->histograms, g_metrics->histograms,
+                   snap->histogram_count * sizeof(metrics_histogram_t *));
+    }
+    pthread_mutex_unlock(&metrics_mutex);
+
+    if (!snap->counters || !snap->gauges || !snap->histograms) {
+        snapshot_free(snap);
+        return -1;
     }
 
+    /* Sorted by name, then labels, so each family's series are adjacent */
+    qsort(snap->counters, snap->counter_count, sizeof(metrics_counter_t *), compare_counters);
+    qsort(snap->gauges, snap->gauge_count, sizeof(metrics_gauge_t *), compare_gauges);
+    qsort(snap->histograms, snap->histogram_count, sizeof(metrics_histogram_t *),
+          compare_histograms);
+    return 0;
+}
+
+/* Pieces of a series' label block: `name{labels}`, or bare `name`. */
+static const char *lbl_open(const char *labels)  { return labels ? "{" : ""; }
+static const char *lbl(const char *labels)       { return labels ? labels : ""; }
+static const char *lbl_close(const char *labels) { return labels ? "}" : ""; }
+
+/* The summary gauges exported beside each histogram family. */
+static const struct {
+    const char *suffix;
+    const char *help;
+    size_t offset;
+} histogram_summaries[] = {
+    { "min",    "Histogram minimum",         offsetof(metrics_histogram_stats_t, min) },
+    { "max",    "Histogram maximum",         offsetof(metrics_histogram_stats_t, max) },
+    { "mean",   "Histogram mean",            offsetof(metrics_histogram_stats_t, mean) },
+    { "median", "Histogram median",          offsetof(metrics_histogram_stats_t, median) },
+    { "p95",    "Histogram 95th percentile", offsetof(metrics_histogram_stats_t, p95) },
+    { "p99",    "Histogram 99th percentile", offsetof(metrics_histogram_stats_t, p99) }
+};
+
+#define HISTOGRAM_SUMMARY_COUNT \
+    ((int)(sizeof(histogram_summaries) / sizeof(histogram_summaries[0])))
+
+/*
+ * Exposition cache.
+ *
+ * Almost all of an export is the same from one scrape to the next: HELP and
+ * TYPE lines, sanitized names, label blocks, bucket bounds, the order of the
+ * series. Only the numbers move. So each export format keeps a template --
+ * its text with the values cut out, plus a list of fields saying which value
+ * goes where -- built from a sorted snapshot and kept until the set of
+ * series changes (metrics_layout). A scrape then copies text and formats
+ * numbers into a buffer sized up front, with no lock but exposition_mutex,
+ * which only orders scrapes against each other and against a rebuild.
+ */
+#define EXPOSITION_COUNTER      1   /* metric: counter */
+#define EXPOSITION_GAUGE        2   /* metric: gauge */
+#define EXPOSITION_BUCKET       3   /* hist, arg: cumulative count up to bucket arg */
+#define EXPOSITION_HIST_COUNT   4   /* hist */
+#define EXPOSITION_HIST_SUM     5   /* hist */
+#define EXPOSITION_HIST_SUMMARY 6   /* hist, arg: histogram_summaries[] entry */
+#define EXPOSITION_TIMESTAMP    7   /* the time of the scrape */
+
+/* Room for any one formatted value */
+#define EXPOSITION_VALUE_MAX 48
+
+struct exposition_field {
+    size_t text_end;    /* the template text up to here comes before the value */
+    int kind;
+    int arg;
+    void *metric;
+    size_t hist;        /* slot in exposition.hists */
+};
+
+/* Per-histogram scratch, read once per scrape for all of its fields */
+struct exposition_hist {
+    metrics_histogram_t *metric;
+    uint64_t cumulative[METRICS_HISTOGRAM_BUCKETS];
+    metrics_histogram_stats_t stats;
+};
+
+struct exposition {
+    unsigned layout;    /* metrics_layout the template matches; 0 for none */
+    char *text;
+    size_t text_len;
+    size_t text_cap;
+    struct exposition_field *fields;
+    size_t field_count;
+    size_t field_cap;
+    struct exposition_hist *hists;
+    size_t hist_count;
+};
+
+static pthread_mutex_t exposition_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct exposition prometheus_exposition;
+static struct exposition json_exposition;
+
+static void exposition_free(struct exposition *x) {
+    free(x->text);
+    free(x->fields);
+    free(x->hists);
+    memset(x, 0, sizeof(*x));
+}
+
+static void exposition_cleanup(void) {
+    pthread_mutex_lock(&exposition_mutex);
+    exposition_free(&prometheus_exposition);
+    exposition_free(&json_exposition);
+    pthread_mutex_unlock(&exposition_mutex);
+}
+
+/* Empty the template for a rebuild, keeping its buffers. */
+static int exposition_begin(struct exposition *x, size_t hist_count) {
+    struct exposition_hist *hists;
+
+    x->layout = 0;
+    x->text_len = 0;
+    x->field_count = 0;
+    x->hist_count = 0;
+    if (!x->text) {
+        x->text = malloc(METRICS_EXPORT_INITIAL_SIZE);
+        if (!x->text) return -1;
+        x->text_cap = METRICS_EXPORT_INITIAL_SIZE;
+    }
+    x->text[0] = '\0';
+
+    /* +1: never ask malloc for zero bytes */
+    hists = realloc(x->hists, (hist_count + 1) * sizeof(struct exposition_hist));
+    if (!hists) return -1;
+    x->hists = hists;
+    return 0;
+}
+
+/* Put a value at the current end of the template text. Dropped once the
+ * text has hit METRICS_EXPORT_MAX_SIZE, along with the text it belonged to. */
+static int exposition_field(struct exposition *x, int kind, void *metric,
+                            size_t hist, int arg) {
+    struct exposition_field *f;
+
+    if (!x->text) return -1;
+    if (x->text_len + 1 >= METRICS_EXPORT_MAX_SIZE) return 0;
+    if (x->field_count >= x->field_cap) {
+        size_t new_cap = x->field_cap ? x->field_cap * 2 : 256;
+        struct exposition_field *fields = realloc(x->fields,
+            new_cap * sizeof(struct exposition_field));
+        if (!fields) return -1;
+        x->fields = fields;
+        x->field_cap = new_cap;
+    }
+    f = &x->fields[x->field_count++];
+    f->text_end = x->text_len;
+    f->kind = kind;
+    f->arg = arg;
+    f->metric = metric;
+    f->hist = hist;
+    return 0;
+}
+
+static size_t exposition_add_hist(struct exposition *x, metrics_histogram_t *hist) {
+    x->hists[x->hist_count].metric = hist;
+    return x->hist_count++;
+}
+
+static size_t format_u64(char *out, uint64_t v) {
+    char digits[24];
+    size_t n = 0, i;
+
+    do {
+        digits[n++] = (char)('0' + (int)(v % 10));
+        v /= 10;
+    } while (v);
+    for (i = 0; i < n; i++) out[i] = digits[n - 1 - i];
+    return n;
+}
+
+static size_t format_double(char *out, double v) {
+    int n = snprintf(out, EXPOSITION_VALUE_MAX, "%.2f", v);
+    if (n < 0 || n >= EXPOSITION_VALUE_MAX) {
+        n = snprintf(out, EXPOSITION_VALUE_MAX, "%.6e", v);
+    }
+    return n < 0 ? 0 : (size_t)n;
+}
+
+static size_t format_field(char *out, const struct exposition *x,
+                           const struct exposition_field *f) {
+    const struct exposition_hist *h = &x->hists[f->hist];
+
+    switch (f->kind) {
+        case EXPOSITION_COUNTER:
+            return format_u64(out, counter_sum((metrics_counter_t *)f->metric));
+        case EXPOSITION_GAUGE:
+            return format_double(out, double_load(&((metrics_gauge_t *)f->metric)->bits));
+        case EXPOSITION_BUCKET:
+            return format_u64(out, h->cumulative[f->arg]);
+        case EXPOSITION_HIST_COUNT:
+            return format_u64(out, h->stats.count);
+        case EXPOSITION_HIST_SUM:
+            return format_double(out, h->stats.sum);
+        case EXPOSITION_HIST_SUMMARY:
+            return format_double(out, *(const double *)((const char *)&h->stats +
+                                                        histogram_summaries[f->arg].offset));
+        case EXPOSITION_TIMESTAMP: {
+            time_t now = time(NULL);
+            struct tm tm_info;
+            if (!localtime_r(&now, &tm_info)) return 0;
+            return strftime(out, EXPOSITION_VALUE_MAX, "%Y-%m-%dT%H:%M:%S", &tm_info);
+        }
+    }
+    return 0;
+}
+
+/* Fill the template in with current values. */
+static char *exposition_render(struct exposition *x) {
+    char *result, *p;
+    size_t i, t = 0;
+
+    result = malloc(x->text_len + x->field_count * EXPOSITION_VALUE_MAX + 1);
+    if (!result) return NULL;
+
+    for (i = 0; i < x->hist_count; i++) {
+        struct exposition_hist *h = &x->hists[i];
+        uint64_t cumulative = 0;
+        int b;
+
+        histogram_stats(h->metric, h->cumulative, &h->stats);
+        for (b = 0; b < METRICS_HISTOGRAM_BUCKETS; b++) {
+            cumulative += h->cumulative[b];
+            h->cumulative[b] = cumulative;
+        }
+    }
+
+    p = result;
+    for (i = 0; i < x->field_count; i++) {
+        const struct exposition_field *f = &x->fields[i];
+        memcpy(p, x->text + t, f->text_end - t);
+        p += f->text_end - t;
+        t = f->text_end;
+        p += format_field(p, x, f);
+    }
+    memcpy(p, x->text + t, x->text_len - t);
+    p += x->text_len - t;
+    *p = '\0';
+    return result;
+}
+
+/* Render an export, rebuilding its template first if series have been
+ * registered since it was built. */
+static char *exposition_export(struct exposition *x,
+                               int (*build)(struct exposition *, struct metrics_snapshot *)) {
+    char *result = NULL;
+
+    if (!g_metrics) return NULL;
+
+    pthread_mutex_lock(&exposition_mutex);
+    if (x->layout == 0 || x->layout != __atomic_load_n(&metrics_layout, __ATOMIC_ACQUIRE)) {
+        struct metrics_snapshot snap;
+        if (snapshot_take(&snap) == 0) {
+            if (build(x, &snap) == 0 && x->text) x->layout = snap.layout;
+            snapshot_free(&snap);
+        }
+    }
+    if (x->layout != 0) result = exposition_render(x);
+    pthread_mutex_unlock(&exposition_mutex);
+    return result;
+}
+
+/* End of the family starting at snapshot index i: the series sharing its
+ * name are adjacent once the snapshot is sorted. */
+#define FAMILY_END(arr, count, i, j) do { \
+    (j) = (i) + 1; \
+    while ((j) < (int)(count) && strcmp((arr)[j]->name, (arr)[i]->name) == 0) (j)++; \
+} while (0)
+
+static int build_prometheus(struct exposition *x, struct metrics_snapshot *snap) {
+    int i, j, k, s, b;
+
+    if (exposition_begin(x, snap->histogram_count) != 0) return -1;
+
     /* Add timestamp */
-    buf_appendf(&result, &len, &pos,
+    buf_appendf(&x->text, &x->text_cap, &x->text_len,
         "# HELP millennium_metrics_start_time Start time of the metrics collection\n");
-    buf_appendf(&result, &len, &pos,
+    buf_appendf(&x->text, &x->text_cap, &x->text_len,
         "# TYPE millennium_metrics_start_time counter\n");
-    buf_appendf(&result, &len, &pos,
-        "millennium_metrics_start_time %ld\n\n", (long)g_metrics->start_time);
-
-    /* Export counters */
-    for (i = 0; i < (int)g_metrics->counter_count; i++) {
-        char *sanitized_name = metrics_sanitize_name(g_metrics->counter_names[i]);
-        if (sanitized_name) {
-            buf_appendf(&result, &len, &pos,
-                "# HELP %s Counter metric\n", sanitized_name);
-            buf_appendf(&result, &len, &pos,
-                "# TYPE %s counter\n", sanitized_name);
-            buf_appendf(&result, &len, &pos,
-                "%s %llu\n", sanitized_name, (unsigned long long)g_metrics->counters[i].value);
-            free(sanitized_name);
+    buf_appendf(&x->text, &x->text_cap, &x->text_len,
+        "millennium_metrics_start_time %ld\n\n", (long)snap->start_time);
+
+    /* Export counters: HELP/TYPE once per family, then each of its series */
+    for (i = 0; i < (int)snap->counter_count; i = j) {
+        const char *name = snap->counters[i]->sanitized;
+        FAMILY_END(snap->counters, snap->counter_count, i, j);
+        buf_appendf(&x->text, &x->text_cap, &x->text_len,
+            "# HELP %s Counter metric\n", name);
+        buf_appendf(&x->text, &x->text_cap, &x->text_len,
+            "# TYPE %s counter\n", name);
+        for (k = i; k < j; k++) {
+            const char *labels = snap->counters[k]->labels;
+            buf_appendf(&x->text, &x->text_cap, &x->text_len, "%s%s%s%s ",
+                name, lbl_open(labels), lbl(labels), lbl_close(labels));
+            if (exposition_field(x, EXPOSITION_COUNTER, snap->counters[k], 0, 0) != 0) return -1;
+            buf_appendf(&x->text, &x->text_cap, &x->text_len, "\n");
         }
     }
 
-    if (g_metrics->counter_count > 0) {
-        buf_appendf(&result, &len, &pos, "\n");
+    if (snap->counter_count > 0) {
+        buf_appendf(&x->text, &x->text_cap, &x->text_len, "\n");
     }
 
     /* Export gauges */
-    for (i = 0; i < (int)g_metrics->gauge_count; i++) {
-        char *sanitized_name = metrics_sanitize_name(g_metrics->gauge_names[i]);
-        if (sanitized_name) {
-            buf_appendf(&result, &len, &pos,
-                "# HELP %s Gauge metric\n", sanitized_name);
-            buf_appendf(&result, &len, &pos,
-                "# TYPE %s gauge\n", sanitized_name);
-            buf_appendf(&result, &len, &pos,
-                "%s %.2f\n", sanitized_name, g_metrics->gauges[i].value);
-            free(sanitized_name);
+    for (i = 0; i < (int)snap->gauge_count; i = j) {
+        const char *name = snap->gauges[i]->sanitized;
+        FAMILY_END(snap->gauges, snap->gauge_count, i, j);
+        buf_appendf(&x->text, &x->text_cap, &x->text_len,
+            "# HELP %s Gauge metric\n", name);
+        buf_appendf(&x->text, &x->text_cap, &x->text_len,
+            "# TYPE %s gauge\n", name);
+        for (k = i; k < j; k++) {
+            const char *labels = snap->gauges[k]->labels;
+            buf_appendf(&x->text, &x->text_cap, &x->text_len, "%s%s%s%s ",
+                name, lbl_open(labels), lbl(labels), lbl_close(labels));
+            if (exposition_field(x, EXPOSITION_GAUGE, snap->gauges[k], 0, 0) != 0) return -1;
+            buf_appendf(&x->text, &x->text_cap, &x->text_len, "\n");
         }
     }
 
-    if (g_metrics->gauge_count > 0) {
-        buf_appendf(&result, &len, &pos, "\n");
+    if (snap->gauge_count > 0) {
+        buf_appendf(&x->text, &x->text_cap, &x->text_len, "\n");
     }
 
-    /* Export histograms */
-    for (i = 0; i < (int)g_metrics->histogram_count; i++) {
-        metrics_histogram_stats_t stats;
-        char *sanitized_name;
-
-        if (metrics_get_histogram_stats_unlocked(g_metrics->histogram_names[i], &stats) == 0) {
-            sanitized_name = metrics_sanitize_name(g_metrics->histogram_names[i]);
-            if (sanitized_name) {
-                buf_appendf(&result, &len, &pos,
-                    "# HELP %s_count Histogram count\n", sanitized_name);
-                buf_appendf(&result, &len, &pos,
-                    "# TYPE %s_count counter\n", sanitized_name);
-                buf_appendf(&result, &len, &pos,
-                    "%s_count %llu\n", sanitized_name, (unsigned long long)stats.count);
-
-                buf_appendf(&result, &len, &pos,
-                    "# HELP %s_sum Histogram sum\n", sanitized_name);
-                buf_appendf(&result, &len, &pos,
-                    "# TYPE %s_sum counter\n", sanitized_name);
-                buf_appendf(&result, &len, &pos,
-                    "%s_sum %.2f\n", sanitized_name, stats.sum);
-
-                buf_appendf(&result, &len, &pos,
-                    "# HELP %s_min Histogram minimum\n", sanitized_name);
-                buf_appendf(&result, &len, &pos,
-                    "# TYPE %s_min gauge\n", sanitized_name);
-                buf_appendf(&result, &len, &pos,
-                    "%s_min %.2f\n", sanitized_name, stats.min);
-
-                buf_appendf(&result, &len, &pos,
-                    "# HELP %s_max Histogram maximum\n", sanitized_name);
-                buf_appendf(&result, &len, &pos,
-                    "# TYPE %s_max gauge\n", sanitized_name);
-                buf_appendf(&result, &len, &pos,
-                    "%s_max %.2f\n", sanitized_name, stats.max);
-
-                buf_appendf(&result, &len, &pos,
-                    "# HELP %s_mean Histogram mean\n", sanitized_name);
-                buf_appendf(&result, &len, &pos,
-                    "# TYPE %s_mean gauge\n", sanitized_name);
-                buf_appendf(&result, &len, &pos,
-                    "%s_mean %.2f\n", sanitized_name, stats.mean);
-
-                buf_appendf(&result, &len, &pos,
-                    "# HELP %s_median Histogram median\n", sanitized_name);
-                buf_appendf(&result, &len, &pos,
-                    "# TYPE %s_median gauge\n", sanitized_name);
-                buf_appendf(&result, &len, &pos,
-                    "%s_median %.2f\n", sanitized_name, stats.median);
-
-                buf_appendf(&result, &len, &pos,
-                    "# HELP %s_p95 Histogram 95th percentile\n", sanitized_name);
-                buf_appendf(&result, &len, &pos,
-                    "# TYPE %s_p95 gauge\n", sanitized_name);
-                buf_appendf(&result, &len, &pos,
-                    "%s_p95 %.2f\n", sanitized_name, stats.p95);
-
-                buf_appendf(&result, &len, &pos,
-                    "# HELP %s_p99 Histogram 99th percentile\n", sanitized_name);
-                buf_appendf(&result, &len, &pos,
-                    "# TYPE %s_p99 gauge\n", sanitized_name);
-                buf_appendf(&result, &len, &pos,
-                    "%s_p99 %.2f\n\n", sanitized_name, stats.p99);
-
-                free(sanitized_name);
+    /* Export histograms: the histogram family itself, then one gauge family
+     * per summary statistic, each covering every series of the histogram */
+    for (i = 0; i < (int)snap->histogram_count; i = j) {
+        const char *name = snap->histograms[i]->sanitized;
+        size_t first_hist = x->hist_count;
+
+        FAMILY_END(snap->histograms, snap->histogram_count, i, j);
+        buf_appendf(&x->text, &x->text_cap, &x->text_len,
+            "# HELP %s Histogram\n", name);
+        buf_appendf(&x->text, &x->text_cap, &x->text_len,
+            "# TYPE %s histogram\n", name);
+        for (k = i; k < j; k++) {
+            const char *labels = snap->histograms[k]->labels;
+            const char *sep = labels ? "," : "";
+            size_t h = exposition_add_hist(x, snap->histograms[k]);
+
+            /* Every bucket, empty or not: a series missing on one phone
+             * would skew a sum by (le) across phones. */
+            for (b = 0; b < METRICS_HISTOGRAM_BUCKETS - 1; b++) {
+                buf_appendf(&x->text, &x->text_cap, &x->text_len,
+                    "%s_bucket{%s%sle=\"%.10g\"} ", name, lbl(labels), sep,
+                    metrics_histogram_bucket_bound(b));
+                if (exposition_field(x, EXPOSITION_BUCKET, NULL, h, b) != 0) return -1;
+                buf_appendf(&x->text, &x->text_cap, &x->text_len, "\n");
+            }
+            buf_appendf(&x->text, &x->text_cap, &x->text_len,
+                "%s_bucket{%s%sle=\"+Inf\"} ", name, lbl(labels), sep);
+            if (exposition_field(x, EXPOSITION_HIST_COUNT, NULL, h, 0) != 0) return -1;
+            buf_appendf(&x->text, &x->text_cap, &x->text_len, "\n%s_sum%s%s%s ",
+                name, lbl_open(labels), lbl(labels), lbl_close(labels));
+            if (exposition_field(x, EXPOSITION_HIST_SUM, NULL, h, 0) != 0) return -1;
+            buf_appendf(&x->text, &x->text_cap, &x->text_len, "\n%s_count%s%s%s ",
+                name, lbl_open(labels), lbl(labels), lbl_close(labels));
+            if (exposition_field(x, EXPOSITION_HIST_COUNT, NULL, h, 0) != 0) return -1;
+            buf_appendf(&x->text, &x->text_cap, &x->text_len, "\n");
+        }
+
+        for (s = 0; s < HISTOGRAM_SUMMARY_COUNT; s++) {
+            buf_appendf(&x->text, &x->text_cap, &x->text_len, "# HELP %s_%s %s\n",
+                name, histogram_summaries[s].suffix, histogram_summaries[s].help);
+            buf_appendf(&x->text, &x->text_cap, &x->text_len, "# TYPE %s_%s gauge\n",
+                name, histogram_summaries[s].suffix);
+            for (k = i; k < j; k++) {
+                const char *labels = snap->histograms[k]->labels;
+                buf_appendf(&x->text, &x->text_cap, &x->text_len, "%s_%s%s%s%s ",
+                    name, histogram_summaries[s].suffix,
+                    lbl_open(labels), lbl(labels), lbl_close(labels));
+                if (exposition_field(x, EXPOSITION_HIST_SUMMARY, NULL,
+                                     first_hist + (size_t)(k - i), s) != 0) return -1;
+                buf_appendf(&x->text, &x->text_cap, &x->text_len, "\n");
             }
         }
+        buf_appendf(&x->text, &x->text_cap, &x->text_len, "\n");
     }
 
-    pthread_mutex_unlock(&metrics_mutex);
-    return result;
+    return 0;
 }
 
-char *metrics_export_json(void) {
-    char *result = NULL;
-    char *timestamp;
-    int i;
-    size_t len = 0;
-    size_t pos = 0;
-    
-    if (!g_metrics) return NULL;
-    
-    pthread_mutex_lock(&metrics_mutex);
-    
-    timestamp = metrics_format_timestamp();
-    if (!timestamp) {
-        pthread_mutex_unlock(&metrics_mutex);
-        return NULL;
-    }
-    
-    /* Start with a reasonable buffer; buf_appendf grows it as needed so a
-     * long metric name or a full registry can never overflow the allocation. */
-    len = METRICS_EXPORT_INITIAL_SIZE;
-    result = malloc(len);
-    if (!result) {
-        free(timestamp);
-        pthread_mutex_unlock(&metrics_mutex);
-        return NULL;
+char *metrics_export_prometheus(void) {
+    return exposition_export(&prometheus_exposition, build_prometheus);
+}
+
+/* Append `"name{labels}"` as a JSON string: the label values carry quotes,
+ * which JSON needs escaped. */
+static void json_append_key(char **buf, size_t *len, size_t *pos,
+                            const char *name, const char *labels) {
+    const char *parts[4];
+    int p;
+
+    parts[0] = name;
+    parts[1] = lbl_open(labels);
+    parts[2] = lbl(labels);
+    parts[3] = lbl_close(labels);
+    buf_appendf(buf, len, pos, "\"");
+    for (p = 0; p < 4; p++) {
+        const char *s = parts[p];
+        while (*s) {
+            size_t run = strcspn(s, "\"\\");
+            if (run > 0) buf_appendf(buf, len, pos, "%.*s", (int)run, s);
+            s += run;
+            if (*s) buf_appendf(buf, len, pos, "\\%c", *s++);
+        }
     }
+    buf_appendf(buf, len, pos, "\"");
+}
 
-    buf_appendf(&result, &len, &pos, "{\n");
-    buf_appendf(&result, &len, &pos, "  \"timestamp\": \"%s\",\n", timestamp);
-    buf_appendf(&result, &len, &pos, "  \"counters\": {\n");
+static int build_json(struct exposition *x, struct metrics_snapshot *snap) {
+    int i, s;
+
+    if (exposition_begin(x, snap->histogram_count) != 0) return -1;
+
+    buf_appendf(&x->text, &x->text_cap, &x->text_len, "{\n");
+    buf_appendf(&x->text, &x->text_cap, &x->text_len, "  \"timestamp\": \"");
+    if (exposition_field(x, EXPOSITION_TIMESTAMP, NULL, 0, 0) != 0) return -1;
+    buf_appendf(&x->text, &x->text_cap, &x->text_len, "\",\n");
+    buf_appendf(&x->text, &x->text_cap, &x->text_len, "  \"counters\": {\n");
 
     /* Export counters */
-    for (i = 0; i < (int)g_metrics->counter_count; i++) {
-        if (i > 0) buf_appendf(&result, &len, &pos, ",\n");
-        buf_appendf(&result, &len, &pos, "    \"%s\": %llu",
-            g_metrics->counter_names[i], (unsigned long long)g_metrics->counters[i].value);
+    for (i = 0; i < (int)snap->counter_count; i++) {
+        if (i > 0) buf_appendf(&x->text, &x->text_cap, &x->text_len, ",\n");
+        buf_appendf(&x->text, &x->text_cap, &x->text_len, "    ");
+        json_append_key(&x->text, &x->text_cap, &x->text_len,
+            snap->counters[i]->name, snap->counters[i]->labels);
+        buf_appendf(&x->text, &x->text_cap, &x->text_len, ": ");
+        if (exposition_field(x, EXPOSITION_COUNTER, snap->counters[i], 0, 0) != 0) return -1;
     }
 
-    buf_appendf(&result, &len, &pos, "\n  },\n");
-    buf_appendf(&result, &len, &pos, "  \"gauges\": {\n");
+    buf_appendf(&x->text, &x->text_cap, &x->text_len, "\n  },\n");
+    buf_appendf(&x->text, &x->text_cap, &x->text_len, "  \"gauges\": {\n");
 
     /* Export gauges */
-    for (i = 0; i < (int)g_metrics->gauge_count; i++) {
-        if (i > 0) buf_appendf(&result, &len, &pos, ",\n");
-        buf_appendf(&result, &len, &pos, "    \"%s\": %.2f",
-            g_metrics->gauge_names[i], g_metrics->gauges[i].value);
+    for (i = 0; i < (int)snap->gauge_count; i++) {
+        if (i > 0) buf_appendf(&x->text, &x->text_cap, &x->text_len, ",\n");
+        buf_appendf(&x->text, &x->text_cap, &x->text_len, "    ");
+        json_append_key(&x->text, &x->text_cap, &x->text_len,
+            snap->gauges[i]->name, snap->gauges[i]->labels);
+        buf_appendf(&x->text, &x->text_cap, &x->text_len, ": ");
+        if (exposition_field(x, EXPOSITION_GAUGE, snap->gauges[i], 0, 0) != 0) return -1;
     }
 
-    buf_appendf(&result, &len, &pos, "\n  },\n");
-    buf_appendf(&result, &len, &pos, "  \"histograms\": {\n");
+    buf_appendf(&x->text, &x->text_cap, &x->text_len, "\n  },\n");
+    buf_appendf(&x->text, &x->text_cap, &x->text_len, "  \"histograms\": {\n");
 
     /* Export histograms */
-    for (i = 0; i < (int)g_metrics->histogram_count; i++) {
-        metrics_histogram_stats_t stats;
-
-        if (metrics_get_histogram_stats_unlocked(g_metrics->histogram_names[i], &stats) == 0) {
-            if (i > 0) buf_appendf(&result, &len, &pos, ",\n");
-            buf_appendf(&result, &len, &pos, "    \"%s\": {\n",
-                g_metrics->histogram_names[i]);
-            buf_appendf(&result, &len, &pos,
-                "      \"count\": %llu,\n", (unsigned long long)stats.count);
-            buf_appendf(&result, &len, &pos,
-                "      \"sum\": %.2f,\n", stats.sum);
-            buf_appendf(&result, &len, &pos,
-                "      \"min\": %.2f,\n", stats.min);
-            buf_appendf(&result, &len, &pos,
-                "      \"max\": %.2f,\n", stats.max);
-            buf_appendf(&result, &len, &pos,
-                "      \"mean\": %.2f,\n", stats.mean);
-            buf_appendf(&result, &len, &pos,
-                "      \"median\": %.2f,\n", stats.median);
-            buf_appendf(&result, &len, &pos,
-                "      \"p95\": %.2f,\n", stats.p95);
-            buf_appendf(&result, &len, &pos,
-                "      \"p99\": %.2f\n", stats.p99);
-            buf_appendf(&result, &len, &pos, "    }");
+    for (i = 0; i < (int)snap->histogram_count; i++) {
+        size_t h = exposition_add_hist(x, snap->histograms[i]);
+
+        if (i > 0) buf_appendf(&x->text, &x->text_cap, &x->text_len, ",\n");
+        buf_appendf(&x->text, &x->text_cap, &x->text_len, "    ");
+        json_append_key(&x->text, &x->text_cap, &x->text_len,
+            snap->histograms[i]->name, snap->histograms[i]->labels);
+        buf_appendf(&x->text, &x->text_cap, &x->text_len, ": {\n");
+        buf_appendf(&x->text, &x->text_cap, &x->text_len, "      \"count\": ");
+        if (exposition_field(x, EXPOSITION_HIST_COUNT, NULL, h, 0) != 0) return -1;
+        buf_appendf(&x->text, &x->text_cap, &x->text_len, ",\n      \"sum\": ");
+        if (exposition_field(x, EXPOSITION_HIST_SUM, NULL, h, 0) != 0) return -1;
+        for (s = 0; s < HISTOGRAM_SUMMARY_COUNT; s++) {
+            buf_appendf(&x->text, &x->text_cap, &x->text_len, ",\n      \"%s\": ",
+                histogram_summaries[s].suffix);
+            if (exposition_field(x, EXPOSITION_HIST_SUMMARY, NULL, h, s) != 0) return -1;
         }
+        buf_appendf(&x->text, &x->text_cap, &x->text_len, "\n    }");
     }
 
-    buf_appendf(&result, &len, &pos, "\n  }\n");
-    buf_appendf(&result, &len, &pos, "}\n");
+    buf_appendf(&x->text, &x->text_cap, &x->text_len, "\n  }\n");
+    buf_appendf(&x->text, &x->text_cap, &x->text_len, "}\n");
 
-    free(timestamp);
-    pthread_mutex_unlock(&metrics_mutex);
-    return result;
+    return 0;
+}
+
+char *metrics_export_json(void) {
+    return exposition_export(&json_exposition, build_json);
 }
 
 char *metrics_sanitize_name(const char *name) {
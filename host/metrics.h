@@ -10,21 +10,45 @@ typedef struct metrics_counter metrics_counter_t;
 typedef struct metrics_gauge metrics_gauge_t;
 typedef struct metrics_histogram metrics_histogram_t;
 typedef struct metrics_histogram_stats metrics_histogram_stats_t;
+typedef struct metrics_ref metrics_ref_t;
 typedef struct metrics metrics_t;
 
-/* Counter structure */
-struct metrics_counter {
+/* Counters are split into shards, one cache line each, and every thread
+ * adds to its own with a relaxed atomic: threads never contend on a line or
+ * a lock, and a scrape sums the shards. Threads are dealt shards round-robin
+ * as they first touch a counter, so more threads than shards share some. */
+#define METRICS_SHARDS 8
+#define METRICS_CACHE_LINE 64
+
+struct metrics_counter_shard {
     uint64_t value;
+    char pad[METRICS_CACHE_LINE - sizeof(uint64_t)];
+};
+
+/* Counter structure. Each metric is allocated on its own, cache-line
+ * aligned, and never moves or goes away until metrics_cleanup(), so a
+ * pointer to one is a handle. */
+struct metrics_counter {
+    struct metrics_counter_shard shards[METRICS_SHARDS];
     time_t last_reset;
+    char *name;
+    char *labels;   /* see "Labels" below; NULL for none */
+    char *sanitized;    /* name as exported, rendered at registration */
 };
 
-/* Gauge structure */
+/* Gauge structure. A gauge is set, not summed, so it is one atomic word
+ * rather than shards: the double's bit pattern, stored and loaded whole.
+ * Padded to a cache line like the counters. */
 struct metrics_gauge {
-    double value;
-    time_t last_update;
+    uint64_t bits;
+    char *name;
+    char *labels;
+    char *sanitized;
+    char pad[METRICS_CACHE_LINE - sizeof(uint64_t) - 3 * sizeof(char *)];
 };
 
-/* Histogram statistics structure */
+/* Histogram statistics structure. count, sum, min and max are exact; the
+ * quantiles are interpolated within a bucket (see below). */
 struct metrics_histogram_stats {
     uint64_t count;
     double sum;
@@ -36,37 +60,106 @@ struct metrics_histogram_stats {
     double p99;
 };
 
-/* Histogram structure */
+/* Histograms are log-linear: each power of two from 2^METRICS_HISTOGRAM_MIN_EXP
+ * to 2^(METRICS_HISTOGRAM_MIN_EXP + METRICS_HISTOGRAM_OCTAVES) -- 1/128 to
+ * 131072, which spans seconds and milliseconds alike -- is split into
+ * METRICS_HISTOGRAM_SUB_BUCKETS equal buckets, so a bucket is at most a quarter
+ * as wide as its lower bound. A bucket holds (lower, upper], so a value on a
+ * bound counts under that bound's `le`, as Prometheus reads it. Bucket 0
+ * takes everything up to the bottom of the range, including zero and
+ * negatives; the last bucket everything above it. The bounds are fixed, so the same histogram on different phones can be summed
+ * bucket by bucket, and exported as Prometheus _bucket{le=...} series. */
+#define METRICS_HISTOGRAM_MIN_EXP (-7)
+#define METRICS_HISTOGRAM_OCTAVES 24
+#define METRICS_HISTOGRAM_SUB_BUCKETS 4
+#define METRICS_HISTOGRAM_BUCKETS \
+    (METRICS_HISTOGRAM_OCTAVES * METRICS_HISTOGRAM_SUB_BUCKETS + 2)
+
+/* Histogram structure. Constant size; observing is a bucket increment plus
+ * atomic updates of the sum and extremes (doubles held as bit patterns, like
+ * a gauge), with no lock. The count is the sum of the buckets. */
 struct metrics_histogram {
-    double *values;
-    size_t values_size;
-    size_t values_capacity;
-    uint64_t count;
-    double sum;
-    double min_value;
-    double max_value;
+    uint64_t buckets[METRICS_HISTOGRAM_BUCKETS];
+    uint64_t sum_bits;
+    uint64_t min_bits;
+    uint64_t max_bits;
+    char *name;
+    char *labels;
+    char *sanitized;
 };
 
-/* Main metrics structure */
+/* Upper bound (Prometheus `le`) of histogram bucket i; +Inf for the last. */
+double metrics_histogram_bucket_bound(int i);
+
+/* Bucket a value falls in. */
+int metrics_histogram_bucket_index(double value);
+
+/* Labels. A metric is a family name plus an optional label set, so one
+ * family ("plugin_activations") carries one series per label value rather
+ * than a name per value. A label set is rendered once, when its series is
+ * registered, into the canonical Prometheus form -- pairs sorted by label
+ * name, values escaped -- and interned on the series:
+ *
+ *     plugin="Classic Phone",source="boot"
+ *
+ * The name-based API accepts the same form as a series key, so
+ * metrics_get_counter("plugin_activations{plugin=\"Jukebox\"}") reads one
+ * series. Keep label values to a small, fixed set: every distinct value is a
+ * series for the life of the process. */
+#define METRICS_MAX_LABELS 4
+
+/* One slot of the name index: an open-addressing hash table (linear probing)
+ * over every registered series, keyed by kind, name and labels. Metrics are
+ * never unregistered, so there are no tombstones. kind 0 marks an empty
+ * slot. */
+struct metrics_slot {
+    uint32_t hash;
+    int kind;
+    const char *name;   /* the metric's own copies */
+    const char *labels;
+    void *metric;
+};
+
+/* Main metrics structure. The arrays hold the metrics in registration order;
+ * exports sort them into families. index finds them by name and labels. */
 struct metrics {
-    metrics_counter_t *counters;
-    char **counter_names;
+    metrics_counter_t **counters;
     size_t counter_count;
     size_t counter_capacity;
     
-    metrics_gauge_t *gauges;
-    char **gauge_names;
+    metrics_gauge_t **gauges;
     size_t gauge_count;
     size_t gauge_capacity;
     
-    metrics_histogram_t *histograms;
-    char **histogram_names;
+    metrics_histogram_t **histograms;
     size_t histogram_count;
     size_t histogram_capacity;
+
+    struct metrics_slot *index;
+    size_t index_capacity;  /* power of two */
+    size_t index_used;
     
     time_t start_time;
 };
 
+/* A metric name and the handle it last resolved to, for call sites that hit
+ * the same metric over and over. Declare it static with METRICS_REF_INIT; the
+ * first use registers the metric and every later one is a load and a
+ * compare. It resolves again after metrics_cleanup()/metrics_init(), and to
+ * NULL -- which every handle operation ignores -- while metrics are down.
+ * A ref must only ever be used for one kind of metric. */
+struct metrics_ref {
+    const char *name;
+    const char *label;        /* optional single label, NULL for none */
+    const char *label_value;
+    void *handle;
+    unsigned generation;
+};
+
+#define METRICS_REF_INIT(name) { (name), NULL, NULL, NULL, 0 }
+#define METRICS_LABELED_REF_INIT(name, label, value) \
+    { (name), (label), (value), NULL, 0 }
+
 /* Global metrics instance */
 extern metrics_t *g_metrics;
 
@@ -90,10 +183,55 @@ double metrics_get_gauge(const char *name);
 int metrics_observe_histogram(const char *name, double value);
 int metrics_get_histogram_stats(const char *name, metrics_histogram_stats_t *stats);
 
+/* Handle operations. *_get registers the metric if it is new and returns its
+ * handle, or NULL before metrics_init() or on allocation failure; the handle
+ * stays valid until metrics_cleanup(). The update calls are O(1), do no
+ * string work, and are no-ops on a NULL handle. */
+metrics_counter_t *metrics_counter_get(const char *name);
+metrics_gauge_t *metrics_gauge_get(const char *name);
+metrics_histogram_t *metrics_histogram_get(const char *name);
+
+/* Series of a labelled family: the name, then label name/value pairs ending
+ * in NULL, e.g. metrics_counter_with_labels("arduino_i2c_drops", "source",
+ * "alpha", NULL). At most METRICS_MAX_LABELS pairs. Same handle rules as
+ * *_get; the label set is rendered and hashed, so cache the handle (or use a
+ * METRICS_LABELED_REF_INIT ref) on hot paths. */
+metrics_counter_t *metrics_counter_with_labels(const char *name, ...);
+metrics_gauge_t *metrics_gauge_with_labels(const char *name, ...);
+metrics_histogram_t *metrics_histogram_with_labels(const char *name, ...);
+
+void metrics_counter_add(metrics_counter_t *counter, uint64_t amount);
+void metrics_gauge_set(metrics_gauge_t *gauge, double value);
+void metrics_gauge_add(metrics_gauge_t *gauge, double amount);
+void metrics_histogram_observe(metrics_histogram_t *hist, double value);
+
+/* Resolve a cached ref (see struct metrics_ref). */
+metrics_counter_t *metrics_counter_ref(metrics_ref_t *ref);
+metrics_gauge_t *metrics_gauge_ref(metrics_ref_t *ref);
+metrics_histogram_t *metrics_histogram_ref(metrics_ref_t *ref);
+
+/* Hot-path updates by literal name: each expansion keeps its own static ref,
+ * so the name is looked up once per metrics_init() rather than per call.
+ * `name` must outlive the program (a string literal or a static table). */
+#define METRICS_COUNTER_ADD(name, amount) do { \
+    static metrics_ref_t metrics_ref_ = METRICS_REF_INIT(name); \
+    metrics_counter_add(metrics_counter_ref(&metrics_ref_), (amount)); \
+} while (0)
+#define METRICS_GAUGE_SET(name, value) do { \
+    static metrics_ref_t metrics_ref_ = METRICS_REF_INIT(name); \
+    metrics_gauge_set(metrics_gauge_ref(&metrics_ref_), (value)); \
+} while (0)
+#define METRICS_HISTOGRAM_OBSERVE(name, value) do { \
+    static metrics_ref_t metrics_ref_ = METRICS_REF_INIT(name); \
+    metrics_histogram_observe(metrics_histogram_ref(&metrics_ref_), (value)); \
+} while (0)
+
 /* Utility methods */
 int metrics_reset_all(void);
 
-/* Export methods */
+/* Export methods. Each returns a malloc'd document the caller frees. The
+ * text around the values is cached and rebuilt only when a series is
+ * registered, so a scrape costs little more than formatting the numbers. */
 char *metrics_export_prometheus(void);
 char *metrics_export_json(void);
 
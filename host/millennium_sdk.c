@@ -11,6 +11,7 @@
 #include "serial_recovery.h"
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 /* #include <linux/serial.h> */ /* Linux-specific, not available on macOS */
 #include <pthread.h>
 #include <signal.h>
@@ -21,91 +22,133 @@
 #include <termios.h>
 #include <time.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#define HAVE_EVENTFD 1
+#else
+#define HAVE_EVENTFD 0
+#endif
 
 /* Forward declarations */
 static void sip_event_cb(enum pjsip_iface_event ev, const char *text, void *client);
 static void event_queue_push(struct millennium_client *client, void *event);
 static void *event_queue_pop(struct millennium_client *client);
-static int event_queue_empty(struct millennium_client *client);
 static void event_queue_clear(struct millennium_client *client);
 static char *string_duplicate(const char *src);
-static void string_buffer_append(struct millennium_client *client, const char *data, size_t len);
-static void string_buffer_ensure_capacity(struct millennium_client *client, size_t needed);
 static int open_serial_port(struct millennium_client *client, const char *device);
+static int notify_open(struct millennium_client *client);
+static void notify_close(struct millennium_client *client);
+static void serial_kick(struct millennium_client *client);
+static speed_t rate_to_speed(long rate);
+static void negotiate_link_rate(struct millennium_client *client);
 
 /* SIP registration state: 0=unknown, 1=ok, -1=fail */
 static int g_sip_registered = 0;
 static char g_sip_last_error[256] = {0};
 static pthread_mutex_t g_sip_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-/* The event queue is produced by both the main loop (serial events) and PJSUA
- * worker threads (SIP call-state events, via the SIP callback) and consumed by
- * the main loop, so its linked-list/malloc operations must be serialized or the
- * heap corrupts. This guards push/pop/empty; clear() runs only at shutdown and
- * reuses those locked primitives, so it stays lock-free itself. */
-static pthread_mutex_t g_queue_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-/* Event queue implementation */
+/* Event queue. Produced by both the main loop (serial events) and PJSUA
+ * worker threads (SIP call-state events, via the SIP callback) and consumed
+ * by the main loop. It is an event_ring -- a bounded lock-free MPSC FIFO -- so
+ * a producer never allocates, never blocks on the consumer, and the backlog
+ * cannot grow past EVENT_RING_CAPACITY while the main loop is stalled.
+ *
+ * Takes ownership of `event`. On overflow the NEWEST event is dropped (see
+ * event_ring.h for why) and destroyed here; the drop is counted in the ring's
+ * stats, which the daemon publishes as event_queue_* gauges. */
 static void event_queue_push(struct millennium_client *client, void *event) {
-    struct event_queue_node *node = malloc(sizeof(struct event_queue_node));
-    if (!node) {
-        logger_error_with_category("SDK", "Failed to allocate memory for event queue node");
+    if (event_ring_push(&client->event_queue, event) != 0) {
+        struct event_ring_stats st;
+        event_ring_get_stats(&client->event_queue, &st);
+        /* Log on the 1st, 2nd, 4th, 8th... drop: a saturated ring is hit on
+         * every push, and one line per event would bury the cause. */
+        if ((st.dropped_total & (st.dropped_total - 1)) == 0) {
+            logger_warnf_with_category("SDK",
+                "Event queue full (%lu/%lu); dropped %s (%lu dropped total)",
+                st.depth, st.capacity, event_get_name((event_t *)event),
+                st.dropped_total);
+        }
+        event_destroy((event_t *)event);
         return;
     }
 
-    node->event = event;
-    node->next = NULL;
-
-    pthread_mutex_lock(&g_queue_mutex);
-    if (client->event_queue_tail) {
-        client->event_queue_tail->next = node;
-    } else {
-        client->event_queue_head = node;
-    }
-    client->event_queue_tail = node;
-    pthread_mutex_unlock(&g_queue_mutex);
+    millennium_client_notify(client);
 }
 
 static void *event_queue_pop(struct millennium_client *client) {
-    struct event_queue_node *node;
-    void *event;
+    return event_ring_pop(&client->event_queue);
+}
 
-    pthread_mutex_lock(&g_queue_mutex);
-    if (!client->event_queue_head) {
-        pthread_mutex_unlock(&g_queue_mutex);
-        return NULL;
+/* Shutdown only: runs after PJSUA is stopped, so there are no producers. */
+static void event_queue_clear(struct millennium_client *client) {
+    void *event;
+    while ((event = event_queue_pop(client)) != NULL) {
+        event_destroy((event_t *)event);
     }
+    event_ring_destroy(&client->event_queue);
+}
 
-    node = client->event_queue_head;
-    event = node->event;
+/* Engine wakeup fd. Written from any thread (PJSUA workers included), so it
+ * is only ever touched with single non-blocking syscalls: a full pipe or an
+ * eventfd at its ceiling already means "wake up", so EAGAIN is success. */
+static int notify_open(struct millennium_client *client) {
+#if HAVE_EVENTFD
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd == -1) return -1;
+    client->notify_fd = fd;
+    client->notify_wr_fd = fd;
+#else
+    int fds[2];
+    if (pipe(fds) == -1) return -1;
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL, 0) | O_NONBLOCK);
+    client->notify_fd = fds[0];
+    client->notify_wr_fd = fds[1];
+#endif
+    return 0;
+}
 
-    client->event_queue_head = node->next;
-    if (!client->event_queue_head) {
-        client->event_queue_tail = NULL;
+static void notify_close(struct millennium_client *client) {
+    if (client->notify_wr_fd != -1 && client->notify_wr_fd != client->notify_fd) {
+        close(client->notify_wr_fd);
     }
-    pthread_mutex_unlock(&g_queue_mutex);
-
-    free(node);
-    return event;
+    if (client->notify_fd != -1) {
+        close(client->notify_fd);
+    }
+    client->notify_fd = -1;
+    client->notify_wr_fd = -1;
 }
 
-static int event_queue_empty(struct millennium_client *client) {
-    int empty;
-    pthread_mutex_lock(&g_queue_mutex);
-    empty = (client->event_queue_head == NULL);
-    pthread_mutex_unlock(&g_queue_mutex);
-    return empty;
+void millennium_client_notify(struct millennium_client *client) {
+    ssize_t n;
+#if HAVE_EVENTFD
+    uint64_t one = 1;
+#else
+    char one = 1;
+#endif
+    if (!client || client->notify_wr_fd == -1) return;
+    do {
+        n = write(client->notify_wr_fd, &one, sizeof(one));
+    } while (n == -1 && errno == EINTR);
 }
 
-static void event_queue_clear(struct millennium_client *client) {
-    while (!event_queue_empty(client)) {
-        void *event = event_queue_pop(client);
-        if (event) {
-            event_destroy((event_t *)event);
-        }
+void millennium_client_drain_notify(struct millennium_client *client) {
+#if HAVE_EVENTFD
+    uint64_t count;
+#else
+    char count[64];
+#endif
+    if (!client || client->notify_fd == -1) return;
+    /* One read resets an eventfd; a pipe may need a few. */
+    while (read(client->notify_fd, &count, sizeof(count)) > 0) {
+        if (HAVE_EVENTFD) break;
     }
 }
 
+int millennium_client_get_notify_fd(struct millennium_client *client) {
+    return client ? client->notify_fd : -1;
+}
+
 /* String utilities */
 static char *string_duplicate(const char *src) {
     size_t len;
@@ -119,48 +162,6 @@ static char *string_duplicate(const char *src) {
     return dst;
 }
 
-#define MAX_INPUT_BUFFER_SIZE (256 * 1024)  /* 256KB cap to prevent unbounded growth (#127) */
-
-static void string_buffer_ensure_capacity(struct millennium_client *client, size_t needed) {
-    if (needed > MAX_INPUT_BUFFER_SIZE) {
-        logger_warn_with_category("SDK", "Input buffer would exceed cap, discarding");
-        client->input_buffer_size = 0;
-        if (client->input_buffer) client->input_buffer[0] = '\0';
-        return;
-    }
-    if (needed >= client->input_buffer_capacity) {
-        size_t new_capacity = client->input_buffer_capacity * 2;
-        char *new_buffer;
-        if (new_capacity < needed) {
-            new_capacity = needed + 1;
-        }
-        if (new_capacity > MAX_INPUT_BUFFER_SIZE) {
-            new_capacity = MAX_INPUT_BUFFER_SIZE;
-        }
-        new_buffer = realloc(client->input_buffer, new_capacity);
-        if (new_buffer) {
-            client->input_buffer = new_buffer;
-            client->input_buffer_capacity = new_capacity;
-        } else {
-            logger_error_with_category("SDK", "Failed to reallocate input buffer");
-        }
-    }
-}
-
-static void string_buffer_append(struct millennium_client *client, const char *data, size_t len) {
-    size_t needed;
-    if (!client || !data || len == 0) return;
-    
-    needed = client->input_buffer_size + len + 1;
-    string_buffer_ensure_capacity(client, needed);
-    /* Only append if we have space (realloc may have failed) (#128) */
-    if (client->input_buffer && needed <= client->input_buffer_capacity) {
-        memcpy(client->input_buffer + client->input_buffer_size, data, len);
-        client->input_buffer_size += len;
-        client->input_buffer[client->input_buffer_size] = '\0';
-    }
-}
-
 /* SIP event callback (invoked from a PJSUA worker thread). Mirrors the old
  * baresip ua_event_handler: it tracks registration state for the health check
  * and queues call-state events for the daemon's event loop. */
@@ -222,6 +223,7 @@ void millennium_sdk_get_sip_status(int *registered, char *last_error, size_t las
 static int open_serial_port(struct millennium_client *client, const char *device) {
     int flags;
     struct termios options;
+    speed_t speed;
 
     if (client->display_fd != -1) {
         close(client->display_fd);
@@ -242,20 +244,57 @@ static int open_serial_port(struct millennium_client *client, const char *device
         return -1;
     }
 
+    speed = rate_to_speed(client->link_rate_base);
+    if (speed == 0) {
+        logger_warnf_with_category("SDK", "hardware.baud_rate %ld not supported; using %ld",
+                                   client->link_rate_base, LINK_RATE_BASE);
+        client->link_rate_base = LINK_RATE_BASE;
+        speed = B9600;
+    }
+
     tcgetattr(client->display_fd, &options);
-    cfsetispeed(&options, BAUD_RATE);
-    cfsetospeed(&options, BAUD_RATE);
+    cfsetispeed(&options, speed);
+    cfsetospeed(&options, speed);
     options.c_cflag |= (CS8 | CLOCAL | CREAD);
     options.c_cflag &= ~(PARENB | CSTOPB);
 #ifdef CRTSCTS
     options.c_cflag &= ~CRTSCTS;
 #endif
-    options.c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG);
+    options.c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG | IEXTEN);
+    /* The link is binary: link frames carry any byte value, 0x0A, 0x0D and
+     * 0x11/0x13 included. Left on, ONLCR turned an 0x0A going out into
+     * 0x0D 0x0A and ICRNL an 0x0D coming in into 0x0A, and either broke the
+     * frame's CRC; IXON swallowed the flow-control bytes outright. */
+    options.c_oflag &= ~OPOST;
+    options.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL |
+                         IXON | IXOFF | IXANY);
+    /* VMIN=1 so a readable-but-empty tty cannot return 0 and look like EOF to
+     * the event-driven engine loop. O_NONBLOCK still makes read() return at
+     * once; this only pins down what "no data" looks like. */
+    options.c_cc[VMIN] = 1;
+    options.c_cc[VTIME] = 0;
     tcsetattr(client->display_fd, TCSANOW, &options);
 
     clock_gettime(CLOCK_MONOTONIC, &client->last_serial_activity);
     client->serial_healthy = 1;
     client->reconnect_attempts = 0;
+    client->serial_generation++;
+    serial_parser_reset(&client->serial_parser);
+    serial_link_rx_reset(&client->link_rx);
+    client->vfd_shown_valid = 0;  /* the Arduino may have rebooted blank */
+    client->key_capture_ms = -1;
+    client->key_display_capture_ms = -1;
+    {
+        unsigned long stale = serial_tx_reset(&client->serial_tx);
+        if (stale > 0) {
+            logger_infof_with_category("SDK", "Discarded %lu frames queued for the old serial port", stale);
+        }
+    }
+
+    client->link_rate = client->link_rate_base;
+    if (client->serial_framing) {
+        negotiate_link_rate(client);
+    }
 
     return 0;
 }
@@ -271,18 +310,19 @@ struct millennium_client *millennium_client_create(void) {
     /* Initialize all fields */
     memset(client, 0, sizeof(struct millennium_client));
     client->display_fd = -1;
+    client->notify_fd = -1;
+    client->notify_wr_fd = -1;
     client->is_open = 0;
-    client->input_buffer_capacity = 1024;
-    client->input_buffer = malloc(client->input_buffer_capacity);
-    if (!client->input_buffer) {
+    serial_parser_init(&client->serial_parser);
+    serial_link_rx_init(&client->link_rx);
+    serial_tx_init(&client->serial_tx);
+    client->key_capture_ms = -1;
+    client->key_display_capture_ms = -1;
+    if (event_ring_init(&client->event_queue, EVENT_RING_CAPACITY) != 0) {
         free(client);
-        logger_error_with_category("SDK", "Failed to allocate input buffer");
+        logger_error_with_category("SDK", "Failed to allocate event queue");
         return NULL;
     }
-    client->input_buffer[0] = '\0';
-    client->input_buffer_size = 0;
-    client->event_queue_head = NULL;
-    client->event_queue_tail = NULL;
     client->thread_handle = NULL;
     client->display_message = NULL;
     client->display_dirty = 0;
@@ -294,7 +334,29 @@ struct millennium_client *millennium_client_create(void) {
     
     /* Get current time */
     clock_gettime(CLOCK_MONOTONIC, &client->last_update_time);
+
+    if (notify_open(client) != 0) {
+        logger_errorf_with_category("SDK", "Failed to create engine notify fd: %s", strerror(errno));
+        millennium_client_destroy(client);
+        return NULL;
+    }
     
+    /* Link settings; open_serial_port() needs them. */
+    {
+        config_data_t *cfg = config_get_instance();
+
+        /* Off for a Beta still running firmware without CMD_DISPLAY_RUN,
+         * which would read the run's operands as commands. */
+        client->display_partial_updates =
+            config_get_bool(cfg, "hardware.display_partial_updates", 1);
+        /* Off for a Beta still running the bare-marker firmware, which also
+         * rules out rate negotiation: that needs the framed link. */
+        client->serial_framing =
+            config_get_bool(cfg, "hardware.serial_framing", 1);
+        client->link_rate_base = config_get_baud_rate(cfg);
+        client->link_rate_max = config_get_int(cfg, "hardware.baud_rate_max", 1000000);
+    }
+
     {
         const char *display_device = "/dev/serial/by-id/usb-Arduino_LLC_Millennium_Beta-if00";
         strncpy(client->serial_device_path, display_device, sizeof(client->serial_device_path) - 1);
@@ -355,14 +417,12 @@ void millennium_client_destroy(struct millennium_client *client) {
     if (client) {
         millennium_client_close(client);
         
-        if (client->input_buffer) {
-            free(client->input_buffer);
-        }
         if (client->display_message) {
             free(client->display_message);
         }
         
         event_queue_clear(client);
+        notify_close(client);
         free(client);
     }
 }
@@ -446,6 +506,22 @@ void millennium_client_check_serial(struct millennium_client *client) {
 #if SERIAL_WATCHDOG_ENABLED
     clock_gettime(CLOCK_MONOTONIC, &now);
 
+    /* A negotiated rate that starts corrupting frames is marginal for this
+     * wiring. Strike it and close the port: the reconnect below renegotiates
+     * without it, and ends at the base rate if nothing faster holds. */
+    if (client->display_fd != -1 && client->link_rate > client->link_rate_base) {
+        unsigned long errors = client->link_rx.crc_errors + client->link_rx.framing_errors;
+        long now_ms = (long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+        if (link_rate_monitor_check(&client->link_rate_monitor, errors, now_ms)) {
+            int idx = link_rate_index(client->link_rate);
+            if (idx >= 0) client->link_rate_failed |= 1u << idx;
+            logger_warnf_with_category("SDK",
+                "Serial link errors at %ld baud; reopening at a slower rate", client->link_rate);
+            close(client->display_fd);
+            client->display_fd = -1;
+        }
+    }
+
     /* The policy lives in serial_recovery.c so it can be unit-tested; this
      * function just samples the link and carries the verdict out (#247). */
     st.fd_open = (client->display_fd != -1);
@@ -476,7 +552,7 @@ void millennium_client_check_serial(struct millennium_client *client) {
     }
 
     /* (#59) Send periodic keepalive when idle to avoid false watchdog triggers.
-     * Arduino consumes CMD_KEEPALIVE (0x06) as no-op; write_command updates last_serial_activity. */
+     * Arduino consumes CMD_KEEPALIVE (0x06) as no-op; flushing it updates last_serial_activity. */
     if (action == SERIAL_ACTION_KEEPALIVE) {
         millennium_client_write_command(client, CMD_KEEPALIVE, NULL, 0);
     }
@@ -531,20 +607,39 @@ void millennium_client_update(struct millennium_client *client) {
     /* Read directly from the file descriptor */
     while ((bytes_read = read(client->display_fd, buffer, sizeof(buffer))) > 0) {
         millennium_client_serial_activity(client);
-        string_buffer_append(client, buffer, bytes_read);
-        millennium_client_process_event_buffer(client);
+        millennium_client_feed_serial(client, buffer, (size_t)bytes_read);
     }
 
-    if (bytes_read == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
-        logger_errorf_with_category("SDK", "Error reading from display_fd: %s", strerror(errno));
+    if (bytes_read == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        /* A hard error (EIO after a USB unplug) will not clear by retrying,
+         * and the event-driven loop would otherwise be woken for it forever.
+         * Close the fd: the watchdog treats a closed fd as a dead link and
+         * starts reconnecting on its next pass instead of a minute later. */
+        logger_errorf_with_category("SDK", "Error reading from display_fd: %s; closing", strerror(errno));
+        close(client->display_fd);
+        client->display_fd = -1;
+        return;
     }
 
     clock_gettime(CLOCK_MONOTONIC, &current_time);
 
+    /* Runs sent since the last full repaint may have been lost without a
+     * REJECT reaching us; restate the whole display now and then. */
+    if (client->vfd_patched && client->display_message &&
+        (long)current_time.tv_sec * 1000 + current_time.tv_nsec / 1000000 -
+        client->vfd_repaint_ms >= VFD_REPAINT_INTERVAL_MS) {
+        client->vfd_shown_valid = 0;
+        client->display_dirty = 1;
+    }
+
     elapsed_ms = (current_time.tv_sec - client->last_update_time.tv_sec) * 1000 +
                      (current_time.tv_nsec - client->last_update_time.tv_nsec) / 1000000;
     
-    if (client->display_dirty && elapsed_ms > 33) {
+    /* Hold the update while earlier display frames are still queued: the
+     * partial update is diffed against what they leave on the VFD, so one
+     * diff taken once they drain covers every change made meanwhile. */
+    if (client->display_dirty && elapsed_ms > DISPLAY_MIN_WRITE_INTERVAL_MS &&
+        serial_tx_lane_depth(&client->serial_tx, SERIAL_TX_DISPLAY) == 0) {
         millennium_client_write_to_display(client, client->display_message);
         client->last_update_time = current_time;
         client->display_dirty = 0;
@@ -555,99 +650,136 @@ void millennium_client_update(struct millennium_client *client) {
     }
 }
 
-void millennium_client_process_event_buffer(struct millennium_client *client) {
-    while (client->input_buffer_size > 0) {
-        size_t event_start = 0;
-        size_t i;
-        char event_type;
-        char *payload;
-        size_t payload_len;
-        size_t remove_len;
-        logger_debug_with_category("SDK", client->input_buffer);
-
-        for (i = 0; i < client->input_buffer_size; i++) {
-            char c = client->input_buffer[i];
-            if (c == '@' || c == 'K' || c == 'C' || c == 'V' || c == 'A' || 
-                c == 'B' || c == 'D' || c == 'E' || c == 'F' || c == 'H' ||
-                c == EVENT_TYPE_DIAG || c == EVENT_TYPE_HEARTBEAT) {
-                event_start = i;
-                break;
-            }
-        }
-        
-        if (i >= client->input_buffer_size) {
-            return; /* No event marker found */
-        }
+int millennium_client_next_timeout_ms(struct millennium_client *client) {
+    struct timespec now;
+    long elapsed_ms;
 
-        event_type = client->input_buffer[event_start];
-        payload = millennium_client_extract_payload(client, event_type, event_start);
-        
-        logger_debugf_with_category("SDK", "Event type: %c", event_type);
-        
-        if (payload) {
-            logger_debugf_with_category("SDK", "Payload: %s", payload);
-        }
+    if (!client || !client->display_dirty || client->display_fd == -1) return -1;
+    /* update() waits for the display lane to drain; ENGINE_WAKE_WRITABLE
+     * brings the loop back for that, so there is no deadline to sleep to. */
+    if (serial_tx_lane_depth(&client->serial_tx, SERIAL_TX_DISPLAY) > 0) return -1;
 
-        millennium_client_create_and_queue_event_char(client, event_type, payload);
-        
-        /* Remove processed data from buffer */
-        payload_len = payload ? strlen(payload) : 0;
-        remove_len = event_start + payload_len + 1;
-        if (remove_len < client->input_buffer_size) {
-            memmove(client->input_buffer, client->input_buffer + remove_len, 
-                   client->input_buffer_size - remove_len);
-            client->input_buffer_size -= remove_len;
-            client->input_buffer[client->input_buffer_size] = '\0';
-        } else {
-            client->input_buffer_size = 0;
-            client->input_buffer[0] = '\0';
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed_ms = (now.tv_sec - client->last_update_time.tv_sec) * 1000 +
+                 (now.tv_nsec - client->last_update_time.tv_nsec) / 1000000;
+    /* update() writes once elapsed exceeds the interval, i.e. at interval+1. */
+    if (elapsed_ms > DISPLAY_MIN_WRITE_INTERVAL_MS) return 0;
+    return (int)(DISPLAY_MIN_WRITE_INTERVAL_MS + 1 - elapsed_ms);
+}
+
+/* serial_parser callback: one complete frame from the Arduino. */
+static void on_serial_frame(void *ctx, char marker, const char *payload, size_t len) {
+    logger_debugf_with_category("SDK", "Frame: %c (%lu payload bytes)",
+                                marker, (unsigned long)len);
+    millennium_client_create_and_queue_event_char((struct millennium_client *)ctx,
+                                                  marker, payload);
+}
+
+/* Histograms fed by stamped events: how old each event was when it reached
+ * us, and how long from a keypress to the display update answering it being
+ * written to Beta. */
+#define EVENT_AGE_HISTOGRAM "serial_event_age_ms"
+#define KEY_DISPLAY_HISTOGRAM "keypress_to_display_ms"
+
+static long monotonic_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/* A display update has been queued. If a keypress is still waiting for one,
+ * this update is its answer; key_latency_written() times it out the door. */
+static void key_latency_queued(struct millennium_client *client) {
+    if (client->key_capture_ms < 0) return;
+    if (monotonic_ms() - client->key_capture_ms <= KEY_DISPLAY_WINDOW_MS) {
+        client->key_display_capture_ms = client->key_capture_ms;
+    }
+    client->key_capture_ms = -1;
+}
+
+/* Called after a write to the tty: once the answering update is all out,
+ * record the latency. */
+static void key_latency_written(struct millennium_client *client) {
+    if (client->key_display_capture_ms < 0 ||
+        serial_tx_lane_depth(&client->serial_tx, SERIAL_TX_DISPLAY) > 0) {
+        return;
+    }
+    METRICS_HISTOGRAM_OBSERVE(KEY_DISPLAY_HISTOGRAM,
+                              (double)(monotonic_ms() - client->key_display_capture_ms));
+    client->key_display_capture_ms = -1;
+}
+
+/* serial_link callback: one checked, in-order frame from Beta. The payload
+ * is held to the marker's legacy width, so the event code sees exactly what
+ * the bare-marker parser would have handed it. A card PAN may be shorter:
+ * with an explicit length there is no need to pad it. */
+static void on_link_frame(void *ctx, const serial_link_frame_t *frame) {
+    char payload[SERIAL_MAX_PAYLOAD + 1];
+    unsigned char width = serial_marker_payload_len[frame->type];
+
+    /* Rate handshake replies; negotiate_link_rate() is waiting on one. */
+    if (frame->type == SERIAL_LINK_TYPE_ECHO || frame->type == CMD_LINK_RATE) {
+        struct millennium_client *client = (struct millennium_client *)ctx;
+        if (frame->type == client->link_expect_type && frame->len == client->link_expect_len &&
+            memcmp(frame->payload, client->link_expect, frame->len) == 0) {
+            client->link_reply_type = frame->type;
         }
-        
-        /* Free payload after processing to prevent memory leak */
-        if (payload) {
-            free(payload);
-            payload = NULL;
+        return;
+    }
+
+    /* Beta dropped a damaged frame of ours. If it was a display run, the VFD
+     * is not what vfd_shown says: repaint it in full. */
+    if (frame->type == SERIAL_LINK_TYPE_REJECT) {
+        struct millennium_client *client = (struct millennium_client *)ctx;
+        logger_debug_with_category("SDK", "Beta rejected a damaged frame; repainting the display");
+        client->vfd_shown_valid = 0;
+        if (client->display_message) client->display_dirty = 1;
+        return;
+    }
+
+    if (width == SERIAL_NOT_MARKER || frame->len > width ||
+        (frame->len < width && frame->type != EVENT_TYPE_CARD)) {
+        logger_warnf_with_category("SDK", "Ignoring link frame type 0x%02x with %lu payload bytes",
+                                   frame->type, (unsigned long)frame->len);
+        return;
+    }
+    if (frame->stamped) {
+        struct millennium_client *client = (struct millennium_client *)ctx;
+        METRICS_HISTOGRAM_OBSERVE(EVENT_AGE_HISTOGRAM, (double)frame->age_ms);
+        if (frame->type == EVENT_TYPE_KEYPAD) {
+            client->key_capture_ms = monotonic_ms() - (long)frame->age_ms;
         }
     }
+    memcpy(payload, frame->payload, frame->len);
+    payload[frame->len] = '\0';
+    on_serial_frame(ctx, (char)frame->type, payload, frame->len);
 }
 
-char *millennium_client_extract_payload(struct millennium_client *client, char event_type, size_t event_start) {
-    size_t payload_length = 0;
-    switch (event_type) {
-    case EVENT_TYPE_KEYPAD:
-    case EVENT_TYPE_HOOK:
-    case EVENT_TYPE_COIN:
-        payload_length = 1;
-        break;
-    case EVENT_TYPE_CARD:
-        payload_length = 16;
-        break;
-    case EVENT_TYPE_EEPROM_ERROR:
-        payload_length = 3;
-        break;
-    case EVENT_TYPE_DIAG:
-        payload_length = EVENT_DIAG_PAYLOAD_LEN;
-        break;
-    case EVENT_TYPE_COIN_UPLOAD_START:
-    case EVENT_TYPE_COIN_UPLOAD_END:
-    case EVENT_TYPE_COIN_VALIDATION_START:
-    case EVENT_TYPE_COIN_VALIDATION_END:
-    case EVENT_TYPE_HEARTBEAT:
-        payload_length = 0;
-        break;
-    default:
-        return NULL;
+/* Acknowledge everything up to link_rx.ack_seq. Queued directly rather than
+ * through serial_queue(): an ACK is a link frame, not a command. If it is
+ * lost, Beta retransmits and gets another. */
+static void send_link_ack(struct millennium_client *client) {
+    unsigned char wire[SERIAL_LINK_MAX_ENCODED];
+    size_t n;
+
+    client->link_rx.ack_pending = 0;
+    if (client->display_fd == -1) return;
+    n = serial_link_encode(SERIAL_LINK_FLAG_ACK, client->link_rx.ack_seq,
+                           SERIAL_LINK_TYPE_ACK, NULL, 0, wire, sizeof(wire));
+    if (n > 0 && serial_tx_enqueue(&client->serial_tx, SERIAL_TX_CONTROL, wire, n) == 0) {
+        serial_kick(client);
     }
+}
 
-    if (event_start + payload_length < client->input_buffer_size) {
-        char *payload = malloc(payload_length + 1);
-        if (payload) {
-            memcpy(payload, client->input_buffer + event_start + 1, payload_length);
-            payload[payload_length] = '\0';
-            return payload;
-        }
+void millennium_client_feed_serial(struct millennium_client *client, const char *data, size_t len) {
+    if (!client) return;
+    if (client->serial_framing) {
+        serial_link_rx_feed(&client->link_rx, data, len, on_link_frame, client);
+        /* One cumulative ACK per read, not one per frame. */
+        if (client->link_rx.ack_pending) send_link_ack(client);
+        return;
     }
-    return NULL;
+    serial_parser_feed(&client->serial_parser, data, len, on_serial_frame, client);
 }
 
 void millennium_client_create_and_queue_event_ptr(struct millennium_client *client, void *event) {
@@ -705,11 +837,13 @@ void millennium_client_create_and_queue_event_char(struct millennium_client *cli
              * actually moves -- otherwise a single drop would spam the log
              * forever. Remembered per source; two sources, so a tiny array. */
             static long last_logged[2] = { -1, -1 };
+            static metrics_ref_t drops_gauge[2] = {
+                METRICS_LABELED_REF_INIT("arduino_i2c_drops", "source", "alpha"),
+                METRICS_LABELED_REF_INIT("arduino_i2c_drops", "source", "beta")
+            };
             int idx = (source[0] == 'a') ? 0 : 1;
-            char metric[64];
 
-            snprintf(metric, sizeof(metric), "arduino_i2c_drops_%s", source);
-            metrics_set_gauge(metric, (double)count);
+            metrics_gauge_set(metrics_gauge_ref(&drops_gauge[idx]), (double)count);
 
             if (count != last_logged[idx]) {
                 if (count > 0) {
@@ -739,6 +873,10 @@ void millennium_client_set_display(struct millennium_client *client, const char
     }
     
     client->display_dirty = 1;
+    /* A web-thread control command can dirty the display while the main loop
+     * is blocked waiting for input; wake it so the write is not held until
+     * the next tick. */
+    millennium_client_notify(client);
     if (client->display_message) {
         free(client->display_message);
         client->display_message = NULL;
@@ -749,14 +887,334 @@ void millennium_client_set_display(struct millennium_client *client, const char
     }
 }
 
+/* Queue one frame (opcode + operands) for the Arduino, wrapped as a link
+ * frame unless the link is in legacy mode; `replace` drops the frames on its
+ * lane that have not started (see serial_tx_replace). Returns 0, or -1 if the
+ * frame was dropped. Nothing is written until serial_kick(). */
+static int serial_queue(struct millennium_client *client, serial_tx_lane_t lane,
+                        const uint8_t *frame, size_t len, int replace) {
+    unsigned char wire[SERIAL_LINK_MAX_ENCODED];
+    const uint8_t opcode = frame[0];
+    int rc;
+    if (client->display_fd == -1) {
+        logger_warnf_with_category("SDK", "Serial port closed; dropping command %d", opcode);
+        if (lane == SERIAL_TX_DISPLAY) client->vfd_shown_valid = 0;
+        return -1;
+    }
+    if (client->serial_framing) {
+        size_t n = serial_link_encode(0, client->link_tx_seq, opcode, frame + 1, len - 1,
+                                      wire, sizeof(wire));
+        if (n == 0) {
+            logger_errorf_with_category("SDK", "Command %d too long to frame (%lu bytes); dropped",
+                                        opcode, (unsigned long)len);
+            if (lane == SERIAL_TX_DISPLAY) client->vfd_shown_valid = 0;
+            return -1;
+        }
+        client->link_tx_seq++;
+        frame = wire;
+        len = n;
+    }
+    rc = replace ? serial_tx_replace(&client->serial_tx, lane, frame, len)
+                 : serial_tx_enqueue(&client->serial_tx, lane, frame, len);
+    if (rc != 0) {
+        struct serial_tx_stats st;
+        serial_tx_get_stats(&client->serial_tx, &st);
+        /* Same power-of-two throttle as the event queue's overflow log. */
+        if ((st.frames_dropped_total & (st.frames_dropped_total - 1)) == 0) {
+            logger_errorf_with_category("SDK",
+                    "Serial output queue full; dropped command %d (%lu dropped so far)",
+                    opcode, st.frames_dropped_total);
+        }
+        if (lane == SERIAL_TX_DISPLAY) client->vfd_shown_valid = 0;
+        return -1;
+    }
+    return 0;
+}
+
+/* Write as much of the queue as the tty takes right now -- usually all of
+ * it, so an idle link sends immediately. Whatever is left waits for
+ * ENGINE_WAKE_WRITABLE; the notify makes the engine loop re-arm for it even
+ * when the caller is a web thread. */
+static void serial_kick(struct millennium_client *client) {
+    millennium_client_flush_serial(client);
+    if (millennium_client_serial_tx_pending(client)) {
+        millennium_client_notify(client);
+    }
+}
+
+/* ── Line-rate negotiation (link_rate.h) ── */
+
+static speed_t rate_to_speed(long rate) {
+    switch (rate) {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+#ifdef B500000
+    case 500000: return B500000;
+#endif
+#ifdef B1000000
+    case 1000000: return B1000000;
+#endif
+    default: return 0;
+    }
+}
+
+/* Change the tty's rate once what is already written has gone out. */
+static int set_line_rate(int fd, long rate) {
+    struct termios options;
+    speed_t speed = rate_to_speed(rate);
+    if (speed == 0 || tcgetattr(fd, &options) != 0) return -1;
+    cfsetispeed(&options, speed);
+    cfsetospeed(&options, speed);
+    return tcsetattr(fd, TCSADRAIN, &options);
+}
+
+static long ms_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+static void sleep_ms(long ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000L;
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+    }
+}
+
+/* Queue one control frame and wait (up to LINK_RATE_REPLY_MS) until it is on
+ * the wire. The handshake runs before the engine loop is back to flushing
+ * for us, and a rate change must not overtake the bytes before it. Beta's
+ * echo of this frame is the reply link_wait_reply() then waits for. */
+static int link_send_now(struct millennium_client *client, uint8_t type,
+                         const unsigned char *payload, size_t len) {
+    uint8_t frame[1 + LINK_RATE_PATTERN_LEN];
+    struct timespec start;
+
+    frame[0] = type;
+    memcpy(frame + 1, payload, len);
+    client->link_expect_type = type;
+    memcpy(client->link_expect, payload, len);
+    client->link_expect_len = len;
+    client->link_reply_type = 0;
+    if (serial_queue(client, SERIAL_TX_CONTROL, frame, 1 + len, 0) != 0) return -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (client->display_fd != -1 && serial_tx_pending(&client->serial_tx) > 0) {
+        struct pollfd pfd;
+        long left = LINK_RATE_REPLY_MS - ms_since(&start);
+        if (left <= 0) return -1;
+        millennium_client_flush_serial(client);
+        if (serial_tx_pending(&client->serial_tx) == 0) break;
+        pfd.fd = client->display_fd;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        poll(&pfd, 1, (int)left);
+    }
+    if (client->display_fd == -1) return -1;
+    tcdrain(client->display_fd);
+    return 0;
+}
+
+/* Read what Beta sends for up to timeout_ms, processing it as usual (events
+ * keep flowing). With `quiet_ms` >= 0, stop early once nothing has arrived
+ * for that long; otherwise once the awaited handshake reply is in. */
+static int link_read(struct millennium_client *client, long timeout_ms, long quiet_ms) {
+    struct timespec start;
+    struct timespec last;
+    char buffer[256];
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    last = start;
+    while (client->display_fd != -1 && (quiet_ms >= 0 || client->link_reply_type == 0)) {
+        struct pollfd pfd;
+        ssize_t n;
+        long left = timeout_ms - ms_since(&start);
+        if (quiet_ms >= 0 && quiet_ms - ms_since(&last) < left) {
+            left = quiet_ms - ms_since(&last);
+        }
+        if (left <= 0) break;
+        pfd.fd = client->display_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, (int)left) <= 0) continue;
+        n = read(client->display_fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            clock_gettime(CLOCK_MONOTONIC, &last);
+            millennium_client_serial_activity(client);
+            millennium_client_feed_serial(client, buffer, (size_t)n);
+        } else if (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            return -1;
+        }
+    }
+    return client->display_fd != -1 ? 0 : -1;
+}
+
+/* Wait for Beta's echo of the last link_send_now() frame: the same type and
+ * payload. 0 once it is in, -1 after timeout_ms. */
+static int link_wait_reply(struct millennium_client *client, long timeout_ms) {
+    link_read(client, timeout_ms, -1);
+    return client->link_reply_type != 0 ? 0 : -1;
+}
+
+/* Ask Beta to move to `rate` and prove the line carries it. On failure both
+ * ends are back at the base rate. */
+static int link_try_rate(struct millennium_client *client, long rate) {
+    unsigned char p[LINK_RATE_PAYLOAD];
+    int probe;
+
+    link_rate_put(p, rate);
+    if (link_send_now(client, CMD_LINK_RATE, p, sizeof(p)) != 0 ||
+        link_wait_reply(client, LINK_RATE_REPLY_MS) != 0) {
+        return -1;  /* declined or unheard: Beta is still at the base rate */
+    }
+
+    if (set_line_rate(client->display_fd, rate) == 0) {
+        for (probe = 0; probe < LINK_RATE_PROBES; probe++) {
+            unsigned char pattern[LINK_RATE_PATTERN_LEN];
+            link_rate_test_pattern(pattern, sizeof(pattern),
+                                   (unsigned)client->serial_generation * 8u + (unsigned)probe);
+            if (link_send_now(client, SERIAL_LINK_TYPE_ECHO, pattern, sizeof(pattern)) == 0 &&
+                link_wait_reply(client, LINK_RATE_REPLY_MS) == 0) {
+                return 0;
+            }
+        }
+    }
+
+    /* Beta switched but nothing got through: it reverts on its own once
+     * LINK_RATE_CONFIRM_MS passes without a valid frame. */
+    set_line_rate(client->display_fd, client->link_rate_base);
+    sleep_ms(LINK_RATE_REVERT_WAIT_MS);
+    return -1;
+}
+
+/* Called from open_serial_port() with the tty at the base rate. Takes at
+ * most LINK_RATE_HANDSHAKE_MS.
+ *
+ * This blocks the engine thread, under engine_mutex, and is meant to. The
+ * port only reopens when the link is already unusable -- at startup, after
+ * the watchdog finds it dead, or when the rate monitor strikes a marginal
+ * rate -- and with no link there are no keys, hook, coins or display to
+ * serve. What does wait is bounded: PJSIP events queue in the event ring
+ * and web control commands on their worker, for at most the two seconds.
+ * Reopens are spaced by the reconnect backoff, or a minute apart for a port
+ * that opens but stays silent (the watchdog's idle limit). Driven from the
+ * reactor instead, every queued display and coin frame would have to be held
+ * back while the tty changes speed under them, and every read taken apart
+ * into handshake replies and events, for a path that runs when nothing else
+ * can. */
+static void negotiate_link_rate(struct millennium_client *client) {
+    long plan[LINK_RATE_CANDIDATES];
+    unsigned char base[LINK_RATE_PAYLOAD];
+    struct timespec start;
+    struct timespec now;
+    int n, i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    /* Beta may still be at a rate negotiated with an earlier connection (a
+     * daemon restart does not reset it). Tell it to drop to the base rate at
+     * every rate it could be listening on; the requests it cannot decode are
+     * dropped as noise. */
+    link_rate_put(base, client->link_rate_base);
+    for (i = 0; i < LINK_RATE_CANDIDATES && client->display_fd != -1; i++) {
+        long rate = link_rate_candidates[i];
+        if (rate == client->link_rate_base || rate > client->link_rate_max ||
+            set_line_rate(client->display_fd, rate) != 0) {
+            continue;
+        }
+        link_send_now(client, CMD_LINK_RATE, base, sizeof(base));
+    }
+    if (client->display_fd == -1) return;
+    set_line_rate(client->display_fd, client->link_rate_base);
+    /* Over USB the line rate is only nominal, so Beta decodes every one of
+     * those requests and echoes each. Take them all in now, until the line
+     * is quiet, so the first candidate is not answered by one of them. */
+    client->link_expect_type = 0;
+    link_read(client, 3 * LINK_RATE_REPLY_MS, LINK_RATE_REPLY_MS);
+
+    n = link_rate_plan(client->link_rate_max, client->link_rate_base,
+                       client->link_rate_failed, plan, LINK_RATE_CANDIDATES);
+    for (i = 0; i < n && client->display_fd != -1; i++) {
+        if (rate_to_speed(plan[i]) == 0) continue;
+        if (ms_since(&start) + LINK_RATE_TRY_MS > LINK_RATE_HANDSHAKE_MS) {
+            logger_infof_with_category("SDK", "Rate handshake out of time; %ld baud and slower "
+                                       "are left for the next connection", plan[i]);
+            break;
+        }
+        if (link_try_rate(client, plan[i]) == 0) {
+            client->link_rate = plan[i];
+            break;
+        }
+        client->link_rate_failed |= 1u << link_rate_index(plan[i]);
+        logger_warnf_with_category("SDK", "Serial link failed at %ld baud", plan[i]);
+    }
+    logger_infof_with_category("SDK", "Serial link running at %ld baud", client->link_rate);
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    link_rate_monitor_reset(&client->link_rate_monitor,
+                            client->link_rx.crc_errors + client->link_rx.framing_errors,
+                            (long)now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+long millennium_client_get_link_rate(struct millennium_client *client) {
+    return (client && client->display_fd != -1) ? client->link_rate : 0;
+}
+
+/* Send only the cells of `cells` that differ from what the VFD shows, one
+ * CMD_DISPLAY_RUN per dirty span. Returns 0 when the VFD is (or will be) up
+ * to date, -1 if the caller must fall back to a full repaint. */
+static int write_display_runs(struct millennium_client *client, const char cells[VFD_CELLS]) {
+    vfd_run_t runs[VFD_MAX_RUNS];
+    int n, i;
+
+    n = vfd_diff(client->vfd_shown, cells, runs, VFD_MAX_RUNS);
+    if (n < 0 || serial_tx_lane_depth(&client->serial_tx, SERIAL_TX_DISPLAY) + (unsigned)n >
+                 SERIAL_TX_LANE_FRAMES) {
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        uint8_t frame[3 + VFD_COLS];
+        frame[0] = CMD_DISPLAY_RUN;
+        frame[1] = runs[i].cell;
+        frame[2] = runs[i].len;
+        memcpy(frame + 3, cells + runs[i].cell, runs[i].len);
+        if (serial_queue(client, SERIAL_TX_DISPLAY, frame, 3 + (size_t)runs[i].len, 0) != 0) {
+            return -1;  /* serial_queue invalidated vfd_shown */
+        }
+    }
+    memcpy(client->vfd_shown, cells, VFD_CELLS);
+    logger_debugf_with_category("SDK", "Display updated with %d partial runs", n);
+    if (n > 0) {
+        client->vfd_patched = 1;
+        key_latency_queued(client);
+    }
+    serial_kick(client);
+    return 0;
+}
+
 void millennium_client_write_to_display(struct millennium_client *client, const char *message) {
-    uint8_t cmd_data;
-    size_t total_bytes_written = 0;
+    uint8_t frame[2 + DISPLAY_MAX_PAYLOAD];
+    char cells[VFD_CELLS];
+    int have_cells;
     size_t message_length;
-    if (!message) return;
+    if (!client || !message) return;
 
     logger_debugf_with_category("SDK", "Writing message to display: %s", message);
 
+    /* The usual 20x2 frame, and we know what the VFD shows: send the cells
+     * that changed. A scroll step or a ticking clock is then a few bytes and
+     * a few ms of Arduino time instead of the ~192 ms full repaint below. */
+    have_cells = (vfd_cells_from_message(message, cells) == 0);
+    if (have_cells && client->display_partial_updates && client->vfd_shown_valid &&
+        write_display_runs(client, cells) == 0) {
+        return;
+    }
+
     /* The declared length and the number of bytes actually written must agree
      * (#229). The old code narrowed strlen() to uint8_t for the header but then
      * wrote the full strlen() in the body, so any message of 256 bytes or more
@@ -772,36 +1230,20 @@ void millennium_client_write_to_display(struct millennium_client *client, const
                 (unsigned long)strlen(message), DISPLAY_MAX_PAYLOAD);
     }
 
-    /* Step 1: Write the command */
-    cmd_data = (uint8_t)message_length;
-    millennium_client_write_command(client, 0x02, &cmd_data, 1);
-
-    /* Step 2: Write the message in a loop to ensure all bytes are written */
-
-    while (total_bytes_written < message_length) {
-        ssize_t bytes_written = write(client->display_fd, message + total_bytes_written,
-                                      message_length - total_bytes_written);
-
-        if (bytes_written > 0) {
-            total_bytes_written += bytes_written;
-        } else if (bytes_written == -1) {
-            if (errno == EINTR) {
-                /* Interrupted by a signal, retry */
-                continue;
-            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                /* Non-blocking mode: handle or wait before retrying */
-                struct timespec sleep_time = {0, 200000}; /* 200 microseconds */
-                nanosleep(&sleep_time, NULL);
-                continue;
-            } else {
-                /* Log other errors and exit */
-                logger_errorf_with_category("SDK", "Error writing to display: %s", strerror(errno));
-                return;
-            }
-        }
+    /* One frame: opcode, declared length, message. Queued as a unit so the
+     * length byte and the body can never be separated by another command. */
+    frame[0] = 0x02;
+    frame[1] = (uint8_t)message_length;
+    memcpy(frame + 2, message, message_length);
+    if (serial_queue(client, SERIAL_TX_DISPLAY, frame, message_length + 2, 1) == 0) {
+        /* A full repaint is the baseline later diffs are taken against. */
+        client->vfd_shown_valid = have_cells;
+        if (have_cells) memcpy(client->vfd_shown, cells, VFD_CELLS);
+        client->vfd_repaint_ms = monotonic_ms();
+        client->vfd_patched = 0;
+        key_latency_queued(client);
     }
-
-    logger_debugf_with_category("SDK", "Successfully wrote %lu bytes to display.", (unsigned long)total_bytes_written);
+    serial_kick(client);
 }
 
 void millennium_client_write_to_coin_validator(struct millennium_client *client, uint8_t data) {
@@ -812,83 +1254,91 @@ void millennium_client_write_to_coin_validator(struct millennium_client *client,
         client->coin_gate_cmd = millennium_coin_gate_track(client->coin_gate_cmd, data);
     }
 
-    /* Step 1: Write the command */
+    /* Control lane: goes out ahead of any display repaint still queued. */
     millennium_client_write_command(client, 0x03, &data, 1);
 
-    logger_debugf_with_category("SDK", "Successfully wrote command to coin validator: %d", data);
+    logger_debugf_with_category("SDK", "Queued command to coin validator: %d", data);
 }
 
 void *millennium_client_next_event(struct millennium_client *client) {
-    if (!event_queue_empty(client)) {
-        void *event = event_queue_pop(client);
-        char *repr = event_get_repr((event_t *)event);
-        logger_debugf_with_category("SDK", "Dequeued event: %s %s", 
-                event_get_name((event_t *)event), repr ? repr : "");
-        if (repr) free(repr);
+    void *event = event_queue_pop(client);
+    if (event) {
+        char repr[64];
+        logger_debugf_with_category("SDK", "Dequeued event: %s %s",
+                event_get_name((event_t *)event),
+                event_format_repr((event_t *)event, repr, sizeof(repr)));
         return event;
     }
     return NULL;
 }
 
+void millennium_client_get_event_queue_stats(struct millennium_client *client,
+                                             struct event_ring_stats *out) {
+    event_ring_get_stats(client ? &client->event_queue : NULL, out);
+}
+
 void millennium_client_set_ua(struct millennium_client *client, void *ua) {
     client->ua = ua;
     logger_debugf_with_category("SDK", "UA set to: %p", client->ua);
 }
 
 void millennium_client_write_command(struct millennium_client *client, uint8_t command, const uint8_t *data, size_t data_size) {
+    uint8_t frame[SERIAL_TX_MAX_FRAME];
+
     logger_debugf_with_category("SDK", "Writing command to display: %d", command);
 
     if (!client) return;
-
-    /* Step 1: Write the command */
-    while (1) {
-        ssize_t bytes_written = write(client->display_fd, &command, 1);
-        if (bytes_written == 1) {
-            break;
-        } else if (bytes_written == -1) {
-            if (errno == EINTR) {
-                continue;
-            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                struct timespec sleep_time = {0, 200000}; /* 200 microseconds */
-                nanosleep(&sleep_time, NULL);
-                continue;
-            } else {
-                logger_errorf_with_category("SDK", "Failed to write command: %d, error: %s", 
-                        command, strerror(errno));
-                return;
-            }
-        }
+    if (data_size + 1 > sizeof(frame)) {
+        logger_errorf_with_category("SDK", "Command %d operands too long (%lu bytes); dropped",
+                command, (unsigned long)data_size);
+        return;
     }
 
-    /* Step 2: Write the data if it exists */
+    frame[0] = command;
     if (data && data_size > 0) {
-        size_t total_bytes_written = 0;
-
-        while (total_bytes_written < data_size) {
-            ssize_t result = write(client->display_fd, data + total_bytes_written,
-                                 data_size - total_bytes_written);
-
-            if (result > 0) {
-                total_bytes_written += result;
-            } else if (result == -1) {
-                if (errno == EINTR) {
-                    /* Interrupted by a signal, retry */
-                    continue;
-                } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                    /* Non-blocking mode: handle or log and retry */
-                    struct timespec sleep_time = {0, 200000}; /* 200 microseconds */
-                    nanosleep(&sleep_time, NULL);
-                    continue;
-                } else {
-                    logger_errorf_with_category("SDK", "Error writing data to display, error: %s", strerror(errno));
-                    return;
-                }
-            }
-        }
+        memcpy(frame + 1, data, data_size);
+    } else {
+        data_size = 0;
+    }
+    if (serial_queue(client, SERIAL_TX_CONTROL, frame, data_size + 1, 0) == 0) {
+        serial_kick(client);
+    }
+}
+
+void millennium_client_flush_serial(struct millennium_client *client) {
+    long written;
 
-        logger_debugf_with_category("SDK", "Successfully wrote %lu bytes of data to display.", (unsigned long)total_bytes_written);
+    if (!client || client->display_fd == -1 || serial_tx_pending(&client->serial_tx) == 0) {
+        return;
     }
 
-    /* Any successful write counts as serial activity for the watchdog */
-    millennium_client_serial_activity(client);
+    written = serial_tx_flush(&client->serial_tx, client->display_fd);
+    if (written > 0) {
+        /* Any successful write counts as serial activity for the watchdog */
+        millennium_client_serial_activity(client);
+        key_latency_written(client);
+    } else if (written == -1) {
+        /* Not retried: a write error on the tty is an unplug or a dead
+         * driver, and the read side closes the fd on the same condition.
+         * The queue would only replay into the next connection. */
+        unsigned long dropped = serial_tx_reset(&client->serial_tx);
+        client->vfd_shown_valid = 0;
+        client->key_display_capture_ms = -1;
+        logger_errorf_with_category("SDK", "Error writing to display: %s; dropped %lu queued frames",
+                strerror(errno), dropped);
+    }
+}
+
+int millennium_client_serial_tx_pending(struct millennium_client *client) {
+    return client && client->display_fd != -1 && serial_tx_pending(&client->serial_tx) > 0;
+}
+
+void millennium_client_get_serial_tx_stats(struct millennium_client *client,
+                                           struct serial_tx_stats *out) {
+    serial_tx_get_stats(client ? &client->serial_tx : NULL, out);
+}
+
+void millennium_client_get_serial_link_stats(struct millennium_client *client,
+                                             struct serial_link_stats *out) {
+    serial_link_get_stats(client ? &client->link_rx : NULL, out);
 }
@@ -5,6 +5,12 @@
 #include <string.h>   /* strlen, for millennium_display_payload_len */
 #include <stdint.h>
 #include <time.h>
+#include "event_ring.h"
+#include "link_rate.h"
+#include "serial_link.h"
+#include "serial_parser.h"
+#include "serial_tx.h"
+#include "vfd_diff.h"
 
 /* Forward declarations */
 struct millennium_client;
@@ -28,15 +34,54 @@ typedef struct millennium_logger {
 typedef struct millennium_client {
     int display_fd;
     int is_open;
-    char *input_buffer;
-    size_t input_buffer_size;
-    size_t input_buffer_capacity;
+    /* Arduino -> Pi frame parser; holds any frame split across reads. */
+    serial_parser_t serial_parser;
+    /* Framed link (serial_link.h) in place of the bare marker stream above,
+     * unless hardware.serial_framing is off for older Beta firmware. */
+    int serial_framing;
+    serial_link_rx_t link_rx;
+    unsigned char link_tx_seq;
+    /* Line rate (link_rate.h): negotiated up from hardware.baud_rate towards
+     * hardware.baud_rate_max each time the port opens. */
+    long link_rate;
+    long link_rate_base;
+    long link_rate_max;
+    unsigned link_rate_failed;  /* candidates that failed; bit i = link_rate_candidates[i] */
+    link_rate_monitor_t link_rate_monitor;
+    /* The handshake reply negotiation is waiting for: Beta echoes each
+     * request's payload, so type and payload are the request's. Frames of
+     * that type carrying anything else (replies to earlier requests) are
+     * ignored; link_reply_type is set once the awaited one arrives. */
+    unsigned char link_expect_type;
+    unsigned char link_expect[LINK_RATE_PATTERN_LEN];
+    size_t link_expect_len;
+    unsigned char link_reply_type;
+    /* Keypress-to-display latency, from the age Beta stamps on each event
+     * (SERIAL_LINK_FLAG_STAMP). Monotonic ms of the newest keypress no
+     * display update has answered yet, and of the keypress the queued update
+     * answers; -1 for none. */
+    long key_capture_ms;
+    long key_display_capture_ms;
+    /* Pi -> Arduino output queue, flushed without blocking as the tty takes
+     * it. Touched only under engine_mutex. */
+    serial_tx_t serial_tx;
+    /* What the VFD will show once the display frames already queued are
+     * written, so the next update can send only the cells that differ
+     * (CMD_DISPLAY_RUN). Invalid until the first full repaint, and again
+     * whenever a display frame is lost -- dropped here, or reported damaged
+     * by Beta (SERIAL_LINK_TYPE_REJECT) -- or the port is reopened. */
+    char vfd_shown[VFD_CELLS];
+    int vfd_shown_valid;
+    /* Monotonic ms of the last full repaint queued, and whether runs have
+     * been sent on top of it since: they are repainted over every
+     * VFD_REPAINT_INTERVAL_MS in case one was lost unreported. */
+    long vfd_repaint_ms;
+    int vfd_patched;
+    int display_partial_updates;  /* hardware.display_partial_updates */
     
-    /* Event queue - simple linked list implementation */
-    struct event_queue_node {
-        void *event;
-        struct event_queue_node *next;
-    } *event_queue_head, *event_queue_tail;
+    /* Event queue: bounded lock-free MPSC ring of event_t pointers. Pushed
+     * by the main loop and PJSUA threads, popped only by the main loop. */
+    struct event_ring event_queue;
     
     /* Thread handle - using pthread for C89 compatibility */
     void *thread_handle;
@@ -60,6 +105,17 @@ typedef struct millennium_client {
     /* (#239) Last coin-gate command sent to the validator, replayed after a
      * serial reconnect.  0 until the daemon gates the validator once. */
     uint8_t coin_gate_cmd;
+
+    /* Engine wakeup. Signalled whenever work appears that the main loop would
+     * otherwise only find by polling: an event queued from a PJSUA thread, or
+     * the display going dirty from a web-thread control command. An eventfd on
+     * Linux (both fields the same fd), a non-blocking pipe elsewhere. */
+    int notify_fd;      /* read end: the engine loop watches this */
+    int notify_wr_fd;   /* write end */
+
+    /* Bumped every time open_serial_port() succeeds, so the engine loop can
+     * tell a reopened port from the old one even when the fd number repeats. */
+    unsigned serial_generation;
 } millennium_client_t;
 
 /* Function declarations */
@@ -85,6 +141,35 @@ void millennium_client_write_to_coin_validator(struct millennium_client *client,
 void millennium_client_update(struct millennium_client *client);
 void *millennium_client_next_event(struct millennium_client *client);
 
+/* Engine loop integration (see engine_loop.h). notify_fd becomes readable when
+ * the SDK has queued work; drain it before processing so the next wait blocks.
+ * next_timeout_ms is how long the loop may sleep before update() has deferred
+ * work due (a rate-limited display write): -1 if nothing is pending. */
+int millennium_client_get_notify_fd(struct millennium_client *client);
+void millennium_client_drain_notify(struct millennium_client *client);
+void millennium_client_notify(struct millennium_client *client);
+int millennium_client_next_timeout_ms(struct millennium_client *client);
+
+/* Serial output (see serial_tx.h). Commands and repaints are queued and
+ * written as far as the tty will take without blocking; flush_serial writes
+ * more of the backlog (call it on ENGINE_WAKE_WRITABLE), and serial_tx_pending
+ * says whether the engine loop should be watching for writability. Callers
+ * hold engine_mutex, like every other write path. */
+void millennium_client_flush_serial(struct millennium_client *client);
+int millennium_client_serial_tx_pending(struct millennium_client *client);
+void millennium_client_get_serial_tx_stats(struct millennium_client *client,
+                                           struct serial_tx_stats *out);
+/* Line rate the serial link is running at, in baud; 0 while closed. */
+long millennium_client_get_link_rate(struct millennium_client *client);
+/* Receive-side counters of the framed link; all zero in legacy mode. */
+void millennium_client_get_serial_link_stats(struct millennium_client *client,
+                                             struct serial_link_stats *out);
+
+/* Snapshot of the event queue's depth/high-water/drop counters, for metrics.
+ * Lock-free, callable from any thread. NULL-safe (zeroes the output). */
+void millennium_client_get_event_queue_stats(struct millennium_client *client,
+                                             struct event_ring_stats *out);
+
 /* Call functions */
 void millennium_client_call(struct millennium_client *client, const char *number);
 void millennium_client_answer_call(struct millennium_client *client);
@@ -94,8 +179,7 @@ void millennium_client_set_ua(struct millennium_client *client, void *ua);
 
 /* Internal functions */
 void millennium_client_write_command(struct millennium_client *client, uint8_t command, const uint8_t *data, size_t data_size);
-void millennium_client_process_event_buffer(struct millennium_client *client);
-char *millennium_client_extract_payload(struct millennium_client *client, char event_type, size_t event_start);
+void millennium_client_feed_serial(struct millennium_client *client, const char *data, size_t len);
 void millennium_client_write_to_display(struct millennium_client *client, const char *message);
 
 /* Serial health and reconnection */
@@ -110,13 +194,17 @@ void list_audio_devices(void);
 void millennium_sdk_get_sip_status(int *registered, char *last_error, size_t last_error_size);
 
 /* Constants */
-#define BAUD_RATE B9600
 #define ASYNC_WORKERS 4
+#define DISPLAY_MIN_WRITE_INTERVAL_MS 33  /* rate limit on display repaints */
+#define KEY_DISPLAY_WINDOW_MS 2000  /* a display update later than this answers no keypress */
+#define VFD_REPAINT_INTERVAL_MS 30000  /* full repaint this often while runs are sent */
 #define SERIAL_WATCHDOG_SECONDS 60
 #define SERIAL_KEEPALIVE_INTERVAL 30   /* (#59) send keepalive when idle this long */
 #define SERIAL_MAX_BACKOFF_SECONDS 60
 #define SERIAL_WATCHDOG_ENABLED 1
 #define CMD_KEEPALIVE 0x06  /* Pi->Arduino: no-op, resets watchdog activity timer */
+#define CMD_DISPLAY_RUN 0x07  /* Pi->Arduino: cell, length, chars -- write in place */
+#define CMD_LINK_RATE 0x08    /* Pi->Arduino: 4-byte big-endian baud rate; echoed, then switched to */
 
 /* Largest display payload the 0x02 frame can carry (#229).
  *
@@ -125,9 +213,11 @@ void millennium_sdk_get_sip_status(int *registered, char *last_error, size_t las
  * The length is also carried in a single byte, so it could never exceed 255
  * regardless.
  *
- * The framing has no resynchronisation: the receiver consumes exactly the
- * number of bytes the header declares, so if the header and the body ever
- * disagree the remainder of the message is read as command opcodes. */
+ * The legacy framing has no resynchronisation: the receiver consumes exactly
+ * the number of bytes the header declares, so if the header and the body ever
+ * disagree the remainder of the message is read as command opcodes. The
+ * framed link (serial_link.h) carries the same operands inside a checked
+ * frame, which SERIAL_LINK_MAX_PAYLOAD is sized for. */
 #define DISPLAY_MAX_PAYLOAD 100
 
 /* Number of bytes millennium_client_write_to_display will actually send for
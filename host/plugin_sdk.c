@@ -153,7 +153,7 @@ void sdk_release_session(void) {
         } else {
             call_metrics_incoming_ended();
         }
-        metrics_increment_counter("plugin_switch_calls_released", 1);
+        METRICS_COUNTER_ADD("plugin_switch_calls_released", 1);
         logger_warn_with_category("Plugins",
                 "Plugin switched during a call; releasing it");
     }
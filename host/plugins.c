@@ -21,6 +21,11 @@ static int plugin_count = 0;
 static int active_plugin_index = -1;
 static pthread_mutex_t plugins_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/* Per-plugin series of the plugin_activations counter, labelled with the
+ * plugin name at registration and resolved through a cached ref (metrics.h).
+ * Indexed like plugins[], whose slots never move. */
+static metrics_ref_t activation_ref[MAX_PLUGINS];
+
 /* External references */
 extern daemon_state_data_t *daemon_state;
 extern millennium_client_t *client;
@@ -88,6 +93,12 @@ int plugins_register(const char *name, const char *description,
     plugins[plugin_count].handle_card = card_handler;
     plugins[plugin_count].handle_activation = activation_handler;
     plugins[plugin_count].handle_tick = tick_handler;
+
+    activation_ref[plugin_count].name = "plugin_activations";
+    activation_ref[plugin_count].label = "plugin";
+    activation_ref[plugin_count].label_value = name;
+    activation_ref[plugin_count].handle = NULL;
+    activation_ref[plugin_count].generation = 0;
     
     plugin_count++;
     
@@ -98,22 +109,20 @@ int plugins_register(const char *name, const char *description,
 /* Bump the activation counters for a plugin that was just made active.
  *
  * Exposes which of the built-in experiences actually get used on a phone in
- * the field: a per-plugin counter (plugin_activations_<name>) plus an
+ * the field: a per-plugin counter (plugin_activations{plugin="<name>"}) plus an
  * aggregate (plugin_activations_total). Both are plain Prometheus counters, so
  * they ride out through the existing dynamic metrics export with no endpoint
  * changes. "Activation" here means "made the active plugin" — that includes the
  * boot-time default and a restore from persistence, not only deliberate user
  * switches, which is the honest count for a counter named this way.
  *
- * Called *after* releasing plugins_mutex: metrics_increment_counter takes its
- * own lock, and keeping the two mutexes strictly un-nested avoids any lock
+ * Called *after* releasing plugins_mutex: the metrics calls take their own
+ * lock, and keeping the two mutexes strictly un-nested avoids any lock
  * ordering concern. Safe before metrics_init() too — the increment is a no-op
  * until the metrics subsystem is up. */
-static void plugins_record_activation(const char *name) {
-    char counter[128];
-    metrics_increment_counter("plugin_activations_total", 1);
-    snprintf(counter, sizeof(counter), "plugin_activations_%s", name);
-    metrics_increment_counter(counter, 1);
+static void plugins_record_activation(int index) {
+    METRICS_COUNTER_ADD("plugin_activations_total", 1);
+    metrics_counter_add(metrics_counter_ref(&activation_ref[index]), 1);
 }
 
 int plugins_activate(const char *plugin_name) {
@@ -183,7 +192,7 @@ int plugins_activate(const char *plugin_name) {
     pthread_mutex_unlock(&plugins_mutex);
 
     logger_infof_with_category("Plugins", "Plugin %s activated", plugin_name);
-    plugins_record_activation(plugin_name);
+    plugins_record_activation(i);
     return 0;
 }
 
@@ -409,11 +409,11 @@ static void classic_phone_start_call(void) {
      * the same priority order as classic_phone_check_and_call() selects the
      * type (free number first, then card, then coin). */
     if (classic_phone_data.is_emergency_call) {
-        metrics_increment_counter("calls_emergency", 1);
+        METRICS_COUNTER_ADD("calls_emergency", 1);
     } else if (classic_phone_data.is_card_call) {
-        metrics_increment_counter("calls_card", 1);
+        METRICS_COUNTER_ADD("calls_card", 1);
     } else {
-        metrics_increment_counter("calls_coin", 1);
+        METRICS_COUNTER_ADD("calls_coin", 1);
     }
 
     snprintf(log_msg, sizeof(log_msg), "%s call to %s",
@@ -508,7 +508,7 @@ static void classic_phone_tick(void) {
     if (remaining <= 0) {
         logger_info_with_category("ClassicPhone",
                                   "Call timeout reached, ending call");
-        metrics_increment_counter("calls_timed_out", 1);
+        METRICS_COUNTER_ADD("calls_timed_out", 1);
         classic_phone_end_call();
         return;
     }
@@ -0,0 +1,213 @@
+#include "serial_link.h"
+
+#include <string.h>
+
+uint16_t serial_link_crc16(const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    uint16_t crc = 0xFFFF;
+    size_t i;
+    int bit;
+    for (i = 0; i < len; i++) {
+        crc ^= (uint16_t)(p[i] << 8);
+        for (bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+/* COBS-encode `len` bytes of `in` to `out`, which has room for `len + len/254
+ * + 1`. Returns the encoded length. */
+static size_t cobs_encode(const unsigned char *in, size_t len, unsigned char *out) {
+    size_t code_at = 0, o = 1, i;
+    unsigned char code = 1;
+    for (i = 0; i < len; i++) {
+        if (in[i] == 0) {
+            out[code_at] = code;
+            code_at = o++;
+            code = 1;
+        } else {
+            out[o++] = in[i];
+            if (++code == 0xFF) {
+                out[code_at] = code;
+                code_at = o++;
+                code = 1;
+            }
+        }
+    }
+    out[code_at] = code;
+    return o;
+}
+
+/* Decode `len` bytes of COBS from `in` to `out` (room for `out_size`).
+ * Returns the decoded length, or -1 if the input is not valid COBS or does
+ * not fit. */
+static long cobs_decode(const unsigned char *in, size_t len,
+                        unsigned char *out, size_t out_size) {
+    size_t i = 0, o = 0;
+    while (i < len) {
+        unsigned char code = in[i++];
+        unsigned char k;
+        if (code == 0) return -1;
+        for (k = 1; k < code; k++) {
+            if (i >= len || o >= out_size) return -1;
+            out[o++] = in[i++];
+        }
+        if (code < 0xFF && i < len) {
+            if (o >= out_size) return -1;
+            out[o++] = 0;
+        }
+    }
+    return (long)o;
+}
+
+size_t serial_link_encode(unsigned char flags, unsigned char seq, unsigned char type,
+                          const void *payload, size_t len,
+                          unsigned char *out, size_t out_size) {
+    unsigned char raw[SERIAL_LINK_MAX_DECODED];
+    size_t raw_len, enc_len;
+    uint16_t crc;
+
+    if (!out || len > SERIAL_LINK_MAX_PAYLOAD || (len > 0 && !payload)) return 0;
+
+    raw[0] = (unsigned char)((SERIAL_LINK_VERSION << 4) | (flags & 0x0F));
+    raw[1] = seq;
+    raw[2] = type;
+    if (len > 0) memcpy(raw + SERIAL_LINK_HEADER, payload, len);
+    raw_len = SERIAL_LINK_HEADER + len;
+    crc = serial_link_crc16(raw, raw_len);
+    raw[raw_len++] = (unsigned char)(crc >> 8);
+    raw[raw_len++] = (unsigned char)(crc & 0xFF);
+
+    if (out_size < raw_len + raw_len / 254 + 1 + 2) return 0;
+    out[0] = 0;
+    enc_len = cobs_encode(raw, raw_len, out + 1);
+    out[1 + enc_len] = 0;
+    return enc_len + 2;
+}
+
+void serial_link_rx_init(serial_link_rx_t *rx) {
+    if (!rx) return;
+    memset(rx, 0, sizeof(*rx));
+}
+
+void serial_link_rx_reset(serial_link_rx_t *rx) {
+    if (!rx) return;
+    rx->have = 0;
+    rx->overflow = 0;
+    rx->synced = 0;
+    rx->last_syn = 0;
+    rx->ack_pending = 0;
+}
+
+/* Sequence-number check for a reliable frame. Returns 1 to deliver it. */
+static int accept_reliable(serial_link_rx_t *rx, unsigned char flags, unsigned char seq) {
+    int syn = (flags & SERIAL_LINK_FLAG_SYN) != 0;
+    /* The sender sets SYN on every frame until it hears its first ACK. SYN
+     * after a non-SYN frame is therefore a restarted sender; SYN after SYN
+     * is the same one, still numbering from where it started. */
+    int restart = syn && !rx->last_syn;
+
+    if (!rx->synced || restart || seq == (unsigned char)(rx->last_seq + 1)) {
+        rx->synced = 1;
+        rx->last_seq = seq;
+        rx->last_syn = syn;
+        rx->ack_pending = 1;
+        rx->ack_seq = seq;
+        return 1;
+    }
+    if ((signed char)(seq - rx->last_seq) <= 0) {
+        /* Already delivered; our ACK must have been lost. Say so again. */
+        rx->duplicates++;
+        rx->ack_pending = 1;
+        rx->ack_seq = rx->last_seq;
+        return 0;
+    }
+    /* A frame in between was lost. Drop this one too and let go-back-N
+     * resend both in order. */
+    rx->out_of_order++;
+    return 0;
+}
+
+/* One complete encoded frame is in rx->buf. */
+static int process_frame(serial_link_rx_t *rx, serial_link_frame_cb cb, void *ctx) {
+    unsigned char raw[SERIAL_LINK_MAX_DECODED];
+    long n = cobs_decode(rx->buf, rx->have, raw, sizeof(raw));
+    serial_link_frame_t f;
+    uint16_t crc;
+
+    if (n < SERIAL_LINK_HEADER + SERIAL_LINK_CRC) {
+        rx->framing_errors++;
+        return 0;
+    }
+    crc = (uint16_t)((raw[n - 2] << 8) | raw[n - 1]);
+    if (serial_link_crc16(raw, (size_t)n - SERIAL_LINK_CRC) != crc) {
+        rx->crc_errors++;
+        return 0;
+    }
+    if ((raw[0] >> 4) != SERIAL_LINK_VERSION) {
+        rx->version_errors++;
+        return 0;
+    }
+
+    f.flags = raw[0] & 0x0F;
+    f.seq = raw[1];
+    f.type = raw[2];
+    f.payload = raw + SERIAL_LINK_HEADER;
+    f.len = (size_t)n - SERIAL_LINK_HEADER - SERIAL_LINK_CRC;
+    f.stamped = (f.flags & SERIAL_LINK_FLAG_STAMP) != 0;
+    f.age_ms = 0;
+    if (f.stamped) {
+        if (f.len < SERIAL_LINK_STAMP_LEN) {
+            rx->framing_errors++;
+            return 0;
+        }
+        f.len -= SERIAL_LINK_STAMP_LEN;
+        f.age_ms = (unsigned)((f.payload[f.len] << 8) | f.payload[f.len + 1]);
+    }
+
+    if ((f.flags & SERIAL_LINK_FLAG_ACK_REQ) && !accept_reliable(rx, f.flags, f.seq)) {
+        return 0;
+    }
+    rx->frames_ok++;
+    if (cb) cb(ctx, &f);
+    return 1;
+}
+
+size_t serial_link_rx_feed(serial_link_rx_t *rx, const void *data, size_t len,
+                           serial_link_frame_cb cb, void *ctx) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    size_t frames = 0, i;
+
+    if (!rx || !data) return 0;
+
+    for (i = 0; i < len; i++) {
+        unsigned char c = bytes[i];
+        if (c == 0) {
+            if (rx->overflow) {
+                rx->framing_errors++;
+            } else if (rx->have > 0) {
+                frames += (size_t)process_frame(rx, cb, ctx);
+            }
+            rx->have = 0;
+            rx->overflow = 0;
+        } else if (rx->have < sizeof(rx->buf)) {
+            rx->buf[rx->have++] = c;
+        } else {
+            rx->overflow = 1;
+        }
+    }
+    return frames;
+}
+
+void serial_link_get_stats(const serial_link_rx_t *rx, struct serial_link_stats *out) {
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if (!rx) return;
+    out->frames_ok = rx->frames_ok;
+    out->crc_errors = rx->crc_errors;
+    out->framing_errors = rx->framing_errors;
+    out->version_errors = rx->version_errors;
+    out->duplicates = rx->duplicates;
+    out->out_of_order = rx->out_of_order;
+}
@@ -0,0 +1,171 @@
+/* Framed, checksummed link between the Pi and the display Arduino (Beta).
+ *
+ * The original protocol is bare ASCII: a marker letter and a payload whose
+ * width is implied by the letter (serial_parser.h). It has no way to tell a
+ * payload byte from a marker, no checksum, and no resynchronisation, so one
+ * stray debug letter from Beta used to eat the real events behind it (#259),
+ * and a keypress lost on the way was simply gone.
+ *
+ * Link version 1 wraps every message, in both directions, as
+ *
+ *     0x00  COBS( ver|flags  seq  type  payload...  crc_hi crc_lo )  0x00
+ *
+ *   ver|flags  high nibble SERIAL_LINK_VERSION, low nibble SERIAL_LINK_FLAG_*
+ *   seq        sender's sequence number (meaningful on reliable frames)
+ *   type       Beta -> Pi: the EVENT_TYPE_* letter; Pi -> Beta: the command
+ *              opcode (0x02 display, 0x03 coin, ...); SERIAL_LINK_TYPE_ACK
+ *   payload    exactly what followed the marker/opcode in the old protocol
+ *   crc        CRC-16/CCITT-FALSE over ver|flags..payload, big-endian
+ *
+ * COBS removes every 0x00 from the frame, so 0x00 only ever delimits: a
+ * receiver that loses its place -- line noise, a reset mid-frame -- is back
+ * in sync at the next delimiter, and the CRC rejects whatever was damaged.
+ * Sending a delimiter before the frame as well as after flushes anything a
+ * rebooting peer left half-written.
+ *
+ * Reliable frames (SERIAL_LINK_FLAG_ACK_REQ: keypad, hook, coin, card and
+ * coin-EEPROM events) are numbered consecutively by Beta and held until the Pi
+ * acknowledges them. The Pi acknowledges cumulatively -- one ACK for the
+ * newest in-order frame -- and ignores a frame that skips ahead, so Beta's
+ * go-back-N retransmission refills any gap in order. A retransmission the Pi
+ * has already accepted is acknowledged again but not delivered twice: a coin
+ * is credited once however many times it crosses the wire. Heartbeats and
+ * diagnostics are sent unreliably.
+ *
+ * Beta numbers from 0 after every reset and marks its frames SYN until the
+ * first ACK comes back, so a SYN frame after an unmarked one tells the Pi to
+ * start over from that frame's number. (A Beta that resets again before any
+ * ACK reaches it is indistinguishable from its own retransmission; its first
+ * events can then be taken for duplicates.)
+ *
+ * Events captured by hand -- a key, the hook, a card, a coin -- are sent with
+ * SERIAL_LINK_FLAG_STAMP: the last SERIAL_LINK_STAMP_LEN payload bytes are
+ * the milliseconds since the Arduino that saw the event captured it,
+ * big-endian, saturating at 0xFFFF. Alpha counts its own queueing and I2C
+ * retries, Beta adds its ring and retransmissions, each on its own clock, so
+ * the Pi can place the capture on its monotonic clock without the three ever
+ * agreeing on the time. The receiver strips the age before the callback.
+ *
+ * Commands from the Pi are checked but not acknowledged: a corrupted one is
+ * dropped. The coin gate is restated on every tick, so the next one repairs
+ * it. Display updates are not: most are CMD_DISPLAY_RUNs diffed against
+ * what the VFD is taken to show, so one lost puts every later diff on a
+ * wrong base. Beta therefore answers each damaged frame it drops with an
+ * unreliable SERIAL_LINK_TYPE_REJECT, on which the Pi forgets what the VFD
+ * shows and repaints it in full; and while runs are being sent the Pi
+ * repaints in full every VFD_REPAINT_INTERVAL_MS anyway, for a frame lost
+ * without a trace or a report that was lost itself.
+ *
+ * The Arduino side (display.ino) carries its own copy of the encoder, the
+ * decoder and the CRC; the unit tests pin the byte format down.
+ */
+#ifndef SERIAL_LINK_H
+#define SERIAL_LINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SERIAL_LINK_VERSION 1
+
+#define SERIAL_LINK_FLAG_ACK_REQ 0x01  /* reliable: acknowledge this seq */
+#define SERIAL_LINK_FLAG_ACK     0x02  /* acknowledges every reliable frame up to seq */
+#define SERIAL_LINK_FLAG_SYN     0x04  /* sender has not yet had an ACK since it started */
+#define SERIAL_LINK_FLAG_STAMP   0x08  /* payload ends with the event's age, below */
+
+#define SERIAL_LINK_TYPE_ACK 0x00
+/* Round-trip test: the receiver sends the payload straight back, unreliably,
+ * with the same type. Used to confirm a new line rate (link_rate.h). */
+#define SERIAL_LINK_TYPE_ECHO 0x01
+/* Beta -> Pi, unreliable, no payload: a frame from the Pi arrived damaged
+ * and was dropped. Neither an event letter nor a command opcode. */
+#define SERIAL_LINK_TYPE_REJECT 0x7F
+
+#define SERIAL_LINK_HEADER 3  /* ver|flags, seq, type */
+#define SERIAL_LINK_CRC    2
+#define SERIAL_LINK_STAMP_LEN 2
+
+/* Largest payload: the 0x02 display command's length byte and 100 chars,
+ * with a little room. */
+#define SERIAL_LINK_MAX_PAYLOAD 104
+#define SERIAL_LINK_MAX_DECODED \
+    (SERIAL_LINK_HEADER + SERIAL_LINK_MAX_PAYLOAD + SERIAL_LINK_CRC)
+/* COBS adds one byte per 254 (rounded up); plus the two delimiters. */
+#define SERIAL_LINK_MAX_ENCODED \
+    (SERIAL_LINK_MAX_DECODED + SERIAL_LINK_MAX_DECODED / 254 + 1 + 2)
+
+/* One frame that passed the CRC and version checks. `payload` points into
+ * the receiver's buffer and is only valid during the callback; a stamp has
+ * already been taken off it into `age_ms`. */
+typedef struct {
+    unsigned char flags;
+    unsigned char seq;
+    unsigned char type;
+    const unsigned char *payload;
+    size_t len;
+    int stamped;          /* SERIAL_LINK_FLAG_STAMP was set */
+    unsigned age_ms;      /* ...and this is the event's age on arrival */
+} serial_link_frame_t;
+
+typedef void (*serial_link_frame_cb)(void *ctx, const serial_link_frame_t *frame);
+
+typedef struct {
+    /* Encoded bytes since the last delimiter. */
+    unsigned char buf[SERIAL_LINK_MAX_ENCODED];
+    size_t have;
+    int overflow;            /* this frame outgrew buf; skip to the delimiter */
+
+    /* Reliable delivery. */
+    int synced;              /* last_seq is meaningful */
+    unsigned char last_seq;  /* newest reliable seq delivered in order */
+    int last_syn;            /* ...and it carried SYN */
+    int ack_pending;         /* an ACK for ack_seq is owed to the sender */
+    unsigned char ack_seq;
+
+    /* Lifetime counters. */
+    unsigned long frames_ok;       /* delivered to the callback */
+    unsigned long crc_errors;
+    unsigned long framing_errors;  /* bad COBS, too short, too long, stamp missing */
+    unsigned long version_errors;
+    unsigned long duplicates;      /* retransmissions already delivered */
+    unsigned long out_of_order;    /* skipped ahead of a lost frame; dropped */
+} serial_link_rx_t;
+
+/* Counter snapshot for metrics; all lifetime totals. */
+struct serial_link_stats {
+    unsigned long frames_ok;
+    unsigned long crc_errors;
+    unsigned long framing_errors;
+    unsigned long version_errors;
+    unsigned long duplicates;
+    unsigned long out_of_order;
+};
+
+/* CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF): "123456789" -> 0x29B1. */
+uint16_t serial_link_crc16(const void *data, size_t len);
+
+/* Build a complete frame, delimiters included, into `out`. Returns its
+ * length, or 0 if the payload is too long or `out` too small
+ * (SERIAL_LINK_MAX_ENCODED always suffices). */
+size_t serial_link_encode(unsigned char flags, unsigned char seq, unsigned char type,
+                          const void *payload, size_t len,
+                          unsigned char *out, size_t out_size);
+
+/* Fresh receiver: no partial frame, not synced, counters zeroed. */
+void serial_link_rx_init(serial_link_rx_t *rx);
+
+/* Drop any partial frame and forget the peer's sequence (its next reliable
+ * frame is accepted whatever its number). Counters are kept. Call when the
+ * port is reopened. */
+void serial_link_rx_reset(serial_link_rx_t *rx);
+
+/* Feed received bytes. `cb` sees each good, non-duplicate frame in order.
+ * Afterwards, if rx->ack_pending is set the caller owes the sender an ACK
+ * for rx->ack_seq (and clears ack_pending once it is queued). Returns the
+ * number of frames delivered. */
+size_t serial_link_rx_feed(serial_link_rx_t *rx, const void *data, size_t len,
+                           serial_link_frame_cb cb, void *ctx);
+
+/* NULL-safe (zeroes the output). */
+void serial_link_get_stats(const serial_link_rx_t *rx, struct serial_link_stats *out);
+
+#endif /* SERIAL_LINK_H */
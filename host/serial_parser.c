@@ -0,0 +1,100 @@
+#include "serial_parser.h"
+
+#include <string.h>
+
+#define NM SERIAL_NOT_MARKER
+
+/* Indexed by byte value. Must agree with the EVENT_TYPE_* letters in events.h
+ * (unit-tested) and must not claim any byte Beta writes back as a debug echo
+ * (#259, also unit-tested):
+ *
+ *   'K' keypad 1   'H' hook 1    'V' coin 1     'C' card 16    'E' EEPROM error 3
+ *   'G' diag 4     'P' heartbeat 0
+ *   'A' 'B' 'D' 'F' coin EEPROM upload/validation start/end 0
+ *   '@' 0 -- a legacy marker with no event. The old scanner consumed it as
+ *          a frame, so it still is; the SDK ignores it.
+ */
+const unsigned char serial_marker_payload_len[256] = {
+    /* 0x00 */ NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM,
+    /* 0x10 */ NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM,
+    /* 0x20 */ NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM,
+    /* 0x30 */ NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM,
+    /* 0x40  @   A   B   C   D   E   F   G   H   I   J   K   L   M   N   O */
+               0,  0,  0, 16,  0,  3,  0,  4,  1, NM, NM,  1, NM, NM, NM, NM,
+    /* 0x50  P   Q   R   S   T   U   V   W   X   Y   Z   [   \   ]   ^   _ */
+               0, NM, NM, NM, NM, NM,  1, NM, NM, NM, NM, NM, NM, NM, NM, NM,
+    /* 0x60 */ NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM,
+    /* 0x70 */ NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM,
+    /* 0x80 */ NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM,
+    /* 0x90 */ NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM,
+    /* 0xA0 */ NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM,
+    /* 0xB0 */ NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM,
+    /* 0xC0 */ NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM,
+    /* 0xD0 */ NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM,
+    /* 0xE0 */ NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM,
+    /* 0xF0 */ NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, NM
+};
+
+#undef NM
+
+void serial_parser_init(serial_parser_t *p) {
+    if (!p) return;
+    memset(p, 0, sizeof(*p));
+}
+
+void serial_parser_reset(serial_parser_t *p) {
+    if (!p) return;
+    p->marker = 0;
+    p->need = 0;
+    p->have = 0;
+    p->payload[0] = '\0';
+}
+
+static void emit(serial_parser_t *p, serial_frame_cb cb, void *ctx) {
+    p->payload[p->have] = '\0';
+    p->frames_total++;
+    if (cb) cb(ctx, (char)p->marker, p->payload, p->have);
+    p->marker = 0;
+    p->need = 0;
+    p->have = 0;
+}
+
+size_t serial_parser_feed(serial_parser_t *p, const void *data, size_t len,
+                          serial_frame_cb cb, void *ctx) {
+    /* Bytes, not chars: the table is indexed by value, and a signed char
+     * would go negative for line noise above 0x7F. */
+    const unsigned char *bytes = (const unsigned char *)data;
+    size_t i = 0;
+    size_t frames = 0;
+
+    if (!p || !data) return 0;
+
+    while (i < len) {
+        if (p->marker == 0) {
+            /* Hunting. */
+            unsigned char c = bytes[i++];
+            unsigned char plen = serial_marker_payload_len[c];
+            if (plen == SERIAL_NOT_MARKER) {
+                p->skipped_bytes++;
+                continue;
+            }
+            p->marker = c;
+            p->need = plen;
+            p->have = 0;
+        } else {
+            /* Collecting: take as much of the payload as this feed holds. */
+            size_t take = len - i;
+            if (take > p->need) take = p->need;
+            memcpy(p->payload + p->have, bytes + i, take);
+            p->have += take;
+            p->need -= take;
+            i += take;
+        }
+
+        if (p->marker != 0 && p->need == 0) {
+            emit(p, cb, ctx);
+            frames++;
+        }
+    }
+    return frames;
+}
@@ -0,0 +1,66 @@
+/* Incremental parser for the Arduino -> Pi serial event stream.
+ *
+ * The stream is a sequence of frames: one marker byte (an EVENT_TYPE_* letter
+ * from events.h) followed by a fixed-width payload whose length depends only
+ * on the marker. Bytes outside a frame are line noise or Beta's debug echoes
+ * and are skipped.
+ *
+ * This used to be done by appending every read() to a growing input_buffer
+ * and, per event, rescanning it from the start with a chain of comparisons,
+ * malloc'ing the payload, strlen'ing it, and memmove'ing the tail down -- so a
+ * burst (a card swipe, a diagnostics replay) cost O(n^2) and a handful of
+ * allocations per event. It also dropped the marker of any frame whose payload
+ * was split across two reads.
+ *
+ * The parser here is a byte-at-a-time state machine: hunting for a marker, or
+ * collecting a payload. A partial frame is simply the parser's state, so reads
+ * are fed straight in as they arrive and each byte is looked at exactly once.
+ * Completed payloads are handed to the callback from the parser's own
+ * fixed-size frame buffer; nothing is allocated.
+ *
+ * serial_marker_payload_len[] is the single definition of the framing. The
+ * CBMC harness (tests/cbmc_serial_parser.c) compiles this file rather than a
+ * copy of it, so the proof covers the code that ships.
+ */
+#ifndef SERIAL_PARSER_H
+#define SERIAL_PARSER_H
+
+#include <stddef.h>
+
+/* Longest payload of any marker (the 16-digit card number). */
+#define SERIAL_MAX_PAYLOAD 16
+
+/* serial_marker_payload_len[] entry for a byte that does not start a frame. */
+#define SERIAL_NOT_MARKER 0xFF
+
+/* Payload length for each byte value, or SERIAL_NOT_MARKER. */
+extern const unsigned char serial_marker_payload_len[256];
+
+/* Called once per complete frame. `payload` is NUL-terminated and `len` bytes
+ * long (it may contain NULs of its own); it is only valid during the call. */
+typedef void (*serial_frame_cb)(void *ctx, char marker, const char *payload, size_t len);
+
+typedef struct {
+    unsigned char marker; /* frame being collected; 0 while hunting */
+    size_t need;          /* payload bytes the current frame still needs */
+    size_t have;          /* payload bytes collected so far */
+    char payload[SERIAL_MAX_PAYLOAD + 1];
+    /* Lifetime counters. */
+    unsigned long frames_total;
+    unsigned long skipped_bytes;  /* bytes seen while hunting that were not markers */
+} serial_parser_t;
+
+/* Reset to hunting with no partial frame; counters are zeroed too. */
+void serial_parser_init(serial_parser_t *p);
+
+/* Drop any partial frame but keep the counters. Call when the link is
+ * reopened: half a frame from before an unplug must not swallow the first
+ * bytes of the new connection. */
+void serial_parser_reset(serial_parser_t *p);
+
+/* Feed `len` bytes. Invokes `cb` for every frame completed by these bytes and
+ * returns how many that was. A frame may span any number of feeds. */
+size_t serial_parser_feed(serial_parser_t *p, const void *data, size_t len,
+                          serial_frame_cb cb, void *ctx);
+
+#endif /* SERIAL_PARSER_H */
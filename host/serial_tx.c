@@ -0,0 +1,198 @@
+#include "serial_tx.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+void serial_tx_init(serial_tx_t *tx) {
+    if (!tx) return;
+    memset(tx, 0, sizeof(*tx));
+    tx->active_lane = -1;
+}
+
+unsigned long serial_tx_reset(serial_tx_t *tx) {
+    unsigned long discarded = 0;
+    int lane;
+    if (!tx) return 0;
+    for (lane = 0; lane < SERIAL_TX_LANES; lane++) {
+        discarded += tx->lanes[lane].count;
+        tx->lanes[lane].head = 0;
+        tx->lanes[lane].count = 0;
+    }
+    tx->active_lane = -1;
+    tx->active_off = 0;
+    tx->queued_bytes = 0;
+    tx->frames_dropped_total += discarded;
+    return discarded;
+}
+
+static struct serial_tx_frame *ring_at(struct serial_tx_ring *r, unsigned i) {
+    return &r->frames[(r->head + i) % SERIAL_TX_LANE_FRAMES];
+}
+
+/* Drop the frames on `lane` that have not started going out. The head stays
+ * if it is partly written: it has to finish or the Arduino loses framing. */
+static void coalesce(serial_tx_t *tx, serial_tx_lane_t lane) {
+    struct serial_tx_ring *r = &tx->lanes[lane];
+    unsigned keep = (tx->active_lane == (int)lane) ? 1 : 0;
+    unsigned i;
+    for (i = keep; i < r->count; i++) {
+        tx->queued_bytes -= ring_at(r, i)->len;
+        tx->frames_coalesced_total++;
+    }
+    if (r->count > keep) r->count = keep;
+}
+
+int serial_tx_enqueue(serial_tx_t *tx, serial_tx_lane_t lane,
+                      const void *frame, size_t len) {
+    struct serial_tx_ring *r;
+    struct serial_tx_frame *slot;
+
+    if (!tx || (unsigned)lane >= SERIAL_TX_LANES || !frame ||
+        len == 0 || len > SERIAL_TX_MAX_FRAME) {
+        return -1;
+    }
+    r = &tx->lanes[lane];
+
+    if (r->count == SERIAL_TX_LANE_FRAMES) {
+        tx->frames_dropped_total++;
+        return -1;
+    }
+
+    slot = ring_at(r, r->count);
+    memcpy(slot->bytes, frame, len);
+    slot->len = len;
+    r->count++;
+
+    tx->queued_bytes += len;
+    if (tx->queued_bytes > tx->high_water_bytes) {
+        tx->high_water_bytes = tx->queued_bytes;
+    }
+    return 0;
+}
+
+int serial_tx_replace(serial_tx_t *tx, serial_tx_lane_t lane,
+                      const void *frame, size_t len) {
+    if (!tx || (unsigned)lane >= SERIAL_TX_LANES || !frame ||
+        len == 0 || len > SERIAL_TX_MAX_FRAME) {
+        return -1;
+    }
+    coalesce(tx, lane);
+    return serial_tx_enqueue(tx, lane, frame, len);
+}
+
+unsigned serial_tx_lane_depth(const serial_tx_t *tx, serial_tx_lane_t lane) {
+    if (!tx || (unsigned)lane >= SERIAL_TX_LANES) return 0;
+    return tx->lanes[lane].count;
+}
+
+int serial_tx_peek(const serial_tx_t *tx, struct iovec *iov, int max) {
+    int n = 0;
+    int lane;
+    if (!tx || !iov) return 0;
+
+    if (tx->active_lane >= 0 && n < max) {
+        const struct serial_tx_ring *r = &tx->lanes[tx->active_lane];
+        const struct serial_tx_frame *f = &r->frames[r->head];
+        iov[n].iov_base = (void *)(f->bytes + tx->active_off);
+        iov[n].iov_len = f->len - tx->active_off;
+        n++;
+    }
+    for (lane = 0; lane < SERIAL_TX_LANES; lane++) {
+        const struct serial_tx_ring *r = &tx->lanes[lane];
+        unsigned i = (lane == tx->active_lane) ? 1 : 0;
+        for (; i < r->count && n < max; i++) {
+            const struct serial_tx_frame *f =
+                &r->frames[(r->head + i) % SERIAL_TX_LANE_FRAMES];
+            iov[n].iov_base = (void *)f->bytes;
+            iov[n].iov_len = f->len;
+            n++;
+        }
+    }
+    return n;
+}
+
+void serial_tx_consume(serial_tx_t *tx, size_t n) {
+    if (!tx) return;
+    if (n > tx->queued_bytes) n = tx->queued_bytes;
+    tx->bytes_written_total += n;
+
+    while (n > 0) {
+        int lane;
+        struct serial_tx_ring *r;
+        size_t off, rem;
+
+        /* Same order as serial_tx_peek(). */
+        if (tx->active_lane >= 0) {
+            lane = tx->active_lane;
+        } else if (tx->lanes[SERIAL_TX_CONTROL].count > 0) {
+            lane = SERIAL_TX_CONTROL;
+        } else {
+            lane = SERIAL_TX_DISPLAY;
+        }
+        r = &tx->lanes[lane];
+        off = (lane == tx->active_lane) ? tx->active_off : 0;
+        rem = r->frames[r->head].len - off;
+
+        if (n >= rem) {
+            r->head = (r->head + 1) % SERIAL_TX_LANE_FRAMES;
+            r->count--;
+            tx->queued_bytes -= rem;
+            tx->frames_written_total++;
+            tx->active_lane = -1;
+            tx->active_off = 0;
+            n -= rem;
+        } else {
+            tx->active_lane = lane;
+            tx->active_off = off + n;
+            tx->queued_bytes -= n;
+            n = 0;
+        }
+    }
+}
+
+long serial_tx_flush(serial_tx_t *tx, int fd) {
+    long total = 0;
+    if (!tx) return 0;
+
+    while (tx->queued_bytes > 0) {
+        struct iovec iov[SERIAL_TX_MAX_IOV];
+        int cnt = serial_tx_peek(tx, iov, SERIAL_TX_MAX_IOV);
+        ssize_t n = writev(fd, iov, cnt);
+
+        if (n > 0) {
+            serial_tx_consume(tx, (size_t)n);
+            total += (long)n;
+        } else if (n == -1 && errno == EINTR) {
+            continue;
+        } else if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            /* The rest goes out when the engine loop reports the fd writable. */
+            tx->would_block_total++;
+            break;
+        } else if (n == -1) {
+            return -1;
+        } else {
+            break;
+        }
+    }
+    return total;
+}
+
+size_t serial_tx_pending(const serial_tx_t *tx) {
+    return tx ? tx->queued_bytes : 0;
+}
+
+void serial_tx_get_stats(const serial_tx_t *tx, struct serial_tx_stats *out) {
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if (!tx) return;
+    out->queued_bytes = tx->queued_bytes;
+    out->queued_frames = (unsigned long)tx->lanes[SERIAL_TX_CONTROL].count +
+                         tx->lanes[SERIAL_TX_DISPLAY].count;
+    out->high_water_bytes = tx->high_water_bytes;
+    out->bytes_written_total = tx->bytes_written_total;
+    out->frames_written_total = tx->frames_written_total;
+    out->frames_coalesced_total = tx->frames_coalesced_total;
+    out->frames_dropped_total = tx->frames_dropped_total;
+    out->would_block_total = tx->would_block_total;
+}
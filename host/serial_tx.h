@@ -0,0 +1,152 @@
+#ifndef SERIAL_TX_H
+#define SERIAL_TX_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * serial_tx: the Pi -> Arduino output queue.
+ *
+ * Every command to the Arduino used to be written straight to the tty from
+ * whichever code path produced it, spinning in a 200 us nanosleep() on EAGAIN
+ * until the last byte was out. At 9600 baud a 100-character display repaint is
+ * over 100 ms of wire time, so once the tty's output buffer filled -- a burst
+ * of repaints from a game animation, or an Arduino that stopped draining its
+ * USB endpoint -- the engine thread sat in that loop instead of reading
+ * keypresses, and a coin-gate command queued behind a repaint waited for all
+ * of it.
+ *
+ * serial_tx instead holds whole frames (opcode + operands) in two fixed lanes
+ * and writes them out with writev() only as far as the fd will take without
+ * blocking; the rest waits for the fd to become writable again (the engine
+ * loop's ENGINE_WAKE_WRITABLE). Enqueueing never blocks and never allocates.
+ *
+ *   - SERIAL_TX_CONTROL carries coin-validator commands and keepalives. It is
+ *     always drained ahead of the display lane, so arming or dropping the
+ *     coin gate is never stuck behind a repaint.
+ *   - SERIAL_TX_DISPLAY carries display updates. A full repaint supersedes
+ *     every display frame that has not started going out yet, so it is
+ *     queued with serial_tx_replace() (coalescing): under back-pressure the
+ *     VFD skips stale frames rather than replaying them one by one. Partial
+ *     updates (CMD_DISPLAY_RUN) only make sense on top of what came before,
+ *     so they are plain serial_tx_enqueue()s.
+ *
+ * Priority is per frame, not per byte. The legacy command parser has no
+ * resync (and a framed link would lose both frames to the CRC), so once the
+ * first byte of a frame has been written the rest of that frame goes next,
+ * whatever its lane; a control frame jumps ahead of every display frame that
+ * has not started.
+ *
+ * Not thread-safe: the SDK only touches it under engine_mutex.
+ */
+
+/* Largest frame: opcode, length byte, and a DISPLAY_MAX_PAYLOAD (100) byte
+ * display message, with room to spare -- or the same wrapped as a link frame
+ * (SERIAL_LINK_MAX_ENCODED, 112). */
+#define SERIAL_TX_MAX_FRAME 128
+
+/* Frames each lane can hold. The control lane only backs up while the link is
+ * stalled, and a stalled link is reset on reconnect. The SDK holds display
+ * updates back until the display lane has drained, so it holds at most one
+ * repaint or one diff's worth of runs (VFD_MAX_RUNS) plus a replacing repaint. */
+#define SERIAL_TX_LANE_FRAMES 16
+
+typedef enum {
+    SERIAL_TX_CONTROL = 0,
+    SERIAL_TX_DISPLAY = 1,
+    SERIAL_TX_LANES
+} serial_tx_lane_t;
+
+/* Most iovecs serial_tx_peek() will fill: one per queued frame. */
+#define SERIAL_TX_MAX_IOV (SERIAL_TX_LANES * SERIAL_TX_LANE_FRAMES)
+
+struct serial_tx_frame {
+    size_t len;
+    unsigned char bytes[SERIAL_TX_MAX_FRAME];
+};
+
+struct serial_tx_ring {
+    struct serial_tx_frame frames[SERIAL_TX_LANE_FRAMES];
+    unsigned head;   /* index of the oldest frame */
+    unsigned count;  /* frames queued, including a partly written head */
+};
+
+typedef struct {
+    struct serial_tx_ring lanes[SERIAL_TX_LANES];
+    int active_lane;      /* lane whose head frame is partly written; -1 = none */
+    size_t active_off;    /* bytes of that frame already written */
+    size_t queued_bytes;  /* unwritten bytes across both lanes */
+    /* Lifetime counters (see serial_tx_get_stats). */
+    size_t high_water_bytes;
+    unsigned long long bytes_written_total;
+    unsigned long frames_written_total;
+    unsigned long frames_coalesced_total;
+    unsigned long frames_dropped_total;
+    unsigned long would_block_total;
+} serial_tx_t;
+
+/* Snapshot for metrics. queued_* are instantaneous; the rest are lifetime
+ * totals, so bytes/sec is the delta of bytes_written_total over time. */
+struct serial_tx_stats {
+    size_t queued_bytes;
+    unsigned long queued_frames;
+    size_t high_water_bytes;
+    unsigned long long bytes_written_total;
+    unsigned long frames_written_total;
+    unsigned long frames_coalesced_total;
+    unsigned long frames_dropped_total;  /* lane full, or discarded by a reset */
+    unsigned long would_block_total;     /* flushes that stopped on EAGAIN */
+};
+
+/* Empty queue, zeroed counters. */
+void serial_tx_init(serial_tx_t *tx);
+
+/* Discard everything queued, including a partly written frame, and return
+ * how many frames that was (counted as dropped). Call when the port is
+ * reopened: the tail of a frame begun on the old connection would be parsed
+ * as an opcode by the new one. Counters are kept. */
+unsigned long serial_tx_reset(serial_tx_t *tx);
+
+/* Queue one frame of `len` (1..SERIAL_TX_MAX_FRAME) bytes on `lane`. Returns
+ * 0, or -1 if the frame is malformed or the lane is full (counted as a drop;
+ * nothing is queued). */
+int serial_tx_enqueue(serial_tx_t *tx, serial_tx_lane_t lane,
+                      const void *frame, size_t len);
+
+/* As serial_tx_enqueue, but first discard the frames on `lane` that have not
+ * started going out (counted as coalesced). For a frame that makes everything
+ * queued before it on its lane redundant. */
+int serial_tx_replace(serial_tx_t *tx, serial_tx_lane_t lane,
+                      const void *frame, size_t len);
+
+/* Frames queued on `lane`, including a partly written one. */
+unsigned serial_tx_lane_depth(const serial_tx_t *tx, serial_tx_lane_t lane);
+
+/* Fill `iov` (up to `max` entries) with the unwritten bytes in send order:
+ * the rest of a partly written frame, then control frames, then display
+ * frames. Returns the number of entries used. */
+int serial_tx_peek(const serial_tx_t *tx, struct iovec *iov, int max);
+
+/* Mark the first `n` bytes of serial_tx_peek()'s order as written. */
+void serial_tx_consume(serial_tx_t *tx, size_t n);
+
+/* Write as much as `fd` (non-blocking) accepts, via writev. Returns the
+ * number of bytes written (0 if it would block or nothing is queued), or -1
+ * on a hard write error with errno set; the queue is left as it was. */
+long serial_tx_flush(serial_tx_t *tx, int fd);
+
+/* Unwritten bytes; non-zero means the owner wants POLLOUT. */
+size_t serial_tx_pending(const serial_tx_t *tx);
+
+/* NULL-safe (zeroes the output). */
+void serial_tx_get_stats(const serial_tx_t *tx, struct serial_tx_stats *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SERIAL_TX_H */
@@ -97,30 +97,16 @@ static int sim_sip_registered = 1;  /* 1=registered (default), 0=unavailable */
 
 static millennium_client_t *sim_client = NULL;
 
-/* Event queue — reused from the SDK, simplified */
+/* Event queue — the SDK's event_ring, so scenarios exercise the same bounded
+ * FIFO (and overflow policy: the newest event is dropped) as the daemon. */
 static void sim_queue_push(millennium_client_t *c, void *ev) {
-    struct event_queue_node *node = malloc(sizeof(struct event_queue_node));
-    if (!node) return;
-    node->event = ev;
-    node->next  = NULL;
-    if (c->event_queue_tail) {
-        c->event_queue_tail->next = node;
-    } else {
-        c->event_queue_head = node;
+    if (event_ring_push(&c->event_queue, ev) != 0) {
+        event_destroy((event_t *)ev);
     }
-    c->event_queue_tail = node;
 }
 
 static void *sim_queue_pop(millennium_client_t *c) {
-    struct event_queue_node *node;
-    void *ev;
-    if (!c->event_queue_head) return NULL;
-    node = c->event_queue_head;
-    ev   = node->event;
-    c->event_queue_head = node->next;
-    if (!c->event_queue_head) c->event_queue_tail = NULL;
-    free(node);
-    return ev;
+    return event_ring_pop(&c->event_queue);
 }
 
 millennium_client_t *millennium_client_create(void) {
@@ -128,11 +114,9 @@ millennium_client_t *millennium_client_create(void) {
     if (!c) return NULL;
     c->display_fd  = -1;
     c->is_open     = 1;
-    c->input_buffer = malloc(64);
-    if (c->input_buffer) {
-        c->input_buffer[0] = '\0';
-        c->input_buffer_size = 0;
-        c->input_buffer_capacity = 64;
+    if (event_ring_init(&c->event_queue, EVENT_RING_CAPACITY) != 0) {
+        free(c);
+        return NULL;
     }
     sim_client = c;
     return c;
@@ -140,13 +124,13 @@ millennium_client_t *millennium_client_create(void) {
 
 void millennium_client_destroy(millennium_client_t *c) {
     if (!c) return;
-    if (c->input_buffer)    free(c->input_buffer);
     if (c->display_message) free(c->display_message);
     /* drain queue */
-    while (c->event_queue_head) {
-        void *ev = sim_queue_pop(c);
-        if (ev) event_destroy((event_t *)ev);
+    {
+        void *ev;
+        while ((ev = sim_queue_pop(c)) != NULL) event_destroy((event_t *)ev);
     }
+    event_ring_destroy(&c->event_queue);
     free(c);
     if (sim_client == c) sim_client = NULL;
 }
@@ -247,11 +231,8 @@ void audio_tones_play_clip(const char *path) {
     fprintf(stderr, "[CLIP] %s\n", sim_last_clip);
 }
 
-void millennium_client_process_event_buffer(millennium_client_t *c) { (void)c; }
-
-char *millennium_client_extract_payload(millennium_client_t *c, char t, size_t s) {
-    (void)c; (void)t; (void)s;
-    return NULL;
+void millennium_client_feed_serial(millennium_client_t *c, const char *d, size_t n) {
+    (void)c; (void)d; (void)n;
 }
 
 void millennium_client_create_and_queue_event_char(millennium_client_t *c, char t, const char *p) {
@@ -297,29 +278,29 @@ time_t               daemon_start_time;
 /* ── Minimal event handlers (mirror daemon.c essentials) ───────────── */
 
 static void sim_handle_coin(coin_event_t *ev) {
-    char *code;
+    const char *code;
     int val = 0;
 
     if (!ev || !daemon_state) return;
-    code = coin_event_get_coin_code(ev);
-    if (!code) return;
+    code = coin_event_get_coin_name(ev);
 
     if (strcmp(code, "COIN_6") == 0)      val = 5;
     else if (strcmp(code, "COIN_7") == 0) val = 10;
     else if (strcmp(code, "COIN_8") == 0) val = 25;
 
     if (val > 0 && daemon_state->current_state == DAEMON_STATE_IDLE_UP) {
-        const char *denom = (val == 5)  ? "coins_5c"  :
-                            (val == 10) ? "coins_10c" :
-                            (val == 25) ? "coins_25c" : "coins_other";
+        const char *denom = (val == 5)  ? "5c"  :
+                            (val == 10) ? "10c" :
+                            (val == 25) ? "25c" : "other";
         daemon_state->inserted_cents += val;
         daemon_state_update_activity(daemon_state);
         metrics_increment_counter("coins_inserted", 1);
         metrics_increment_counter("coins_value_cents", val);
-        metrics_increment_counter(denom, 1);  /* mirror daemon.c per-denomination tally */
+        /* mirror daemon.c per-denomination tally */
+        metrics_counter_add(metrics_counter_with_labels("coins_by_denomination",
+                                                        "denomination", denom, NULL), 1);
         plugins_handle_coin(val, code);
     }
-    free(code);
 }
 
 static void sim_handle_hook(hook_state_change_event_t *ev) {
@@ -33,7 +33,8 @@
 (*   - the PJSUA worker thread (call state), via sip_event_cb               *)
 (*     (millennium_sdk.c:169)                                               *)
 (*                                                                         *)
-(* Their relative order is decided by whichever thread wins g_queue_mutex.  *)
+(* Their relative order is decided by whichever thread wins the CAS on the *)
+(* event ring's tail (event_ring.c) -- formerly g_queue_mutex.             *)
 (* That -- not concurrent handler execution -- is the whole race surface.   *)
 (*                                                                         *)
 (* KEY MODELING DECISION: `hook` is the *physical* handset position, kept   *)
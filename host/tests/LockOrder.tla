@@ -68,7 +68,6 @@ RealChains ==
     [ MainLoop     |-> << <<"engine","g_monitor","daemon_state","plugins">>,
                           <<"engine","daemon_state","metrics">>,
                           <<"engine","daemon_state","logger">>,
-                          <<"engine","g_queue">>,
                           <<"engine","tone">> >>,
       WebWorker    |-> << <<"engine","daemon_state","plugins">>,
                           <<"engine","daemon_state","metrics">>,
@@ -76,8 +75,8 @@ RealChains ==
                           <<"metrics">> >>,
       HealthThread |-> << <<"g_monitor","daemon_state","metrics">>,
                           <<"g_monitor","daemon_state","logger">> >>,
-      PjsuaWorker  |-> << <<"g_queue">>,
-                          <<"g_sip">>,
+      \* No g_queue: the event queue is a lock-free ring (event_ring.c).
+      PjsuaWorker  |-> << <<"g_sip">>,
                           <<"logger">> >>,
       LoggerWriter |-> << <<"logger_file","log_queue">>,
                           <<"log_queue">> >> ]
@@ -43,6 +43,26 @@ run "GET /api/health returns JSON" "curl -s $BASE/api/health" "overall_status"
 # overall status is CRITICAL/UNKNOWN, so probes can react to the code alone).
 run "GET /api/health returns HTTP 200 when healthy" \
     "curl -s -o /dev/null -w '%{http_code}' $BASE/api/health" "200"
+# Keep-alive: curl reuses the connection for a second URL only if the
+# daemon left it open (num_connects is 0 for a reused one).
+run "Second request reuses the connection" \
+    "curl -s -o /dev/null -o /dev/null -w '%{num_connects} ' $BASE/api/state $BASE/api/health" "1 0"
+# The dashboard page revalidates: its ETag sent back gets a 304, no body.
+ETAG=$(curl -s -D - -o /dev/null "$BASE/" | sed -n 's/^[Ee][Tt][Aa][Gg]: *//p' | tr -d '\r')
+run "GET / with its ETag returns 304" \
+    "curl -s -o /dev/null -w '%{http_code}' -H 'If-None-Match: $ETAG' $BASE/" "304"
+# Fifty log lines run past the 8 KB a response body used to be cut at; the
+# closing total only arrives if the whole body did.
+run "GET /api/logs with 50 entries is not truncated" \
+    "curl -s '$BASE/api/logs?level=ALL&max_entries=50' | tail -c 32" '"total":'
+# A range past the 30 days kept is refused, not multiplied out of a long
+run "GET /api/metrics/history with an overlong range returns 400" \
+    "curl -s -o /dev/null -w '%{http_code}' '$BASE/api/metrics/history?name=x&range=99999999d'" "400"
+# A body length the server cannot honour is refused up front, not waited on
+run "POST with a negative Content-Length returns 400" \
+    "curl -s -o /dev/null -w '%{http_code}' -X POST $BASE/api/control -H 'Content-Length: -1' -d x" "400"
+run "POST with a Content-Length past the buffer returns 413" \
+    "curl -s -o /dev/null -w '%{http_code}' -X POST $BASE/api/control -H 'Content-Length: 99999999' -d x" "413"
 
 # Control: handset_up
 run "POST handset_up" \
@@ -78,6 +98,12 @@ run "POST handset_down" \
 run "POST activate_plugin" \
     "curl -s -X POST $BASE/api/control -H 'Content-Type: application/json' -d '{\"action\":\"activate_plugin\",\"plugin\":\"Classic Phone\"}'" \
     '"success":true'
+# The same switch through a route with the plugin named in its path
+run "POST /api/plugins/:name/activate" \
+    "curl -s -X POST '$BASE/api/plugins/Classic%20Phone/activate'" \
+    '"success":true'
+run "Wrong method on a route returns 405" \
+    "curl -s -o /dev/null -w '%{http_code}' -X DELETE $BASE/api/state" "405"
 
 echo ""
 if [ $FAILED -eq 0 ]; then
@@ -1,88 +1,124 @@
 /*
  * ThreadSanitizer harness for the daemon's serial event queue.
  *
- * The push/pop below are kept identical to event_queue_push/event_queue_pop in
- * millennium_sdk.c. In the daemon the queue is produced by both the main loop
- * (serial events) and PJSUA worker threads (SIP call-state events) and consumed
- * by the main loop; with no lock those concurrent linked-list/malloc operations
- * corrupt the heap (observed as a SIGABRT under load). This reproduces that and
- * verifies the fix.
+ * Links the real event_ring.c -- the bounded lock-free MPSC ring behind
+ * event_queue_push/event_queue_pop in millennium_sdk.c -- and drives it the
+ * way the daemon does: two producers (the main loop's serial events and the
+ * PJSUA worker's call-state events) and one consumer (the main loop).
+ *
+ * The queue used to be a malloc'd linked list behind g_queue_mutex; with no
+ * lock those concurrent list operations corrupted the heap (observed as a
+ * SIGABRT under load). The ring needs no lock, so this now checks that its
+ * atomics are sufficient: no races, no lost or duplicated items, and each
+ * producer's items arrive in the order it pushed them. The ring is kept small
+ * so producers hit the full path (drop, retry) constantly.
  *
  *   make tsan-queue        # builds + runs both variants under ThreadSanitizer
  *
- * Locked build  -> clean (no races).  -DNO_LOCK build -> ThreadSanitizer reports
- * data races on event_queue_head/tail. (Keep in sync with millennium_sdk.c.)
+ * Normal build -> clean (no races), prints done.
+ * -DTWO_CONSUMERS build -> ThreadSanitizer reports data races on the ring's
+ * head: the single-consumer contract is load-bearing, and this shows the
+ * harness can see a violation of it.
  */
+#include "../event_ring.h"
 #include <pthread.h>
-#include <stdlib.h>
 #include <stdio.h>
+#include <stdlib.h>
 
-struct event_queue_node { void *event; struct event_queue_node *next; };
-struct millennium_client {
-    struct event_queue_node *event_queue_head, *event_queue_tail;
-};
+#define N    50000
+#define CAP  16
 
-#ifdef NO_LOCK
-#define QLOCK()   ((void)0)
-#define QUNLOCK() ((void)0)
+static struct event_ring ring;
+static long received;
+static long last_seen[3];   /* per producer: last sequence popped */
+static int failed;
+
+static void *producer(void *arg) {
+    long id = (long)arg, i;
+    for (i = 1; i <= N; i++) {
+#ifdef TWO_CONSUMERS
+        /* Drop on full, like the daemon: the consumers give up after a
+         * bounded number of pops, so a retrying producer could spin forever. */
+        event_ring_push(&ring, (void *)(id * (N + 1) + i));
 #else
-static pthread_mutex_t g_queue_mutex = PTHREAD_MUTEX_INITIALIZER;
-#define QLOCK()   pthread_mutex_lock(&g_queue_mutex)
-#define QUNLOCK() pthread_mutex_unlock(&g_queue_mutex)
+        /* The daemon drops on full; here retry so every item must arrive. */
+        while (event_ring_push(&ring, (void *)(id * (N + 1) + i)) != 0) {
+            /* spin */
+        }
 #endif
-
-static void event_queue_push(struct millennium_client *client, void *event) {
-    struct event_queue_node *node = malloc(sizeof(struct event_queue_node));
-    if (!node) return;
-    node->event = event;
-    node->next = NULL;
-    QLOCK();
-    if (client->event_queue_tail) client->event_queue_tail->next = node;
-    else client->event_queue_head = node;
-    client->event_queue_tail = node;
-    QUNLOCK();
+    }
+    return NULL;
 }
 
-static void *event_queue_pop(struct millennium_client *client) {
-    struct event_queue_node *node;
-    void *event;
-    QLOCK();
-    if (!client->event_queue_head) { QUNLOCK(); return NULL; }
-    node = client->event_queue_head;
-    event = node->event;
-    client->event_queue_head = node->next;
-    if (!client->event_queue_head) client->event_queue_tail = NULL;
-    QUNLOCK();
-    free(node);
-    return event;
+static void check_item(long v) {
+    long id = v / (N + 1), seq = v % (N + 1);
+    if (id < 1 || id > 2 || seq != last_seen[id] + 1) {
+        fprintf(stderr, "FAIL: producer %ld item %ld after %ld\n",
+                id, seq, (id >= 1 && id <= 2) ? last_seen[id] : -1L);
+        failed = 1;
+        return;
+    }
+    last_seen[id] = seq;
 }
 
-static struct millennium_client cl;
-#define N 50000
-
-static void *producer(void *arg) {
-    long id = (long)arg, i;
-    for (i = 0; i < N; i++) event_queue_push(&cl, (void *)(id * N + i + 1));
+static void *consumer(void *arg) {
+    (void)arg;
+    while (received < 2L * N && !failed) {
+        void *item = event_ring_pop(&ring);
+        if (item) {
+            check_item((long)item);
+            received++;
+        }
+    }
     return NULL;
 }
 
-/* Bounded pop attempts so the (corrupting) no-lock run still terminates after
- * ThreadSanitizer has flagged the race, instead of spinning on a lost item. */
-static void *consumer(void *arg) {
-    long tries = 0;
+#ifdef TWO_CONSUMERS
+/* Bounded, unchecked pops, run on two threads at once: enough for
+ * ThreadSanitizer to flag the race, without waiting on items they now split. */
+static void *rogue_consumer(void *arg) {
+    long tries;
     (void)arg;
-    while (tries < 4 * N) { event_queue_pop(&cl); tries++; }
+    for (tries = 0; tries < 4L * N; tries++) event_ring_pop(&ring);
     return NULL;
 }
+#endif
 
 int main(void) {
     pthread_t p1, p2, c1;
+    struct event_ring_stats st;
+#ifdef TWO_CONSUMERS
+    pthread_t c2;
+#endif
+
+    if (event_ring_init(&ring, CAP) != 0) return 1;
     pthread_create(&p1, NULL, producer, (void *)1);  /* main-loop serial pushes */
     pthread_create(&p2, NULL, producer, (void *)2);  /* PJSUA call-state pushes */
+#ifdef TWO_CONSUMERS
+    pthread_create(&c1, NULL, rogue_consumer, NULL);
+    pthread_create(&c2, NULL, rogue_consumer, NULL);
+    pthread_join(p1, NULL);
+    pthread_join(p2, NULL);
+    pthread_join(c1, NULL);
+    pthread_join(c2, NULL);
+    printf("done (two consumers)\n");
+    (void)consumer;
+    (void)st;
+#else
     pthread_create(&c1, NULL, consumer, NULL);        /* main-loop consumer      */
     pthread_join(p1, NULL);
     pthread_join(p2, NULL);
     pthread_join(c1, NULL);
-    printf("done\n");
+
+    event_ring_get_stats(&ring, &st);
+    if (failed || received != 2L * N || st.pushed_total != 2UL * N ||
+        st.depth != 0 || st.high_water > CAP) {
+        fprintf(stderr, "FAIL: received=%ld pushed=%lu depth=%lu high_water=%lu\n",
+                received, st.pushed_total, st.depth, st.high_water);
+        return 1;
+    }
+    printf("done (%lu full-ring rejections retried)\n", st.dropped_total);
+#endif
+    event_ring_destroy(&ring);
     return 0;
 }
@@ -5,7 +5,9 @@
 #include "../daemon_state.h"
 #include "../plugins.h"
 #include "../logger.h"
+#include "../log_record.h"
 #include "../metrics.h"
+#include "../tsdb.h"
 #include "../call_metrics.h"
 #include "../millennium_sdk.h"
 #include "../coin_gate.h"
@@ -16,13 +18,26 @@
 #include "../clock_source.h"
 #include "../state_persistence.h"
 #include "../conn_queue.h"
+#include "../web_router.h"
 #include "../health_monitor.h"
 #include "../display_manager.h"
 #include "../wav.h"
+#include "../engine_loop.h"
+#include "../event_ring.h"
+#include "../link_rate.h"
+#include "../serial_link.h"
+#include "../serial_parser.h"
+#include "../serial_tx.h"
+#include "../vfd_diff.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <pthread.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 
 /* ── Stubs for linker (plugins.c references these) ──────────────── */
 
@@ -60,8 +75,7 @@ void millennium_client_write_command(millennium_client_t *c, uint8_t cmd, const
     (void)c; (void)cmd; (void)d; (void)sz;
 }
 void millennium_client_set_ua(millennium_client_t *c, void *ua) { (void)c; (void)ua; }
-void millennium_client_process_event_buffer(millennium_client_t *c) { (void)c; }
-char *millennium_client_extract_payload(millennium_client_t *c, char t, size_t s) { (void)c; (void)t; (void)s; return NULL; }
+void millennium_client_feed_serial(millennium_client_t *c, const char *d, size_t n) { (void)c; (void)d; (void)n; }
 void millennium_client_create_and_queue_event_char(millennium_client_t *c, char t, const char *p) { (void)c; (void)t; (void)p; }
 void millennium_client_create_and_queue_event_ptr(millennium_client_t *c, void *e) { (void)c; (void)e; }
 int millennium_client_serial_is_healthy(millennium_client_t *c) { (void)c; return 1; }
@@ -548,14 +562,14 @@ static void test_plugins_activation_metrics(void) {
     plugins_init();
     TEST_ASSERT_EQ_INT((int)metrics_get_counter("plugin_activations_total"), 1);
     TEST_ASSERT_EQ_INT(
-        (int)metrics_get_counter("plugin_activations_Classic Phone"), 1);
+        (int)metrics_get_counter("plugin_activations{plugin=\"Classic Phone\"}"), 1);
 
     /* Each activation bumps the aggregate and the per-plugin counter. */
     TEST_ASSERT_EQ_INT(plugins_activate("Fortune Teller"), 0);
     TEST_ASSERT_EQ_INT(plugins_activate("Fortune Teller"), 0);
     TEST_ASSERT_EQ_INT((int)metrics_get_counter("plugin_activations_total"), 3);
     TEST_ASSERT_EQ_INT(
-        (int)metrics_get_counter("plugin_activations_Fortune Teller"), 2);
+        (int)metrics_get_counter("plugin_activations{plugin=\"Fortune Teller\"}"), 2);
 
     /* A failed activation must not move any counter. */
     TEST_ASSERT_EQ_INT(plugins_activate("Nonexistent"), -1);
@@ -1476,6 +1490,352 @@ static void test_logger_queue_stats(void) {
     remove(path);
 }
 
+/* The writer takes whatever has queued up as one batch: lines logged while
+ * it is busy go out together, in order, and the sync policy decides which
+ * batches are fdatasync'd. The observer holds up the first batch so the
+ * rest pile up behind it. */
+static int batch_calls = 0;
+static unsigned long batch_lines = 0;
+static unsigned long batch_max = 0;
+
+static void observe_test_batch(unsigned long lines, size_t bytes, double ms) {
+    (void)bytes;
+    (void)ms;
+    if (batch_calls++ == 0) {
+        struct timespec pause;
+        pause.tv_sec = 0;
+        pause.tv_nsec = 50000000L;
+        nanosleep(&pause, NULL);
+    }
+    batch_lines += lines;
+    if (lines > batch_max) {
+        batch_max = lines;
+    }
+}
+
+static void test_logger_batched_writes(void) {
+    const char *path = "/tmp/millennium_logger_batch_test.log";
+    char buf[16384];
+    logger_queue_stats_t st;
+    unsigned long long syncs;
+    FILE *f;
+    size_t got;
+    int i;
+
+    remove(path);
+    logger_set_log_to_console(0);
+    logger_set_level(LOG_LEVEL_VERBOSE);
+    logger_set_sync_policy(LOG_SYNC_ERROR, 1000);
+    logger_set_batch_observer(observe_test_batch);
+    logger_set_log_file(path);
+    logger_set_log_to_file(1);
+    batch_calls = 0;
+    batch_lines = 0;
+    batch_max = 0;
+
+    for (i = 0; i < 100; i++) {
+        logger_infof_with_category("BatchTest", "line %d", i);
+    }
+    logger_flush();
+    logger_get_queue_stats(&st);
+    syncs = st.syncs_total;
+
+    TEST_ASSERT_EQ_INT((int)batch_lines, 100);
+    TEST_ASSERT(batch_max > 1);
+    TEST_ASSERT(batch_calls < 100);
+
+    /* LOG_SYNC_ERROR: INFO lines alone were not synced, nor is a WARN;
+     * an ERROR is */
+    logger_warnf_with_category("BatchTest", "careful");
+    logger_flush();
+    logger_get_queue_stats(&st);
+    TEST_ASSERT(st.syncs_total == syncs);
+    logger_errorf_with_category("BatchTest", "boom");
+    logger_flush();
+    logger_get_queue_stats(&st);
+    TEST_ASSERT(st.syncs_total == syncs + 1);
+
+    /* LOG_SYNC_BATCH: every batch */
+    logger_set_sync_policy(LOG_SYNC_BATCH, 1000);
+    logger_infof_with_category("BatchTest", "synced");
+    logger_flush();
+    logger_get_queue_stats(&st);
+    TEST_ASSERT(st.syncs_total == syncs + 2);
+
+    logger_set_batch_observer(NULL);
+    logger_shutdown();
+    logger_set_log_to_file(0);
+
+    f = fopen(path, "r");
+    TEST_ASSERT_NOT_NULL(f);
+    got = fread(buf, 1, sizeof(buf) - 1, f);
+    buf[got] = '\0';
+    fclose(f);
+    TEST_ASSERT_NOT_NULL(strstr(buf, "[BatchTest] line 0\n"));
+    TEST_ASSERT(strstr(buf, "[BatchTest] line 98\n") < strstr(buf, "[BatchTest] line 99\n"));
+    TEST_ASSERT_NOT_NULL(strstr(buf, "[BatchTest] boom\n"));
+
+    logger_set_sync_policy(LOG_SYNC_ERROR, 1000);
+    logger_set_log_to_console(1);
+    logger_set_level(LOG_LEVEL_ERROR);
+    remove(path);
+}
+
+/* Level gating: a disabled message must cost nothing -- its arguments are
+ * not evaluated -- and a category override opens one category up without
+ * the rest. */
+static int gated_arg_calls = 0;
+
+static int gated_arg(void) {
+    gated_arg_calls++;
+    return 42;
+}
+
+static int recent_logs_contain(const char *needle) {
+    static char logs[1000][512];
+    int n = logger_get_recent_logs(logs, 1000);
+    int i;
+    for (i = 0; i < n; i++) {
+        if (strstr(logs[i], needle) != NULL) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* The in-memory log holds as many messages as fit its bytes, drops the
+ * oldest first, and answers level and category queries from its index. */
+static void test_logger_memory_ring(void) {
+    static char logs[1000][512];
+    logger_entry_t entries[8];
+    size_t bytes = 0;
+    int n, i;
+
+    logger_set_log_to_console(0);
+    logger_set_level(LOG_LEVEL_VERBOSE);
+    logger_set_memory_size(4096);
+
+    logger_warnf_with_category("RingTest", "old warning");
+    for (i = 0; i < 200; i++) {
+        logger_debugf_with_category("RingTest", "filler %d", i);
+    }
+    n = logger_get_recent_logs(logs, 1000);
+    TEST_ASSERT(n > 10 && n < 200);
+    for (i = 0; i < n; i++) {
+        bytes += strlen(logs[i]);
+    }
+    TEST_ASSERT(bytes <= 4096);
+    TEST_ASSERT_NOT_NULL(strstr(logs[n - 1], "[RingTest] filler 199"));
+    TEST_ASSERT_NOT_NULL(strstr(logs[n - 2], "[RingTest] filler 198"));
+
+    /* The warning has been overwritten; a new one is found past the DEBUG
+     * lines after it, along with the one in another category */
+    TEST_ASSERT_EQ_INT(logger_get_recent_entries(entries, 8, LOG_LEVEL_WARN, "RingTest"), 0);
+    logger_warnf_with_category("RingTest", "new warning");
+    logger_errorf_with_category("RingOther", "other error");
+    for (i = 0; i < 20; i++) {
+        logger_debugf_with_category("RingTest", "after %d", i);
+    }
+    n = logger_get_recent_entries(entries, 8, LOG_LEVEL_WARN, NULL);
+    TEST_ASSERT_EQ_INT(n, 2);
+    TEST_ASSERT_EQ_INT(entries[0].level, LOG_LEVEL_WARN);
+    TEST_ASSERT_EQ_STR(entries[0].category, "RingTest");
+    TEST_ASSERT_NOT_NULL(strstr(entries[0].text, "[WARN] [RingTest] new warning"));
+    TEST_ASSERT(entries[0].time_ms > 0);
+    TEST_ASSERT_EQ_INT(entries[1].level, LOG_LEVEL_ERROR);
+    TEST_ASSERT_EQ_STR(entries[1].category, "RingOther");
+
+    n = logger_get_recent_entries(entries, 8, LOG_LEVEL_WARN, "RingTest");
+    TEST_ASSERT_EQ_INT(n, 1);
+    TEST_ASSERT_NOT_NULL(strstr(entries[0].text, "new warning"));
+    n = logger_get_recent_entries(entries, 3, LOG_LEVEL_VERBOSE, "RingTest");
+    TEST_ASSERT_EQ_INT(n, 3);
+    TEST_ASSERT_NOT_NULL(strstr(entries[2].text, "after 19"));
+    TEST_ASSERT_EQ_INT(logger_get_recent_entries(entries, 8, LOG_LEVEL_VERBOSE, "NoSuchCategory"), 0);
+
+    /* Growing keeps what there is */
+    logger_set_memory_size(LOGGER_MEMORY_BYTES_DEFAULT);
+    n = logger_get_recent_entries(entries, 8, LOG_LEVEL_WARN, NULL);
+    TEST_ASSERT_EQ_INT(n, 2);
+    TEST_ASSERT_NOT_NULL(strstr(entries[0].text, "new warning"));
+    TEST_ASSERT(recent_logs_contain("[RingTest] after 19"));
+
+    logger_set_log_to_console(1);
+    logger_set_level(LOG_LEVEL_ERROR);
+}
+
+static void test_logger_level_gating(void) {
+    logger_set_log_to_console(0);
+    logger_set_level(LOG_LEVEL_INFO);
+    gated_arg_calls = 0;
+
+    logger_debugf_with_category("GateTest", "skipped %d", gated_arg());
+    LOG_VERBOSE("skipped %d", gated_arg());
+    TEST_ASSERT_EQ_INT(gated_arg_calls, 0);
+    TEST_ASSERT(!LOGGER_ENABLED(LOG_LEVEL_DEBUG, "GateTest"));
+
+    logger_infof_with_category("GateTest", "kept %d", gated_arg());
+    TEST_ASSERT_EQ_INT(gated_arg_calls, 1);
+    TEST_ASSERT(recent_logs_contain("[GateTest] kept 42"));
+
+    /* DEBUG for one category only */
+    TEST_ASSERT_EQ_INT(logger_set_category_level("GateDebug", LOG_LEVEL_DEBUG), 0);
+    TEST_ASSERT_EQ_INT(logger_floor, LOG_LEVEL_DEBUG);
+    logger_debugf_with_category("GateDebug", "debug %d", gated_arg());
+    logger_debugf_with_category("GateTest", "debug %d", gated_arg());
+    TEST_ASSERT_EQ_INT(gated_arg_calls, 2);
+    TEST_ASSERT(recent_logs_contain("[GateDebug] debug 42"));
+    TEST_ASSERT(!recent_logs_contain("[GateTest] debug 42"));
+
+    /* An override can also quiet a category below the global level */
+    TEST_ASSERT_EQ_INT(logger_set_category_level("GateDebug", LOG_LEVEL_ERROR), 0);
+    TEST_ASSERT_EQ_INT(logger_floor, LOG_LEVEL_INFO);
+    logger_warnf_with_category("GateDebug", "warn %d", gated_arg());
+    TEST_ASSERT_EQ_INT(gated_arg_calls, 2);
+
+    logger_clear_category_level("GateDebug");
+    TEST_ASSERT(LOGGER_ENABLED(LOG_LEVEL_INFO, "GateDebug"));
+    TEST_ASSERT(!LOGGER_ENABLED(LOG_LEVEL_DEBUG, "GateDebug"));
+
+    logger_set_log_to_console(1);
+    logger_set_level(LOG_LEVEL_ERROR);
+}
+
+/* Binary records carry the raw arguments; rendering one must give exactly
+ * what printf would have, for every conversion the encoder accepts. */
+static size_t encode_test_event(unsigned char *buf, size_t size,
+                                const char *format, ...) {
+    unsigned char types[LOG_RECORD_MAX_ARGS];
+    int nargs = log_format_parse(format, types, LOG_RECORD_MAX_ARGS);
+    va_list args;
+    size_t len;
+
+    va_start(args, format);
+    len = log_record_event(buf, size, 7, LOG_LEVEL_WARN, 0, types, nargs, args);
+    va_end(args);
+    return len;
+}
+
+static int lookup_test_format(void *ctx, uint32_t id, const char **category,
+                              const char **format) {
+    if (id != 7) {
+        return -1;
+    }
+    *category = "Rec";
+    *format = (const char *)ctx;
+    return 0;
+}
+
+static void test_log_record_roundtrip(void) {
+    const char *format = "%s=%d %5.2f %lu %c %x%% [%-6s] %*d %.3s %lld %hhu %zu";
+    unsigned char record[LOG_RECORD_MAX];
+    unsigned char types[LOG_RECORD_MAX_ARGS];
+    char expected[256];
+    char line[512];
+    const char *message;
+    size_t len;
+
+    len = encode_test_event(record, sizeof(record), format, "coins", -25, 3.14159,
+                            4000000000UL, 'x', 255, "ab", 5, 42, "truncate",
+                            -9000000000LL, 300, (size_t)12);
+    TEST_ASSERT(len > 0);
+    TEST_ASSERT_EQ_INT((int)log_record_length(record, len), (int)len);
+    TEST_ASSERT_EQ_INT(log_record_level(record, len), LOG_LEVEL_WARN);
+
+    snprintf(expected, sizeof(expected), format, "coins", -25, 3.14159,
+             4000000000UL, 'x', 255, "ab", 5, 42, "truncate",
+             -9000000000LL, (unsigned char)300, (size_t)12);
+    TEST_ASSERT(log_record_render(record, len, lookup_test_format,
+                                  (void *)format, line, sizeof(line)) > 0);
+    message = strstr(line, "[WARN] [Rec] ");
+    TEST_ASSERT_NOT_NULL(message);
+    TEST_ASSERT_EQ_STR(message + strlen("[WARN] [Rec] "), expected);
+
+    /* A string too long for the record is cut, not the record dropped */
+    {
+        char big[1000];
+        char wide[1024];
+        memset(big, 'z', sizeof(big) - 1);
+        big[sizeof(big) - 1] = '\0';
+        len = encode_test_event(record, sizeof(record), "%s|%d", big, 9);
+        TEST_ASSERT(len > 0 && len <= sizeof(record));
+        TEST_ASSERT(log_record_render(record, len, lookup_test_format,
+                                      (void *)"%s|%d", wide, sizeof(wide)) > 0);
+        TEST_ASSERT_NOT_NULL(strstr(wide, "zzz|9"));
+    }
+
+    /* Conversions the records cannot carry are refused, so the site logs text */
+    TEST_ASSERT_EQ_INT(log_format_parse("%d%n", types, LOG_RECORD_MAX_ARGS), -1);
+    TEST_ASSERT_EQ_INT(log_format_parse("%Lf", types, LOG_RECORD_MAX_ARGS), -1);
+    TEST_ASSERT_EQ_INT(log_format_parse("100%% %s", types, LOG_RECORD_MAX_ARGS), 1);
+}
+
+/* Binary mode end to end: messages go to the file as records, /api/logs'
+ * view of the ring still reads as text, and the file decodes -- across a
+ * reopen, which starts a new dictionary -- to the same lines. */
+static void test_logger_binary_file(void) {
+    const char *path = "/tmp/millennium_logger_binary_test.log";
+    static unsigned char data[65536];
+    struct log_reader reader;
+    char line[512];
+    size_t len, offset;
+    FILE *f;
+    int level, lines, i;
+
+    remove(path);
+    logger_set_log_to_console(0);
+    logger_set_level(LOG_LEVEL_VERBOSE);
+    logger_set_log_format(LOG_FORMAT_BINARY);
+    logger_set_log_file(path);
+    logger_set_log_to_file(1);
+
+    for (i = 0; i < 3; i++) {
+        logger_infof_with_category("BinTest", "coins=%d balance=%.2f who=%s",
+                                   25 * i, 0.75, "Alice");
+    }
+    logger_warn_with_category("BinTest", "plain message");
+    TEST_ASSERT(recent_logs_contain("[INFO] [BinTest] coins=50 balance=0.75 who=Alice"));
+    TEST_ASSERT(recent_logs_contain("[WARN] [BinTest] plain message"));
+
+    /* A second run appending to the same file */
+    logger_flush();
+    logger_set_log_to_file(0);
+    logger_set_log_to_file(1);
+    logger_errorf_with_category("BinTest", "after reopen %u", 7u);
+    logger_flush();
+    logger_shutdown();
+    logger_set_log_to_file(0);
+
+    f = fopen(path, "rb");
+    TEST_ASSERT_NOT_NULL(f);
+    len = fread(data, 1, sizeof(data), f);
+    fclose(f);
+    TEST_ASSERT(len > 0 && data[0] == LOG_RECORD_HEADER);
+
+    log_reader_init(&reader);
+    offset = 0;
+    lines = 0;
+    while (log_reader_next(&reader, data, len, &offset, &level, line, sizeof(line))) {
+        if (lines == 2) {
+            TEST_ASSERT_NOT_NULL(strstr(line, "[INFO] [BinTest] coins=50 balance=0.75 who=Alice"));
+        }
+        if (lines == 4) {
+            TEST_ASSERT_NOT_NULL(strstr(line, "[ERROR] [BinTest] after reopen 7"));
+            TEST_ASSERT_EQ_INT(level, LOG_LEVEL_ERROR);
+        }
+        lines++;
+    }
+    TEST_ASSERT_EQ_INT(lines, 5);
+    TEST_ASSERT_EQ_INT((int)offset, (int)len);
+    TEST_ASSERT_EQ_INT((int)reader.skipped, 0);
+    log_reader_free(&reader);
+
+    logger_set_log_format(LOG_FORMAT_TEXT);
+    logger_set_log_to_console(1);
+    logger_set_level(LOG_LEVEL_ERROR);
+    remove(path);
+}
+
 /* ── Metrics export ─────────────────────────────────────────────── */
 
 static void test_metrics_export_prometheus_basic(void) {
@@ -1504,6 +1864,296 @@ static void test_metrics_export_json_basic(void) {
     metrics_cleanup();
 }
 
+/* Handles are stable: the same name always yields the same handle, the
+ * string API and the handle see the same value, and metrics_reset_all()
+ * zeroes values without invalidating handles. The name index must keep
+ * finding every metric across its growth, and a counter and a gauge may
+ * share a name without colliding. */
+static void test_metrics_handles(void) {
+    metrics_counter_t *c;
+    metrics_gauge_t *g;
+    metrics_histogram_t *h;
+    metrics_histogram_stats_t stats;
+    char name[32];
+    int i;
+
+    TEST_ASSERT(metrics_counter_get("before_init") == NULL);
+    metrics_counter_add(NULL, 1);           /* no-op, must not crash */
+
+    TEST_ASSERT_EQ_INT(metrics_init(), 0);
+    c = metrics_counter_get("coins_inserted");
+    TEST_ASSERT_NOT_NULL(c);
+    TEST_ASSERT(metrics_counter_get("coins_inserted") == c);
+    metrics_counter_add(c, 2);
+    metrics_increment_counter("coins_inserted", 3);
+    TEST_ASSERT_EQ_INT((int)metrics_get_counter("coins_inserted"), 5);
+
+    g = metrics_gauge_get("coins_inserted");   /* same name, other kind */
+    TEST_ASSERT_NOT_NULL(g);
+    metrics_gauge_set(g, 1.5);
+    metrics_gauge_add(g, 1.0);
+    TEST_ASSERT(metrics_get_gauge("coins_inserted") == 2.5);
+    TEST_ASSERT_EQ_INT((int)metrics_get_counter("coins_inserted"), 5);
+
+    h = metrics_histogram_get("latency");
+    metrics_histogram_observe(h, 4.0);
+    TEST_ASSERT_EQ_INT(metrics_get_histogram_stats("latency", &stats), 0);
+    TEST_ASSERT_EQ_INT((int)stats.count, 1);
+
+    /* Enough names to grow the index several times over. */
+    for (i = 0; i < 500; i++) {
+        snprintf(name, sizeof(name), "counter_%d", i);
+        metrics_increment_counter(name, (uint64_t)i);
+    }
+    for (i = 0; i < 500; i++) {
+        snprintf(name, sizeof(name), "counter_%d", i);
+        TEST_ASSERT_EQ_INT((int)metrics_get_counter(name), i);
+    }
+    TEST_ASSERT(metrics_counter_get("coins_inserted") == c);
+    TEST_ASSERT_EQ_INT((int)metrics_get_counter("absent"), 0);
+
+    metrics_reset_all();
+    TEST_ASSERT(metrics_counter_get("coins_inserted") == c);
+    metrics_counter_add(c, 1);
+    TEST_ASSERT_EQ_INT((int)metrics_get_counter("coins_inserted"), 1);
+
+    metrics_cleanup();
+}
+
+/* A cached ref resolves once, goes NULL while metrics are down, and
+ * resolves afresh -- never to a freed handle -- after a re-init. */
+static void test_metrics_refs(void) {
+    static metrics_ref_t ref = METRICS_REF_INIT("ref_counter");
+    metrics_counter_t *first;
+    int i;
+
+    TEST_ASSERT(metrics_counter_ref(&ref) == NULL);
+
+    TEST_ASSERT_EQ_INT(metrics_init(), 0);
+    first = metrics_counter_ref(&ref);
+    TEST_ASSERT_NOT_NULL(first);
+    TEST_ASSERT(metrics_counter_ref(&ref) == first);
+    for (i = 0; i < 3; i++) {
+        METRICS_COUNTER_ADD("ref_macro", 1);
+    }
+    TEST_ASSERT_EQ_INT((int)metrics_get_counter("ref_macro"), 3);
+    metrics_cleanup();
+
+    TEST_ASSERT(metrics_counter_ref(&ref) == NULL);
+
+    TEST_ASSERT_EQ_INT(metrics_init(), 0);
+    metrics_counter_add(metrics_counter_ref(&ref), 4);
+    TEST_ASSERT_EQ_INT((int)metrics_get_counter("ref_counter"), 4);
+    METRICS_COUNTER_ADD("ref_macro", 1);
+    TEST_ASSERT_EQ_INT((int)metrics_get_counter("ref_macro"), 1);
+    metrics_cleanup();
+}
+
+/* Threads adding to one counter land on different shards; the scrape-time
+ * sum must still account for every add, with scrapes running alongside. */
+#define SHARD_TEST_THREADS 6
+#define SHARD_TEST_ADDS 20000
+
+static void *shard_adder(void *arg) {
+    metrics_counter_t *c = (metrics_counter_t *)arg;
+    int i;
+    for (i = 0; i < SHARD_TEST_ADDS; i++) {
+        metrics_counter_add(c, 1);
+        METRICS_GAUGE_SET("shard_gauge", (double)i);
+    }
+    return NULL;
+}
+
+static void test_metrics_sharded_counters(void) {
+    pthread_t threads[SHARD_TEST_THREADS];
+    metrics_counter_t *c;
+    char *out;
+    int i;
+
+    TEST_ASSERT_EQ_INT(metrics_init(), 0);
+    c = metrics_counter_get("sharded");
+    for (i = 0; i < SHARD_TEST_THREADS; i++) {
+        TEST_ASSERT_EQ_INT(pthread_create(&threads[i], NULL, shard_adder, c), 0);
+    }
+    for (i = 0; i < 20; i++) {
+        out = metrics_export_prometheus();
+        TEST_ASSERT_NOT_NULL(out);
+        free(out);
+    }
+    for (i = 0; i < SHARD_TEST_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    TEST_ASSERT_EQ_INT((int)metrics_get_counter("sharded"),
+                       SHARD_TEST_THREADS * SHARD_TEST_ADDS);
+    TEST_ASSERT(metrics_get_gauge("shard_gauge") == (double)(SHARD_TEST_ADDS - 1));
+
+    out = metrics_export_json();
+    TEST_ASSERT(strstr(out, "\"sharded\": 120000") != NULL);
+    free(out);
+
+    metrics_reset_counter("sharded");
+    TEST_ASSERT_EQ_INT((int)metrics_get_counter("sharded"), 0);
+    metrics_cleanup();
+}
+
+/* Log-linear histogram buckets: every value lands in the bucket whose
+ * bounds contain it, bucket widths stay within a quarter of the bound, and
+ * quantiles read back within a bucket's width. count/sum/min/max stay exact,
+ * and the Prometheus export is a true cumulative _bucket series. */
+static void test_metrics_histogram_buckets(void) {
+    static const double samples[] = {
+        0.0, -3.0, 0.001, 0.0078125, 0.01, 0.5, 1.0, 1.2, 3.0, 42.0,
+        999.0, 1000.0, 65535.0, 131071.0, 131072.0, 1e9
+    };
+    metrics_histogram_stats_t stats;
+    char *out;
+    int i, b;
+
+    for (i = 0; i < (int)(sizeof(samples) / sizeof(samples[0])); i++) {
+        b = metrics_histogram_bucket_index(samples[i]);
+        TEST_ASSERT(b >= 0 && b < METRICS_HISTOGRAM_BUCKETS);
+        TEST_ASSERT(samples[i] <= metrics_histogram_bucket_bound(b));
+        if (b > 0) TEST_ASSERT(samples[i] > metrics_histogram_bucket_bound(b - 1));
+    }
+    for (b = 1; b < METRICS_HISTOGRAM_BUCKETS - 1; b++) {
+        double lo = metrics_histogram_bucket_bound(b - 1);
+        double hi = metrics_histogram_bucket_bound(b);
+        TEST_ASSERT(hi > lo);
+        TEST_ASSERT(hi - lo <= lo / METRICS_HISTOGRAM_SUB_BUCKETS + 1e-12);
+    }
+
+    TEST_ASSERT_EQ_INT(metrics_init(), 0);
+    for (i = 1; i <= 1000; i++) {
+        metrics_observe_histogram("latency_ms", (double)i);
+    }
+    TEST_ASSERT_EQ_INT(metrics_get_histogram_stats("latency_ms", &stats), 0);
+    TEST_ASSERT_EQ_INT((int)stats.count, 1000);
+    TEST_ASSERT(stats.sum == 500500.0);
+    TEST_ASSERT(stats.min == 1.0);
+    TEST_ASSERT(stats.max == 1000.0);
+    TEST_ASSERT(stats.median > 500.0 * 0.85 && stats.median < 500.0 * 1.15);
+    TEST_ASSERT(stats.p95 > 950.0 * 0.85 && stats.p95 <= 1000.0);
+    TEST_ASSERT(stats.p99 > 990.0 * 0.85 && stats.p99 <= 1000.0);
+
+    metrics_observe_histogram("single", 42.0);
+    TEST_ASSERT_EQ_INT(metrics_get_histogram_stats("single", &stats), 0);
+    TEST_ASSERT(stats.median == 42.0 && stats.p99 == 42.0);
+
+    /* A value exactly on a bound counts under that bound's le */
+    metrics_observe_histogram("on_bound", 4.0);
+    TEST_ASSERT_EQ_INT(metrics_histogram_bucket_index(4.0),
+                       metrics_histogram_bucket_index(3.5) + 1);
+
+    out = metrics_export_prometheus();
+    TEST_ASSERT_NOT_NULL(out);
+    TEST_ASSERT(strstr(out, "# TYPE latency_ms histogram") != NULL);
+    TEST_ASSERT(strstr(out, "latency_ms_bucket{le=\"0.0078125\"} 0") != NULL);
+    TEST_ASSERT(strstr(out, "latency_ms_bucket{le=\"2\"} 2") != NULL);
+    TEST_ASSERT(strstr(out, "latency_ms_bucket{le=\"1024\"} 1000") != NULL);
+    TEST_ASSERT(strstr(out, "latency_ms_bucket{le=\"+Inf\"} 1000") != NULL);
+    TEST_ASSERT(strstr(out, "latency_ms_count 1000") != NULL);
+    TEST_ASSERT(strstr(out, "on_bound_bucket{le=\"3.5\"} 0") != NULL);
+    TEST_ASSERT(strstr(out, "on_bound_bucket{le=\"4\"} 1") != NULL);
+    free(out);
+    metrics_cleanup();
+}
+
+/* Labelled series: the label set is canonical (sorted, escaped) whatever
+ * order it is given in, reads back through the series-key form of the name
+ * API, and a family exports with one HELP/TYPE ahead of all its series. */
+static void test_metrics_labels(void) {
+    static metrics_ref_t ref = METRICS_LABELED_REF_INIT("lbl_requests", "route", "/b");
+    metrics_counter_t *a, *b;
+    metrics_histogram_t *h;
+    char *out;
+    const char *first, *second;
+
+    TEST_ASSERT_EQ_INT(metrics_init(), 0);
+    a = metrics_counter_with_labels("lbl_requests", "route", "/a", "method", "GET", NULL);
+    b = metrics_counter_with_labels("lbl_requests", "method", "GET", "route", "/a", NULL);
+    TEST_ASSERT_NOT_NULL(a);
+    TEST_ASSERT(a == b);
+    TEST_ASSERT(metrics_counter_ref(&ref) != a);
+    TEST_ASSERT(metrics_counter_get("lbl_requests") != a);
+    metrics_counter_add(a, 2);
+    metrics_counter_add(metrics_counter_ref(&ref), 5);
+    metrics_counter_add(metrics_counter_with_labels("lbl_requests", "route",
+                                                    "say \"hi\"\\", NULL), 1);
+    TEST_ASSERT_EQ_INT((int)metrics_get_counter(
+        "lbl_requests{method=\"GET\",route=\"/a\"}"), 2);
+    TEST_ASSERT_EQ_INT((int)metrics_get_counter("lbl_requests{route=\"/b\"}"), 5);
+    TEST_ASSERT_EQ_INT((int)metrics_get_counter("lbl_requests"), 0);
+
+    h = metrics_histogram_with_labels("lbl_latency", "stage", "dial", NULL);
+    metrics_histogram_observe(h, 3.0);
+
+    out = metrics_export_prometheus();
+    TEST_ASSERT_NOT_NULL(out);
+    first = strstr(out, "# TYPE lbl_requests counter");
+    TEST_ASSERT(first != NULL);
+    TEST_ASSERT(first && strstr(first + 1, "# TYPE lbl_requests counter") == NULL);
+    TEST_ASSERT(strstr(out, "lbl_requests{method=\"GET\",route=\"/a\"} 2\n") != NULL);
+    TEST_ASSERT(strstr(out, "lbl_requests{route=\"say \\\"hi\\\"\\\\\"} 1\n") != NULL);
+    /* Sorted: the unlabelled series, then by label set */
+    second = strstr(out, "lbl_requests{route=\"/b\"} 5");
+    TEST_ASSERT(second != NULL && second > strstr(out, "lbl_requests{method="));
+    TEST_ASSERT(strstr(out, "lbl_latency_bucket{stage=\"dial\",le=\"+Inf\"} 1") != NULL);
+    TEST_ASSERT(strstr(out, "lbl_latency_count{stage=\"dial\"} 1") != NULL);
+    TEST_ASSERT(strstr(out, "lbl_latency_p99{stage=\"dial\"} 3.00") != NULL);
+    free(out);
+
+    out = metrics_export_json();
+    TEST_ASSERT_NOT_NULL(out);
+    TEST_ASSERT(strstr(out, "\"lbl_requests{route=\\\"/b\\\"}\": 5") != NULL);
+    free(out);
+    metrics_cleanup();
+}
+
+/* The exposition cache: values move between scrapes without the template
+ * being rebuilt, a newly registered series shows up in the next scrape, and
+ * a template never outlives the registry it was built from. */
+static void test_metrics_exposition_cache(void) {
+    metrics_counter_t *c;
+    metrics_gauge_t *g;
+    char *out;
+
+    TEST_ASSERT_EQ_INT(metrics_init(), 0);
+    c = metrics_counter_get("cache_hits");
+    g = metrics_gauge_get("cache_temp");
+    metrics_counter_add(c, 7);
+    metrics_gauge_set(g, 21.5);
+    out = metrics_export_prometheus();
+    TEST_ASSERT(out && strstr(out, "cache_hits 7\n") != NULL);
+    TEST_ASSERT(out && strstr(out, "cache_temp 21.50\n") != NULL);
+    free(out);
+
+    metrics_counter_add(c, 18446744073709551615ULL - 7);
+    metrics_gauge_set(g, -1e300);
+    out = metrics_export_prometheus();
+    TEST_ASSERT(out && strstr(out, "cache_hits 18446744073709551615\n") != NULL);
+    TEST_ASSERT(out && strstr(out, "cache_temp -1.000000e+300\n") != NULL);
+    free(out);
+
+    metrics_observe_histogram("cache_latency", 2.0);
+    out = metrics_export_json();
+    TEST_ASSERT(out && strstr(out, "\"cache_hits\": 18446744073709551615") != NULL);
+    TEST_ASSERT(out && strstr(out, "\"count\": 1,\n      \"sum\": 2.00") != NULL);
+    free(out);
+    out = metrics_export_prometheus();
+    TEST_ASSERT(out && strstr(out, "cache_latency_count 1\n") != NULL);
+    free(out);
+    metrics_cleanup();
+
+    TEST_ASSERT_EQ_INT(metrics_init(), 0);
+    metrics_increment_counter("cache_other", 1);
+    out = metrics_export_prometheus();
+    TEST_ASSERT(out && strstr(out, "cache_other 1\n") != NULL);
+    TEST_ASSERT(out && strstr(out, "cache_hits") == NULL);
+    free(out);
+    metrics_cleanup();
+    TEST_ASSERT(metrics_export_prometheus() == NULL);
+}
+
 /* Regression for the export buffer-overflow fix (buf_appendf). The JSON
  * exporter sized its buffer from an *average* budget (100 bytes per counter),
  * so a registry of many long-named counters whose lines each exceed that
@@ -1548,6 +2198,117 @@ static void test_metrics_export_no_overflow(void) {
     metrics_cleanup();
 }
 
+/* ── Metrics history tests ─────────────────────────────────────── */
+
+/* A minute boundary, so minute buckets line up with the loop below */
+#define HIST_T0 ((time_t)1700000040)
+
+/* Samples land in the 1 s tier as-is, close into minutes as a mean (the last
+ * value for a counter) and into hours from those; the open bucket reads back
+ * as what it has so far, skipped buckets as NaN, and long ranges merge into
+ * wider buckets to fit max_points. */
+static void test_tsdb_downsampling(void) {
+    struct tsdb_point pts[100];
+    long step = 0;
+    int s, n;
+
+    TEST_ASSERT_EQ_INT(metrics_init(), 0);
+    TEST_ASSERT_EQ_INT(tsdb_open(NULL), 1);
+    TEST_ASSERT_EQ_INT(tsdb_track("hist_gauge", TSDB_GAUGE), 0);
+    TEST_ASSERT_EQ_INT(tsdb_track("hist_count", TSDB_COUNTER), 0);
+
+    for (s = 0; s < 180; s++) {
+        metrics_set_gauge("hist_gauge", (double)s);
+        metrics_increment_counter("hist_count", 1);
+        tsdb_record(HIST_T0 + s);
+        tsdb_record(HIST_T0 + s);   /* same second: ignored */
+    }
+
+    n = tsdb_query("hist_gauge", 10, HIST_T0 + 179, pts, 100, &step);
+    TEST_ASSERT_EQ_INT(n, 10);
+    TEST_ASSERT_EQ_INT((int)step, 1);
+    TEST_ASSERT(pts[0].t == HIST_T0 + 170 && pts[0].value == 170.0);
+    TEST_ASSERT(pts[9].value == 179.0);
+
+    /* An hour comes from the minute tier */
+    n = tsdb_query("hist_gauge", 3600, HIST_T0 + 179, pts, 100, &step);
+    TEST_ASSERT_EQ_INT(n, 60);
+    TEST_ASSERT_EQ_INT((int)step, 60);
+    TEST_ASSERT(pts[56].value != pts[56].value);
+    TEST_ASSERT(pts[57].t == HIST_T0 && pts[57].value == 29.5);
+    TEST_ASSERT(pts[58].value == 89.5);
+    TEST_ASSERT(pts[59].value == 149.5);    /* the open minute */
+    n = tsdb_query("hist_count", 3600, HIST_T0 + 179, pts, 100, &step);
+    TEST_ASSERT(pts[57].value == 60.0 && pts[58].value == 120.0 && pts[59].value == 180.0);
+
+    /* Merged three minutes to a point */
+    n = tsdb_query("hist_gauge", 3600, HIST_T0 + 179, pts, 20, &step);
+    TEST_ASSERT_EQ_INT(n, 20);
+    TEST_ASSERT_EQ_INT((int)step, 180);
+    TEST_ASSERT(pts[19].value == 89.5);
+    n = tsdb_query("hist_count", 3600, HIST_T0 + 179, pts, 20, &step);
+    TEST_ASSERT(pts[19].value == 180.0);
+
+    /* Five minutes without samples, then one; a late sample from a clock
+     * stepped back is dropped */
+    metrics_set_gauge("hist_gauge", 1000.0);
+    tsdb_record(HIST_T0 + 479);
+    tsdb_record(HIST_T0 + 400);
+    n = tsdb_query("hist_gauge", 3600, HIST_T0 + 479, pts, 100, &step);
+    TEST_ASSERT_EQ_INT(n, 60);
+    TEST_ASSERT(pts[59].value == 1000.0);
+    TEST_ASSERT(pts[58].value != pts[58].value && pts[55].value != pts[55].value);
+    TEST_ASSERT(pts[54].value == 149.5);
+
+    /* Two days come from the hour tier: the open hour so far */
+    n = tsdb_query("hist_gauge", 2 * 86400, HIST_T0 + 479, pts, 100, &step);
+    TEST_ASSERT_EQ_INT(n, 48);
+    TEST_ASSERT_EQ_INT((int)step, 3600);
+    TEST_ASSERT(pts[47].value == 89.5);
+
+    TEST_ASSERT_EQ_INT(tsdb_query("not_tracked", 3600, HIST_T0, pts, 100, &step), -1);
+    tsdb_close();
+    TEST_ASSERT_EQ_INT(tsdb_track("hist_gauge", TSDB_GAUGE), -1);
+    metrics_cleanup();
+}
+
+/* The minute and hour tiers live in the history file and come back after a
+ * restart, columns and all; the file never changes size. */
+static void test_tsdb_survives_restart(void) {
+    const char *path = "/tmp/millennium_tsdb.test";
+    struct tsdb_point pts[100];
+    struct stat st;
+    off_t size;
+    long step;
+    int s;
+
+    remove(path);
+    TEST_ASSERT_EQ_INT(metrics_init(), 0);
+    TEST_ASSERT_EQ_INT(tsdb_open(path), 0);
+    TEST_ASSERT_EQ_INT(tsdb_track("hist_gauge", TSDB_GAUGE), 0);
+    metrics_set_gauge("hist_gauge", 7.0);
+    for (s = 0; s < 120; s++) {
+        tsdb_record(HIST_T0 + s);
+    }
+    tsdb_close();
+    TEST_ASSERT_EQ_INT(stat(path, &st), 0);
+    size = st.st_size;
+
+    TEST_ASSERT_EQ_INT(tsdb_open(path), 0);
+    TEST_ASSERT_EQ_INT(tsdb_query("hist_gauge", 3600, HIST_T0 + 119, pts, 100, &step), 60);
+    TEST_ASSERT(pts[58].value == 7.0 && pts[59].value == 7.0);
+    TEST_ASSERT(pts[57].value != pts[57].value);
+    TEST_ASSERT_EQ_INT(tsdb_track("hist_other", TSDB_GAUGE), 0);
+    TEST_ASSERT_EQ_INT(tsdb_query("hist_other", 3600, HIST_T0 + 119, pts, 100, &step), 60);
+    TEST_ASSERT(pts[59].value != pts[59].value);
+    tsdb_close();
+    TEST_ASSERT_EQ_INT(stat(path, &st), 0);
+    TEST_ASSERT(st.st_size == size);
+
+    remove(path);
+    metrics_cleanup();
+}
+
 /* ── Call-duration metric tests ────────────────────────────────── */
 
 /* call_metrics times a connected call between started()/ended() using the
@@ -1925,6 +2686,21 @@ static void test_conn_queue_close_drains_then_signals(void) {
     conn_queue_destroy(&q);
 }
 
+static void test_conn_queue_try_pop(void) {
+    struct conn_queue q;
+    TEST_ASSERT_EQ_INT(conn_queue_init(&q, 2), 0);
+
+    TEST_ASSERT_EQ_INT(conn_queue_try_pop(&q), -1);  /* empty: no wait */
+    TEST_ASSERT_EQ_INT(conn_queue_try_push(&q, 5), 0);
+    TEST_ASSERT_EQ_INT(conn_queue_try_push(&q, 6), 0);
+    TEST_ASSERT_EQ_INT(conn_queue_try_pop(&q), 5);
+    TEST_ASSERT_EQ_INT(conn_queue_try_pop(&q), 6);
+    TEST_ASSERT_EQ_INT(conn_queue_try_pop(&q), -1);
+    TEST_ASSERT_EQ_INT(conn_queue_try_pop(NULL), -1);
+
+    conn_queue_destroy(&q);
+}
+
 static void test_conn_queue_null_safety(void) {
     TEST_ASSERT_EQ_INT(conn_queue_init(NULL, 4), -1);
     TEST_ASSERT_EQ_INT(conn_queue_init((struct conn_queue*)0, 0), -1);
@@ -2029,6 +2805,1199 @@ static void test_conn_queue_stats_null_safety(void) {
     TEST_ASSERT_EQ_INT((int)st.rejected_total, 0);
 }
 
+/* ── Web router ─────────────────────────────────────────────────── */
+
+/* Match a NUL-terminated method and path */
+static int router_match(const struct web_router* r, const char* method, const char* path,
+                        struct web_route_match* m) {
+    return web_router_match(r, method, strlen(method), path, strlen(path), m);
+}
+
+static void test_web_router_literal_routes(void) {
+    struct web_router r;
+    struct web_route_match m;
+    TEST_ASSERT_EQ_INT(web_router_init(&r), 0);
+
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "GET", "/api/metrics", 1), 0);
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "GET", "/api/metrics/history", 2), 0);
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "GET", "/api/health", 3), 0);
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "GET", "/", 4), 0);
+
+    TEST_ASSERT_EQ_INT(router_match(&r, "GET", "/api/metrics", &m), WEB_ROUTER_FOUND);
+    TEST_ASSERT_EQ_INT(m.id, 1);
+    TEST_ASSERT_EQ_INT(m.param_count, 0);
+    TEST_ASSERT_EQ_INT(router_match(&r, "GET", "/api/metrics/history", &m), WEB_ROUTER_FOUND);
+    TEST_ASSERT_EQ_INT(m.id, 2);
+    TEST_ASSERT_EQ_INT(router_match(&r, "GET", "/api/health", &m), WEB_ROUTER_FOUND);
+    TEST_ASSERT_EQ_INT(m.id, 3);
+    TEST_ASSERT_EQ_INT(router_match(&r, "GET", "/", &m), WEB_ROUTER_FOUND);
+    TEST_ASSERT_EQ_INT(m.id, 4);
+
+    /* Prefixes and extensions of a route are not it */
+    TEST_ASSERT_EQ_INT(router_match(&r, "GET", "/api/metric", &m), WEB_ROUTER_NOT_FOUND);
+    TEST_ASSERT_EQ_INT(router_match(&r, "GET", "/api/metrics/", &m), WEB_ROUTER_NOT_FOUND);
+    TEST_ASSERT_EQ_INT(router_match(&r, "GET", "/api/", &m), WEB_ROUTER_NOT_FOUND);
+    TEST_ASSERT_EQ_INT(router_match(&r, "GET", "", &m), WEB_ROUTER_NOT_FOUND);
+
+    /* The path need not be NUL-terminated */
+    TEST_ASSERT_EQ_INT(web_router_match(&r, "GET", 3, "/api/healthXYZ", 11, &m), WEB_ROUTER_FOUND);
+    TEST_ASSERT_EQ_INT(m.id, 3);
+
+    web_router_destroy(&r);
+}
+
+static void test_web_router_params_and_wildcard(void) {
+    struct web_router r;
+    struct web_route_match m;
+    TEST_ASSERT_EQ_INT(web_router_init(&r), 0);
+
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "POST", "/api/plugins/:name/activate", 1), 0);
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "GET", "/api/plugins/:name", 2), 0);
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "GET", "/files/*path", 3), 0);
+
+    TEST_ASSERT_EQ_INT(router_match(&r, "POST", "/api/plugins/Jukebox/activate", &m),
+                       WEB_ROUTER_FOUND);
+    TEST_ASSERT_EQ_INT(m.id, 1);
+    TEST_ASSERT_EQ_INT(m.param_count, 1);
+    TEST_ASSERT_EQ_STR(m.param_names[0], "name");
+    TEST_ASSERT_EQ_INT((int)m.param_offsets[0], 13);
+    TEST_ASSERT_EQ_INT((int)m.param_lens[0], 7);
+
+    TEST_ASSERT_EQ_INT(router_match(&r, "GET", "/api/plugins/Trivia", &m), WEB_ROUTER_FOUND);
+    TEST_ASSERT_EQ_INT(m.id, 2);
+    TEST_ASSERT_EQ_INT((int)m.param_lens[0], 6);
+    /* A parameter is one whole, non-empty segment */
+    TEST_ASSERT_EQ_INT(router_match(&r, "GET", "/api/plugins/", &m), WEB_ROUTER_NOT_FOUND);
+    TEST_ASSERT_EQ_INT(router_match(&r, "GET", "/api/plugins/a/b", &m), WEB_ROUTER_NOT_FOUND);
+
+    /* A wildcard takes the rest of the path, slashes and all, or nothing */
+    TEST_ASSERT_EQ_INT(router_match(&r, "GET", "/files/css/site.css", &m), WEB_ROUTER_FOUND);
+    TEST_ASSERT_EQ_INT(m.id, 3);
+    TEST_ASSERT_EQ_STR(m.param_names[0], "path");
+    TEST_ASSERT_EQ_INT((int)m.param_offsets[0], 7);
+    TEST_ASSERT_EQ_INT((int)m.param_lens[0], 12);
+    TEST_ASSERT_EQ_INT(router_match(&r, "GET", "/files/", &m), WEB_ROUTER_FOUND);
+    TEST_ASSERT_EQ_INT((int)m.param_lens[0], 0);
+    TEST_ASSERT_EQ_INT(router_match(&r, "GET", "/files", &m), WEB_ROUTER_NOT_FOUND);
+
+    web_router_destroy(&r);
+}
+
+/* Literal text beats a parameter beats a wildcard, and a lookup that goes
+ * down the literal branch to a dead end comes back for the others */
+static void test_web_router_precedence_backtracks(void) {
+    struct web_router r;
+    struct web_route_match m;
+    TEST_ASSERT_EQ_INT(web_router_init(&r), 0);
+
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "GET", "/a/new", 1), 0);
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "GET", "/a/:id", 2), 0);
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "GET", "/a/:id/edit", 3), 0);
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "GET", "/a/new/x/y", 4), 0);
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "GET", "/*rest", 5), 0);
+
+    TEST_ASSERT_EQ_INT(router_match(&r, "GET", "/a/new", &m), WEB_ROUTER_FOUND);
+    TEST_ASSERT_EQ_INT(m.id, 1);
+    TEST_ASSERT_EQ_INT(m.param_count, 0);
+    TEST_ASSERT_EQ_INT(router_match(&r, "GET", "/a/newer", &m), WEB_ROUTER_FOUND);
+    TEST_ASSERT_EQ_INT(m.id, 2);
+    /* "new" leads to "/x/y" only, so "edit" is the parameter route's */
+    TEST_ASSERT_EQ_INT(router_match(&r, "GET", "/a/new/edit", &m), WEB_ROUTER_FOUND);
+    TEST_ASSERT_EQ_INT(m.id, 3);
+    TEST_ASSERT_EQ_INT(m.param_count, 1);
+    TEST_ASSERT_EQ_INT((int)m.param_offsets[0], 3);
+    TEST_ASSERT_EQ_INT((int)m.param_lens[0], 3);
+    /* Neither fits: the wildcard at the root, with no stale parameter */
+    TEST_ASSERT_EQ_INT(router_match(&r, "GET", "/a/new/x", &m), WEB_ROUTER_FOUND);
+    TEST_ASSERT_EQ_INT(m.id, 5);
+    TEST_ASSERT_EQ_INT(m.param_count, 1);
+    TEST_ASSERT_EQ_STR(m.param_names[0], "rest");
+    TEST_ASSERT_EQ_INT((int)m.param_offsets[0], 1);
+
+    web_router_destroy(&r);
+}
+
+static void test_web_router_methods(void) {
+    struct web_router r;
+    struct web_route_match m;
+    char allow[64];
+    TEST_ASSERT_EQ_INT(web_router_init(&r), 0);
+
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "GET", "/api/update", 1), 0);
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "POST", "/api/update", 2), 0);
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "*", "/", 3), 0);
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "GET", "/", 4), 0);
+
+    TEST_ASSERT_EQ_INT(router_match(&r, "POST", "/api/update", &m), WEB_ROUTER_FOUND);
+    TEST_ASSERT_EQ_INT(m.id, 2);
+    TEST_ASSERT_EQ_INT(router_match(&r, "DELETE", "/api/update", &m), WEB_ROUTER_NO_METHOD);
+    web_router_allow(&m, allow, sizeof(allow));
+    TEST_ASSERT_EQ_STR(allow, "GET, POST");
+
+    /* "*" answers the methods the path has no route of its own for */
+    TEST_ASSERT_EQ_INT(router_match(&r, "GET", "/", &m), WEB_ROUTER_FOUND);
+    TEST_ASSERT_EQ_INT(m.id, 4);
+    TEST_ASSERT_EQ_INT(router_match(&r, "HEAD", "/", &m), WEB_ROUTER_FOUND);
+    TEST_ASSERT_EQ_INT(m.id, 3);
+
+    web_router_destroy(&r);
+}
+
+static void test_web_router_add_replace_find(void) {
+    struct web_router r;
+    struct web_route_match m;
+    char pattern[32];
+    int i;
+    TEST_ASSERT_EQ_INT(web_router_init(&r), 0);
+
+    /* Well past the 32 routes the server's table used to hold */
+    for (i = 0; i < 200; i++) {
+        snprintf(pattern, sizeof(pattern), "/r/%d", i);
+        TEST_ASSERT_EQ_INT(web_router_add(&r, "GET", pattern, i), 0);
+    }
+    TEST_ASSERT_EQ_INT(r.route_count, 200);
+    for (i = 0; i < 200; i++) {
+        snprintf(pattern, sizeof(pattern), "/r/%d", i);
+        TEST_ASSERT_EQ_INT(router_match(&r, "GET", pattern, &m), WEB_ROUTER_FOUND);
+        TEST_ASSERT_EQ_INT(m.id, i);
+        TEST_ASSERT_EQ_INT(web_router_find(&r, "GET", pattern), i);
+    }
+
+    /* The same method and pattern again replaces, not duplicates */
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "GET", "/r/7", 700), 0);
+    TEST_ASSERT_EQ_INT(r.route_count, 200);
+    TEST_ASSERT_EQ_INT(web_router_find(&r, "GET", "/r/7"), 700);
+
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "GET", "/p/:name/x", 1), 0);
+    TEST_ASSERT_EQ_INT(web_router_find(&r, "GET", "/p/:name/x"), 1);
+    TEST_ASSERT_EQ_INT(web_router_find(&r, "GET", "/p/:other/x"), -1);
+    TEST_ASSERT_EQ_INT(web_router_find(&r, "POST", "/p/:name/x"), -1);
+    TEST_ASSERT_EQ_INT(web_router_find(&r, "GET", "/p/:name"), -1);
+    TEST_ASSERT_EQ_INT(web_router_find(&r, "GET", "/r/1000"), -1);
+
+    web_router_destroy(&r);
+    TEST_ASSERT_NULL(r.root);
+}
+
+static void test_web_router_rejects_bad_patterns(void) {
+    struct web_router r;
+    TEST_ASSERT_EQ_INT(web_router_init(&r), 0);
+
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "GET", "api/state", 1), -1);
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "GET", "/files/*path/more", 1), -1);
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "GET", "/a/:/b", 1), -1);
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "GET", "/:a/:b/:c/:d/:e/:f/:g/:h/:i", 1), -1);
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "A-METHOD-TOO-LONG", "/", 1), -1);
+    /* Two names for one parameter could not both be filled in */
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "GET", "/p/:name", 1), 0);
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "POST", "/p/:id", 2), -1);
+    /* ':' and '*' are plain text away from the start of a segment */
+    TEST_ASSERT_EQ_INT(web_router_add(&r, "GET", "/time:now*", 3), 0);
+    TEST_ASSERT_EQ_INT(web_router_find(&r, "GET", "/time:now*"), 3);
+    TEST_ASSERT_EQ_INT(r.route_count, 2);
+
+    web_router_destroy(&r);
+}
+
+/* ── Engine loop ────────────────────────────────────────────────── */
+
+/* An idle loop must block until the tick, not return early: waking for
+ * nothing is exactly what this replaced. */
+static void test_engine_loop_idle_waits_for_tick(void) {
+    engine_loop_t *loop = engine_loop_create(50);
+    unsigned wake = 0;
+    int tries = 0;
+    TEST_ASSERT_NOT_NULL(loop);
+    while (wake == 0 && tries++ < 10) {
+        wake = engine_loop_wait(loop, -1);
+    }
+    engine_loop_destroy(loop);
+    TEST_ASSERT_EQ_INT((int)wake, ENGINE_WAKE_TICK);
+}
+
+static void test_engine_loop_notify_and_serial_wake(void) {
+    engine_loop_t *loop = engine_loop_create(10000);
+    int notify[2], serial[2];
+    char c = 'K';
+    TEST_ASSERT_NOT_NULL(loop);
+    TEST_ASSERT_EQ_INT(pipe(notify), 0);
+    TEST_ASSERT_EQ_INT(pipe(serial), 0);
+
+    engine_loop_set_notify_fd(loop, notify[0]);
+    engine_loop_set_serial_fd(loop, serial[0], 1);
+    TEST_ASSERT_EQ_INT((int)engine_loop_wait(loop, 0), 0);
+
+    TEST_ASSERT_EQ_INT((int)write(notify[1], &c, 1), 1);
+    TEST_ASSERT_EQ_INT((int)engine_loop_wait(loop, 1000), ENGINE_WAKE_NOTIFY);
+    TEST_ASSERT_EQ_INT((int)read(notify[0], &c, 1), 1);
+
+    TEST_ASSERT_EQ_INT((int)write(serial[1], &c, 1), 1);
+    TEST_ASSERT_EQ_INT((int)engine_loop_wait(loop, 1000), ENGINE_WAKE_SERIAL);
+    TEST_ASSERT_EQ_INT((int)read(serial[0], &c, 1), 1);
+
+    /* Unwatching the serial fd silences it. */
+    TEST_ASSERT_EQ_INT((int)write(serial[1], &c, 1), 1);
+    engine_loop_set_serial_fd(loop, -1, 1);
+    TEST_ASSERT_EQ_INT((int)engine_loop_wait(loop, 0), 0);
+
+    engine_loop_destroy(loop);
+    close(notify[0]); close(notify[1]);
+    close(serial[0]); close(serial[1]);
+}
+
+/* A hung-up serial fd is dropped so it cannot spin the loop, and only a new
+ * generation re-arms it -- even when the reopened port gets the same number. */
+static void test_engine_loop_hangup_needs_new_generation(void) {
+    engine_loop_t *loop = engine_loop_create(10000);
+    int serial[2];
+    TEST_ASSERT_NOT_NULL(loop);
+    TEST_ASSERT_EQ_INT(pipe(serial), 0);
+
+    engine_loop_set_serial_fd(loop, serial[0], 7);
+    close(serial[1]);   /* writer gone: the read end reports hang-up */
+    TEST_ASSERT_EQ_INT((int)engine_loop_wait(loop, 1000), ENGINE_WAKE_SERIAL);
+    TEST_ASSERT_EQ_INT((int)engine_loop_wait(loop, 0), 0);
+
+    engine_loop_set_serial_fd(loop, serial[0], 7);
+    TEST_ASSERT_EQ_INT((int)engine_loop_wait(loop, 0), 0);
+    engine_loop_set_serial_fd(loop, serial[0], 8);
+    TEST_ASSERT_EQ_INT((int)engine_loop_wait(loop, 1000), ENGINE_WAKE_SERIAL);
+
+    engine_loop_destroy(loop);
+    close(serial[0]);
+}
+
+/* Writability is only reported while asked for: a tty is almost always
+ * writable, so standing interest would spin the loop. A socketpair end is
+ * readable and writable like the tty. */
+static void test_engine_loop_want_write(void) {
+    engine_loop_t *loop = engine_loop_create(10000);
+    int sv[2];
+    char c = 'K';
+    TEST_ASSERT_NOT_NULL(loop);
+    TEST_ASSERT_EQ_INT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+
+    engine_loop_set_serial_fd(loop, sv[0], 1);
+    TEST_ASSERT_EQ_INT((int)engine_loop_wait(loop, 0), 0);
+
+    engine_loop_set_serial_want_write(loop, 1);
+    TEST_ASSERT_EQ_INT((int)engine_loop_wait(loop, 1000), ENGINE_WAKE_WRITABLE);
+
+    TEST_ASSERT_EQ_INT((int)write(sv[1], &c, 1), 1);
+    TEST_ASSERT_EQ_INT((int)engine_loop_wait(loop, 1000),
+                       ENGINE_WAKE_SERIAL | ENGINE_WAKE_WRITABLE);
+
+    /* Interest survives a reopen. */
+    engine_loop_set_serial_fd(loop, sv[0], 2);
+    TEST_ASSERT_EQ_INT((int)engine_loop_wait(loop, 1000),
+                       ENGINE_WAKE_SERIAL | ENGINE_WAKE_WRITABLE);
+
+    engine_loop_set_serial_want_write(loop, 0);
+    TEST_ASSERT_EQ_INT((int)read(sv[0], &c, 1), 1);
+    TEST_ASSERT_EQ_INT((int)engine_loop_wait(loop, 0), 0);
+
+    engine_loop_destroy(loop);
+    close(sv[0]); close(sv[1]);
+}
+
+static void test_engine_loop_null_safety(void) {
+    TEST_ASSERT_NULL(engine_loop_create(0));
+    TEST_ASSERT_EQ_INT((int)engine_loop_wait(NULL, 0), 0);
+    engine_loop_set_serial_fd(NULL, 3, 1);
+    engine_loop_set_notify_fd(NULL, 3);
+    engine_loop_set_serial_want_write(NULL, 1);
+    engine_loop_destroy(NULL);
+}
+
+/* ── Event ring (SDK event queue, lock-free MPSC) ───────────────── */
+
+/* Items are opaque pointers; small integers cast to void* keep these readable.
+ * NULL is reserved to mean "empty", so start at 1. */
+#define RING_ITEM(n) ((void *)(long)(n))
+
+static void test_event_ring_fifo_across_laps(void) {
+    struct event_ring r;
+    long i;
+    TEST_ASSERT_EQ_INT(event_ring_init(&r, 4), 0);
+    TEST_ASSERT_NULL(event_ring_pop(&r));
+
+    /* Ten laps of a 4-slot ring, three items at a time: every slot is reused
+     * at a new sequence number, which is what the per-slot seq has to get
+     * right. */
+    for (i = 1; i <= 30; i += 3) {
+        TEST_ASSERT_EQ_INT(event_ring_push(&r, RING_ITEM(i)), 0);
+        TEST_ASSERT_EQ_INT(event_ring_push(&r, RING_ITEM(i + 1)), 0);
+        TEST_ASSERT_EQ_INT(event_ring_push(&r, RING_ITEM(i + 2)), 0);
+        TEST_ASSERT(event_ring_pop(&r) == RING_ITEM(i));
+        TEST_ASSERT(event_ring_pop(&r) == RING_ITEM(i + 1));
+        TEST_ASSERT(event_ring_pop(&r) == RING_ITEM(i + 2));
+    }
+    TEST_ASSERT_NULL(event_ring_pop(&r));
+    event_ring_destroy(&r);
+}
+
+/* The overflow policy is reject-newest: the queued items are untouched, the
+ * push reports failure so the caller can free the rejected item, and the drop
+ * is counted. */
+static void test_event_ring_full_drops_newest(void) {
+    struct event_ring r;
+    struct event_ring_stats st;
+    TEST_ASSERT_EQ_INT(event_ring_init(&r, 2), 0);
+
+    TEST_ASSERT_EQ_INT(event_ring_push(&r, RING_ITEM(1)), 0);
+    TEST_ASSERT_EQ_INT(event_ring_push(&r, RING_ITEM(2)), 0);
+    TEST_ASSERT_EQ_INT(event_ring_push(&r, RING_ITEM(3)), -1);
+    TEST_ASSERT_EQ_INT(event_ring_push(&r, RING_ITEM(4)), -1);
+
+    event_ring_get_stats(&r, &st);
+    TEST_ASSERT_EQ_INT((int)st.capacity, 2);
+    TEST_ASSERT_EQ_INT((int)st.depth, 2);
+    TEST_ASSERT_EQ_INT((int)st.high_water, 2);
+    TEST_ASSERT_EQ_INT((int)st.pushed_total, 2);
+    TEST_ASSERT_EQ_INT((int)st.dropped_total, 2);
+
+    TEST_ASSERT(event_ring_pop(&r) == RING_ITEM(1));
+    TEST_ASSERT(event_ring_pop(&r) == RING_ITEM(2));
+    TEST_ASSERT_NULL(event_ring_pop(&r));
+
+    /* Draining frees room again; high_water and the totals are lifetime. */
+    TEST_ASSERT_EQ_INT(event_ring_push(&r, RING_ITEM(5)), 0);
+    event_ring_get_stats(&r, &st);
+    TEST_ASSERT_EQ_INT((int)st.depth, 1);
+    TEST_ASSERT_EQ_INT((int)st.high_water, 2);
+    TEST_ASSERT_EQ_INT((int)st.pushed_total, 3);
+    TEST_ASSERT_EQ_INT((int)st.dropped_total, 2);
+
+    event_ring_destroy(&r);
+}
+
+static void test_event_ring_bad_args(void) {
+    struct event_ring r;
+    struct event_ring_stats st;
+    TEST_ASSERT_EQ_INT(event_ring_init(NULL, 4), -1);
+    TEST_ASSERT_EQ_INT(event_ring_init(&r, 0), -1);
+    TEST_ASSERT_EQ_INT(event_ring_init(&r, 1), -1);
+    TEST_ASSERT_EQ_INT(event_ring_init(&r, 6), -1);   /* not a power of two */
+    TEST_ASSERT_EQ_INT(event_ring_push(NULL, RING_ITEM(1)), -1);
+    TEST_ASSERT_NULL(event_ring_pop(NULL));
+
+    TEST_ASSERT_EQ_INT(event_ring_init(&r, 2), 0);
+    TEST_ASSERT_EQ_INT(event_ring_push(&r, NULL), -1);  /* NULL means empty */
+    event_ring_destroy(&r);
+    event_ring_destroy(NULL);   /* must not crash */
+
+    event_ring_get_stats(NULL, NULL);
+    st.depth = 99;
+    event_ring_get_stats(NULL, &st);
+    TEST_ASSERT_EQ_INT((int)st.depth, 0);
+    TEST_ASSERT_EQ_INT((int)st.capacity, 0);
+}
+
+/* Two producers racing one consumer, as in the daemon (serial + PJSUA). The
+ * ring is small so the full path is exercised; producers retry on full so
+ * every item must arrive exactly once and in per-producer order. The
+ * ThreadSanitizer build of this is `make tsan-queue`. */
+#define RING_MT_N 20000
+static struct event_ring mt_ring;
+
+static void *ring_mt_producer(void *arg) {
+    long id = (long)arg, i;
+    for (i = 1; i <= RING_MT_N; i++) {
+        while (event_ring_push(&mt_ring, RING_ITEM(id * (RING_MT_N + 1) + i)) != 0) {
+            /* full: let the consumer catch up */
+        }
+    }
+    return NULL;
+}
+
+static void test_event_ring_two_producers(void) {
+    pthread_t p1, p2;
+    long last[3] = { 0, 0, 0 };
+    long received = 0;
+    int in_order = 1;
+    struct event_ring_stats st;
+
+    TEST_ASSERT_EQ_INT(event_ring_init(&mt_ring, 8), 0);
+    pthread_create(&p1, NULL, ring_mt_producer, (void *)1L);
+    pthread_create(&p2, NULL, ring_mt_producer, (void *)2L);
+    while (received < 2L * RING_MT_N) {
+        void *item = event_ring_pop(&mt_ring);
+        long v, id, seq;
+        if (!item) continue;
+        v = (long)item;
+        id = v / (RING_MT_N + 1);
+        seq = v % (RING_MT_N + 1);
+        if (id < 1 || id > 2 || seq != last[id] + 1) {
+            in_order = 0;
+            break;
+        }
+        last[id] = seq;
+        received++;
+    }
+    pthread_join(p1, NULL);
+    pthread_join(p2, NULL);
+
+    TEST_ASSERT(in_order);
+    TEST_ASSERT_EQ_INT((int)received, 2 * RING_MT_N);
+    event_ring_get_stats(&mt_ring, &st);
+    TEST_ASSERT_EQ_INT((int)st.pushed_total, 2 * RING_MT_N);
+    TEST_ASSERT_EQ_INT((int)st.depth, 0);
+    TEST_ASSERT(st.high_water <= 8);
+    event_ring_destroy(&mt_ring);
+}
+
+/* ── Event pool (zero-allocation events) ────────────────────────── */
+
+/* Pool counters are process-wide and other suites create events too, so
+ * these assert on deltas from a snapshot rather than absolute values. */
+static void test_event_pool_create_destroy_balances(void) {
+    event_pool_stats_t before, during, after;
+    keypad_event_t *k;
+    call_state_event_t *c;
+
+    event_pool_get_stats(&before);
+    TEST_ASSERT_EQ_INT((int)before.capacity, EVENT_POOL_SIZE);
+
+    k = keypad_event_create('5');
+    c = call_state_event_create("CALL_INCOMING", NULL, EVENT_CALL_STATE_INCOMING);
+    TEST_ASSERT_NOT_NULL(k);
+    TEST_ASSERT_NOT_NULL(c);
+    TEST_ASSERT_EQ_INT(keypad_event_get_key(k), '5');
+    TEST_ASSERT_EQ_INT(call_state_event_get_state(c), EVENT_CALL_STATE_INCOMING);
+
+    event_pool_get_stats(&during);
+    TEST_ASSERT_EQ_INT((int)(during.in_use - before.in_use), 2);
+    TEST_ASSERT_EQ_INT((int)(during.allocated_total - before.allocated_total), 2);
+    TEST_ASSERT(during.high_water >= during.in_use);
+
+    event_destroy((event_t *)k);
+    event_destroy((event_t *)c);
+    event_pool_get_stats(&after);
+    TEST_ASSERT_EQ_INT((int)after.in_use, (int)before.in_use);
+    TEST_ASSERT_EQ_INT((int)after.exhausted_total, (int)before.exhausted_total);
+}
+
+/* A full pool must not lose events: creation falls back to the heap, the
+ * fallback is counted, and destroying a heap event frees it rather than
+ * corrupting the bitmap. */
+static void test_event_pool_exhaustion_falls_back_to_heap(void) {
+    static coin_event_t *held[EVENT_POOL_SIZE + 2];
+    event_pool_stats_t before, full, after;
+    int i, n = EVENT_POOL_SIZE + 2;
+
+    event_pool_get_stats(&before);
+    for (i = 0; i < n; i++) {
+        held[i] = coin_event_create(0x36);
+        TEST_ASSERT_NOT_NULL(held[i]);
+    }
+    event_pool_get_stats(&full);
+    TEST_ASSERT_EQ_INT((int)full.in_use, EVENT_POOL_SIZE);
+    TEST_ASSERT_EQ_INT((int)full.high_water, EVENT_POOL_SIZE);
+    TEST_ASSERT_EQ_INT((int)(full.exhausted_total - before.exhausted_total),
+                       n - (EVENT_POOL_SIZE - (int)before.in_use));
+
+    for (i = 0; i < n; i++) {
+        TEST_ASSERT_EQ_STR(coin_event_get_coin_name(held[i]), "COIN_6");
+        event_destroy((event_t *)held[i]);
+    }
+    event_pool_get_stats(&after);
+    TEST_ASSERT_EQ_INT((int)after.in_use, (int)before.in_use);
+
+    /* Slots freed above are reusable. */
+    held[0] = coin_event_create(0x37);
+    event_pool_get_stats(&after);
+    TEST_ASSERT_EQ_INT((int)after.exhausted_total, (int)full.exhausted_total);
+    event_destroy((event_t *)held[0]);
+}
+
+static void test_event_format_repr(void) {
+    char buf[64];
+    hook_state_change_event_t *h = hook_state_change_event_create('U');
+    coin_eeprom_validation_error_t *e = coin_eeprom_validation_error_create(1, 2, 3);
+    coin_event_t *c = coin_event_create(0x99);
+    char *heap;
+
+    TEST_ASSERT_EQ_STR(event_format_repr((event_t *)h, buf, sizeof(buf)), "Up");
+    TEST_ASSERT_EQ_STR(event_get_name((event_t *)h), "HookStateChangeEvent");
+    TEST_ASSERT_EQ_STR(event_format_repr((event_t *)e, buf, sizeof(buf)),
+                       "Addr: 1, Expected: 2, Actual: 3");
+    TEST_ASSERT_EQ_STR(event_format_repr((event_t *)c, buf, sizeof(buf)), "UNKNOWN_COIN");
+    TEST_ASSERT_EQ_STR(event_format_repr(NULL, buf, sizeof(buf)), "Unknown");
+    TEST_ASSERT_EQ_STR(event_format_repr((event_t *)e, buf, 5), "Addr");  /* truncates */
+
+    heap = event_get_repr((event_t *)c);
+    TEST_ASSERT_EQ_STR(heap, "UNKNOWN_COIN");
+    free(heap);
+    heap = coin_event_get_coin_code(c);
+    TEST_ASSERT_EQ_STR(heap, "UNKNOWN_COIN");
+    free(heap);
+
+    TEST_ASSERT_NULL(coin_event_get_coin_name(NULL));
+    TEST_ASSERT_EQ_STR(event_get_name(NULL), "UnknownEvent");
+    event_destroy(NULL);  /* must not crash */
+
+    event_destroy((event_t *)h);
+    event_destroy((event_t *)e);
+    event_destroy((event_t *)c);
+}
+
+/* ── Serial frame parser ────────────────────────────────────────── */
+
+/* Records what the parser emitted, for assertions. */
+typedef struct {
+    int count;
+    char markers[64];
+    char payloads[64][SERIAL_MAX_PAYLOAD + 1];
+    size_t lens[64];
+} frame_log_t;
+
+static void log_frame(void *ctx, char marker, const char *payload, size_t len) {
+    frame_log_t *log = (frame_log_t *)ctx;
+    if (log->count >= 64) return;
+    log->markers[log->count] = marker;
+    memcpy(log->payloads[log->count], payload, len + 1);
+    log->lens[log->count] = len;
+    log->count++;
+}
+
+/* The table is the framing contract with the Arduinos: every event type the
+ * host handles is a marker with the right width, and nothing else is -- in
+ * particular none of Beta's debug echoes (#259). */
+static void test_serial_parser_table_matches_event_types(void) {
+    static const char beta_debug_only[] = { '?', 'L', 'W', 'R', 'X', 'Y', 'Z' };
+    int i, markers = 0;
+
+    TEST_ASSERT_EQ_INT(serial_marker_payload_len[(unsigned char)EVENT_TYPE_KEYPAD], 1);
+    TEST_ASSERT_EQ_INT(serial_marker_payload_len[(unsigned char)EVENT_TYPE_HOOK], 1);
+    TEST_ASSERT_EQ_INT(serial_marker_payload_len[(unsigned char)EVENT_TYPE_COIN], 1);
+    TEST_ASSERT_EQ_INT(serial_marker_payload_len[(unsigned char)EVENT_TYPE_CARD], 16);
+    TEST_ASSERT_EQ_INT(serial_marker_payload_len[(unsigned char)EVENT_TYPE_EEPROM_ERROR], 3);
+    TEST_ASSERT_EQ_INT(serial_marker_payload_len[(unsigned char)EVENT_TYPE_DIAG],
+                       EVENT_DIAG_PAYLOAD_LEN);
+    TEST_ASSERT_EQ_INT(serial_marker_payload_len[(unsigned char)EVENT_TYPE_HEARTBEAT], 0);
+    TEST_ASSERT_EQ_INT(serial_marker_payload_len[(unsigned char)EVENT_TYPE_COIN_UPLOAD_START], 0);
+    TEST_ASSERT_EQ_INT(serial_marker_payload_len[(unsigned char)EVENT_TYPE_COIN_UPLOAD_END], 0);
+    TEST_ASSERT_EQ_INT(serial_marker_payload_len[(unsigned char)EVENT_TYPE_COIN_VALIDATION_START], 0);
+    TEST_ASSERT_EQ_INT(serial_marker_payload_len[(unsigned char)EVENT_TYPE_COIN_VALIDATION_END], 0);
+    TEST_ASSERT_EQ_INT(serial_marker_payload_len['@'], 0);
+
+    for (i = 0; i < (int)sizeof(beta_debug_only); i++) {
+        TEST_ASSERT_EQ_INT(serial_marker_payload_len[(unsigned char)beta_debug_only[i]],
+                           SERIAL_NOT_MARKER);
+    }
+    for (i = 0; i < 256; i++) {
+        if (serial_marker_payload_len[i] != SERIAL_NOT_MARKER) {
+            TEST_ASSERT(serial_marker_payload_len[i] <= SERIAL_MAX_PAYLOAD);
+            markers++;
+        }
+    }
+    TEST_ASSERT_EQ_INT(markers, 12);  /* the 11 event types above plus '@' */
+}
+
+/* The old buffer parser dropped the marker of a frame whose payload had not
+ * arrived yet; a read boundary between 'K' and its digit lost the keypress. */
+static void test_serial_parser_frame_split_across_reads(void) {
+    serial_parser_t p;
+    frame_log_t log;
+    memset(&log, 0, sizeof(log));
+    serial_parser_init(&p);
+
+    TEST_ASSERT_EQ_INT((int)serial_parser_feed(&p, "K", 1, log_frame, &log), 0);
+    TEST_ASSERT_EQ_INT((int)serial_parser_feed(&p, "5C12345678", 10, log_frame, &log), 1);
+    TEST_ASSERT_EQ_INT((int)serial_parser_feed(&p, "90123456H", 9, log_frame, &log), 1);
+    TEST_ASSERT_EQ_INT((int)serial_parser_feed(&p, "U", 1, log_frame, &log), 1);
+
+    TEST_ASSERT_EQ_INT(log.count, 3);
+    TEST_ASSERT_EQ_INT(log.markers[0], 'K');
+    TEST_ASSERT_EQ_STR(log.payloads[0], "5");
+    TEST_ASSERT_EQ_INT(log.markers[1], 'C');
+    TEST_ASSERT_EQ_STR(log.payloads[1], "1234567890123456");
+    TEST_ASSERT_EQ_INT((int)log.lens[1], 16);
+    TEST_ASSERT_EQ_INT(log.markers[2], 'H');
+    TEST_ASSERT_EQ_STR(log.payloads[2], "U");
+    TEST_ASSERT_EQ_INT((int)p.frames_total, 3);
+}
+
+/* Noise between frames is skipped and counted; a burst parses in one pass;
+ * payload bytes are taken by width even when they look like markers or NUL,
+ * so the stream never desyncs. */
+static void test_serial_parser_noise_and_fixed_width(void) {
+    static const char stream[] = "\r\n?xxK1PV6E\0KHGA007K2";
+    serial_parser_t p;
+    frame_log_t log;
+    memset(&log, 0, sizeof(log));
+    serial_parser_init(&p);
+
+    TEST_ASSERT_EQ_INT((int)serial_parser_feed(&p, stream, sizeof(stream) - 1,
+                                               log_frame, &log), 6);
+    TEST_ASSERT_EQ_INT((int)p.skipped_bytes, 5);   /* \r \n ? x x */
+    TEST_ASSERT_EQ_INT(log.markers[0], 'K');
+    TEST_ASSERT_EQ_INT(log.markers[1], 'P');
+    TEST_ASSERT_EQ_INT((int)log.lens[1], 0);
+    TEST_ASSERT_EQ_INT(log.markers[2], 'V');
+    TEST_ASSERT_EQ_STR(log.payloads[2], "6");
+    TEST_ASSERT_EQ_INT(log.markers[3], 'E');          /* payload "\0KH" */
+    TEST_ASSERT_EQ_INT((int)log.lens[3], 3);
+    TEST_ASSERT_EQ_INT(log.payloads[3][1], 'K');
+    TEST_ASSERT_EQ_INT(log.markers[4], 'G');
+    TEST_ASSERT_EQ_STR(log.payloads[4], "A007");
+    TEST_ASSERT_EQ_INT(log.markers[5], 'K');
+    TEST_ASSERT_EQ_STR(log.payloads[5], "2");
+}
+
+/* A reconnect must not let half a frame from before the unplug eat the first
+ * bytes of the new link. */
+static void test_serial_parser_reset_drops_partial(void) {
+    serial_parser_t p;
+    frame_log_t log;
+    memset(&log, 0, sizeof(log));
+    serial_parser_init(&p);
+
+    serial_parser_feed(&p, "C1234", 5, log_frame, &log);
+    serial_parser_reset(&p);
+    TEST_ASSERT_EQ_INT((int)serial_parser_feed(&p, "K9", 2, log_frame, &log), 1);
+    TEST_ASSERT_EQ_INT(log.count, 1);
+    TEST_ASSERT_EQ_INT(log.markers[0], 'K');
+    TEST_ASSERT_EQ_STR(log.payloads[0], "9");
+
+    TEST_ASSERT_EQ_INT((int)serial_parser_feed(NULL, "K1", 2, log_frame, &log), 0);
+    TEST_ASSERT_EQ_INT((int)serial_parser_feed(&p, NULL, 2, log_frame, &log), 0);
+    TEST_ASSERT_EQ_INT((int)serial_parser_feed(&p, "K1", 2, NULL, NULL), 1);
+    serial_parser_init(NULL);
+    serial_parser_reset(NULL);
+}
+
+/* ── Serial output queue ─────────────────────────────────────────── */
+
+/* Concatenate what serial_tx_peek() would send, for assertions. */
+static size_t tx_peek_bytes(const serial_tx_t *tx, char *out, size_t size) {
+    struct iovec iov[SERIAL_TX_MAX_IOV];
+    int n = serial_tx_peek(tx, iov, SERIAL_TX_MAX_IOV);
+    size_t len = 0;
+    int i;
+    for (i = 0; i < n && len + iov[i].iov_len < size; i++) {
+        memcpy(out + len, iov[i].iov_base, iov[i].iov_len);
+        len += iov[i].iov_len;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+/* A coin-gate command queued behind repaints goes first, and a repaint
+ * replaces the one it supersedes instead of queueing behind it. */
+static void test_serial_tx_control_first_display_coalesced(void) {
+    serial_tx_t tx;
+    struct serial_tx_stats st;
+    char out[256];
+    serial_tx_init(&tx);
+
+    TEST_ASSERT_EQ_INT(serial_tx_replace(&tx, SERIAL_TX_DISPLAY, "D1old", 5), 0);
+    TEST_ASSERT_EQ_INT(serial_tx_replace(&tx, SERIAL_TX_DISPLAY, "D2new", 5), 0);
+    TEST_ASSERT_EQ_INT(serial_tx_enqueue(&tx, SERIAL_TX_CONTROL, "cz", 2), 0);
+
+    tx_peek_bytes(&tx, out, sizeof(out));
+    TEST_ASSERT_EQ_STR(out, "czD2new");
+    TEST_ASSERT_EQ_INT((int)serial_tx_pending(&tx), 7);
+    TEST_ASSERT_EQ_INT((int)serial_tx_lane_depth(&tx, SERIAL_TX_DISPLAY), 1);
+
+    serial_tx_get_stats(&tx, &st);
+    TEST_ASSERT_EQ_INT((int)st.queued_frames, 2);
+    TEST_ASSERT_EQ_INT((int)st.frames_coalesced_total, 1);
+    TEST_ASSERT_EQ_INT((int)st.high_water_bytes, 7);
+
+    /* Plain enqueues on the display lane (partial updates) stack up. */
+    TEST_ASSERT_EQ_INT(serial_tx_enqueue(&tx, SERIAL_TX_DISPLAY, "r1", 2), 0);
+    TEST_ASSERT_EQ_INT(serial_tx_enqueue(&tx, SERIAL_TX_DISPLAY, "r2", 2), 0);
+    tx_peek_bytes(&tx, out, sizeof(out));
+    TEST_ASSERT_EQ_STR(out, "czD2newr1r2");
+    TEST_ASSERT_EQ_INT((int)serial_tx_lane_depth(&tx, SERIAL_TX_DISPLAY), 3);
+
+    serial_tx_consume(&tx, 11);
+    TEST_ASSERT_EQ_INT((int)serial_tx_pending(&tx), 0);
+    TEST_ASSERT_EQ_INT((int)serial_tx_lane_depth(&tx, SERIAL_TX_DISPLAY), 0);
+    serial_tx_get_stats(&tx, &st);
+    TEST_ASSERT_EQ_INT((int)st.frames_written_total, 4);
+    TEST_ASSERT_EQ_INT((int)st.bytes_written_total, 11);
+}
+
+/* Once a frame has started it finishes before anything else, whatever its
+ * lane: the Arduino would read a control frame spliced into a repaint as
+ * part of the message. Coalescing leaves the in-flight repaint alone too. */
+static void test_serial_tx_partial_frame_finishes_first(void) {
+    serial_tx_t tx;
+    char out[256];
+    serial_tx_init(&tx);
+
+    serial_tx_enqueue(&tx, SERIAL_TX_DISPLAY, "ABCDE", 5);
+    serial_tx_consume(&tx, 2);
+    serial_tx_enqueue(&tx, SERIAL_TX_CONTROL, "c", 1);
+    serial_tx_replace(&tx, SERIAL_TX_DISPLAY, "VWXYZ", 5);
+    serial_tx_replace(&tx, SERIAL_TX_DISPLAY, "12345", 5);
+
+    tx_peek_bytes(&tx, out, sizeof(out));
+    TEST_ASSERT_EQ_STR(out, "CDEc12345");
+
+    serial_tx_consume(&tx, 4);   /* "CDE" and "c" */
+    tx_peek_bytes(&tx, out, sizeof(out));
+    TEST_ASSERT_EQ_STR(out, "12345");
+
+    /* A reopen throws away even a half-sent frame. */
+    serial_tx_consume(&tx, 1);
+    TEST_ASSERT_EQ_INT((int)serial_tx_reset(&tx), 1);
+    TEST_ASSERT_EQ_INT((int)serial_tx_pending(&tx), 0);
+    serial_tx_enqueue(&tx, SERIAL_TX_CONTROL, "f", 1);
+    tx_peek_bytes(&tx, out, sizeof(out));
+    TEST_ASSERT_EQ_STR(out, "f");
+}
+
+/* flush writes through writev without blocking: a full fd leaves the queue
+ * intact for the next writable wake. */
+static void test_serial_tx_flush_nonblocking(void) {
+    serial_tx_t tx;
+    struct serial_tx_stats st;
+    int fds[2];
+    char buf[4096];
+    long filled = 0;
+    ssize_t n;
+    serial_tx_init(&tx);
+    TEST_ASSERT_EQ_INT(pipe(fds), 0);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK);
+
+    serial_tx_enqueue(&tx, SERIAL_TX_DISPLAY, "\x02\x02hi", 4);
+    serial_tx_enqueue(&tx, SERIAL_TX_CONTROL, "\x03" "f", 2);
+    TEST_ASSERT_EQ_INT((int)serial_tx_flush(&tx, fds[1]), 6);
+    TEST_ASSERT_EQ_INT((int)read(fds[0], buf, sizeof(buf)), 6);
+    TEST_ASSERT(memcmp(buf, "\x03" "f\x02\x02hi", 6) == 0);
+
+    /* Fill the pipe, then flush: nothing written, nothing lost. */
+    memset(buf, 'x', sizeof(buf));
+    while ((n = write(fds[1], buf, sizeof(buf))) > 0) filled += (long)n;
+    while (filled > 0 && (n = write(fds[1], buf, 1)) > 0) filled += (long)n;
+    serial_tx_enqueue(&tx, SERIAL_TX_CONTROL, "\x03z", 2);
+    TEST_ASSERT_EQ_INT((int)serial_tx_flush(&tx, fds[1]), 0);
+    TEST_ASSERT_EQ_INT((int)serial_tx_pending(&tx), 2);
+    serial_tx_get_stats(&tx, &st);
+    TEST_ASSERT_EQ_INT((int)st.would_block_total, 1);
+
+    while (read(fds[0], buf, sizeof(buf)) > 0) {}
+    TEST_ASSERT_EQ_INT((int)serial_tx_flush(&tx, fds[1]), 2);
+    TEST_ASSERT_EQ_INT((int)serial_tx_pending(&tx), 0);
+
+    /* A hard error is reported, and the queue is the caller's to reset. */
+    close(fds[0]);
+    close(fds[1]);
+    serial_tx_enqueue(&tx, SERIAL_TX_CONTROL, "\x03" "c", 2);
+    TEST_ASSERT_EQ_INT((int)serial_tx_flush(&tx, fds[1]), -1);
+    TEST_ASSERT_EQ_INT(errno, EBADF);
+    TEST_ASSERT_EQ_INT((int)serial_tx_pending(&tx), 2);
+}
+
+/* A full lane rejects the newest frame and counts it; malformed frames are
+ * rejected outright. */
+static void test_serial_tx_lane_full_and_bad_args(void) {
+    serial_tx_t tx;
+    struct serial_tx_stats st;
+    char big[SERIAL_TX_MAX_FRAME + 1];
+    int i;
+    serial_tx_init(&tx);
+
+    for (i = 0; i < SERIAL_TX_LANE_FRAMES; i++) {
+        TEST_ASSERT_EQ_INT(serial_tx_enqueue(&tx, SERIAL_TX_CONTROL, "\x06", 1), 0);
+    }
+    TEST_ASSERT_EQ_INT(serial_tx_enqueue(&tx, SERIAL_TX_CONTROL, "\x06", 1), -1);
+    /* The display lane is separate and still takes a repaint. */
+    TEST_ASSERT_EQ_INT(serial_tx_enqueue(&tx, SERIAL_TX_DISPLAY, "\x02\x00", 2), 0);
+    serial_tx_get_stats(&tx, &st);
+    TEST_ASSERT_EQ_INT((int)st.frames_dropped_total, 1);
+    TEST_ASSERT_EQ_INT((int)st.queued_frames, SERIAL_TX_LANE_FRAMES + 1);
+
+    memset(big, 'x', sizeof(big));
+    TEST_ASSERT_EQ_INT(serial_tx_enqueue(&tx, SERIAL_TX_DISPLAY, big, sizeof(big)), -1);
+    TEST_ASSERT_EQ_INT(serial_tx_enqueue(&tx, SERIAL_TX_DISPLAY, big, 0), -1);
+    TEST_ASSERT_EQ_INT(serial_tx_enqueue(&tx, SERIAL_TX_LANES, big, 1), -1);
+    TEST_ASSERT_EQ_INT(serial_tx_enqueue(NULL, SERIAL_TX_CONTROL, big, 1), -1);
+    TEST_ASSERT_EQ_INT(serial_tx_replace(&tx, SERIAL_TX_LANES, big, 1), -1);
+    TEST_ASSERT_EQ_INT((int)serial_tx_lane_depth(NULL, SERIAL_TX_CONTROL), 0);
+    TEST_ASSERT_EQ_INT((int)serial_tx_flush(NULL, 1), 0);
+    serial_tx_get_stats(NULL, &st);
+    TEST_ASSERT_EQ_INT((int)st.queued_bytes, 0);
+    serial_tx_init(NULL);
+    serial_tx_consume(NULL, 1);
+}
+
+/* ── VFD partial updates ─────────────────────────────────────────── */
+
+/* Only the 20 + LF + 20 layout the daemon builds can be diffed. */
+static void test_vfd_cells_from_message(void) {
+    char cells[VFD_CELLS];
+    TEST_ASSERT_EQ_INT(vfd_cells_from_message(
+        "Insert 50 cents     \nThen dial           ", cells), 0);
+    TEST_ASSERT_EQ_INT(cells[0], 'I');
+    TEST_ASSERT_EQ_INT(cells[19], ' ');
+    TEST_ASSERT_EQ_INT(cells[20], 'T');
+
+    TEST_ASSERT_EQ_INT(vfd_cells_from_message("Short\nlines", cells), -1);
+    TEST_ASSERT_EQ_INT(vfd_cells_from_message(
+        "Insert 50 cents      Then dial           ", cells), -1);   /* no LF */
+    TEST_ASSERT_EQ_INT(vfd_cells_from_message(
+        "Insert\n50 cents    \nThen dial           ", cells), -1);  /* LF in row */
+    TEST_ASSERT_EQ_INT(vfd_cells_from_message(NULL, cells), -1);
+}
+
+/* One run per dirty span; spans a header apart or less merge; a run never
+ * crosses into the next row. */
+static void test_vfd_diff_runs(void) {
+    char from[VFD_CELLS], to[VFD_CELLS];
+    vfd_run_t runs[VFD_MAX_RUNS];
+    memset(from, ' ', sizeof(from));
+    memcpy(to, from, sizeof(to));
+
+    TEST_ASSERT_EQ_INT(vfd_diff(from, to, runs, VFD_MAX_RUNS), 0);
+
+    to[2] = 'a';                    /* gap of 3 to cell 6: merged */
+    to[6] = 'b';
+    to[12] = 'c';                   /* gap of 5: a run of its own */
+    to[19] = 'd';                   /* row end ... */
+    to[20] = 'e';                   /* ... and the next row's start stay apart */
+    TEST_ASSERT_EQ_INT(vfd_diff(from, to, runs, VFD_MAX_RUNS), 4);
+    TEST_ASSERT_EQ_INT(runs[0].cell, 2);
+    TEST_ASSERT_EQ_INT(runs[0].len, 5);
+    TEST_ASSERT_EQ_INT(runs[1].cell, 12);
+    TEST_ASSERT_EQ_INT(runs[1].len, 1);
+    TEST_ASSERT_EQ_INT(runs[2].cell, 19);
+    TEST_ASSERT_EQ_INT(runs[2].len, 1);
+    TEST_ASSERT_EQ_INT(runs[3].cell, 20);
+    TEST_ASSERT_EQ_INT(runs[3].len, 1);
+
+    TEST_ASSERT_EQ_INT(vfd_diff(from, to, runs, 3), -1);
+    TEST_ASSERT_EQ_INT(vfd_diff(NULL, to, runs, VFD_MAX_RUNS), -1);
+}
+
+/* VFD_MAX_RUNS really is the worst case, so the SDK's stack array suffices. */
+static void test_vfd_diff_worst_case_fits(void) {
+    char from[VFD_CELLS], to[VFD_CELLS];
+    vfd_run_t runs[VFD_MAX_RUNS];
+    int stride, i, n;
+
+    for (stride = 1; stride <= VFD_COLS; stride++) {
+        memset(from, ' ', sizeof(from));
+        memcpy(to, from, sizeof(to));
+        for (i = 0; i < VFD_CELLS; i++) {
+            if ((i % VFD_COLS) % stride == 0) to[i] = '*';
+        }
+        n = vfd_diff(from, to, runs, VFD_MAX_RUNS);
+        TEST_ASSERT(n >= 1 && n <= VFD_MAX_RUNS);
+    }
+    TEST_ASSERT_EQ_INT(VFD_MAX_RUNS, 8);
+    TEST_ASSERT(VFD_MAX_RUNS <= SERIAL_TX_LANE_FRAMES);
+}
+
+/* ── Serial link framing ─────────────────────────────────────────── */
+
+struct link_capture {
+    int frames;
+    unsigned char types[8];
+    unsigned char last_payload[SERIAL_LINK_MAX_PAYLOAD];
+    size_t last_len;
+    int last_stamped;
+    unsigned last_age;
+};
+
+static void link_capture_cb(void *ctx, const serial_link_frame_t *f) {
+    struct link_capture *cap = (struct link_capture *)ctx;
+    if (cap->frames < (int)sizeof(cap->types)) cap->types[cap->frames] = f->type;
+    cap->frames++;
+    memcpy(cap->last_payload, f->payload, f->len);
+    cap->last_len = f->len;
+    cap->last_stamped = f->stamped;
+    cap->last_age = f->age_ms;
+}
+
+/* Frame a reliable event from "Beta" into `out`. */
+static size_t link_event(unsigned char flags, unsigned char seq, char type,
+                         const char *payload, unsigned char *out) {
+    return serial_link_encode((unsigned char)(SERIAL_LINK_FLAG_ACK_REQ | flags), seq,
+                              (unsigned char)type, payload, strlen(payload),
+                              out, SERIAL_LINK_MAX_ENCODED);
+}
+
+/* CRC-16/CCITT-FALSE check value, and a payload full of zeros survives COBS
+ * with no zero left inside the frame. */
+static void test_serial_link_encode_roundtrip(void) {
+    unsigned char wire[SERIAL_LINK_MAX_ENCODED];
+    unsigned char payload[SERIAL_LINK_MAX_PAYLOAD];
+    struct link_capture cap;
+    serial_link_rx_t rx;
+    size_t n, i;
+
+    TEST_ASSERT_EQ_INT(serial_link_crc16("123456789", 9), 0x29B1);
+
+    for (i = 0; i < sizeof(payload); i++) payload[i] = (unsigned char)(i % 3 ? i : 0);
+    n = serial_link_encode(0, 7, 0x02, payload, sizeof(payload), wire, sizeof(wire));
+    TEST_ASSERT(n > sizeof(payload) + SERIAL_LINK_HEADER + SERIAL_LINK_CRC);
+    TEST_ASSERT(n <= SERIAL_LINK_MAX_ENCODED);
+    TEST_ASSERT_EQ_INT(wire[0], 0);
+    TEST_ASSERT_EQ_INT(wire[n - 1], 0);
+    for (i = 1; i < n - 1; i++) TEST_ASSERT(wire[i] != 0);
+
+    memset(&cap, 0, sizeof(cap));
+    serial_link_rx_init(&rx);
+    TEST_ASSERT_EQ_INT((int)serial_link_rx_feed(&rx, wire, n, link_capture_cb, &cap), 1);
+    TEST_ASSERT_EQ_INT(cap.types[0], 0x02);
+    TEST_ASSERT_EQ_INT((int)cap.last_len, (int)sizeof(payload));
+    TEST_ASSERT(memcmp(cap.last_payload, payload, sizeof(payload)) == 0);
+    TEST_ASSERT_EQ_INT(rx.ack_pending, 0);   /* not a reliable frame */
+
+    /* Too long, or nowhere to put it. The largest frame fits one tx slot. */
+    TEST_ASSERT_EQ_INT((int)serial_link_encode(0, 0, 0x02, payload, SERIAL_LINK_MAX_PAYLOAD + 1,
+                                               wire, sizeof(wire)), 0);
+    TEST_ASSERT_EQ_INT((int)serial_link_encode(0, 0, 0x02, payload, 10, wire, 12), 0);
+    TEST_ASSERT(SERIAL_LINK_MAX_ENCODED <= SERIAL_TX_MAX_FRAME);
+}
+
+/* A damaged frame costs that frame only: the receiver is back in step at the
+ * next delimiter, whether the damage is a flipped bit, leading garbage, or a
+ * frame that never ends. Frames split byte by byte still arrive. */
+static void test_serial_link_resync(void) {
+    unsigned char a[SERIAL_LINK_MAX_ENCODED], b[SERIAL_LINK_MAX_ENCODED];
+    unsigned char junk[SERIAL_LINK_MAX_ENCODED + 8];
+    struct link_capture cap;
+    serial_link_rx_t rx;
+    size_t na, nb, i;
+    unsigned long framing;
+
+    memset(&cap, 0, sizeof(cap));
+    serial_link_rx_init(&rx);
+    na = link_event(0, 0, 'K', "5", a);
+    nb = link_event(0, 1, 'H', "U", b);
+
+    a[3] ^= 0x10;                                     /* corrupt frame 0 */
+    serial_link_rx_feed(&rx, "Y L\x05R", 5, link_capture_cb, &cap);  /* old debug echo */
+    serial_link_rx_feed(&rx, a, na, link_capture_cb, &cap);
+    for (i = 0; i < nb; i++) serial_link_rx_feed(&rx, b + i, 1, link_capture_cb, &cap);
+    TEST_ASSERT_EQ_INT(cap.frames, 1);
+    TEST_ASSERT_EQ_INT(cap.types[0], 'H');
+    TEST_ASSERT_EQ_INT((int)rx.crc_errors + (int)rx.framing_errors, 2);
+
+    /* A run with no delimiter overflows the buffer and is thrown away whole. */
+    framing = rx.framing_errors;
+    memset(junk, 0x41, sizeof(junk));
+    serial_link_rx_feed(&rx, junk, sizeof(junk), link_capture_cb, &cap);
+    nb = link_event(0, 2, 'V', "1", b);
+    serial_link_rx_feed(&rx, b, nb, link_capture_cb, &cap);
+    TEST_ASSERT_EQ_INT(cap.frames, 2);
+    TEST_ASSERT_EQ_INT(cap.types[1], 'V');
+    TEST_ASSERT_EQ_INT((int)(rx.framing_errors - framing), 1);
+
+    /* Another link version is refused, not misread. */
+    nb = link_event(0, 3, 'K', "1", b);
+    {
+        unsigned char raw[8];
+        uint16_t crc;
+        raw[0] = (unsigned char)(((SERIAL_LINK_VERSION + 1) << 4) | SERIAL_LINK_FLAG_ACK_REQ);
+        raw[1] = 3; raw[2] = 'K'; raw[3] = '1';
+        crc = serial_link_crc16(raw, 4);
+        raw[4] = (unsigned char)(crc >> 8); raw[5] = (unsigned char)crc;
+        /* No zero bytes in raw here, so COBS is just a length prefix. */
+        b[0] = 0; b[1] = 7; memcpy(b + 2, raw, 6); b[8] = 0;
+        serial_link_rx_feed(&rx, b, 9, link_capture_cb, &cap);
+    }
+    TEST_ASSERT_EQ_INT(cap.frames, 2);
+    TEST_ASSERT_EQ_INT((int)rx.version_errors, 1);
+}
+
+/* Go-back-N from the receiver's side: deliver in order and ACK the newest,
+ * re-ACK but do not redeliver a retransmission, drop a frame past a gap. */
+static void test_serial_link_reliable_delivery(void) {
+    unsigned char w[SERIAL_LINK_MAX_ENCODED];
+    struct link_capture cap;
+    serial_link_rx_t rx;
+    size_t n;
+
+    memset(&cap, 0, sizeof(cap));
+    serial_link_rx_init(&rx);
+
+    /* Not synced yet: any number starts the sequence. */
+    n = link_event(0, 41, 'K', "1", w);
+    serial_link_rx_feed(&rx, w, n, link_capture_cb, &cap);
+    n = link_event(0, 42, 'V', "2", w);
+    serial_link_rx_feed(&rx, w, n, link_capture_cb, &cap);
+    TEST_ASSERT_EQ_INT(cap.frames, 2);
+    TEST_ASSERT_EQ_INT(rx.ack_pending, 1);
+    TEST_ASSERT_EQ_INT(rx.ack_seq, 42);
+    rx.ack_pending = 0;
+
+    /* The ACK was lost and 42 comes again: one coin, not two. */
+    serial_link_rx_feed(&rx, w, n, link_capture_cb, &cap);
+    TEST_ASSERT_EQ_INT(cap.frames, 2);
+    TEST_ASSERT_EQ_INT((int)rx.duplicates, 1);
+    TEST_ASSERT_EQ_INT(rx.ack_pending, 1);
+    TEST_ASSERT_EQ_INT(rx.ack_seq, 42);
+    rx.ack_pending = 0;
+
+    /* 43 was lost; 44 must wait for it. */
+    n = link_event(0, 44, 'K', "4", w);
+    serial_link_rx_feed(&rx, w, n, link_capture_cb, &cap);
+    TEST_ASSERT_EQ_INT(cap.frames, 2);
+    TEST_ASSERT_EQ_INT((int)rx.out_of_order, 1);
+    TEST_ASSERT_EQ_INT(rx.ack_pending, 0);
+    n = link_event(0, 43, 'K', "3", w);
+    serial_link_rx_feed(&rx, w, n, link_capture_cb, &cap);
+    n = link_event(0, 44, 'K', "4", w);
+    serial_link_rx_feed(&rx, w, n, link_capture_cb, &cap);
+    TEST_ASSERT_EQ_INT(cap.frames, 4);
+    TEST_ASSERT_EQ_INT(cap.types[2], 'K');
+    TEST_ASSERT_EQ_INT(cap.last_payload[0], '4');
+    TEST_ASSERT_EQ_INT(rx.ack_seq, 44);
+
+    /* Sequence numbers wrap. */
+    rx.last_seq = 255;
+    n = link_event(0, 0, 'K', "0", w);
+    TEST_ASSERT_EQ_INT((int)serial_link_rx_feed(&rx, w, n, link_capture_cb, &cap), 1);
+}
+
+/* Beta reset: SYN after unmarked frames restarts the sequence, but SYN after
+ * SYN is the same unacknowledged sender retransmitting. */
+static void test_serial_link_syn_restart(void) {
+    unsigned char w[SERIAL_LINK_MAX_ENCODED];
+    struct link_capture cap;
+    serial_link_rx_t rx;
+    size_t n;
+
+    memset(&cap, 0, sizeof(cap));
+    serial_link_rx_init(&rx);
+    n = link_event(0, 0, 'K', "1", w);
+    serial_link_rx_feed(&rx, w, n, link_capture_cb, &cap);
+    n = link_event(0, 1, 'K', "2", w);
+    serial_link_rx_feed(&rx, w, n, link_capture_cb, &cap);
+    TEST_ASSERT_EQ_INT(cap.frames, 2);
+
+    /* Beta resets and numbers from 0 again. */
+    n = link_event(SERIAL_LINK_FLAG_SYN, 0, 'H', "D", w);
+    serial_link_rx_feed(&rx, w, n, link_capture_cb, &cap);
+    TEST_ASSERT_EQ_INT(cap.frames, 3);
+    TEST_ASSERT_EQ_INT(rx.ack_seq, 0);
+
+    /* Our ACK has not reached it yet: the resend is a duplicate. */
+    serial_link_rx_feed(&rx, w, n, link_capture_cb, &cap);
+    TEST_ASSERT_EQ_INT(cap.frames, 3);
+    TEST_ASSERT_EQ_INT((int)rx.duplicates, 1);
+    n = link_event(SERIAL_LINK_FLAG_SYN, 1, 'H', "U", w);
+    serial_link_rx_feed(&rx, w, n, link_capture_cb, &cap);
+    TEST_ASSERT_EQ_INT(cap.frames, 4);
+
+    /* A reopened port forgets the sequence: whatever comes next starts it. */
+    serial_link_rx_reset(&rx);
+    n = link_event(0, 200, 'K', "9", w);
+    TEST_ASSERT_EQ_INT((int)serial_link_rx_feed(&rx, w, n, link_capture_cb, &cap), 1);
+    TEST_ASSERT_EQ_INT((int)rx.duplicates, 1);   /* counters survive a reset */
+}
+
+/* A stamped event loses its age bytes before the callback, which gets the
+ * age instead; a stamp flag with no room for the age is a framing error. */
+static void test_serial_link_stamp(void) {
+    unsigned char w[SERIAL_LINK_MAX_ENCODED];
+    struct link_capture cap;
+    serial_link_rx_t rx;
+    size_t n;
+
+    memset(&cap, 0, sizeof(cap));
+    serial_link_rx_init(&rx);
+    n = link_event(SERIAL_LINK_FLAG_STAMP, 0, 'K', "5\x01\x2C", w);
+    TEST_ASSERT_EQ_INT((int)serial_link_rx_feed(&rx, w, n, link_capture_cb, &cap), 1);
+    TEST_ASSERT_EQ_INT((int)cap.last_len, 1);
+    TEST_ASSERT_EQ_INT(cap.last_payload[0], '5');
+    TEST_ASSERT_EQ_INT(cap.last_stamped, 1);
+    TEST_ASSERT_EQ_INT((int)cap.last_age, 300);
+
+    /* A card PAN keeps its variable width; the age is always the tail. */
+    n = link_event(SERIAL_LINK_FLAG_STAMP, 1, 'C', "4111\xFF\xFF", w);
+    serial_link_rx_feed(&rx, w, n, link_capture_cb, &cap);
+    TEST_ASSERT_EQ_INT((int)cap.last_len, 4);
+    TEST_ASSERT_EQ_INT((int)cap.last_age, 0xFFFF);
+
+    /* Unstamped frames are untouched. */
+    n = link_event(0, 2, 'H', "U", w);
+    serial_link_rx_feed(&rx, w, n, link_capture_cb, &cap);
+    TEST_ASSERT_EQ_INT((int)cap.last_len, 1);
+    TEST_ASSERT_EQ_INT(cap.last_stamped, 0);
+
+    n = serial_link_encode(SERIAL_LINK_FLAG_STAMP, 0, 'P', "x", 1, w, sizeof(w));
+    TEST_ASSERT_EQ_INT((int)serial_link_rx_feed(&rx, w, n, link_capture_cb, &cap), 0);
+    TEST_ASSERT_EQ_INT((int)rx.framing_errors, 1);
+    TEST_ASSERT_EQ_INT(cap.frames, 3);
+}
+
+/* ── Link rate negotiation ───────────────────────────────────────── */
+
+/* Fastest first, capped by baud_rate_max, above the base, minus failures. */
+static void test_link_rate_plan(void) {
+    long plan[LINK_RATE_CANDIDATES];
+    int n;
+
+    n = link_rate_plan(1000000, 9600, 0, plan, LINK_RATE_CANDIDATES);
+    TEST_ASSERT_EQ_INT(n, 4);
+    TEST_ASSERT(plan[0] == 1000000 && plan[3] == 115200);
+
+    n = link_rate_plan(230400, 9600, 0, plan, LINK_RATE_CANDIDATES);
+    TEST_ASSERT_EQ_INT(n, 2);
+    TEST_ASSERT(plan[0] == 230400 && plan[1] == 115200);
+
+    /* A rate that failed is skipped; the base itself is never a candidate. */
+    n = link_rate_plan(1000000, 115200,
+                       1u << link_rate_index(1000000), plan, LINK_RATE_CANDIDATES);
+    TEST_ASSERT_EQ_INT(n, 2);
+    TEST_ASSERT(plan[0] == 500000 && plan[1] == 230400);
+
+    /* Negotiation off: max at the base. */
+    TEST_ASSERT_EQ_INT(link_rate_plan(9600, 9600, 0, plan, LINK_RATE_CANDIDATES), 0);
+    TEST_ASSERT_EQ_INT(link_rate_index(9600), -1);
+}
+
+/* The rate crosses the wire big-endian; the test pattern carries the bytes a
+ * bad line mangles first and differs from one probe to the next. */
+static void test_link_rate_payload_and_pattern(void) {
+    unsigned char p[LINK_RATE_PAYLOAD];
+    unsigned char a[LINK_RATE_PATTERN_LEN], b[LINK_RATE_PATTERN_LEN];
+    int has_zero = 0, has_ff = 0;
+    size_t i;
+
+    link_rate_put(p, 1000000);
+    TEST_ASSERT(p[0] == 0x00 && p[1] == 0x0F && p[2] == 0x42 && p[3] == 0x40);
+    TEST_ASSERT(link_rate_get(p) == 1000000);
+
+    link_rate_test_pattern(a, sizeof(a), 1);
+    link_rate_test_pattern(b, sizeof(b), 2);
+    for (i = 0; i < sizeof(a); i++) {
+        if (a[i] == 0x00) has_zero = 1;
+        if (a[i] == 0xFF) has_ff = 1;
+    }
+    TEST_ASSERT(has_zero && has_ff);
+    TEST_ASSERT(memcmp(a, b, sizeof(a)) != 0);
+    TEST_ASSERT(LINK_RATE_PATTERN_LEN <= SERIAL_MAX_PAYLOAD);  /* fits a Beta event frame */
+}
+
+/* A burst of errors inside one window trips the fallback; the same number
+ * spread thinly does not. */
+static void test_link_rate_error_monitor(void) {
+    link_rate_monitor_t m;
+
+    memset(&m, 0, sizeof(m));
+    link_rate_monitor_reset(&m, 100, 0);
+    TEST_ASSERT_EQ_INT(link_rate_monitor_check(&m, 102, 1000), 0);
+    TEST_ASSERT_EQ_INT(link_rate_monitor_check(&m, 100 + LINK_RATE_ERROR_LIMIT, 2000), 1);
+
+    link_rate_monitor_reset(&m, 0, 0);
+    TEST_ASSERT_EQ_INT(link_rate_monitor_check(&m, LINK_RATE_ERROR_LIMIT - 1, 5000), 0);
+    /* Window rolls over: counting starts again from here. */
+    TEST_ASSERT_EQ_INT(link_rate_monitor_check(&m, LINK_RATE_ERROR_LIMIT - 1,
+                                               LINK_RATE_ERROR_WINDOW_MS), 0);
+    TEST_ASSERT_EQ_INT(link_rate_monitor_check(&m, 2 * LINK_RATE_ERROR_LIMIT - 2,
+                                               LINK_RATE_ERROR_WINDOW_MS + 1000), 0);
+    TEST_ASSERT_EQ_INT(link_rate_monitor_check(NULL, 1000, 0), 0);
+}
+
 /* ── CLI argument parsing ───────────────────────────────────────── */
 
 static void test_cli_no_args_runs(void) {
@@ -2233,9 +4202,9 @@ static void test_health_metrics_published(void) {
     health_monitor_publish_metrics();
 
     /* Per-check status gauges mirror each check's last result. */
-    TEST_ASSERT_EQ_INT((int)metrics_get_gauge("health_check_ut_serial_status"),
+    TEST_ASSERT_EQ_INT((int)metrics_get_gauge("health_check_status{check=\"ut_serial\"}"),
                        (int)HEALTH_STATUS_HEALTHY);
-    TEST_ASSERT_EQ_INT((int)metrics_get_gauge("health_check_ut_sip_status"),
+    TEST_ASSERT_EQ_INT((int)metrics_get_gauge("health_check_status{check=\"ut_sip\"}"),
                        (int)HEALTH_STATUS_CRITICAL);
 
     /* Overall rollup is the worst status across all checks. */
@@ -2446,8 +4415,8 @@ static void test_diag_parse_rejects_malformed(void) {
 }
 
 /* The count is ASCII rather than a raw byte precisely so a zero never appears
- * as NUL: process_event_buffer() consumes strlen(payload)+1, so an embedded
- * NUL would truncate the event and desync everything after it. */
+ * as NUL: payloads reach the event layer as C strings, so an embedded NUL
+ * would truncate the count. */
 static void test_diag_payload_has_no_embedded_nul(void) {
     TEST_ASSERT_EQ_INT((int)strlen("A000"), EVENT_DIAG_PAYLOAD_LEN);
     TEST_ASSERT_EQ_INT((int)strlen("B000"), EVENT_DIAG_PAYLOAD_LEN);
@@ -2620,11 +4589,26 @@ int main(void) {
     TEST_SUITE_BEGIN("Logger");
     TEST_SUITE_RUN(test_logger_async_file_write);
     TEST_SUITE_RUN(test_logger_queue_stats);
+    TEST_SUITE_RUN(test_logger_batched_writes);
+    TEST_SUITE_RUN(test_logger_level_gating);
+    TEST_SUITE_RUN(test_logger_memory_ring);
+    TEST_SUITE_RUN(test_log_record_roundtrip);
+    TEST_SUITE_RUN(test_logger_binary_file);
 
     TEST_SUITE_BEGIN("Metrics Export");
     TEST_SUITE_RUN(test_metrics_export_prometheus_basic);
     TEST_SUITE_RUN(test_metrics_export_json_basic);
     TEST_SUITE_RUN(test_metrics_export_no_overflow);
+    TEST_SUITE_RUN(test_metrics_handles);
+    TEST_SUITE_RUN(test_metrics_refs);
+    TEST_SUITE_RUN(test_metrics_sharded_counters);
+    TEST_SUITE_RUN(test_metrics_histogram_buckets);
+    TEST_SUITE_RUN(test_metrics_labels);
+    TEST_SUITE_RUN(test_metrics_exposition_cache);
+
+    TEST_SUITE_BEGIN("Metrics History");
+    TEST_SUITE_RUN(test_tsdb_downsampling);
+    TEST_SUITE_RUN(test_tsdb_survives_restart);
 
     TEST_SUITE_BEGIN("Call Metrics");
     TEST_SUITE_RUN(test_call_duration_histogram);
@@ -2649,10 +4633,64 @@ int main(void) {
     TEST_SUITE_RUN(test_conn_queue_full_rejects);
     TEST_SUITE_RUN(test_conn_queue_wraps_around);
     TEST_SUITE_RUN(test_conn_queue_close_drains_then_signals);
+    TEST_SUITE_RUN(test_conn_queue_try_pop);
     TEST_SUITE_RUN(test_conn_queue_null_safety);
     TEST_SUITE_RUN(test_conn_queue_blocking_pop_wakes);
     TEST_SUITE_RUN(test_conn_queue_stats);
     TEST_SUITE_RUN(test_conn_queue_stats_null_safety);
+    TEST_SUITE_RUN(test_web_router_literal_routes);
+    TEST_SUITE_RUN(test_web_router_params_and_wildcard);
+    TEST_SUITE_RUN(test_web_router_precedence_backtracks);
+    TEST_SUITE_RUN(test_web_router_methods);
+    TEST_SUITE_RUN(test_web_router_add_replace_find);
+    TEST_SUITE_RUN(test_web_router_rejects_bad_patterns);
+
+    TEST_SUITE_BEGIN("Engine Loop");
+    TEST_SUITE_RUN(test_engine_loop_idle_waits_for_tick);
+    TEST_SUITE_RUN(test_engine_loop_notify_and_serial_wake);
+    TEST_SUITE_RUN(test_engine_loop_hangup_needs_new_generation);
+    TEST_SUITE_RUN(test_engine_loop_want_write);
+    TEST_SUITE_RUN(test_engine_loop_null_safety);
+
+    TEST_SUITE_BEGIN("Event Ring");
+    TEST_SUITE_RUN(test_event_ring_fifo_across_laps);
+    TEST_SUITE_RUN(test_event_ring_full_drops_newest);
+    TEST_SUITE_RUN(test_event_ring_bad_args);
+    TEST_SUITE_RUN(test_event_ring_two_producers);
+
+    TEST_SUITE_BEGIN("Event Pool");
+    TEST_SUITE_RUN(test_event_pool_create_destroy_balances);
+    TEST_SUITE_RUN(test_event_pool_exhaustion_falls_back_to_heap);
+    TEST_SUITE_RUN(test_event_format_repr);
+
+    TEST_SUITE_BEGIN("Serial Frame Parser");
+    TEST_SUITE_RUN(test_serial_parser_table_matches_event_types);
+    TEST_SUITE_RUN(test_serial_parser_frame_split_across_reads);
+    TEST_SUITE_RUN(test_serial_parser_noise_and_fixed_width);
+    TEST_SUITE_RUN(test_serial_parser_reset_drops_partial);
+
+    TEST_SUITE_BEGIN("Serial Output Queue");
+    TEST_SUITE_RUN(test_serial_tx_control_first_display_coalesced);
+    TEST_SUITE_RUN(test_serial_tx_partial_frame_finishes_first);
+    TEST_SUITE_RUN(test_serial_tx_flush_nonblocking);
+    TEST_SUITE_RUN(test_serial_tx_lane_full_and_bad_args);
+
+    TEST_SUITE_BEGIN("VFD Partial Updates");
+    TEST_SUITE_RUN(test_vfd_cells_from_message);
+    TEST_SUITE_RUN(test_vfd_diff_runs);
+    TEST_SUITE_RUN(test_vfd_diff_worst_case_fits);
+
+    TEST_SUITE_BEGIN("Serial Link");
+    TEST_SUITE_RUN(test_serial_link_encode_roundtrip);
+    TEST_SUITE_RUN(test_serial_link_resync);
+    TEST_SUITE_RUN(test_serial_link_reliable_delivery);
+    TEST_SUITE_RUN(test_serial_link_syn_restart);
+    TEST_SUITE_RUN(test_serial_link_stamp);
+
+    TEST_SUITE_BEGIN("Link Rate Negotiation");
+    TEST_SUITE_RUN(test_link_rate_plan);
+    TEST_SUITE_RUN(test_link_rate_payload_and_pattern);
+    TEST_SUITE_RUN(test_link_rate_error_monitor);
 
     TEST_SUITE_BEGIN("CLI");
     TEST_SUITE_RUN(test_cli_no_args_runs);
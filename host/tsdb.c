@@ -0,0 +1,384 @@
+#define _POSIX_C_SOURCE 200112L
+#include "tsdb.h"
+#include "metrics.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TSDB_MAGIC   0x4D545344u    /* "MTSD" */
+#define TSDB_VERSION 1
+
+#define TIER_SECOND 0
+#define TIER_MINUTE 1
+#define TIER_HOUR   2
+#define TIER_COUNT  3
+
+/* A Pi without an RTC boots at the epoch and keeps that time until NTP
+ * answers. Samples stamped then would be filed decades in the past, so
+ * nothing is recorded before this (2020-01-01). */
+#define TSDB_MIN_TIME 1577836800L
+
+/* The history file: this header, padded to a page, then the minute rows and
+ * the hour rows. Only ever read back by the daemon that wrote it, so native
+ * byte order; any mismatch in the geometry starts the file over. */
+#define TSDB_HEADER_SIZE 4096
+
+struct tsdb_file_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t max_series;
+    uint32_t minute_slots;
+    uint32_t hour_slots;
+    uint32_t reserved;
+    int64_t head[TIER_COUNT];       /* newest bucket written per tier; 0 for none */
+    struct {
+        char name[TSDB_NAME_MAX];   /* "" for a free column */
+        int32_t kind;
+        int32_t reserved;
+    } series[TSDB_MAX_SERIES];
+};
+
+/* One resolution. Bucket b covers [b * step, (b + 1) * step) and lives in
+ * row b % slots; rows older than head - slots have been overwritten. The
+ * open bucket accumulates samples until the next one starts. */
+struct tier {
+    long step;
+    long slots;
+    double *rows;                   /* slots x TSDB_MAX_SERIES, time-major */
+    int64_t *head;
+    int64_t open;                   /* bucket accumulating; 0 for none */
+    double sum[TSDB_MAX_SERIES];
+    double last[TSDB_MAX_SERIES];
+    long count[TSDB_MAX_SERIES];
+};
+
+static pthread_mutex_t tsdb_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct tsdb_file_header *header = NULL;
+static size_t mapped_size = 0;      /* nonzero when header is an mmap of the file */
+static struct tier tiers[TIER_COUNT];
+static int64_t second_head = 0;
+static time_t last_sample = 0;
+
+static size_t file_size(void) {
+    return TSDB_HEADER_SIZE +
+           (size_t)(TSDB_MINUTE_SLOTS + TSDB_HOUR_SLOTS) * TSDB_MAX_SERIES * sizeof(double);
+}
+
+static void fill_nan(double *rows, size_t count) {
+    size_t i;
+    for (i = 0; i < count; i++) rows[i] = NAN;
+}
+
+static int header_valid(const struct tsdb_file_header *h) {
+    return h->magic == TSDB_MAGIC && h->version == TSDB_VERSION &&
+           h->max_series == TSDB_MAX_SERIES &&
+           h->minute_slots == TSDB_MINUTE_SLOTS && h->hour_slots == TSDB_HOUR_SLOTS;
+}
+
+/* Map the history file, sized and preallocated so a full SD card surfaces
+ * here rather than as a SIGBUS on some later write. NULL on failure. */
+static void *map_file(const char *path, size_t size) {
+    struct stat st;
+    void *base;
+    int fd;
+
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        logger_warnf_with_category("Metrics", "History file %s: %s", path, strerror(errno));
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != size) {
+        int err = ftruncate(fd, 0) != 0 ? errno : posix_fallocate(fd, 0, (off_t)size);
+        if (err != 0) {
+            logger_warnf_with_category("Metrics", "History file %s: %s", path, strerror(err));
+            close(fd);
+            return NULL;
+        }
+    }
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        logger_warnf_with_category("Metrics", "History file %s: mmap: %s", path, strerror(errno));
+        return NULL;
+    }
+    return base;
+}
+
+int tsdb_open(const char *path) {
+    size_t size = file_size();
+    double *seconds;
+    void *base = NULL;
+    int i;
+
+    tsdb_close();
+
+    seconds = malloc((size_t)TSDB_SECOND_SLOTS * TSDB_MAX_SERIES * sizeof(double));
+    if (!seconds) return -1;
+    fill_nan(seconds, (size_t)TSDB_SECOND_SLOTS * TSDB_MAX_SERIES);
+
+    if (path && path[0]) base = map_file(path, size);
+
+    pthread_mutex_lock(&tsdb_mutex);
+    if (base) {
+        mapped_size = size;
+    } else {
+        base = calloc(1, size);
+        if (!base) {
+            pthread_mutex_unlock(&tsdb_mutex);
+            free(seconds);
+            return -1;
+        }
+    }
+    header = base;
+    if (!header_valid(header)) {
+        if (mapped_size) {
+            logger_info_with_category("Metrics", "Starting a new metrics history file");
+        }
+        memset(header, 0, TSDB_HEADER_SIZE);
+        header->magic = TSDB_MAGIC;
+        header->version = TSDB_VERSION;
+        header->max_series = TSDB_MAX_SERIES;
+        header->minute_slots = TSDB_MINUTE_SLOTS;
+        header->hour_slots = TSDB_HOUR_SLOTS;
+        fill_nan((double *)((char *)base + TSDB_HEADER_SIZE),
+                 (size_t)(TSDB_MINUTE_SLOTS + TSDB_HOUR_SLOTS) * TSDB_MAX_SERIES);
+    }
+
+    memset(tiers, 0, sizeof(tiers));
+    tiers[TIER_SECOND].step = 1;
+    tiers[TIER_SECOND].slots = TSDB_SECOND_SLOTS;
+    tiers[TIER_SECOND].rows = seconds;
+    tiers[TIER_SECOND].head = &second_head;
+    tiers[TIER_MINUTE].step = 60;
+    tiers[TIER_MINUTE].slots = TSDB_MINUTE_SLOTS;
+    tiers[TIER_MINUTE].rows = (double *)((char *)base + TSDB_HEADER_SIZE);
+    tiers[TIER_MINUTE].head = &header->head[TIER_MINUTE];
+    tiers[TIER_HOUR].step = 3600;
+    tiers[TIER_HOUR].slots = TSDB_HOUR_SLOTS;
+    tiers[TIER_HOUR].rows = tiers[TIER_MINUTE].rows + (size_t)TSDB_MINUTE_SLOTS * TSDB_MAX_SERIES;
+    tiers[TIER_HOUR].head = &header->head[TIER_HOUR];
+    for (i = 0; i < TIER_COUNT; i++) {
+        fill_nan(tiers[i].last, TSDB_MAX_SERIES);
+    }
+    second_head = 0;
+    last_sample = 0;
+    i = mapped_size ? 0 : 1;
+    pthread_mutex_unlock(&tsdb_mutex);
+    return i;
+}
+
+/* Write bucket `bucket` of a tier, blanking the rows of any buckets skipped
+ * since the last one written. Older buckets are not rewritten. */
+static void tier_put(struct tier *t, int64_t bucket, const double *values) {
+    int64_t b, from;
+
+    if (*t->head != 0 && bucket < *t->head) return;
+    from = (*t->head == 0 || bucket - *t->head > t->slots) ? bucket - t->slots + 1
+                                                          : *t->head + 1;
+    for (b = from; b < bucket; b++) {
+        fill_nan(&t->rows[(size_t)(b % t->slots) * TSDB_MAX_SERIES], TSDB_MAX_SERIES);
+    }
+    memcpy(&t->rows[(size_t)(bucket % t->slots) * TSDB_MAX_SERIES], values,
+           TSDB_MAX_SERIES * sizeof(double));
+    *t->head = bucket;
+}
+
+/* Value of a column over the samples an open bucket has seen so far. */
+static double open_value(const struct tier *t, int col) {
+    if (t->count[col] == 0) return NAN;
+    return header->series[col].kind == TSDB_COUNTER ? t->last[col]
+                                                    : t->sum[col] / t->count[col];
+}
+
+static void tier_accumulate(int tier, int64_t bucket, const double *values);
+
+/* Write out the open bucket and feed it to the next tier up. */
+static void tier_close(int tier) {
+    struct tier *t = &tiers[tier];
+    double row[TSDB_MAX_SERIES];
+    int c;
+
+    if (t->open == 0) return;
+    for (c = 0; c < TSDB_MAX_SERIES; c++) {
+        row[c] = open_value(t, c);
+    }
+    tier_put(t, t->open, row);
+    if (tier + 1 < TIER_COUNT) {
+        tier_accumulate(tier + 1, t->open * t->step / tiers[tier + 1].step, row);
+    }
+    t->open = 0;
+    memset(t->sum, 0, sizeof(t->sum));
+    memset(t->count, 0, sizeof(t->count));
+    fill_nan(t->last, TSDB_MAX_SERIES);
+}
+
+static void tier_accumulate(int tier, int64_t bucket, const double *values) {
+    struct tier *t = &tiers[tier];
+    int c;
+
+    if (t->open != 0 && t->open != bucket) tier_close(tier);
+    t->open = bucket;
+    for (c = 0; c < TSDB_MAX_SERIES; c++) {
+        if (isnan(values[c])) continue;
+        t->sum[c] += values[c];
+        t->last[c] = values[c];
+        t->count[c]++;
+    }
+}
+
+void tsdb_close(void) {
+    pthread_mutex_lock(&tsdb_mutex);
+    if (header) {
+        /* The minute closes into the hour, then the (partial) hour closes;
+         * a restart within either just overwrites the row. */
+        tier_close(TIER_MINUTE);
+        tier_close(TIER_HOUR);
+        if (mapped_size) {
+            msync(header, mapped_size, MS_SYNC);
+            munmap(header, mapped_size);
+        } else {
+            free(header);
+        }
+        free(tiers[TIER_SECOND].rows);
+    }
+    header = NULL;
+    mapped_size = 0;
+    memset(tiers, 0, sizeof(tiers));
+    pthread_mutex_unlock(&tsdb_mutex);
+}
+
+static int find_column(const char *name) {
+    int c;
+    for (c = 0; c < TSDB_MAX_SERIES; c++) {
+        if (strncmp(header->series[c].name, name, TSDB_NAME_MAX) == 0) return c;
+    }
+    return -1;
+}
+
+int tsdb_track(const char *name, int kind) {
+    int c, i;
+    long r;
+
+    if (!name || !name[0] || strlen(name) >= TSDB_NAME_MAX) return -1;
+
+    pthread_mutex_lock(&tsdb_mutex);
+    if (!header) {
+        pthread_mutex_unlock(&tsdb_mutex);
+        return -1;
+    }
+    c = find_column(name);
+    if (c < 0) {
+        c = find_column("");
+        if (c < 0) {
+            pthread_mutex_unlock(&tsdb_mutex);
+            logger_warnf_with_category("Metrics",
+                "Metrics history is full (%d series); not recording %s",
+                TSDB_MAX_SERIES, name);
+            return -1;
+        }
+        /* A column freed by an older build may still hold its history */
+        for (i = 0; i < TIER_COUNT; i++) {
+            for (r = 0; r < tiers[i].slots; r++) {
+                tiers[i].rows[(size_t)r * TSDB_MAX_SERIES + c] = NAN;
+            }
+        }
+        strncpy(header->series[c].name, name, TSDB_NAME_MAX - 1);
+    }
+    header->series[c].kind = kind;
+    pthread_mutex_unlock(&tsdb_mutex);
+    return 0;
+}
+
+void tsdb_record(time_t now) {
+    double values[TSDB_MAX_SERIES];
+    int c;
+
+    if (now < TSDB_MIN_TIME) return;
+
+    pthread_mutex_lock(&tsdb_mutex);
+    if (!header || now <= last_sample) {
+        pthread_mutex_unlock(&tsdb_mutex);
+        return;
+    }
+    last_sample = now;
+
+    for (c = 0; c < TSDB_MAX_SERIES; c++) {
+        const char *name = header->series[c].name;
+        if (!name[0]) {
+            values[c] = NAN;
+        } else if (header->series[c].kind == TSDB_COUNTER) {
+            values[c] = (double)metrics_get_counter(name);
+        } else {
+            values[c] = metrics_get_gauge(name);
+        }
+    }
+    tier_put(&tiers[TIER_SECOND], (int64_t)now, values);
+    tier_accumulate(TIER_MINUTE, (int64_t)now / tiers[TIER_MINUTE].step, values);
+    pthread_mutex_unlock(&tsdb_mutex);
+}
+
+/* Stored value of a column for bucket b of a tier, NaN if there is none. */
+static double bucket_value(const struct tier *t, int col, int64_t b) {
+    if (b == t->open) return open_value(t, col);
+    if (*t->head == 0 || b > *t->head || b <= *t->head - t->slots) return NAN;
+    return t->rows[(size_t)(b % t->slots) * TSDB_MAX_SERIES + col];
+}
+
+int tsdb_query(const char *name, long range, time_t now,
+               struct tsdb_point *points, int max_points, long *step) {
+    const struct tier *t;
+    int64_t newest, b;
+    long n, group, i;
+    int col, counter, out = 0;
+
+    if (!name || !name[0] || !points || max_points < 1) return -1;
+
+    pthread_mutex_lock(&tsdb_mutex);
+    if (!header || (col = find_column(name)) < 0) {
+        pthread_mutex_unlock(&tsdb_mutex);
+        return -1;
+    }
+    counter = header->series[col].kind == TSDB_COUNTER;
+
+    /* Finest tier that reaches back far enough, else the coarsest */
+    t = &tiers[TIER_COUNT - 1];
+    for (i = 0; i < TIER_COUNT; i++) {
+        if (tiers[i].step * tiers[i].slots >= range) {
+            t = &tiers[i];
+            break;
+        }
+    }
+    n = (range + t->step - 1) / t->step;
+    if (n < 1) n = 1;
+    if (n > t->slots) n = t->slots;
+    group = (n + max_points - 1) / max_points;
+    newest = (int64_t)now / t->step;
+
+    for (b = newest - n + 1; b <= newest; b += group) {
+        double sum = 0.0, last = NAN;
+        long count = 0;
+        for (i = 0; i < group && b + i <= newest; i++) {
+            double v = bucket_value(t, col, b + i);
+            if (isnan(v)) continue;
+            sum += v;
+            last = v;
+            count++;
+        }
+        points[out].t = (time_t)(b * t->step);
+        points[out].value = count == 0 ? NAN : counter ? last : sum / count;
+        out++;
+    }
+    if (step) *step = t->step * group;
+    pthread_mutex_unlock(&tsdb_mutex);
+    return out;
+}
@@ -0,0 +1,86 @@
+#ifndef TSDB_H
+#define TSDB_H
+
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * tsdb: a small on-device time-series store, so the dashboard can show a
+ * trend -- coins per hour, queue depth over the day -- without an external
+ * Prometheus.
+ *
+ * A fixed set of metrics (tsdb_track) is sampled once a second from the
+ * daemon's metrics tick and kept at three resolutions:
+ *
+ *     1 s    TSDB_SECOND_SLOTS  (15 minutes)   in memory only
+ *     1 min  TSDB_MINUTE_SLOTS  (24 hours)     in the history file
+ *     1 h    TSDB_HOUR_SLOTS    (30 days)      in the history file
+ *
+ * Each tier is a ring of rows, one row per time bucket and one column per
+ * series. A minute row is written once, when its minute closes, with the
+ * mean of its seconds (the last value, for a counter); an hour row likewise
+ * from its minutes. Buckets with no samples -- the daemon was down -- read
+ * back as NaN.
+ *
+ * The history file is fixed-size and mmap'd, so it survives restarts and
+ * never grows. The rows are laid out time-major: closing a minute dirties
+ * one page of the file for every series together, which bounds SD-card
+ * writes at a page or two a minute however many series are tracked. The
+ * 1 s tier would dirty a page every second, which is why it stays in memory.
+ *
+ * One writer (the main loop) and any number of readers (web threads); a
+ * mutex inside serializes them.
+ */
+
+#define TSDB_MAX_SERIES   16
+#define TSDB_NAME_MAX     64
+
+#define TSDB_SECOND_SLOTS 900
+#define TSDB_MINUTE_SLOTS 1440
+#define TSDB_HOUR_SLOTS   720
+
+/* How a series is downsampled into a coarser bucket */
+#define TSDB_GAUGE   0   /* mean of the samples */
+#define TSDB_COUNTER 1   /* last sample; differences give the rate */
+
+struct tsdb_point {
+    time_t t;       /* start of the bucket */
+    double value;   /* NaN for no data */
+};
+
+/* Open (creating or reinitializing as needed) the history file at `path`.
+ * With a NULL path, or if the file cannot be mapped, history is kept in
+ * memory only and lost on restart. Returns 0 when the file is in use, 1
+ * when running memory-only, -1 on allocation failure. */
+int tsdb_open(const char *path);
+
+/* Write back the open buckets and unmap the file. */
+void tsdb_close(void);
+
+/* Record the metric `name` (a counter or gauge in metrics.h, read by name
+ * each second) as `kind`. A series already in the history file keeps its
+ * history; a new one takes a free column. Returns 0, or -1 when all
+ * TSDB_MAX_SERIES columns are taken or the store is not open. */
+int tsdb_track(const char *name, int kind);
+
+/* Sample every tracked series for the second `now`. Cheap to call more
+ * often than once a second: repeats within a second are ignored, as are
+ * times earlier than the last sample (a clock stepped backwards). */
+void tsdb_record(time_t now);
+
+/* History of `name` over the `range` seconds up to `now`, oldest first,
+ * from the finest tier that covers the range. If that is more than
+ * `max_points` buckets, consecutive buckets are merged (mean, or last for a
+ * counter) so it fits. The bucket width is stored in *step. Returns the
+ * number of points, or -1 if the series is not tracked. */
+int tsdb_query(const char *name, long range, time_t now,
+               struct tsdb_point *points, int max_points, long *step);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TSDB_H */
@@ -0,0 +1,56 @@
+#include "vfd_diff.h"
+
+#include <string.h>
+
+int vfd_cells_from_message(const char *message, char cells[VFD_CELLS]) {
+    int row;
+    if (!message || !cells) return -1;
+    if (strlen(message) != VFD_CELLS + VFD_ROWS - 1) return -1;
+
+    for (row = 0; row < VFD_ROWS; row++) {
+        const char *line = message + row * (VFD_COLS + 1);
+        int col;
+        if (row > 0 && line[-1] != '\n') return -1;
+        for (col = 0; col < VFD_COLS; col++) {
+            /* A stray LF inside a row would make the cells disagree with
+             * what a full repaint shows; let that case take the full path. */
+            if (line[col] == '\n') return -1;
+            cells[row * VFD_COLS + col] = line[col];
+        }
+    }
+    return 0;
+}
+
+int vfd_diff(const char from[VFD_CELLS], const char to[VFD_CELLS],
+             vfd_run_t *runs, int max) {
+    int n = 0;
+    int row;
+    if (!from || !to || !runs) return -1;
+
+    for (row = 0; row < VFD_ROWS; row++) {
+        int base = row * VFD_COLS;
+        int start = -1;   /* first cell of the open run; -1 = none */
+        int last = -1;    /* last dirty cell of the open run */
+        int col;
+
+        for (col = 0; col < VFD_COLS; col++) {
+            if (from[base + col] == to[base + col]) continue;
+            if (start >= 0 && col - last - 1 > VFD_RUN_OVERHEAD) {
+                if (n == max) return -1;
+                runs[n].cell = (unsigned char)(base + start);
+                runs[n].len = (unsigned char)(last - start + 1);
+                n++;
+                start = -1;
+            }
+            if (start < 0) start = col;
+            last = col;
+        }
+        if (start >= 0) {
+            if (n == max) return -1;
+            runs[n].cell = (unsigned char)(base + start);
+            runs[n].len = (unsigned char)(last - start + 1);
+            n++;
+        }
+    }
+    return n;
+}
@@ -0,0 +1,55 @@
+/* Dirty-span diff for the 20x2 VFD on the display Arduino.
+ *
+ * The host used to resend the whole display -- 41 bytes through the 0x02
+ * command -- whenever any of it changed, and the sketch answered every one
+ * with a full repaint: a controller reset, a 100 ms settle and a character
+ * at a time, ~192 ms during which its main loop drained nothing from the I2C
+ * ring. A scrolling line changes every cell of one row per tick, but a clock
+ * or a game score changes two or three.
+ *
+ * CMD_DISPLAY_RUN writes a run of characters in place from a given cell, with
+ * no reset. This module compares the frame the host last queued with the one
+ * it wants and returns the spans that differ, so the SDK sends those instead.
+ *
+ * Cells are numbered row-major: row 0 is 0..19, row 1 is 20..39, which is the
+ * position byte the VFD controller's cursor command takes. A run never crosses
+ * from one row to the next.
+ */
+#ifndef VFD_DIFF_H
+#define VFD_DIFF_H
+
+#include <stddef.h>
+
+#define VFD_COLS 20   /* same as DISPLAY_WIDTH */
+#define VFD_ROWS 2
+#define VFD_CELLS (VFD_COLS * VFD_ROWS)
+
+/* Bytes a run costs on the wire beyond its characters: opcode, cell, length.
+ * Two dirty spans separated by no more unchanged cells than this are sent as
+ * one run -- resending the cells is no dearer than a second header. */
+#define VFD_RUN_OVERHEAD 3
+
+/* Most runs vfd_diff() can return. Spans that close merge, so each run in a
+ * row starts at least VFD_RUN_OVERHEAD + 2 cells after the one before it:
+ * 4 runs per row, 8 in all. */
+#define VFD_MAX_RUNS \
+    (VFD_ROWS * ((VFD_COLS + VFD_RUN_OVERHEAD + 1) / (VFD_RUN_OVERHEAD + 2)))
+
+typedef struct {
+    unsigned char cell;  /* first cell, 0..VFD_CELLS-1 */
+    unsigned char len;   /* cells, >= 1; cell + len stays within the row */
+} vfd_run_t;
+
+/* Unpack a display message in the layout the daemon and display manager
+ * build -- VFD_COLS characters, LF, VFD_COLS characters -- into `cells`.
+ * Returns 0, or -1 if `message` is anything else; such a message can only be
+ * sent as a full repaint. */
+int vfd_cells_from_message(const char *message, char cells[VFD_CELLS]);
+
+/* Compare two frames and write the runs that turn `from` into `to` to `runs`
+ * (room for `max`; VFD_MAX_RUNS is always enough). Returns the number of
+ * runs, 0 if the frames are identical, or -1 if they did not fit. */
+int vfd_diff(const char from[VFD_CELLS], const char to[VFD_CELLS],
+             vfd_run_t *runs, int max);
+
+#endif /* VFD_DIFF_H */
@@ -0,0 +1,357 @@
+#include "web_router.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct web_route_method {
+    char method[16];
+    int id;
+    struct web_route_method* next;
+};
+
+/* A node is reached from its parent by its label, literal text, or -- for a
+ * parameter or wildcard child -- by one segment or the rest of the path.
+ * No two literal children of a node start with the same byte, so at each
+ * node a lookup has at most one literal child to try. */
+struct web_route_node {
+    char* label;
+    size_t label_len;
+    char* name;                          /* a parameter or wildcard's name */
+    struct web_route_node* children;     /* literal children */
+    struct web_route_node* next;         /* the parent's next literal child */
+    struct web_route_node* param;        /* ":name" child */
+    struct web_route_node* wildcard;     /* "*name" child */
+    struct web_route_method* methods;    /* routes whose pattern ends here */
+};
+
+static struct web_route_node* node_new(const char* label, size_t len) {
+    struct web_route_node* node = (struct web_route_node*)calloc(1, sizeof(*node));
+    if (node == NULL) {
+        return NULL;
+    }
+    node->label = (char*)malloc(len + 1);
+    if (node->label == NULL) {
+        free(node);
+        return NULL;
+    }
+    memcpy(node->label, label, len);
+    node->label[len] = '\0';
+    node->label_len = len;
+    return node;
+}
+
+static void node_free(struct web_route_node* node) {
+    while (node != NULL) {
+        struct web_route_node* next = node->next;
+        struct web_route_method* m = node->methods;
+
+        while (m != NULL) {
+            struct web_route_method* m_next = m->next;
+            free(m);
+            m = m_next;
+        }
+        node_free(node->children);
+        node_free(node->param);
+        node_free(node->wildcard);
+        free(node->label);
+        free(node->name);
+        free(node);
+        node = next;
+    }
+}
+
+/* Whether pattern[i] starts a parameter or wildcard segment */
+static int is_capture(const char* pattern, size_t i) {
+    return (pattern[i] == ':' || pattern[i] == '*') && i > 0 && pattern[i - 1] == '/';
+}
+
+/* Descend from node along literal text[0, len): to the child sharing its
+ * first byte, split where the two part, or to a new child holding all of it.
+ * *used is how much of the text the returned node's label took. */
+static struct web_route_node* node_literal(struct web_route_node* node, const char* text,
+                                           size_t len, size_t* used) {
+    struct web_route_node** link;
+    struct web_route_node* child;
+    size_t common = 0;
+
+    for (link = &node->children; *link != NULL; link = &(*link)->next) {
+        if ((*link)->label[0] == text[0]) {
+            break;
+        }
+    }
+    child = *link;
+    if (child == NULL) {
+        child = node_new(text, len);
+        if (child == NULL) {
+            return NULL;
+        }
+        *link = child;
+        *used = len;
+        return child;
+    }
+
+    while (common < child->label_len && common < len && child->label[common] == text[common]) {
+        common++;
+    }
+    if (common < child->label_len) {
+        /* The shared part becomes a node of its own, the old child below it */
+        struct web_route_node* split = node_new(child->label, common);
+        if (split == NULL) {
+            return NULL;
+        }
+        memmove(child->label, child->label + common, child->label_len - common + 1);
+        child->label_len -= common;
+        split->children = child;
+        split->next = child->next;
+        child->next = NULL;
+        *link = split;
+        child = split;
+    }
+    *used = common;
+    return child;
+}
+
+/* The parameter or wildcard child at *link named name[0, len), made if there
+ * is none; NULL if one is there under another name */
+static struct web_route_node* node_capture(struct web_route_node** link, const char* name,
+                                           size_t len) {
+    if (*link != NULL) {
+        if (strlen((*link)->name) != len || memcmp((*link)->name, name, len) != 0) {
+            return NULL;
+        }
+        return *link;
+    }
+    *link = node_new("", 0);
+    if (*link == NULL) {
+        return NULL;
+    }
+    (*link)->name = (char*)malloc(len + 1);
+    if ((*link)->name == NULL) {
+        node_free(*link);
+        *link = NULL;
+        return NULL;
+    }
+    memcpy((*link)->name, name, len);
+    (*link)->name[len] = '\0';
+    return *link;
+}
+
+int web_router_init(struct web_router* router) {
+    if (router == NULL) return -1;
+    router->route_count = 0;
+    router->root = node_new("", 0);
+    return router->root != NULL ? 0 : -1;
+}
+
+void web_router_destroy(struct web_router* router) {
+    if (router == NULL) return;
+    node_free(router->root);
+    router->root = NULL;
+    router->route_count = 0;
+}
+
+int web_router_add(struct web_router* router, const char* method, const char* pattern, int id) {
+    struct web_route_node* node;
+    struct web_route_method** m;
+    size_t i = 0;
+    int params = 0;
+
+    if (router == NULL || router->root == NULL || method == NULL || pattern == NULL ||
+        pattern[0] != '/' || strlen(method) >= sizeof((*m)->method)) {
+        return -1;
+    }
+
+    node = router->root;
+    while (pattern[i] != '\0') {
+        if (is_capture(pattern, i)) {
+            size_t len = strcspn(pattern + i + 1, "/");
+            int wildcard = pattern[i] == '*';
+
+            if ((wildcard && pattern[i + 1 + len] != '\0') || (!wildcard && len == 0) ||
+                ++params > WEB_ROUTER_MAX_PARAMS) {
+                return -1;
+            }
+            node = node_capture(wildcard ? &node->wildcard : &node->param, pattern + i + 1, len);
+            if (node == NULL) {
+                return -1;
+            }
+            i += 1 + len;
+        } else {
+            size_t run = 1;
+            size_t used;
+
+            while (pattern[i + run] != '\0' && !is_capture(pattern, i + run)) {
+                run++;
+            }
+            node = node_literal(node, pattern + i, run, &used);
+            if (node == NULL) {
+                return -1;
+            }
+            i += used;
+        }
+    }
+
+    for (m = &node->methods; *m != NULL; m = &(*m)->next) {
+        if (strcmp((*m)->method, method) == 0) {
+            (*m)->id = id;
+            return 0;
+        }
+    }
+    *m = (struct web_route_method*)calloc(1, sizeof(**m));
+    if (*m == NULL) {
+        return -1;
+    }
+    strcpy((*m)->method, method);
+    (*m)->id = id;
+    router->route_count++;
+    return 0;
+}
+
+int web_router_find(const struct web_router* router, const char* method, const char* pattern) {
+    const struct web_route_node* node;
+    const struct web_route_method* m;
+    size_t i = 0;
+
+    if (router == NULL || router->root == NULL || method == NULL || pattern == NULL) {
+        return -1;
+    }
+
+    node = router->root;
+    while (node != NULL && pattern[i] != '\0') {
+        if (is_capture(pattern, i)) {
+            size_t len = strcspn(pattern + i + 1, "/");
+            node = pattern[i] == '*' ? node->wildcard : node->param;
+            if (node == NULL || strlen(node->name) != len ||
+                memcmp(node->name, pattern + i + 1, len) != 0) {
+                return -1;
+            }
+            i += 1 + len;
+        } else {
+            /* A label never holds a '/' followed by ':' or '*', so it
+             * cannot run past a capture in the pattern */
+            for (node = node->children; node != NULL; node = node->next) {
+                if (node->label[0] == pattern[i]) {
+                    break;
+                }
+            }
+            if (node == NULL || strncmp(node->label, pattern + i, node->label_len) != 0) {
+                return -1;
+            }
+            i += node->label_len;
+        }
+    }
+    for (m = node != NULL ? node->methods : NULL; m != NULL; m = m->next) {
+        if (strcmp(m->method, method) == 0) {
+            return m->id;
+        }
+    }
+    return -1;
+}
+
+static void match_capture(struct web_route_match* match, const struct web_route_node* node,
+                          size_t offset, size_t len) {
+    match->param_names[match->param_count] = node->name;
+    match->param_offsets[match->param_count] = offset;
+    match->param_lens[match->param_count] = len;
+    match->param_count++;
+}
+
+/* The node with routes that path[pos, len) leads to from node, or NULL */
+static const struct web_route_node* node_match(const struct web_route_node* node,
+                                               const char* path, size_t len, size_t pos,
+                                               struct web_route_match* match) {
+    const struct web_route_node* child;
+    const struct web_route_node* found;
+    int count = match->param_count;
+
+    if (pos == len && node->methods != NULL) {
+        return node;
+    }
+    if (pos < len) {
+        for (child = node->children; child != NULL; child = child->next) {
+            if (child->label[0] != path[pos]) {
+                continue;
+            }
+            if (child->label_len <= len - pos &&
+                memcmp(child->label, path + pos, child->label_len) == 0 &&
+                (found = node_match(child, path, len, pos + child->label_len, match)) != NULL) {
+                return found;
+            }
+            break;
+        }
+    }
+    if (node->param != NULL && pos < len && path[pos] != '/' && count < WEB_ROUTER_MAX_PARAMS) {
+        size_t end = pos;
+        while (end < len && path[end] != '/') {
+            end++;
+        }
+        match_capture(match, node->param, pos, end - pos);
+        found = node_match(node->param, path, len, end, match);
+        if (found != NULL) {
+            return found;
+        }
+        match->param_count = count;
+    }
+    if (node->wildcard != NULL && node->wildcard->methods != NULL &&
+        count < WEB_ROUTER_MAX_PARAMS) {
+        match_capture(match, node->wildcard, pos, len - pos);
+        return node->wildcard;
+    }
+    return NULL;
+}
+
+int web_router_match(const struct web_router* router, const char* method, size_t method_len,
+                     const char* path, size_t path_len, struct web_route_match* match) {
+    const struct web_route_method* m;
+    const struct web_route_method* any = NULL;
+
+    if (match == NULL) return WEB_ROUTER_NOT_FOUND;
+    match->id = -1;
+    match->param_count = 0;
+    match->node = NULL;
+    if (router == NULL || router->root == NULL || method == NULL || path == NULL) {
+        return WEB_ROUTER_NOT_FOUND;
+    }
+
+    match->node = node_match(router->root, path, path_len, 0, match);
+    if (match->node == NULL) {
+        match->param_count = 0;
+        return WEB_ROUTER_NOT_FOUND;
+    }
+    for (m = match->node->methods; m != NULL; m = m->next) {
+        if (strlen(m->method) == method_len && memcmp(m->method, method, method_len) == 0) {
+            match->id = m->id;
+            return WEB_ROUTER_FOUND;
+        }
+        if (strcmp(m->method, "*") == 0) {
+            any = m;
+        }
+    }
+    if (any != NULL) {
+        match->id = any->id;
+        return WEB_ROUTER_FOUND;
+    }
+    return WEB_ROUTER_NO_METHOD;
+}
+
+void web_router_allow(const struct web_route_match* match, char* buf, size_t size) {
+    const struct web_route_method* m;
+    size_t used = 0;
+
+    if (buf == NULL || size == 0) return;
+    buf[0] = '\0';
+    if (match == NULL || match->node == NULL) return;
+    for (m = match->node->methods; m != NULL; m = m->next) {
+        size_t len = strlen(m->method);
+        if (used + len + 3 > size) {
+            break;
+        }
+        if (used > 0) {
+            memcpy(buf + used, ", ", 2);
+            used += 2;
+        }
+        memcpy(buf + used, m->method, len);
+        used += len;
+        buf[used] = '\0';
+    }
+}
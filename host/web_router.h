@@ -0,0 +1,90 @@
+#ifndef WEB_ROUTER_H
+#define WEB_ROUTER_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * web_router: the web server's route table, as a radix trie over the path.
+ *
+ * Every request used to be matched by strcmp() against each static route
+ * and then each handler route in turn, and only exact paths could be
+ * routed. Here a lookup walks the trie once along the request path, so its
+ * cost follows the path's length rather than the number of routes, and
+ * there is no fixed limit on how many are added.
+ *
+ * A pattern is a path whose segments may be
+ *   :name   one segment, any text but '/', captured as parameter `name`
+ *   *name   only as the last segment: the rest of the path, possibly empty,
+ *           captured as `name` (which may be empty)
+ * e.g. "/api/plugins/:name/activate", or "/static/" then "*file". Where patterns
+ * overlap, literal text is preferred to a parameter and a parameter to a
+ * wildcard; a lookup that reaches a dead end that way backs up and tries the
+ * next kind.
+ *
+ * Each pattern holds one route per method, identified by an id of the
+ * caller's (the web server's index into its own route array). A route added
+ * for method "*" answers any method the pattern has no route of its own
+ * for.
+ */
+
+/* Parameters one pattern may capture */
+#define WEB_ROUTER_MAX_PARAMS 8
+
+struct web_route_node;
+
+struct web_router {
+    struct web_route_node* root;
+    int route_count;
+};
+
+/* What a lookup found. Parameters are offsets into the path looked up; their
+ * names belong to the router. */
+struct web_route_match {
+    int id;
+    int param_count;
+    const char* param_names[WEB_ROUTER_MAX_PARAMS];
+    size_t param_offsets[WEB_ROUTER_MAX_PARAMS];
+    size_t param_lens[WEB_ROUTER_MAX_PARAMS];
+    const struct web_route_node* node;  /* for web_router_allow() */
+};
+
+/* web_router_match() results */
+#define WEB_ROUTER_FOUND      1
+#define WEB_ROUTER_NOT_FOUND  0
+#define WEB_ROUTER_NO_METHOD -1   /* the path has routes, none for the method */
+
+/* Returns 0, or -1 if out of memory. */
+int web_router_init(struct web_router* router);
+
+/* Free every node. The router may be initialized again afterwards. */
+void web_router_destroy(struct web_router* router);
+
+/* Add route `id` for method and pattern, replacing the one already there.
+ * Returns 0, or -1 on a malformed pattern (not starting with '/', a
+ * wildcard before the end, too many parameters, a parameter named
+ * differently from one another pattern has at the same place) or when out
+ * of memory. */
+int web_router_add(struct web_router* router, const char* method, const char* pattern, int id);
+
+/* The id of the route added for exactly this method and pattern, or -1 */
+int web_router_find(const struct web_router* router, const char* method, const char* pattern);
+
+/* Look up a request: method[0, method_len) and path[0, path_len), neither
+ * of which need be NUL-terminated. Fills `match` when FOUND; when
+ * NO_METHOD, match->node is the path's, for web_router_allow(). */
+int web_router_match(const struct web_router* router, const char* method, size_t method_len,
+                     const char* path, size_t path_len, struct web_route_match* match);
+
+/* The methods a NO_METHOD match's path does have routes for, as an Allow
+ * header value ("GET, POST"), in buf */
+void web_router_allow(const struct web_route_match* match, char* buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WEB_ROUTER_H */
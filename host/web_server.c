@@ -1,8 +1,9 @@
-#define _POSIX_C_SOURCE 200112L
+#define _POSIX_C_SOURCE 200809L
 #include "web_server.h"
 #include "config.h"
 #include "logger.h"
 #include "metrics.h"
+#include "tsdb.h"
 #include "health_monitor.h"
 #include "plugins.h"
 #include "display_manager.h"
@@ -11,7 +12,6 @@
 #include "updater.h"
 
 #include <sys/socket.h>
-#include <sys/select.h>
 #include <sys/time.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -24,7 +24,28 @@
 #include <time.h>
 #include <ctype.h>
 #include <pthread.h>
-#include <unistd.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/sendfile.h>
+#define HAVE_EPOLL 1
+#else
+#include <poll.h>
+#define HAVE_EPOLL 0
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#ifndef MSG_MORE
+#define MSG_MORE 0
+#endif
 
 /* External references to daemon state (will be set by daemon) */
 extern void* daemon_state;
@@ -37,10 +58,14 @@ struct daemon_state_info get_daemon_state_info(void);
 time_t get_daemon_start_time(void);
 int send_control_command(const char* action);
 
-/* Thread function for web server */
-void* web_server_thread_func(void* arg);
+/* Thread functions for web server */
+static void* web_server_loop_func(void* arg);
 static void* web_server_worker_func(void* arg);
 
+/* Defined with the parser, used by the file routes above it */
+static int web_server_request_header_copy(const struct http_request* request, const char* name,
+                                          char* out, size_t size);
+
 /* String utility functions */
 void web_server_strcpy_safe(char* dest, const char* src, size_t dest_size) {
     size_t i;
@@ -122,6 +147,1308 @@ int web_server_strcasecmp(const char* s1, const char* s2) {
     return tolower(*s1) - tolower(*s2);
 }
 
+/* ── Response buffers ────────────────────────────────────────────────────
+ * Handlers used to fill a fixed 8 KB body inside an http_response returned
+ * by value, so every request copied it (and a 20 KB request struct) through
+ * the stack, and a bigger answer -- fifty log lines, the dashboard page --
+ * came out cut short. Now a handler appends to buffers the connection owns
+ * and reuses; the body goes out as built, behind the headers, by
+ * sendmsg(), and may be as large as WEB_SERVER_RESPONSE_MAX. */
+
+/* Once a response is written, a buffer that grew past this is freed rather
+ * than held by an idle keep-alive connection */
+#define WEB_BUF_KEEP 16384
+
+/* Room for `more` bytes after the end of buf; 0, or -1 (and buf marked
+ * failed) if it would pass WEB_SERVER_RESPONSE_MAX or cannot be had */
+static int web_buf_reserve(struct http_buf* buf, size_t more) {
+    size_t cap;
+    char* data;
+
+    if (buf->failed) {
+        return -1;
+    }
+    if (buf->len + more < buf->cap) {
+        return 0;
+    }
+    if (more > WEB_SERVER_RESPONSE_MAX - buf->len) {
+        buf->failed = 1;
+        return -1;
+    }
+    cap = buf->cap > 0 ? buf->cap : 1024;
+    while (cap <= buf->len + more) {
+        cap *= 2;
+    }
+    data = (char*)realloc(buf->data, cap);
+    if (data == NULL) {
+        buf->failed = 1;
+        return -1;
+    }
+    buf->data = data;
+    buf->cap = cap;
+    return 0;
+}
+
+static void web_buf_append(struct http_buf* buf, const char* data, size_t len) {
+    if (web_buf_reserve(buf, len) != 0) {
+        return;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+}
+
+/* Format onto the end of buf. Returns 0, or, when the text is longer than
+ * the room left, the length it needs: reserve that and format it again. */
+static size_t web_buf_vprintf(struct http_buf* buf, const char* format, va_list ap) {
+    int n;
+
+    if (web_buf_reserve(buf, 256) != 0) {
+        return 0;
+    }
+    n = vsnprintf(buf->data + buf->len, buf->cap - buf->len, format, ap);
+    if (n >= 0 && (size_t)n < buf->cap - buf->len) {
+        buf->len += (size_t)n;
+        return 0;
+    }
+    buf->data[buf->len] = '\0';
+    if (n < 0) {
+        buf->failed = 1;
+        return 0;
+    }
+    return (size_t)n;
+}
+
+static void web_buf_printf(struct http_buf* buf, const char* format, ...) {
+    va_list ap;
+    size_t need;
+
+    va_start(ap, format);
+    need = web_buf_vprintf(buf, format, ap);
+    va_end(ap);
+    if (need > 0 && web_buf_reserve(buf, need) == 0) {
+        va_start(ap, format);
+        web_buf_vprintf(buf, format, ap);
+        va_end(ap);
+    }
+}
+
+/* Empty the buffer for the next response, letting go of an outsized one */
+static void web_buf_clear(struct http_buf* buf) {
+    if (buf->cap > WEB_BUF_KEEP) {
+        free(buf->data);
+        buf->data = NULL;
+        buf->cap = 0;
+    }
+    buf->len = 0;
+    buf->failed = 0;
+}
+
+static void web_buf_free(struct http_buf* buf) {
+    free(buf->data);
+    memset(buf, 0, sizeof(*buf));
+}
+
+void web_server_response_init(struct http_response* response) {
+    memset(response, 0, sizeof(*response));
+    response->status_code = 200;
+    response->file_fd = -1;
+}
+
+void web_server_response_reset(struct http_response* response) {
+    struct http_buf headers = response->headers;
+    struct http_buf body = response->body;
+
+    web_buf_clear(&headers);
+    web_buf_clear(&body);
+    web_server_response_init(response);
+    response->headers = headers;
+    response->body = body;
+}
+
+void web_server_response_free(struct http_response* response) {
+    web_buf_free(&response->headers);
+    web_buf_free(&response->body);
+}
+
+void web_server_response_header(struct http_response* response, const char* key, const char* value) {
+    web_buf_printf(&response->headers, "%s: %s\r\n", key, value);
+}
+
+void web_server_response_append(struct http_response* response, const char* data, size_t len) {
+    web_buf_append(&response->body, data, len);
+}
+
+void web_server_response_puts(struct http_response* response, const char* text) {
+    web_buf_append(&response->body, text, strlen(text));
+}
+
+void web_server_response_printf(struct http_response* response, const char* format, ...) {
+    va_list ap;
+    size_t need;
+
+    va_start(ap, format);
+    need = web_buf_vprintf(&response->body, format, ap);
+    va_end(ap);
+    if (need > 0 && web_buf_reserve(&response->body, need) == 0) {
+        va_start(ap, format);
+        web_buf_vprintf(&response->body, format, ap);
+        va_end(ap);
+    }
+}
+
+/* ── Event loop ──────────────────────────────────────────────────────────
+ * The accept thread used to poll a non-blocking accept() every millisecond,
+ * and each worker then read its client with blocking read()s under a 2 s
+ * SO_RCVTIMEO -- so four idle or slow dashboard tabs could hold every worker
+ * while the rest waited in the queue.
+ *
+ * Now one thread waits on every socket at once. On Linux that is an epoll set
+ * with edge-triggered, non-blocking sockets: each readiness change is one
+ * wakeup, after which the loop reads (or accepts, or writes) until EAGAIN. A
+ * request is parsed as far as its headers and Content-Length as the bytes
+ * arrive, and handled when it is complete: on the loop itself when the
+ * handler answers from memory, on a worker when it may block (see
+ * web_server_request_blocks). A worker puts the finished connection on
+ * done_queue and signals wake_fd; the loop writes the response, with EPOLLOUT
+ * carrying on a write the socket would not take in one go. With nothing
+ * connected the loop sleeps until a connection or web_server_stop() arrives.
+ *
+ * A connection outlives its request unless the client asks otherwise (see
+ * WEB_SERVER_KEEPALIVE_TIMEOUT_MS). Requests are taken from the front of its
+ * read buffer one at a time, so a client that pipelines several in one
+ * segment gets its answers back in order, and whatever follows the request
+ * being handled waits in the buffer for the next turn.
+ *
+ * Elsewhere (the macOS dev box runs `make compile-check`) the same loop runs
+ * on poll(), level-triggered, which the read-until-EAGAIN handlers don't
+ * mind. */
+#define WEB_TAG_LISTEN 0
+#define WEB_TAG_WAKE   1
+#define WEB_TAG_FILES  2           /* inotify: a file route's file changed */
+#define WEB_TAG_CONN   3           /* + the connection's slot */
+#define WEB_LOOP_MAX_FDS (WEB_TAG_CONN + WEB_SERVER_MAX_CONNS)
+
+#define WEB_CONN_READING 0
+#define WEB_CONN_WORKING 1         /* with a worker; the loop leaves it be */
+#define WEB_CONN_WRITING 2
+
+/* A client connection. The loop thread owns it, except while WORKING, when
+ * the worker that popped its slot does. */
+struct web_conn {
+    int fd;
+    int slot;
+    int state;
+    int upgrade;               /* a websocket once the 101 is written */
+    int keep_alive;            /* open for another request after this one */
+    int eof;                   /* the client has shut down its end */
+    int requests;              /* served on this connection so far */
+    long long deadline_ms;     /* closed if it has not progressed by then */
+    long long idle_since_ms;   /* when it last had no request in hand */
+    char in[WEB_SERVER_REQUEST_MAX];
+    size_t in_len;
+    size_t scanned;            /* bytes searched for the end of the headers */
+    size_t header_len;         /* 0 until the headers are complete */
+    long content_length;
+    size_t request_len;        /* bytes of in[] the request being served takes */
+    int parsed;                /* request holds the request being served */
+    struct http_request request;
+    struct http_response response;
+    struct http_buf head;      /* the response's status line and headers */
+    int responded;             /* head and response are ready to write */
+    size_t out_sent;           /* of head, then the body */
+    int file_fd;               /* a file route's file, sent after out; or -1 */
+    off_t file_sent;
+    size_t file_len;
+};
+
+struct web_event {
+    int tag;
+    int readable;
+    int writable;
+};
+
+static const char web_server_busy[] =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Content-Type: application/json\r\n"
+    "Retry-After: 1\r\n"
+    "Connection: close\r\n"
+    "Content-Length: 23\r\n"
+    "\r\n"
+    "{\"error\":\"Server busy\"}";
+
+static long long web_server_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void web_server_set_nonblocking(int fd, int on) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, on ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK));
+}
+
+#if HAVE_EPOLL
+
+static int web_loop_open(struct web_server* server) {
+    server->loop_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (server->loop_fd == -1) {
+        return -1;
+    }
+    server->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (server->wake_fd == -1) {
+        close(server->loop_fd);
+        server->loop_fd = -1;
+        return -1;
+    }
+    server->wake_wr_fd = server->wake_fd;
+    /* Without it (-1) cached files are re-checked by age instead */
+    server->files_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    return 0;
+}
+
+static void web_loop_close(struct web_server* server) {
+    if (server->loop_fd >= 0) close(server->loop_fd);
+    if (server->wake_fd >= 0) close(server->wake_fd);
+    if (server->files_fd >= 0) close(server->files_fd);
+    server->loop_fd = server->wake_fd = server->wake_wr_fd = server->files_fd = -1;
+}
+
+static int web_loop_add(struct web_server* server, int fd, int tag) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLET;
+    if (tag >= WEB_TAG_CONN) ev.events |= EPOLLOUT | EPOLLRDHUP;
+    ev.data.u32 = (uint32_t)tag;
+    return epoll_ctl(server->loop_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static void web_loop_del(struct web_server* server, int fd) {
+    epoll_ctl(server->loop_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+static int web_loop_wait(struct web_server* server, struct web_event* evs,
+                         int max, int timeout_ms) {
+    struct epoll_event ready[WEB_LOOP_MAX_FDS];
+    int n, i;
+
+    if (max > (int)(sizeof(ready) / sizeof(ready[0]))) {
+        max = (int)(sizeof(ready) / sizeof(ready[0]));
+    }
+    n = epoll_wait(server->loop_fd, ready, max, timeout_ms);
+    for (i = 0; i < n; i++) {
+        evs[i].tag = (int)ready[i].data.u32;
+        evs[i].readable = (ready[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0;
+        evs[i].writable = (ready[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) != 0;
+    }
+    return n;
+}
+
+static void web_loop_wake(struct web_server* server) {
+    uint64_t one = 1;
+    if (write(server->wake_wr_fd, &one, sizeof(one)) < 0) {
+        /* Already signalled (the counter only overflows after 2^64) */
+    }
+}
+
+#else /* !HAVE_EPOLL: poll() fallback for non-Linux dev builds */
+
+static int web_loop_open(struct web_server* server) {
+    int fds[2];
+    if (pipe(fds) == -1) {
+        return -1;
+    }
+    web_server_set_nonblocking(fds[0], 1);
+    web_server_set_nonblocking(fds[1], 1);
+    server->loop_fd = -1;
+    server->wake_fd = fds[0];
+    server->wake_wr_fd = fds[1];
+    server->files_fd = -1;
+    return 0;
+}
+
+static void web_loop_close(struct web_server* server) {
+    if (server->wake_fd >= 0) close(server->wake_fd);
+    if (server->wake_wr_fd >= 0) close(server->wake_wr_fd);
+    server->loop_fd = server->wake_fd = server->wake_wr_fd = server->files_fd = -1;
+}
+
+static int web_loop_add(struct web_server* server, int fd, int tag) {
+    (void)server; (void)fd; (void)tag;
+    return 0;
+}
+
+static void web_loop_del(struct web_server* server, int fd) {
+    (void)server; (void)fd;
+}
+
+/* Watch what each connection is waiting for: its request, or the room to
+ * write its response. One with a worker is not watched. */
+static int web_loop_wait(struct web_server* server, struct web_event* evs,
+                         int max, int timeout_ms) {
+    struct pollfd pfds[WEB_LOOP_MAX_FDS];
+    int tags[WEB_LOOP_MAX_FDS];
+    int nfds = 0, n, i;
+
+    pfds[nfds].fd = server->server_fd;
+    pfds[nfds].events = POLLIN;
+    tags[nfds++] = WEB_TAG_LISTEN;
+    pfds[nfds].fd = server->wake_fd;
+    pfds[nfds].events = POLLIN;
+    tags[nfds++] = WEB_TAG_WAKE;
+    for (i = 0; i < WEB_SERVER_MAX_CONNS; i++) {
+        struct web_conn* conn = server->conns[i];
+        if (conn == NULL || conn->state == WEB_CONN_WORKING) continue;
+        pfds[nfds].fd = conn->fd;
+        pfds[nfds].events = conn->state == WEB_CONN_READING ? POLLIN : POLLOUT;
+        tags[nfds++] = WEB_TAG_CONN + i;
+    }
+
+    n = poll(pfds, (nfds_t)nfds, timeout_ms);
+    if (n <= 0) {
+        return n;
+    }
+    n = 0;
+    for (i = 0; i < nfds && n < max; i++) {
+        if (pfds[i].revents == 0) continue;
+        evs[n].tag = tags[i];
+        evs[n].readable = (pfds[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0;
+        evs[n].writable = (pfds[i].revents & (POLLOUT | POLLHUP | POLLERR)) != 0;
+        n++;
+    }
+    return n;
+}
+
+static void web_loop_wake(struct web_server* server) {
+    char one = 1;
+    if (write(server->wake_wr_fd, &one, 1) < 0) {
+        /* Pipe full: the loop has wakeups pending already */
+    }
+}
+
+#endif /* HAVE_EPOLL */
+
+static void web_loop_drain_wake(struct web_server* server) {
+    char buf[64];
+    while (read(server->wake_fd, buf, sizeof(buf)) > 0) {
+    }
+}
+
+/* Forget a connection without closing its fd */
+static void web_server_conn_free(struct web_server* server, struct web_conn* conn) {
+    server->conns[conn->slot] = NULL;
+    server->conn_count--;
+    if (conn->file_fd >= 0) close(conn->file_fd);
+    web_buf_free(&conn->head);
+    web_server_response_free(&conn->response);
+    web_server_free(conn);
+}
+
+static void web_server_conn_close(struct web_server* server, struct web_conn* conn) {
+    web_loop_del(server, conn->fd);
+    close(conn->fd);
+    web_server_conn_free(server, conn);
+}
+
+/* Accept a connection into a free slot, or turn it away with a 503 if its
+ * state cannot be allocated */
+static void web_server_conn_open(struct web_server* server, int fd,
+                                 const struct sockaddr_in* addr) {
+    struct web_conn* conn;
+    int slot;
+
+    for (slot = 0; slot < WEB_SERVER_MAX_CONNS; slot++) {
+        if (server->conns[slot] == NULL) break;
+    }
+    conn = slot < WEB_SERVER_MAX_CONNS ?
+        (struct web_conn*)web_server_malloc(sizeof(*conn)) : NULL;
+    if (conn == NULL) {
+        logger_warn_with_category("WebServer",
+            "Out of memory for a connection; rejecting client with 503");
+        send(fd, web_server_busy, sizeof(web_server_busy) - 1, MSG_NOSIGNAL);
+        close(fd);
+        return;
+    }
+
+    memset(conn, 0, sizeof(*conn));
+    conn->fd = fd;
+    conn->slot = slot;
+    conn->state = WEB_CONN_READING;
+    conn->content_length = -1;
+    conn->file_fd = -1;
+    web_server_response_init(&conn->response);
+    conn->idle_since_ms = web_server_now_ms();
+    conn->deadline_ms = conn->idle_since_ms + WEB_SERVER_READ_TIMEOUT_MS;
+    /* inet_ntop (not inet_ntoa): workers format addresses concurrently */
+    if (inet_ntop(AF_INET, &addr->sin_addr, conn->request.client_ip,
+                  sizeof(conn->request.client_ip)) == NULL) {
+        web_server_strcpy_safe(conn->request.client_ip, "unknown",
+                               sizeof(conn->request.client_ip));
+    }
+
+    web_server_set_nonblocking(fd, 1);
+    server->conns[slot] = conn;
+    server->conn_count++;
+    __atomic_add_fetch(&server->connections_total, 1, __ATOMIC_RELAXED);
+    if (web_loop_add(server, fd, WEB_TAG_CONN + slot) != 0) {
+        logger_errorf_with_category("WebServer", "Failed to watch client fd %d: %s",
+                                    fd, strerror(errno));
+        web_server_conn_close(server, conn);
+    }
+}
+
+/* Make room for a new client by closing the connection that has been idle
+ * longest: kept alive after a response, or opened and never used (a
+ * browser's preconnect). Returns 0 if every connection is busy. */
+static int web_server_evict_idle(struct web_server* server) {
+    struct web_conn* oldest = NULL;
+    int i;
+
+    for (i = 0; i < WEB_SERVER_MAX_CONNS; i++) {
+        struct web_conn* conn = server->conns[i];
+        if (conn != NULL && conn->state == WEB_CONN_READING && conn->in_len == 0 &&
+            (oldest == NULL || conn->idle_since_ms < oldest->idle_since_ms)) {
+            oldest = conn;
+        }
+    }
+    if (oldest == NULL) {
+        return 0;
+    }
+    web_server_conn_close(server, oldest);
+    return 1;
+}
+
+static void web_server_accept_all(struct web_server* server) {
+    server->accept_retry = 0;
+    for (;;) {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        int client_fd;
+
+        /* Every slot taken by a client mid-request: leave the rest in the
+         * listen backlog until a connection closes, rather than accepting
+         * them only to refuse */
+        if (server->conn_count >= WEB_SERVER_MAX_CONNS && !web_server_evict_idle(server)) {
+            server->accept_retry = 1;
+            return;
+        }
+        client_fd = accept(server->server_fd, (struct sockaddr*)&client_addr, &client_len);
+
+        if (client_fd >= 0) {
+            web_server_conn_open(server, client_fd, &client_addr);
+            continue;
+        }
+        if (errno == EINTR || errno == ECONNABORTED) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            /* Out of fds, most likely. The pending connections will not
+             * signal again, so come back to them on the next pass. */
+            logger_errorf_with_category("WebServer", "Accept failed: %s", strerror(errno));
+            server->accept_retry = 1;
+        }
+        return;
+    }
+}
+
+/* Case-insensitively scan the request headers line-by-line for `name` (in
+ * lower case, with its colon) and return where its value starts, or NULL.
+ * Scanning per-line (not a raw substring search) avoids matching the token
+ * inside a header value. */
+static const char* web_server_find_header(const char* buf, size_t len, const char* name) {
+    const char* p = buf;
+    const char* end = buf + len;
+    while (p && p < end) {
+        const char* h = p;
+        const char* n = name;
+        while (*n && h < end && (char)tolower((unsigned char)*h) == *n) {
+            h++;
+            n++;
+        }
+        if (*n == '\0') {
+            while (h < end && (*h == ' ' || *h == '\t')) h++;
+            return h;
+        }
+        p = memchr(p, '\n', (size_t)(end - p));
+        if (p) p++;
+    }
+    return NULL;
+}
+
+/* What web_server_parse_content_length() returns besides a length */
+#define WEB_CONTENT_LENGTH_NONE (-1)       /* no Content-Length header */
+#define WEB_CONTENT_LENGTH_INVALID (-2)    /* negative, not a number, or too big */
+
+/* The Content-Length header's value: digits alone, then the end of the line.
+ * A sign, trailing text or a value past a long is WEB_CONTENT_LENGTH_INVALID,
+ * not whatever strtol() made of it. */
+static long web_server_parse_content_length(const char* buf, size_t len) {
+    const char* value = web_server_find_header(buf, len, "content-length:");
+    char* end;
+    long n;
+
+    if (value == NULL) {
+        return WEB_CONTENT_LENGTH_NONE;
+    }
+    if (!isdigit((unsigned char)*value)) {
+        return WEB_CONTENT_LENGTH_INVALID;
+    }
+    errno = 0;
+    n = strtol(value, &end, 10);
+    while (*end == ' ' || *end == '\t') end++;
+    if (errno == ERANGE || (*end != '\r' && *end != '\n')) {
+        return WEB_CONTENT_LENGTH_INVALID;
+    }
+    return n;
+}
+
+/* The error status for a request whose body cannot be read: 400 for a bad
+ * Content-Length, 413 for a body that would not fit in the buffer behind its
+ * headers. 0 if the body can be read. */
+static int web_server_body_status(const struct web_conn* conn) {
+    if (conn->content_length == WEB_CONTENT_LENGTH_INVALID) {
+        return 400;
+    }
+    if (conn->content_length > (long)(sizeof(conn->in) - 1 - conn->header_len)) {
+        return 413;
+    }
+    return 0;
+}
+
+/* Whether the client will take another response on this connection:
+ * HTTP/1.1 keeps it open unless it says "Connection: close", HTTP/1.0 only
+ * if it says "Connection: keep-alive". */
+static int web_server_wants_keep_alive(const char* buf, size_t len) {
+    const char* eol = memchr(buf, '\n', len);
+    const char* value = web_server_find_header(buf, len, "connection:");
+    char token[64];
+    size_t n = 0;
+
+    if (value != NULL) {
+        while (value < buf + len && *value != '\r' && *value != '\n' &&
+               n < sizeof(token) - 1) {
+            token[n++] = (char)tolower((unsigned char)*value++);
+        }
+        token[n] = '\0';
+        if (strstr(token, "close") != NULL) return 0;
+        if (strstr(token, "keep-alive") != NULL) return 1;
+    }
+    /* The request line ends in the version */
+    if (eol != NULL && eol > buf && eol[-1] == '\r') eol--;
+    return eol != NULL && eol - buf >= 8 && memcmp(eol - 8, "HTTP/1.1", 8) == 0;
+}
+
+/* Whether conn->in holds a whole request yet. A request's headers and body
+ * can arrive in separate TCP segments, so a single read() often returns only
+ * the headers with the body still in flight -- that left POST bodies empty,
+ * the cause of /api/control intermittently reporting "Unknown action:
+ * unknown". Only the bytes that arrived since the last call are searched for
+ * the blank line ending the headers; after it, Content-Length says how much
+ * body to wait for. */
+static int web_server_request_complete(struct web_conn* conn) {
+    if (conn->header_len == 0) {
+        size_t i = conn->scanned > 2 ? conn->scanned - 2 : 0;
+        for (; i < conn->in_len; i++) {
+            if (conn->in[i] == '\n' && i >= 1 &&
+                (conn->in[i - 1] == '\n' ||
+                 (i >= 2 && conn->in[i - 1] == '\r' && conn->in[i - 2] == '\n'))) {
+                conn->header_len = i + 1;
+                break;
+            }
+        }
+        conn->scanned = conn->in_len;
+        if (conn->header_len == 0) {
+            return 0;
+        }
+        conn->content_length = web_server_parse_content_length(conn->in, conn->header_len);
+    }
+    /* No body expected (e.g. GET): headers alone are enough. Nor is there
+     * any point waiting for one that will be refused. */
+    if (conn->content_length <= 0 || web_server_body_status(conn) != 0) {
+        return 1;
+    }
+    return conn->in_len - conn->header_len >= (size_t)conn->content_length;
+}
+
+/* Look the request up in the router, once: its route, and the path
+ * parameters the route's pattern captured, as slices of the request */
+static void web_server_route_request(struct web_server* server, struct http_request* request) {
+    struct web_route_match match;
+    int i;
+
+    request->route = -1;
+    request->param_count = 0;
+    if (web_router_match(&server->router, request->buf + request->method.offset,
+                         request->method.len, request->buf + request->path.offset,
+                         request->path.len, &match) != WEB_ROUTER_FOUND) {
+        return;
+    }
+    request->route = match.id;
+    for (i = 0; i < match.param_count; i++) {
+        request->param_names[i] = match.param_names[i];
+        request->param_values[i].offset = request->path.offset + match.param_offsets[i];
+        request->param_values[i].len = match.param_lens[i];
+    }
+    request->param_count = match.param_count;
+}
+
+/* Whether a request may block and so goes to a worker: one for a route
+ * added with web_server_add_blocking_route(). File routes are served from
+ * the file cache below, on the loop. */
+static int web_server_request_blocks(struct web_server* server,
+                                     const struct http_request* request) {
+    return request->route >= 0 && server->routes[request->route].blocking;
+}
+
+/* ── File routes ──────────────────────────────────────────────────────────
+ * Each request for / used to fopen() and fseek() web_portal.html for its
+ * size, then fread() the whole file into a buffer to send. Now a file
+ * route's file is opened once and kept open with its size and ETag; a
+ * request sends it with sendfile() straight from the page cache, or gets a
+ * 304 if the browser's copy is current. A precompressed <file>.gz beside it
+ * (make install writes one) goes to clients that accept gzip.
+ *
+ * The loop thread alone touches the cache. An inotify watch on each file's
+ * directory drops an entry when anything there changes -- an install or OTA
+ * replaces files by rename -- and the next request reopens it. Without
+ * inotify an entry is simply re-checked once it is WEB_FILE_RECHECK_MS old.
+ * A connection sends from its own dup() of the fd, so dropping an entry
+ * never pulls a file out from under a response in progress. */
+#define WEB_FILE_RECHECK_MS 1000
+
+struct web_file_variant {
+    int fd;                    /* -1 if absent */
+    size_t size;
+    char etag[64];
+};
+
+struct web_file {
+    int loaded;
+    int watch;                 /* inotify watch on the directory, or -1 */
+    long long loaded_ms;
+    struct web_file_variant plain;
+    struct web_file_variant gz;
+};
+
+static void web_file_variant_close(struct web_file_variant* v) {
+    if (v->fd >= 0) close(v->fd);
+    v->fd = -1;
+}
+
+static void web_file_unload(struct web_file* file) {
+    web_file_variant_close(&file->plain);
+    web_file_variant_close(&file->gz);
+    file->loaded = 0;
+}
+
+/* Nanoseconds where the platform keeps them: a file edited twice in a
+ * second must still get a new ETag */
+static long long web_file_mtime_ns(const struct stat* st) {
+#ifdef __linux__
+    return (long long)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+#else
+    return (long long)st->st_mtime * 1000000000LL;
+#endif
+}
+
+/* Open one variant; returns its mtime, or -1 if it is not a regular file */
+static long long web_file_variant_open(struct web_file_variant* v, const char* path,
+                                       const char* suffix) {
+    struct stat st;
+
+    v->fd = open(path, O_RDONLY);
+    if (v->fd < 0) {
+        return -1;
+    }
+    if (fstat(v->fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        web_file_variant_close(v);
+        return -1;
+    }
+    fcntl(v->fd, F_SETFD, FD_CLOEXEC);
+    v->size = (size_t)st.st_size;
+    /* Strong: a different file, or the same one rewritten, gets a new one */
+    snprintf(v->etag, sizeof(v->etag), "\"%lx-%lx-%llx%s\"",
+             (unsigned long)st.st_ino, (unsigned long)st.st_size,
+             (unsigned long long)web_file_mtime_ns(&st), suffix);
+    return web_file_mtime_ns(&st);
+}
+
+/* Watch the directory holding `path` */
+static int web_file_watch(struct web_server* server, const char* path) {
+#if HAVE_EPOLL
+    char dir[256];
+    char* slash;
+
+    if (server->files_fd < 0) {
+        return -1;
+    }
+    web_server_strcpy_safe(dir, path, sizeof(dir));
+    slash = strrchr(dir, '/');
+    if (slash == NULL) {
+        web_server_strcpy_safe(dir, ".", sizeof(dir));
+    } else if (slash == dir) {
+        dir[1] = '\0';
+    } else {
+        *slash = '\0';
+    }
+    return inotify_add_watch(server->files_fd, dir,
+        IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE |
+        IN_DELETE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF);
+#else
+    (void)server; (void)path;
+    return -1;
+#endif
+}
+
+/* The cache entry for file route `idx`, loaded and current, or NULL if its
+ * file cannot be opened */
+static struct web_file* web_server_file_get(struct web_server* server, int idx) {
+    struct web_file* file = server->static_files[idx];
+    const char* path = server->static_file_paths[idx];
+    char gz_path[264];
+    long long mtime;
+
+    if (file == NULL) {
+        return NULL;
+    }
+    if (file->loaded && (file->watch >= 0 ||
+                         web_server_now_ms() - file->loaded_ms < WEB_FILE_RECHECK_MS)) {
+        return file;
+    }
+    web_file_unload(file);
+
+    /* Watch before opening, so a change in between is not missed */
+    if (file->watch < 0) {
+        file->watch = web_file_watch(server, path);
+    }
+    mtime = web_file_variant_open(&file->plain, path, "");
+    if (mtime == -1) {
+        return NULL;
+    }
+    snprintf(gz_path, sizeof(gz_path), "%s.gz", path);
+    /* A .gz older than the file was left behind by a hand edit */
+    if (web_file_variant_open(&file->gz, gz_path, "-gz") < mtime) {
+        web_file_variant_close(&file->gz);
+    }
+    file->loaded = 1;
+    file->loaded_ms = web_server_now_ms();
+    return file;
+}
+
+/* Drop the entries an inotify event names. An overflowed queue names none,
+ * so drops them all. */
+static void web_server_files_changed(struct web_server* server) {
+#if HAVE_EPOLL
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+
+    while ((len = read(server->files_fd, buf, sizeof(buf))) > 0) {
+        char* p;
+        for (p = buf; p < buf + len;
+             p += sizeof(struct inotify_event) + ((struct inotify_event*)p)->len) {
+            const struct inotify_event* ev = (const struct inotify_event*)p;
+            int i;
+            for (i = 0; i < server->static_count; i++) {
+                struct web_file* file = server->static_files[i];
+                if (file == NULL ||
+                    (!(ev->mask & IN_Q_OVERFLOW) && ev->wd != file->watch)) {
+                    continue;
+                }
+                web_file_unload(file);
+                if (ev->mask & IN_IGNORED) {
+                    file->watch = -1;  /* the directory itself went away */
+                }
+            }
+        }
+    }
+#else
+    (void)server;
+#endif
+}
+
+/* Close every cached file, and forget the watches with the inotify fd */
+static void web_server_files_unload(struct web_server* server) {
+    int i;
+    for (i = 0; i < server->static_count; i++) {
+        if (server->static_files[i] != NULL) {
+            web_file_unload(server->static_files[i]);
+            server->static_files[i]->watch = -1;
+        }
+    }
+}
+
+/* Whether an Accept-Encoding value takes gzip (and not at q=0) */
+static int web_server_accepts_gzip(const char* value) {
+    const char* p = strstr(value, "gzip");
+    if (p == NULL) {
+        return 0;
+    }
+    p += 4;
+    while (*p == ' ') p++;
+    if (*p == ';') {
+        const char* q = strstr(p, "q=");
+        if (q != NULL && strtod(q + 2, NULL) <= 0.0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* The response to a GET of file route `idx`: the file (or its .gz) to
+ * send, or a 304 when If-None-Match already names it */
+static void web_server_file_response(struct web_server* server, int idx,
+                                     const struct http_request* request,
+                                     struct http_response* response) {
+    struct web_file* file = web_server_file_get(server, idx);
+    const struct web_file_variant* v;
+    char accept_encoding[256];
+    char if_none_match[256];
+    int gzip;
+
+    if (file == NULL) {
+        web_server_handle_not_found(request, response);
+        return;
+    }
+    gzip = web_server_request_header_copy(request, "Accept-Encoding",
+                                          accept_encoding, sizeof(accept_encoding)) &&
+           web_server_accepts_gzip(accept_encoding);
+    v = gzip && file->gz.fd >= 0 ? &file->gz : &file->plain;
+
+    web_server_strcpy_safe(response->content_type, server->static_content_types[idx],
+                           sizeof(response->content_type));
+    web_server_response_header(response, "ETag", v->etag);
+    /* Cache, but ask each time: an update can change the file any moment */
+    web_server_response_header(response, "Cache-Control", "no-cache");
+    if (file->gz.fd >= 0) {
+        web_server_response_header(response, "Vary", "Accept-Encoding");
+    }
+    if (web_server_request_header_copy(request, "If-None-Match",
+                                       if_none_match, sizeof(if_none_match)) &&
+        (strstr(if_none_match, v->etag) != NULL || strcmp(if_none_match, "*") == 0)) {
+        response->status_code = 304;
+        return;
+    }
+    if (v == &file->gz) {
+        web_server_response_header(response, "Content-Encoding", "gzip");
+    }
+    response->is_streaming = 1;
+    response->file_fd = v->fd;
+    response->content_length = v->size;
+}
+
+/* The Connection header, and the blank line ending the headers */
+static void web_server_format_connection(struct http_buf* out,
+                                         const struct http_response* response) {
+    if (response->keep_alive > 0) {
+        web_buf_printf(out,
+            "Connection: keep-alive\r\n"
+            "Keep-Alive: timeout=%d, max=%d\r\n\r\n",
+            WEB_SERVER_KEEPALIVE_TIMEOUT_MS / 1000, response->keep_alive);
+    } else {
+        web_buf_printf(out, "Connection: close\r\n\r\n");
+    }
+}
+
+/* Ready the handler's response in conn to write: its head serialized, and
+ * for a file route the file to follow it */
+static void web_server_conn_render(struct web_conn* conn) {
+    struct http_response* response = &conn->response;
+
+    if (response->headers.failed || response->body.failed) {
+        logger_warn_with_category("WebServer",
+            "Response did not fit in WEB_SERVER_RESPONSE_MAX or memory; sending 500");
+        web_server_response_reset(response);
+        response->status_code = 500;
+    }
+    response->keep_alive = conn->keep_alive && response->status_code != 101 ?
+        WEB_SERVER_KEEPALIVE_MAX - conn->requests : 0;
+    if (response->is_streaming) {
+        conn->file_fd = dup(response->file_fd);
+        conn->file_sent = 0;
+        conn->file_len = response->content_length;
+    }
+    conn->responded = web_server_serialize_head(response, &conn->head) == 0 &&
+                      (!response->is_streaming || conn->file_fd >= 0);
+    conn->out_sent = 0;
+    conn->upgrade = response->status_code == 101;
+}
+
+static void web_server_conn_handle(struct web_server* server, struct web_conn* conn) {
+    char next = conn->in[conn->request_len];
+
+    /* End the body at this request, not any pipelined behind it */
+    conn->in[conn->request_len] = '\0';
+    if (conn->parsed) {
+        web_server_process_request(server, &conn->request, &conn->response);
+    } else {
+        conn->response.status_code = 400;
+    }
+    conn->in[conn->request_len] = next;
+    web_server_conn_render(conn);
+}
+
+/* Register a connection whose 101 has gone out as a websocket. It leaves
+ * the event loop, and its fd goes back to blocking: the broadcaster's sends
+ * expect that. */
+static void web_server_conn_upgrade(struct web_server* server, struct web_conn* conn) {
+    int fd = conn->fd;
+    int total;
+
+    web_loop_del(server, fd);
+    web_server_set_nonblocking(fd, 0);
+    web_server_conn_free(server, conn);
+
+    pthread_mutex_lock(&server->state_mutex);
+    if (server->websocket_count < 32) {
+        server->websocket_connections[server->websocket_count++] = fd;
+        total = server->websocket_count;
+        pthread_mutex_unlock(&server->state_mutex);
+        logger_infof_with_category("WebServer",
+            "WebSocket client connected (fd=%d, total=%d)", fd, total);
+    } else {
+        pthread_mutex_unlock(&server->state_mutex);
+        logger_warn_with_category("WebServer", "Max WebSocket connections reached");
+        close(fd);
+    }
+}
+
+/* Send the next piece of conn's file: by sendfile(), never copying it
+ * through user space, where there is one */
+static ssize_t web_server_send_file(struct web_conn* conn) {
+    size_t left = conn->file_len - (size_t)conn->file_sent;
+#if HAVE_EPOLL
+    return sendfile(conn->fd, conn->file_fd, &conn->file_sent, left);
+#else
+    char buf[16384];
+    ssize_t got, n;
+
+    /* The dup()s share one offset, but only this thread moves it */
+    if (lseek(conn->file_fd, conn->file_sent, SEEK_SET) == (off_t)-1) {
+        return -1;
+    }
+    got = read(conn->file_fd, buf, left < sizeof(buf) ? left : sizeof(buf));
+    if (got <= 0) {
+        return got;
+    }
+    n = send(conn->fd, buf, (size_t)got, MSG_NOSIGNAL);
+    if (n > 0) conn->file_sent += n;
+    return n;
+#endif
+}
+
+/* Send the next piece of the head and body, both at once when the socket
+ * takes them */
+static ssize_t web_server_send_out(struct web_conn* conn, int flags) {
+    struct iovec iov[2];
+    struct msghdr msg;
+    size_t skip = conn->out_sent;
+    int n = 0;
+
+    if (skip < conn->head.len) {
+        iov[n].iov_base = conn->head.data + skip;
+        iov[n].iov_len = conn->head.len - skip;
+        n++;
+        skip = 0;
+    } else {
+        skip -= conn->head.len;
+    }
+    if (skip < conn->response.body.len) {
+        iov[n].iov_base = conn->response.body.data + skip;
+        iov[n].iov_len = conn->response.body.len - skip;
+        n++;
+    }
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = n;
+    return sendmsg(conn->fd, &msg, MSG_NOSIGNAL | flags);
+}
+
+/* Write as much of the response as the socket takes. Returns 1 once it is
+ * all out, 0 if the socket is full (EPOLLOUT brings the loop back), -1 if
+ * the connection failed and has been closed. */
+static int web_server_conn_flush(struct web_server* server, struct web_conn* conn) {
+    /* The file's first bytes share a segment with the headers */
+    int more = conn->file_fd >= 0 ? MSG_MORE : 0;
+    size_t out_len = conn->head.len + conn->response.body.len;
+
+    for (;;) {
+        ssize_t n;
+
+        if (conn->out_sent < out_len) {
+            n = web_server_send_out(conn, more);
+            if (n > 0) conn->out_sent += (size_t)n;
+        } else if (conn->file_fd >= 0 && (size_t)conn->file_sent < conn->file_len) {
+            n = web_server_send_file(conn);
+            if (n == 0) {
+                /* The file shrank after its length went out in the headers */
+                web_server_conn_close(server, conn);
+                return -1;
+            }
+        } else {
+            return 1;
+        }
+        if (n > 0) {
+            conn->deadline_ms = web_server_now_ms() + WEB_SERVER_WRITE_TIMEOUT_MS;
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+        web_server_conn_close(server, conn);
+        return -1;
+    }
+}
+
+/* The response is out: close the connection, make it a websocket, or ready
+ * it for the next request, moving whatever the client pipelined behind this
+ * one to the front of the buffer. Returns 0 if the connection is gone. */
+static int web_server_conn_finish(struct web_server* server, struct web_conn* conn) {
+    size_t rest = conn->in_len - conn->request_len;
+
+    if (conn->upgrade) {
+        web_server_conn_upgrade(server, conn);
+        return 0;
+    }
+    if (!conn->responded || !conn->keep_alive) {
+        web_server_conn_close(server, conn);
+        return 0;
+    }
+
+    web_buf_clear(&conn->head);
+    web_server_response_reset(&conn->response);
+    conn->responded = conn->parsed = 0;
+    conn->out_sent = 0;
+    if (conn->file_fd >= 0) {
+        close(conn->file_fd);
+        conn->file_fd = -1;
+    }
+    memmove(conn->in, conn->in + conn->request_len, rest);
+    conn->in_len = rest;
+    conn->in[rest] = '\0';
+    conn->scanned = conn->header_len = conn->request_len = 0;
+    conn->content_length = -1;
+    conn->state = WEB_CONN_READING;
+    conn->idle_since_ms = web_server_now_ms();
+    conn->deadline_ms = conn->idle_since_ms +
+        (rest > 0 ? WEB_SERVER_READ_TIMEOUT_MS : WEB_SERVER_KEEPALIVE_TIMEOUT_MS);
+    return 1;
+}
+
+/* Read what has arrived, until the socket is drained or the buffer full.
+ * A request has WEB_SERVER_READ_TIMEOUT_MS from its first byte (or from the
+ * accept, for a connection's first) to arrive whole; later bytes do not
+ * extend it, so a client trickling a byte at a time cannot hold the slot.
+ * Returns 0 if the connection failed and has been closed. */
+static int web_server_conn_receive(struct web_server* server, struct web_conn* conn) {
+    size_t before = conn->in_len;
+
+    while (conn->in_len < sizeof(conn->in) - 1 && !conn->eof) {
+        ssize_t n = read(conn->fd, conn->in + conn->in_len,
+                         sizeof(conn->in) - 1 - conn->in_len);
+        if (n > 0) {
+            conn->in_len += (size_t)n;
+            continue;
+        }
+        if (n == 0) {
+            conn->eof = 1;
+            break;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
+        web_server_conn_close(server, conn);
+        return 0;
+    }
+    if (conn->in_len > before) {
+        conn->in[conn->in_len] = '\0';
+        if (before == 0 && conn->requests > 0) {
+            conn->deadline_ms = web_server_now_ms() + WEB_SERVER_READ_TIMEOUT_MS;
+        }
+    }
+    return 1;
+}
+
+/* Whether to serve what the buffer holds: a whole request, or as much of one
+ * as will ever come -- a full buffer is handled as it is, its body cut
+ * short; so is whatever a client sent before closing its end */
+static int web_server_request_ready(struct web_conn* conn) {
+    return web_server_request_complete(conn) || conn->in_len == sizeof(conn->in) - 1 ||
+           (conn->eof && conn->in_len > 0);
+}
+
+static void web_server_conn_respond(struct web_conn* conn) {
+    conn->state = WEB_CONN_WRITING;
+    conn->deadline_ms = web_server_now_ms() + WEB_SERVER_WRITE_TIMEOUT_MS;
+}
+
+/* Serve the request at the front of the buffer: answer it here, or hand it
+ * to a worker */
+static void web_server_conn_dispatch(struct web_server* server, struct web_conn* conn) {
+    int complete = web_server_request_complete(conn);
+    int status = complete ? web_server_body_status(conn) : 0;
+
+    conn->requests++;
+    __atomic_add_fetch(&server->requests_total, 1, __ATOMIC_RELAXED);
+    if (status != 0) {
+        /* Without its body's length there is no telling where the next
+         * request starts, so the connection closes after the error */
+        conn->request_len = conn->header_len;
+        conn->keep_alive = 0;
+        conn->parsed = 0;
+        conn->response.status_code = status;
+        web_server_conn_render(conn);
+        web_server_conn_respond(conn);
+        return;
+    }
+    conn->request_len = complete ?
+        conn->header_len + (conn->content_length > 0 ? (size_t)conn->content_length : 0) :
+        conn->in_len;
+    /* After a request cut short there is no telling where the next starts */
+    conn->keep_alive = complete && conn->requests < WEB_SERVER_KEEPALIVE_MAX &&
+                       web_server_wants_keep_alive(conn->in, conn->header_len);
+
+    /* Parsed once, here; a worker handles it from the same slices */
+    conn->parsed = web_server_parse_request(conn->in, conn->request_len, &conn->request) == 0;
+    if (conn->parsed) {
+        web_server_route_request(server, &conn->request);
+    }
+    if (conn->parsed && web_server_request_blocks(server, &conn->request)) {
+        conn->state = WEB_CONN_WORKING;
+        if (conn_queue_try_push(&server->conn_queue, conn->slot) == 0) {
+            return;
+        }
+        /* Backlog full: shed load rather than grow unboundedly. */
+        logger_warn_with_category("WebServer",
+            "Worker queue full; rejecting request with 503");
+        web_buf_append(&conn->head, web_server_busy, sizeof(web_server_busy) - 1);
+        conn->responded = !conn->head.failed;
+        conn->out_sent = 0;
+        conn->keep_alive = 0;
+        web_server_conn_respond(conn);
+        return;
+    }
+    web_server_conn_handle(server, conn);
+    web_server_conn_respond(conn);
+}
+
+/* Move a connection along as far as it will go: write the response in hand,
+ * then serve the next request in the buffer, reading more when there is
+ * none. Stops when the socket would block, a worker has the request, or the
+ * connection is closed. */
+static void web_server_conn_run(struct web_server* server, struct web_conn* conn) {
+    for (;;) {
+        if (conn->state == WEB_CONN_WRITING) {
+            if (web_server_conn_flush(server, conn) <= 0 ||
+                !web_server_conn_finish(server, conn)) {
+                return;
+            }
+        }
+        if (!web_server_request_ready(conn)) {
+            if (!web_server_conn_receive(server, conn)) {
+                return;
+            }
+            if (!web_server_request_ready(conn)) {
+                if (conn->eof) {
+                    web_server_conn_close(server, conn);
+                }
+                return;
+            }
+        }
+        web_server_conn_dispatch(server, conn);
+        if (conn->state == WEB_CONN_WORKING) {
+            return;
+        }
+    }
+}
+
+/* Close the connections that stopped making progress */
+static void web_server_expire(struct web_server* server) {
+    long long now = web_server_now_ms();
+    int i;
+
+    for (i = 0; i < WEB_SERVER_MAX_CONNS; i++) {
+        struct web_conn* conn = server->conns[i];
+        if (conn != NULL && conn->state != WEB_CONN_WORKING && now >= conn->deadline_ms) {
+            web_server_conn_close(server, conn);
+        }
+    }
+}
+
+static void* web_server_loop_func(void* arg) {
+    struct web_server* server = (struct web_server*)arg;
+    struct web_event evs[WEB_LOOP_MAX_FDS];
+    if (!server) return NULL;
+
+    while (!__atomic_load_n(&server->should_stop, __ATOMIC_ACQUIRE)) {
+        /* Asleep until something happens, unless a deadline needs watching */
+        int timeout_ms = server->conn_count > 0 || server->accept_retry ? 500 : -1;
+        int n = web_loop_wait(server, evs, (int)(sizeof(evs) / sizeof(evs[0])), timeout_ms);
+        int i;
+
+        if (n < 0 && errno != EINTR) {
+            logger_errorf_with_category("WebServer", "Event wait failed: %s", strerror(errno));
+        }
+        for (i = 0; i < n; i++) {
+            struct web_conn* conn;
+
+            if (evs[i].tag == WEB_TAG_LISTEN) {
+                web_server_accept_all(server);
+            } else if (evs[i].tag == WEB_TAG_FILES) {
+                web_server_files_changed(server);
+            } else if (evs[i].tag == WEB_TAG_WAKE) {
+                int slot;
+                web_loop_drain_wake(server);
+                while ((slot = conn_queue_try_pop(&server->done_queue)) >= 0) {
+                    if (server->conns[slot] != NULL) {
+                        web_server_conn_respond(server->conns[slot]);
+                        web_server_conn_run(server, server->conns[slot]);
+                    }
+                }
+            } else if ((conn = server->conns[evs[i].tag - WEB_TAG_CONN]) != NULL) {
+                if ((conn->state == WEB_CONN_READING && evs[i].readable) ||
+                    (conn->state == WEB_CONN_WRITING && evs[i].writable)) {
+                    web_server_conn_run(server, conn);
+                }
+            }
+        }
+        if (server->accept_retry && server->conn_count < WEB_SERVER_MAX_CONNS) {
+            web_server_accept_all(server);
+        }
+        if (server->conn_count > 0) {
+            web_server_expire(server);
+        }
+    }
+
+    return NULL;
+}
+
+/* Worker thread: handles the requests that may block, one at a time, then
+ * hands each connection back to the loop to write the response. Multiple
+ * workers run concurrently, so a slow or expensive request only occupies its
+ * own worker. */
+static void* web_server_worker_func(void* arg) {
+    struct web_server* server = (struct web_server*)arg;
+    if (!server) return NULL;
+
+    for (;;) {
+        int slot = conn_queue_pop(&server->conn_queue);
+        if (slot < 0) {
+            break; /* Queue closed and drained: shut the worker down. */
+        }
+        web_server_conn_handle(server, server->conns[slot]);
+        conn_queue_try_push(&server->done_queue, slot);
+        web_loop_wake(server);
+    }
+
+    return NULL;
+}
+
 /* WebServer creation and destruction */
 struct web_server* web_server_create(int port) {
     int i;
@@ -134,6 +1461,10 @@ struct web_server* web_server_create(int port) {
     server->should_stop = 0;
     server->paused = 0;
     server->server_fd = -1;
+    server->loop_fd = -1;
+    server->wake_fd = -1;
+    server->wake_wr_fd = -1;
+    server->files_fd = -1;
     server->route_count = 0;
     server->static_count = 0;
     server->websocket_count = 0;
@@ -145,8 +1476,24 @@ struct web_server* web_server_create(int port) {
         web_server_free(server);
         return NULL;
     }
+    /* Every connection can be back from a worker at once, so this never fills */
+    if (conn_queue_init(&server->done_queue, WEB_SERVER_MAX_CONNS) != 0) {
+        logger_error_with_category("WebServer", "Failed to init connection queue");
+        conn_queue_destroy(&server->conn_queue);
+        web_server_free(server);
+        return NULL;
+    }
     if (pthread_mutex_init(&server->state_mutex, NULL) != 0) {
         logger_error_with_category("WebServer", "Failed to init state mutex");
+        conn_queue_destroy(&server->done_queue);
+        conn_queue_destroy(&server->conn_queue);
+        web_server_free(server);
+        return NULL;
+    }
+    if (web_router_init(&server->router) != 0) {
+        logger_error_with_category("WebServer", "Failed to init router");
+        pthread_mutex_destroy(&server->state_mutex);
+        conn_queue_destroy(&server->done_queue);
         conn_queue_destroy(&server->conn_queue);
         web_server_free(server);
         return NULL;
@@ -161,15 +1508,33 @@ struct web_server* web_server_create(int port) {
 }
 
 void web_server_destroy(struct web_server* server) {
+    int i;
     if (!server) return;
     
     web_server_stop(server);
+    for (i = 0; i < server->static_count; i++) {
+        web_server_free(server->static_files[i]);
+    }
+    web_router_destroy(&server->router);
+    web_server_free(server->routes);
     conn_queue_destroy(&server->conn_queue);
+    conn_queue_destroy(&server->done_queue);
     pthread_mutex_destroy(&server->state_mutex);
     web_server_free(server);
 }
 
 /* WebServer control functions */
+
+/* Close the listening socket, the event loop's fds and the cached files */
+static void web_server_close_sockets(struct web_server* server) {
+    web_server_files_unload(server);
+    web_loop_close(server);
+    if (server->server_fd >= 0) {
+        close(server->server_fd);
+        server->server_fd = -1;
+    }
+}
+
 void web_server_start(struct web_server* server) {
     if (!server || server->running) return;
     
@@ -181,8 +1546,24 @@ void web_server_start(struct web_server* server) {
     
     /* Initialize server socket */
     web_server_init_socket(server);
+    if (server->server_fd < 0) {
+        server->running = 0;
+        return;
+    }
+
+    if (web_loop_open(server) != 0 ||
+        web_loop_add(server, server->server_fd, WEB_TAG_LISTEN) != 0 ||
+        web_loop_add(server, server->wake_fd, WEB_TAG_WAKE) != 0 ||
+        (server->files_fd >= 0 &&
+         web_loop_add(server, server->files_fd, WEB_TAG_FILES) != 0)) {
+        logger_errorf_with_category("WebServer", "Failed to set up event loop: %s",
+                                    strerror(errno));
+        server->running = 0;
+        web_server_close_sockets(server);
+        return;
+    }
     
-    /* Start worker pool before the accept thread so a connection is never
+    /* Start worker pool before the event loop so a request is never
      * enqueued with no one to service it. */
     server->worker_count = 0;
     {
@@ -199,15 +1580,12 @@ void web_server_start(struct web_server* server) {
     if (server->worker_count == 0) {
         logger_error_with_category("WebServer", "No worker threads started; aborting web server");
         server->running = 0;
-        if (server->server_fd >= 0) {
-            close(server->server_fd);
-            server->server_fd = -1;
-        }
+        web_server_close_sockets(server);
         return;
     }
 
-    /* Start the accept thread */
-    if (pthread_create(&server->server_thread, NULL, web_server_thread_func, server) != 0) {
+    /* Start the event loop */
+    if (pthread_create(&server->server_thread, NULL, web_server_loop_func, server) != 0) {
         logger_error_with_category("WebServer", "Failed to create server thread");
         /* Unwind the workers we just started. */
         conn_queue_close(&server->conn_queue);
@@ -219,23 +1597,22 @@ void web_server_start(struct web_server* server) {
         }
         server->worker_count = 0;
         server->running = 0;
-        if (server->server_fd >= 0) {
-            close(server->server_fd);
-            server->server_fd = -1;
-        }
+        web_server_close_sockets(server);
     }
 }
 
 void web_server_stop(struct web_server* server) {
+    int i;
     if (!server || !server->running) return;
     
-    server->should_stop = 1;
+    __atomic_store_n(&server->should_stop, 1, __ATOMIC_RELEASE);
 
-    /* Stop accepting first: the accept thread sees should_stop and returns. */
+    /* Stop the event loop first: woken, it sees should_stop and returns. */
+    web_loop_wake(server);
     pthread_join(server->server_thread, NULL);
 
     /* Then drain the worker pool: close the queue so blocked workers wake and
-     * exit once any remaining queued connections are serviced. */
+     * exit once any remaining queued requests are handled. */
     conn_queue_close(&server->conn_queue);
     {
         int w;
@@ -245,13 +1622,18 @@ void web_server_stop(struct web_server* server) {
     }
     server->worker_count = 0;
 
-    server->running = 0;
-
-    if (server->server_fd >= 0) {
-        close(server->server_fd);
-        server->server_fd = -1;
+    /* Nothing else touches the connections now */
+    for (i = 0; i < WEB_SERVER_MAX_CONNS; i++) {
+        if (server->conns[i] != NULL) {
+            web_server_conn_close(server, server->conns[i]);
+        }
+    }
+    while (conn_queue_try_pop(&server->done_queue) >= 0) {
     }
 
+    server->running = 0;
+    web_server_close_sockets(server);
+
     logger_info_with_category("WebServer", "Web server stopped");
 }
 
@@ -281,6 +1663,16 @@ void web_server_get_conn_stats(struct web_server* server, struct conn_queue_stat
     conn_queue_get_stats(server ? &server->conn_queue : NULL, out);
 }
 
+void web_server_get_traffic(struct web_server* server, struct web_server_traffic* out) {
+    if (!out) return;
+    if (!server) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    out->connections = __atomic_load_n(&server->connections_total, __ATOMIC_RELAXED);
+    out->requests = __atomic_load_n(&server->requests_total, __ATOMIC_RELAXED);
+}
+
 void web_server_set_port(struct web_server* server, int port) {
     if (!server) return;
     
@@ -296,16 +1688,68 @@ int web_server_get_port(const struct web_server* server) {
 }
 
 /* Route management */
-void web_server_add_route(struct web_server* server, const char* method, const char* path, route_handler_t handler) {
-    int idx;
-    if (!server || !method || !path || !handler) return;
-    if (server->route_count >= 32) return; /* Max routes reached */
 
+/* The route for method and path: the one already there, or a new one added
+ * to routes[] and the router. NULL on a malformed path or out of memory. */
+static struct web_route* web_server_route_slot(struct web_server* server, const char* method,
+                                               const char* path) {
+    int idx = web_router_find(&server->router, method, path);
+
+    if (idx >= 0) {
+        return &server->routes[idx];
+    }
+    if (server->route_count == server->route_capacity) {
+        int capacity = server->route_capacity > 0 ? server->route_capacity * 2 : 16;
+        struct web_route* routes =
+            (struct web_route*)realloc(server->routes, (size_t)capacity * sizeof(*routes));
+        if (!routes) return NULL;
+        server->routes = routes;
+        server->route_capacity = capacity;
+    }
     idx = server->route_count;
-    web_server_strcpy_safe(server->route_methods[idx], method, sizeof(server->route_methods[idx]));
-    web_server_strcpy_safe(server->route_paths[idx], path, sizeof(server->route_paths[idx]));
-    server->route_handlers[idx] = handler;
+    if (web_router_add(&server->router, method, path, idx) != 0) {
+        char msg[320];
+        snprintf(msg, sizeof(msg), "Cannot add route %s %s", method, path);
+        logger_warn_with_category("WebServer", msg);
+        return NULL;
+    }
     server->route_count++;
+    return &server->routes[idx];
+}
+
+static void web_server_add_handler_route(struct web_server* server, const char* method,
+                                         const char* path, route_handler_t handler,
+                                         int blocking) {
+    struct web_route* route;
+    if (!server || !method || !path || !handler) return;
+
+    route = web_server_route_slot(server, method, path);
+    if (!route) return;
+    route->handler = handler;
+    route->blocking = blocking;
+    route->static_idx = -1;
+}
+
+void web_server_add_route(struct web_server* server, const char* method, const char* path, route_handler_t handler) {
+    web_server_add_handler_route(server, method, path, handler, 0);
+}
+
+void web_server_add_blocking_route(struct web_server* server, const char* method, const char* path, route_handler_t handler) {
+    web_server_add_handler_route(server, method, path, handler, 1);
+}
+
+/* Static and file routes answer any method, as they always have */
+static void web_server_add_static_slot(struct web_server* server, const char* path, int idx) {
+    struct web_route* route = web_server_route_slot(server, "*", path);
+    if (!route) {
+        web_server_free(server->static_files[idx]);
+        server->static_files[idx] = NULL;
+        return;
+    }
+    route->handler = NULL;
+    route->blocking = 0;
+    route->static_idx = idx;
+    server->static_count++;
 }
 
 void web_server_add_static_route(struct web_server* server, const char* path, const char* content, const char* content_type) {
@@ -318,7 +1762,7 @@ void web_server_add_static_route(struct web_server* server, const char* path, co
     web_server_strcpy_safe(server->static_contents[idx], content, sizeof(server->static_contents[idx]));
     web_server_strcpy_safe(server->static_content_types[idx], content_type, sizeof(server->static_content_types[idx]));
     server->static_is_file[idx] = 0;  /* Using content, not file */
-    server->static_count++;
+    web_server_add_static_slot(server, path, idx);
 }
 
 void web_server_add_file_route(struct web_server* server, const char* path, const char* file_path, const char* content_type) {
@@ -331,191 +1775,252 @@ void web_server_add_file_route(struct web_server* server, const char* path, cons
     web_server_strcpy_safe(server->static_file_paths[idx], file_path, sizeof(server->static_file_paths[idx]));
     web_server_strcpy_safe(server->static_content_types[idx], content_type, sizeof(server->static_content_types[idx]));
     server->static_is_file[idx] = 1;  /* Using file path */
-    server->static_count++;
+    server->static_files[idx] = (struct web_file*)web_server_malloc(sizeof(struct web_file));
+    if (!server->static_files[idx]) return;
+    memset(server->static_files[idx], 0, sizeof(struct web_file));
+    server->static_files[idx]->watch = -1;
+    server->static_files[idx]->plain.fd = -1;
+    server->static_files[idx]->gz.fd = -1;
+    web_server_add_static_slot(server, path, idx);
 }
 
 /* HTTP parsing functions */
-struct http_request web_server_parse_request(const char* raw_request) {
-    struct http_request request;
-    const char* line_start;
-    const char* line_end;
-    char request_line[512];
-    size_t line_len;
-    char* cr_pos;
-    char* query_pos;
-    const char* header_start;
-    memset(&request, 0, sizeof(request));
-
-    if (!raw_request) return request;
-
-    /* Parse request line */
-    line_start = raw_request;
-    line_end = strchr(line_start, '\n');
-    if (!line_end) return request;
-
-    /* Extract method and path */
-    line_len = line_end - line_start;
-    if (line_len >= sizeof(request_line)) line_len = sizeof(request_line) - 1;
-
-    memcpy(request_line, line_start, line_len);
-    request_line[line_len] = '\0';
-
-    /* Remove \r if present */
-    cr_pos = strchr(request_line, '\r');
-    if (cr_pos) *cr_pos = '\0';
-
-    /* Parse method and path */
-    if (sscanf(request_line, "%15s %255s", request.method, request.path) != 2) {
-        return request;
-    }
-
-    /* Remove query parameters from path */
-    query_pos = strchr(request.path, '?');
-    if (query_pos) {
-        *query_pos = '\0';
-        web_server_parse_query_string(query_pos + 1, &request);
-    }
-
-    /* Parse headers */
-    header_start = line_end + 1;
-    while (header_start && *header_start != '\0') {
-        const char* header_end;
-        char header_line[512];
-        size_t header_len;
-        char* cr_pos;
-        char* colon_pos;
-        header_end = strchr(header_start, '\n');
-        if (!header_end) break;
-
-        /* Check for end of headers (empty line) */
-        if (header_end == header_start + 1) {
+static struct http_slice web_server_slice(size_t start, size_t end) {
+    struct http_slice slice;
+    slice.offset = start;
+    slice.len = end - start;
+    return slice;
+}
+
+/* Narrow buf[*start, *end) past spaces and tabs, and a line's '\r' */
+static void web_server_trim(const char* buf, size_t* start, size_t* end) {
+    while (*start < *end && (buf[*start] == ' ' || buf[*start] == '\t')) (*start)++;
+    while (*end > *start && (buf[*end - 1] == ' ' || buf[*end - 1] == '\t' ||
+                             buf[*end - 1] == '\r')) (*end)--;
+}
+
+/* Split the query string into its key=value pairs; a pair without '=' is
+ * skipped, and any past the sixteenth */
+static void web_server_parse_query(struct http_request* request) {
+    const char* buf = request->buf;
+    size_t pos = request->query.offset;
+    size_t end = pos + request->query.len;
+
+    while (pos < end && request->query_count < 16) {
+        const char* amp = memchr(buf + pos, '&', end - pos);
+        size_t pair_end = amp ? (size_t)(amp - buf) : end;
+        const char* eq = memchr(buf + pos, '=', pair_end - pos);
+
+        if (eq) {
+            request->query_keys[request->query_count] =
+                web_server_slice(pos, (size_t)(eq - buf));
+            request->query_values[request->query_count] =
+                web_server_slice((size_t)(eq - buf) + 1, pair_end);
+            request->query_count++;
+        }
+        pos = pair_end + 1;
+    }
+}
+
+/* The request is not copied: method, path, query pairs, headers and body are
+ * recorded as slices of buf, which must stay put while they are in use.
+ * Headers past the 32nd are ignored. */
+int web_server_parse_request(const char* buf, size_t len, struct http_request* request) {
+    const char* eol;
+    size_t line_end;
+    size_t pos;
+    size_t sp;
+    const char* query;
+
+    if (!buf || !request) return -1;
+    request->buf = buf;
+    request->method = request->path = request->query = request->body = web_server_slice(0, 0);
+    request->header_count = 0;
+    request->query_count = 0;
+    request->route = -1;
+    request->param_count = 0;
+
+    /* Request line: method, target, version */
+    eol = memchr(buf, '\n', len);
+    if (!eol) return -1;
+    line_end = (size_t)(eol - buf);
+    for (sp = 0; sp < line_end && buf[sp] != ' '; sp++) {
+    }
+    if (sp == 0 || sp == line_end) return -1;
+    request->method = web_server_slice(0, sp);
+    pos = sp + 1;
+    for (sp = pos; sp < line_end && buf[sp] != ' ' && buf[sp] != '\r'; sp++) {
+    }
+    if (sp == pos) return -1;
+    query = memchr(buf + pos, '?', sp - pos);
+    if (query) {
+        request->path = web_server_slice(pos, (size_t)(query - buf));
+        request->query = web_server_slice((size_t)(query - buf) + 1, sp);
+        web_server_parse_query(request);
+    } else {
+        request->path = web_server_slice(pos, sp);
+    }
+
+    /* Headers, up to the blank line */
+    pos = line_end + 1;
+    while (pos < len) {
+        size_t start = pos;
+        size_t end;
+        const char* colon;
+
+        eol = memchr(buf + pos, '\n', len - pos);
+        if (!eol) {
+            pos = len;  /* cut off mid-header: there is no body */
             break;
         }
+        end = (size_t)(eol - buf);
+        pos = end + 1;
+        if (end == start || (end == start + 1 && buf[start] == '\r')) {
+            break;
+        }
+
+        colon = memchr(buf + start, ':', end - start);
+        if (colon && request->header_count < 32) {
+            size_t key_start = start, key_end = (size_t)(colon - buf);
+            size_t value_start = key_end + 1, value_end = end;
 
-        header_len = header_end - header_start;
-        if (header_len >= sizeof(header_line)) header_len = sizeof(header_line) - 1;
+            web_server_trim(buf, &key_start, &key_end);
+            web_server_trim(buf, &value_start, &value_end);
+            request->header_keys[request->header_count] = web_server_slice(key_start, key_end);
+            request->header_values[request->header_count] = web_server_slice(value_start, value_end);
+            request->header_count++;
+        }
+    }
 
-        memcpy(header_line, header_start, header_len);
-        header_line[header_len] = '\0';
+    request->body = web_server_slice(pos < len ? pos : len, len);
+    return 0;
+}
 
-        /* Remove \r if present */
-        cr_pos = strchr(header_line, '\r');
-        if (cr_pos) *cr_pos = '\0';
+int web_server_slice_equals(const struct http_request* request, struct http_slice slice,
+                            const char* text) {
+    return strlen(text) == slice.len &&
+           memcmp(request->buf + slice.offset, text, slice.len) == 0;
+}
 
-        /* Parse header key:value */
-        colon_pos = strchr(header_line, ':');
-        if (colon_pos && request.header_count < 32) {
-            char* key;
-            char* value;
-            char* key_end;
-            char* value_end;
-            *colon_pos = '\0';
-            key = header_line;
-            value = colon_pos + 1;
+static int web_server_slice_equals_nocase(const struct http_request* request,
+                                          struct http_slice slice, const char* text) {
+    const char* p = request->buf + slice.offset;
+    size_t i;
 
-            /* Trim whitespace */
-            while (*key == ' ' || *key == '\t') key++;
-            while (*value == ' ' || *value == '\t') value++;
+    for (i = 0; i < slice.len; i++) {
+        if (text[i] == '\0' ||
+            tolower((unsigned char)p[i]) != tolower((unsigned char)text[i])) {
+            return 0;
+        }
+    }
+    return text[i] == '\0';
+}
 
-            key_end = key + strlen(key) - 1;
-            while (key_end > key && (*key_end == ' ' || *key_end == '\t' || *key_end == '\r')) {
-                *key_end = '\0';
-                key_end--;
-            }
+/* A slice as a string, cut short to fit */
+static void web_server_slice_copy(const struct http_request* request, struct http_slice slice,
+                                  char* out, size_t size) {
+    size_t len = slice.len < size - 1 ? slice.len : size - 1;
+    memcpy(out, request->buf + slice.offset, len);
+    out[len] = '\0';
+}
 
-            value_end = value + strlen(value) - 1;
-            while (value_end > value && (*value_end == ' ' || *value_end == '\t' || *value_end == '\r')) {
-                *value_end = '\0';
-                value_end--;
-            }
-            
-            web_server_strcpy_safe(request.header_keys[request.header_count], key, sizeof(request.header_keys[request.header_count]));
-            web_server_strcpy_safe(request.header_values[request.header_count], value, sizeof(request.header_values[request.header_count]));
-            request.header_count++;
+const char* web_server_request_header(const struct http_request* request, const char* name,
+                                      size_t* len) {
+    int i;
+    for (i = 0; i < request->header_count; i++) {
+        if (web_server_slice_equals_nocase(request, request->header_keys[i], name)) {
+            if (len) *len = request->header_values[i].len;
+            return request->buf + request->header_values[i].offset;
         }
-        
-        header_start = header_end + 1;
-    }
-    
-    /* Parse body */
-    if (header_start && *header_start != '\0') {
-        size_t body_len = strlen(header_start);
-        if (body_len >= sizeof(request.body)) body_len = sizeof(request.body) - 1;
-        memcpy(request.body, header_start, body_len);
-        request.body[body_len] = '\0';
     }
-    
-    return request;
-}
-
-void web_server_parse_query_string(const char* query, struct http_request* request) {
-    const char* start;
-    if (!query || !request) return;
-
-    start = query;
-    while (*start && request->query_count < 16) {
-        const char* end;
-        char pair[256];
-        size_t pair_len;
-        char* eq_pos;
-        end = strchr(start, '&');
-        if (!end) end = start + strlen(start);
-
-        pair_len = end - start;
-        if (pair_len >= sizeof(pair)) pair_len = sizeof(pair) - 1;
-
-        memcpy(pair, start, pair_len);
-        pair[pair_len] = '\0';
-
-        eq_pos = strchr(pair, '=');
-        if (eq_pos) {
-            char* key;
-            char* value;
-            char decoded_key[64];
-            char decoded_value[256];
-            *eq_pos = '\0';
-            key = pair;
-            value = eq_pos + 1;
-
-            /* URL decode */
-            web_server_url_decode(key, decoded_key, sizeof(decoded_key));
-            web_server_url_decode(value, decoded_value, sizeof(decoded_value));
-            
-            web_server_strcpy_safe(request->query_keys[request->query_count], decoded_key, sizeof(request->query_keys[request->query_count]));
-            web_server_strcpy_safe(request->query_values[request->query_count], decoded_value, sizeof(request->query_values[request->query_count]));
-            request->query_count++;
+    return NULL;
+}
+
+/* A header's value as a string, for the few that are searched; 0 (and an
+ * empty string) if the request has none */
+static int web_server_request_header_copy(const struct http_request* request, const char* name,
+                                          char* out, size_t size) {
+    int i;
+    for (i = 0; i < request->header_count; i++) {
+        if (web_server_slice_equals_nocase(request, request->header_keys[i], name)) {
+            web_server_slice_copy(request, request->header_values[i], out, size);
+            return 1;
         }
-        
-        if (*end == '\0') break;
-        start = end + 1;
     }
+    out[0] = '\0';
+    return 0;
 }
 
-char* web_server_url_decode(const char* str, char* result, size_t result_size) {
+/* URL-decode src[0, len) into result: %XX escapes, and '+' for space if
+ * plus_is_space (in a query string; in a path it is itself) */
+static char* web_server_url_decode_n(const char* src, size_t len, char* result, size_t result_size,
+                                     int plus_is_space) {
     size_t i, j;
-    if (!str || !result || result_size == 0) return NULL;
+    if (!src || !result || result_size == 0) return NULL;
 
     j = 0;
-    for (i = 0; str[i] != '\0' && j < result_size - 1; i++) {
-        if (str[i] == '%' && i + 2 < strlen(str)) {
-            char hex[3] = {str[i+1], str[i+2], '\0'};
-            int value = strtol(hex, NULL, 16);
+    for (i = 0; i < len && j < result_size - 1; i++) {
+        if (src[i] == '%' && i + 2 < len &&
+            isxdigit((unsigned char)src[i + 1]) && isxdigit((unsigned char)src[i + 2])) {
+            char hex[3];
+            int value;
+            hex[0] = src[i + 1];
+            hex[1] = src[i + 2];
+            hex[2] = '\0';
+            value = (int)strtol(hex, NULL, 16);
             if (value > 0) {
                 result[j++] = (char)value;
                 i += 2;
             } else {
-                result[j++] = str[i];
+                result[j++] = src[i];
             }
-        } else if (str[i] == '+') {
+        } else if (src[i] == '+' && plus_is_space) {
             result[j++] = ' ';
         } else {
-            result[j++] = str[i];
+            result[j++] = src[i];
         }
     }
     result[j] = '\0';
     return result;
 }
 
+char* web_server_url_decode(const char* str, char* result, size_t result_size) {
+    if (!str) return NULL;
+    return web_server_url_decode_n(str, strlen(str), result, result_size, 1);
+}
+
+/* Query values are decoded only when asked for, into the caller's buffer */
+int web_server_request_query(const struct http_request* request, const char* key,
+                             char* value, size_t size) {
+    int i;
+    for (i = 0; i < request->query_count; i++) {
+        char decoded_key[64];
+        web_server_url_decode_n(request->buf + request->query_keys[i].offset,
+                                request->query_keys[i].len, decoded_key, sizeof(decoded_key), 1);
+        if (strcmp(decoded_key, key) == 0) {
+            web_server_url_decode_n(request->buf + request->query_values[i].offset,
+                                    request->query_values[i].len, value, size, 1);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int web_server_request_param(const struct http_request* request, const char* name,
+                             char* value, size_t size) {
+    int i;
+    if (!request || !name || !value) return 0;
+
+    for (i = 0; i < request->param_count; i++) {
+        if (strcmp(request->param_names[i], name) == 0) {
+            web_server_url_decode_n(request->buf + request->param_values[i].offset,
+                                    request->param_values[i].len, value, size, 0);
+            return 1;
+        }
+    }
+    return 0;
+}
+
 /* Socket initialization */
 void web_server_init_socket(struct web_server* server) {
     int opt;
@@ -547,7 +2052,7 @@ void web_server_init_socket(struct web_server* server) {
         return;
     }
     
-    if (listen(server->server_fd, 10) < 0) {
+    if (listen(server->server_fd, WEB_SERVER_MAX_CONNS) < 0) {
         logger_error_with_category("WebServer", "Failed to listen on socket");
         close(server->server_fd);
         server->server_fd = -1;
@@ -562,406 +2067,134 @@ void web_server_init_socket(struct web_server* server) {
     logger_info_with_category("WebServer", start_msg);
 }
 
-/* Short reply sent when the worker queue is saturated, so a flooded server
- * sheds load with a proper 503 instead of silently dropping the connection. */
-static void web_server_send_busy(int client_fd) {
-    static const char* busy =
-        "HTTP/1.1 503 Service Unavailable\r\n"
-        "Content-Type: application/json\r\n"
-        "Retry-After: 1\r\n"
-        "Connection: close\r\n"
-        "Content-Length: 23\r\n"
-        "\r\n"
-        "{\"error\":\"Server busy\"}";
-    send(client_fd, busy, strlen(busy), 0);
-}
-
-/* Accept thread: accepts connections and hands each off to a worker via the
- * connection queue. Accepting stays cheap so the listen backlog drains quickly
- * even while workers are busy with slow requests (#125). */
-void* web_server_thread_func(void* arg) {
-    struct web_server* server = (struct web_server*)arg;
-    if (!server) return NULL;
-
-    while (!server->should_stop) {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-        struct timeval tv;
-        int client_fd = accept(server->server_fd, (struct sockaddr*)&client_addr, &client_len);
-
-        if (client_fd >= 0) {
-            if (conn_queue_try_push(&server->conn_queue, client_fd) != 0) {
-                /* Backlog full: shed load rather than grow unboundedly. */
-                logger_warn_with_category("WebServer",
-                    "Connection queue full; rejecting client with 503");
-                web_server_send_busy(client_fd);
-                close(client_fd);
-            }
-        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
-            /* Log error if it's not just a non-blocking accept */
-            char error_msg[256];
-            snprintf(error_msg, sizeof(error_msg), "Accept failed with error: %d", errno);
-            logger_error_with_category("WebServer", error_msg);
-        }
-
-        /* Small sleep to prevent busy waiting */
-        /* Use select() for C89-compatible microsecond sleep */
-        tv.tv_sec = 0;
-        tv.tv_usec = 1000; /* 1ms */
-        select(0, NULL, NULL, NULL, &tv);
-    }
-
-    return NULL;
-}
-
-/* Worker thread: services one accepted connection at a time, pulled from the
- * shared queue. Multiple workers run concurrently, so a slow or expensive
- * request only occupies its own worker instead of blocking every client. */
-static void* web_server_worker_func(void* arg) {
-    struct web_server* server = (struct web_server*)arg;
-    if (!server) return NULL;
-
-    for (;;) {
-        int client_fd = conn_queue_pop(&server->conn_queue);
-        if (client_fd < 0) {
-            break; /* Queue closed and drained: shut the worker down. */
-        }
-        web_server_handle_client(server, client_fd);
-    }
-
-    return NULL;
-}
-
-/* Case-insensitively scan request text line-by-line for the Content-Length
- * header and return its value, or -1 if absent/malformed. Scanning per-line
- * (not a raw substring search) avoids matching the token inside a body. */
-static long web_server_parse_content_length(const char* buf) {
-    const char* p = buf;
-    while (p && *p) {
-        const char* h = p;
-        const char* n = "content-length:";
-        while (*n && *h && (char)tolower((unsigned char)*h) == *n) {
-            h++;
-            n++;
-        }
-        if (*n == '\0') {
-            while (*h == ' ' || *h == '\t') h++;
-            return strtol(h, NULL, 10);
-        }
-        p = strchr(p, '\n');
-        if (p) p++;
-    }
-    return -1;
-}
-
-void web_server_handle_client(struct web_server* server, int client_fd) {
-    char buffer[4096];
-    ssize_t bytes_read;
-    size_t total = 0;
-    char* header_end = NULL;
-    long content_length = -1;
-    struct timeval tv;
-    if (!server) {
-        close(client_fd);
-        return;
-    }
-
-    /* A request's headers and body can arrive in separate TCP segments, so a
-     * single read() often returns only the headers with the body still in
-     * flight. That left POST bodies empty — the cause of /api/control
-     * intermittently reporting "Unknown action: unknown". Read until the whole
-     * body (per Content-Length) has arrived. A receive timeout keeps a slow or
-     * stalled client from hanging the single-threaded accept loop. */
-    tv.tv_sec = 2;
-    tv.tv_usec = 0;
-    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-
-    memset(buffer, 0, sizeof(buffer));
-    while (total < sizeof(buffer) - 1) {
-        bytes_read = read(client_fd, buffer + total, sizeof(buffer) - 1 - total);
-        if (bytes_read <= 0) {
-            break;   /* EOF, error, or receive timeout */
-        }
-        total += (size_t)bytes_read;
-        buffer[total] = '\0';
-
-        if (!header_end) {
-            header_end = strstr(buffer, "\r\n\r\n");
-            if (header_end) {
-                header_end += 4;
-            } else {
-                char* alt = strstr(buffer, "\n\n");
-                if (alt) header_end = alt + 2;
-            }
-            if (header_end) {
-                content_length = web_server_parse_content_length(buffer);
-            }
-        }
-        if (header_end) {
-            /* No body expected (e.g. GET): headers alone are enough. */
-            if (content_length < 0) {
-                break;
-            }
-            /* Stop once the declared body length has been received. */
-            if ((size_t)(buffer + total - header_end) >= (size_t)content_length) {
-                break;
-            }
-        }
-    }
-
-    if (total > 0) {
-        struct http_request parsed_request = web_server_parse_request(buffer);
-        struct http_response response;
-
-        /* Get client IP for rate limiting */
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-        /* inet_ntop (not inet_ntoa) so concurrent workers don't race on a
-         * shared static buffer. */
-        if (getpeername(client_fd, (struct sockaddr*)&client_addr, &client_len) == 0 &&
-            inet_ntop(AF_INET, &client_addr.sin_addr, parsed_request.client_ip,
-                      sizeof(parsed_request.client_ip)) != NULL) {
-            /* client_ip populated by inet_ntop */
-        } else {
-            web_server_strcpy_safe(parsed_request.client_ip, "unknown", sizeof(parsed_request.client_ip));
-        }
-
-        response = web_server_process_request(server, &parsed_request);
-        
-        if (response.status_code == 101) {
-            /* WebSocket upgrade — send handshake then keep fd open */
-            char* response_str = web_server_serialize_response(&response);
-            if (response_str) {
-                send(client_fd, response_str, strlen(response_str), 0);
-                web_server_free(response_str);
-            }
-            pthread_mutex_lock(&server->state_mutex);
-            if (server->websocket_count < 32) {
-                int total;
-                server->websocket_connections[server->websocket_count++] = client_fd;
-                total = server->websocket_count;
-                pthread_mutex_unlock(&server->state_mutex);
-                logger_infof_with_category("WebServer",
-                    "WebSocket client connected (fd=%d, total=%d)",
-                    client_fd, total);
-            } else {
-                pthread_mutex_unlock(&server->state_mutex);
-                logger_warn_with_category("WebServer", "Max WebSocket connections reached");
-                close(client_fd);
-            }
-            return;
-        } else if (response.is_streaming) {
-            web_server_send_streaming_response(client_fd, &response);
-        } else {
-            char* response_str = web_server_serialize_response(&response);
-            if (response_str) {
-                send(client_fd, response_str, strlen(response_str), 0);
-                web_server_free(response_str);
-            }
-        }
-    }
-    
-    close(client_fd);
-}
-
 /* Request processing */
-struct http_response web_server_process_request(struct web_server* server, const struct http_request* request) {
-    struct http_response response;
-    int i;
-    memset(&response, 0, sizeof(response));
-    response.status_code = 200;
-    
+void web_server_process_request(struct web_server* server, const struct http_request* request,
+                                struct http_response* response) {
+    const struct web_route* route;
+    struct web_route_match match;
+
+    if (!response) return;
     if (!server || !request) {
-        response.status_code = 500;
-        return response;
+        response->status_code = 500;
+        return;
     }
     
     /* When paused (e.g. during audio), reject requests (#122) */
     if (server->paused) {
-        response.status_code = 503;
-        web_server_strcpy_safe(response.content_type, "application/json", sizeof(response.content_type));
-        web_server_strcpy_safe(response.body, "{\"error\":\"Server paused for audio\"}", sizeof(response.body));
-        return response;
+        response->status_code = 503;
+        web_server_strcpy_safe(response->content_type, "application/json", sizeof(response->content_type));
+        web_server_response_puts(response, "{\"error\":\"Server paused for audio\"}");
+        return;
     }
     
     /* Apply rate limiting for API endpoints */
-    if (strncmp(request->path, "/api/", 5) == 0) {
-        if (!web_server_check_rate_limit(server, request->client_ip, request->path)) {
-            return web_server_create_rate_limit_response();
+    if (request->path.len >= 5 && memcmp(request->buf + request->path.offset, "/api/", 5) == 0) {
+        char path[256];
+        web_server_slice_copy(request, request->path, path, sizeof(path));
+        if (!web_server_check_rate_limit(server, request->client_ip, path)) {
+            web_server_create_rate_limit_response(response);
+            return;
         }
     }
     
     /* Check for WebSocket upgrade */
     if (web_server_is_websocket_upgrade(request)) {
-        const char *ws_key = NULL;
+        char ws_key[64];
         char accept_key[64];
-        int hi;
-
-        for (hi = 0; hi < request->header_count; hi++) {
-            if (web_server_strcasecmp(request->header_keys[hi], "Sec-WebSocket-Key") == 0) {
-                ws_key = request->header_values[hi];
-                break;
-            }
-        }
 
-        if (ws_key && ws_compute_accept_key(ws_key, accept_key, sizeof(accept_key)) == 0) {
-            response.status_code = 101;
-            web_server_strcpy_safe(response.header_keys[response.header_count], "Upgrade", sizeof(response.header_keys[response.header_count]));
-            web_server_strcpy_safe(response.header_values[response.header_count], "websocket", sizeof(response.header_values[response.header_count]));
-            response.header_count++;
-            web_server_strcpy_safe(response.header_keys[response.header_count], "Connection", sizeof(response.header_keys[response.header_count]));
-            web_server_strcpy_safe(response.header_values[response.header_count], "Upgrade", sizeof(response.header_values[response.header_count]));
-            response.header_count++;
-            web_server_strcpy_safe(response.header_keys[response.header_count], "Sec-WebSocket-Accept", sizeof(response.header_keys[response.header_count]));
-            web_server_strcpy_safe(response.header_values[response.header_count], accept_key, sizeof(response.header_values[response.header_count]));
-            response.header_count++;
+        if (web_server_request_header_copy(request, "Sec-WebSocket-Key", ws_key, sizeof(ws_key)) &&
+            ws_compute_accept_key(ws_key, accept_key, sizeof(accept_key)) == 0) {
+            response->status_code = 101;
+            web_server_response_header(response, "Upgrade", "websocket");
+            web_server_response_header(response, "Connection", "Upgrade");
+            web_server_response_header(response, "Sec-WebSocket-Accept", accept_key);
         }
-        return response;
+        return;
     }
     
-    /* Check static routes first */
-    for (i = 0; i < server->static_count; i++) {
-        if (strcmp(server->static_paths[i], request->path) == 0) {
-            if (server->static_is_file[i]) {
-                /* File route - create streaming response */
-                FILE* file;
-                response.is_streaming = 1;
-                web_server_strcpy_safe(response.file_path, server->static_file_paths[i], sizeof(response.file_path));
-                web_server_strcpy_safe(response.content_type, server->static_content_types[i], sizeof(response.content_type));
-
-                /* Get file size for Content-Length header */
-                file = fopen(response.file_path, "rb");
-                if (file) {
-                    fseek(file, 0, SEEK_END);
-                    response.content_length = ftell(file);
-                    fclose(file);
-                } else {
-                    response.content_length = 0;
-                }
-            } else {
-                /* Content route - use existing behavior */
-                response.is_streaming = 0;
-                web_server_strcpy_safe(response.body, server->static_contents[i], sizeof(response.body));
-                web_server_strcpy_safe(response.content_type, server->static_content_types[i], sizeof(response.content_type));
-            }
-            return response;
+    /* The route was looked up when the request was parsed */
+    if (request->route >= 0 && request->route < server->route_count) {
+        route = &server->routes[request->route];
+        if (route->static_idx < 0) {
+            route->handler(request, response);
+        } else if (server->static_is_file[route->static_idx]) {
+            /* File route - sent from the file cache */
+            web_server_file_response(server, route->static_idx, request, response);
+        } else {
+            /* Content route - use existing behavior */
+            web_server_response_puts(response, server->static_contents[route->static_idx]);
+            web_server_strcpy_safe(response->content_type,
+                                   server->static_content_types[route->static_idx],
+                                   sizeof(response->content_type));
         }
+        return;
     }
-    
-    /* Check dynamic routes */
-    for (i = 0; i < server->route_count; i++) {
-        if (strcmp(server->route_methods[i], request->method) == 0 && 
-            strcmp(server->route_paths[i], request->path) == 0) {
-            return server->route_handlers[i](request);
-        }
+
+    /* A path with routes, just none for this method, is a 405 naming them */
+    if (web_router_match(&server->router, request->buf + request->method.offset,
+                         request->method.len, request->buf + request->path.offset,
+                         request->path.len, &match) == WEB_ROUTER_NO_METHOD) {
+        char allow[128];
+        web_router_allow(&match, allow, sizeof(allow));
+        response->status_code = 405;
+        web_server_response_header(response, "Allow", allow);
+        web_server_strcpy_safe(response->content_type, "application/json", sizeof(response->content_type));
+        web_server_response_puts(response, "{\"error\":\"Method not allowed\"}");
+        return;
     }
     
     /* Default to 404 */
-    return web_server_handle_not_found(request);
+    web_server_handle_not_found(request, response);
 }
 
 int web_server_is_websocket_upgrade(const struct http_request* request) {
-    int i;
-    int has_upgrade = 0, has_connection = 0;
+    char upgrade[32];
+    char connection[128];
     if (!request) return 0;
 
-    for (i = 0; i < request->header_count; i++) {
-        if (web_server_strcasecmp(request->header_keys[i], "Upgrade") == 0) {
-            if (web_server_strcasecmp(request->header_values[i], "websocket") == 0) {
-                has_upgrade = 1;
-            }
-        } else if (web_server_strcasecmp(request->header_keys[i], "Connection") == 0) {
-            if (strstr(request->header_values[i], "Upgrade") != NULL) {
-                has_connection = 1;
-            }
-        }
+    return web_server_request_header_copy(request, "Upgrade", upgrade, sizeof(upgrade)) &&
+           web_server_strcasecmp(upgrade, "websocket") == 0 &&
+           web_server_request_header_copy(request, "Connection", connection, sizeof(connection)) &&
+           strstr(connection, "Upgrade") != NULL;
+}
+
+static const char* web_server_status_text(int status_code) {
+    switch (status_code) {
+        case 101: return "Switching Protocols";
+        case 200: return "OK";
+        case 202: return "Accepted";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 409: return "Conflict";
+        case 413: return "Payload Too Large";
+        case 429: return "Too Many Requests";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default: return "Unknown";
     }
-    
-    return has_upgrade && has_connection;
 }
 
 /* Response serialization */
-char* web_server_serialize_response(const struct http_response* response) {
-    size_t total_size;
-    char* result;
-    char* ptr;
-    size_t remaining;
-    const char* status_text = "OK";
-    int written;
-    int i;
-    size_t body_len;
-    if (!response) return NULL;
-
-    /* Calculate total size needed */
-    total_size = 1024; /* Base size for status line and headers */
-    total_size += strlen(response->body);
-    total_size += response->header_count * 128; /* Space for headers */
-
-    result = (char*)web_server_malloc(total_size);
-    if (!result) return NULL;
-
-    ptr = result;
-    remaining = total_size;
-
-    /* Status line */
-    switch (response->status_code) {
-        case 200: status_text = "OK"; break;
-        case 404: status_text = "Not Found"; break;
-        case 500: status_text = "Internal Server Error"; break;
-        case 101: status_text = "Switching Protocols"; break;
-        case 429: status_text = "Too Many Requests"; break;
-        case 503: status_text = "Service Unavailable"; break;
-        default: status_text = "Unknown"; break;
-    }
-    
-    written = snprintf(ptr, remaining, "HTTP/1.1 %d %s\r\n", response->status_code, status_text);
-    if (written > 0 && (size_t)written < remaining) {
-        ptr += written;
-        remaining -= written;
-    }
+int web_server_serialize_head(const struct http_response* response, struct http_buf* out) {
+    if (!response || !out) return -1;
 
-    /* Headers */
-    for (i = 0; i < response->header_count; i++) {
-        written = snprintf(ptr, remaining, "%s: %s\r\n", 
-                          response->header_keys[i], response->header_values[i]);
-        if (written > 0 && (size_t)written < remaining) {
-            ptr += written;
-            remaining -= written;
-        }
-    }
-    
-    /* Content-Type header if not already set */
-    if (strlen(response->content_type) > 0) {
-        written = snprintf(ptr, remaining, "Content-Type: %s\r\n", response->content_type);
-        if (written > 0 && (size_t)written < remaining) {
-            ptr += written;
-            remaining -= written;
-        }
+    web_buf_printf(out, "HTTP/1.1 %d %s\r\n", response->status_code,
+                   web_server_status_text(response->status_code));
+    if (response->headers.len > 0) {
+        web_buf_append(out, response->headers.data, response->headers.len);
     }
-    
-    /* Content-Length header */
-    written = snprintf(ptr, remaining, "Content-Length: %lu\r\n", (unsigned long)strlen(response->body));
-    if (written > 0 && (size_t)written < remaining) {
-        ptr += written;
-        remaining -= written;
-    }
-    
-    /* Connection header */
-    written = snprintf(ptr, remaining, "Connection: close\r\n\r\n");
-    if (written > 0 && (size_t)written < remaining) {
-        ptr += written;
-        remaining -= written;
+    if (response->content_type[0] != '\0') {
+        web_buf_printf(out, "Content-Type: %s\r\n", response->content_type);
     }
-    
-    /* Body */
-    body_len = strlen(response->body);
-    if (body_len < remaining) {
-        memcpy(ptr, response->body, body_len);
-        ptr += body_len;
-        *ptr = '\0';
+    /* A 304's would have to be the unsent file's */
+    if (response->status_code != 304) {
+        web_buf_printf(out, "Content-Length: %lu\r\n", (unsigned long)
+                       (response->is_streaming ? response->content_length : response->body.len));
     }
-    
-    return result;
+    web_server_format_connection(out, response);
+    return out->failed ? -1 : 0;
 }
 
 /* API route setup */
@@ -971,26 +2204,32 @@ void web_server_setup_api_routes(struct web_server* server) {
     /* API routes */
     web_server_add_route(server, "GET", "/api/status", web_server_handle_api_status);
     web_server_add_route(server, "GET", "/api/metrics", web_server_handle_api_metrics);
+    web_server_add_route(server, "GET", "/api/metrics/history", web_server_handle_api_metrics_history);
     web_server_add_route(server, "GET", "/api/health", web_server_handle_api_health);
     web_server_add_route(server, "GET", "/api/config", web_server_handle_api_config);
     web_server_add_route(server, "GET", "/api/state", web_server_handle_api_state);
-    web_server_add_route(server, "POST", "/api/control", web_server_handle_api_control);
+    /* Control commands wait for the engine's lock, which it holds while it
+     * handles an event */
+    web_server_add_blocking_route(server, "POST", "/api/control", web_server_handle_api_control);
     web_server_add_route(server, "GET", "/api/logs", web_server_handle_api_logs);
     web_server_add_route(server, "GET", "/api/plugins", web_server_handle_api_plugins);
+    web_server_add_blocking_route(server, "POST", "/api/plugins/:name/activate",
+                                  web_server_handle_api_plugin_activate);
     web_server_add_route(server, "GET", "/api/version", web_server_handle_api_version);
     web_server_add_route(server, "GET", "/api/check-update", web_server_handle_api_check_update);
     web_server_add_route(server, "POST", "/api/update", web_server_handle_api_update);
-    web_server_add_route(server, "GET", "/", web_server_handle_dashboard);
+    /* The built-in dashboard, unless a file route already serves the page */
+    if (web_router_find(&server->router, "*", "/") < 0) {
+        web_server_add_route(server, "GET", "/", web_server_handle_dashboard);
+    }
 }
 
 /* Default handlers */
-struct http_response web_server_handle_not_found(const struct http_request* request) {
-    struct http_response response;
+void web_server_handle_not_found(const struct http_request* request, struct http_response* response) {
     const char* html;
     (void)request; /* Suppress unused parameter warning */
-    memset(&response, 0, sizeof(response));
-    response.status_code = 404;
-    web_server_strcpy_safe(response.content_type, "text/html", sizeof(response.content_type));
+    response->status_code = 404;
+    web_server_strcpy_safe(response->content_type, "text/html", sizeof(response->content_type));
 
     html =
         "<!DOCTYPE html>\n"
@@ -1009,94 +2248,145 @@ struct http_response web_server_handle_not_found(const struct http_request* requ
         "</body>\n"
         "</html>\n";
     
-    web_server_strcpy_safe(response.body, html, sizeof(response.body));
-    return response;
+    web_server_response_puts(response, html);
 }
 
-struct http_response web_server_handle_api_status(const struct http_request* request) {
-    struct http_response response;
+void web_server_handle_api_status(const struct http_request* request, struct http_response* response) {
     time_t now;
     time_t start_time;
     time_t uptime_seconds;
-    char json[512];
     (void)request; /* Suppress unused parameter warning */
-    memset(&response, 0, sizeof(response));
-    response.status_code = 200;
-    web_server_strcpy_safe(response.content_type, "application/json", sizeof(response.content_type));
+    response->status_code = 200;
+    web_server_strcpy_safe(response->content_type, "application/json", sizeof(response->content_type));
 
     /* Calculate actual uptime */
     now = time(NULL);
     start_time = get_daemon_start_time();
     uptime_seconds = now - start_time;
 
-    snprintf(json, sizeof(json),
+    web_server_response_printf(response,
         "{"
         "\"status\":\"running\","
         "\"uptime\":%ld,"
         "\"version\":\"1.0.0\","
         "\"timestamp\":%ld"
-        "}", uptime_seconds, now);
-    
-    web_server_strcpy_safe(response.body, json, sizeof(response.body));
-    return response;
+        "}", (long)uptime_seconds, (long)now);
 }
 
-struct http_response web_server_handle_api_metrics(const struct http_request* request) {
-    struct http_response response;
+void web_server_handle_api_metrics(const struct http_request* request, struct http_response* response) {
     char *json_data;
     (void)request; /* Suppress unused parameter warning */
-    memset(&response, 0, sizeof(response));
-    response.status_code = 200;
-    web_server_strcpy_safe(response.content_type, "application/json", sizeof(response.content_type));
+    response->status_code = 200;
+    web_server_strcpy_safe(response->content_type, "application/json", sizeof(response->content_type));
 
     /* Use C89 metrics API - simplified version */
     json_data = metrics_export_json();
     if (json_data) {
-        web_server_strcpy_safe(response.body, json_data, sizeof(response.body));
+        web_server_response_puts(response, json_data);
         free(json_data);
     } else {
-        web_server_strcpy_safe(response.body, "{\"error\":\"Failed to export metrics\"}", sizeof(response.body));
+        web_server_response_puts(response, "{\"error\":\"Failed to export metrics\"}");
     }
-    return response;
 }
 
-struct http_response web_server_handle_api_health(const struct http_request* request) {
-    struct http_response response;
+/* Most points one history response carries, about 5 KB of JSON at ~25
+ * bytes a point: enough for a chart. Longer ranges come back merged into
+ * wider buckets (tsdb_query). */
+#define HISTORY_MAX_POINTS 200
+
+/* The longest range asked for: the hour tier's span, all the history kept.
+ * Also keeps the unit multiplication below in a 32-bit long. */
+#define HISTORY_RANGE_MAX ((long)TSDB_HOUR_SLOTS * 3600L)
+
+/* A range in seconds, or with an s/m/h/d suffix ("90m", "24h", "7d").
+ * 0 if malformed or longer than HISTORY_RANGE_MAX. */
+static long parse_history_range(const char* text) {
+    char* end;
+    long value = strtol(text, &end, 10);
+    long unit;
+
+    if (end == text || value <= 0) return 0;
+    switch (*end) {
+        case '\0': case 's': unit = 1; break;
+        case 'm': unit = 60; break;
+        case 'h': unit = 3600; break;
+        case 'd': unit = 86400; break;
+        default: return 0;
+    }
+    if (*end && end[1]) return 0;
+    if (value > HISTORY_RANGE_MAX / unit) return 0;
+    return value * unit;
+}
+
+/* GET /api/metrics/history?name=<metric>&range=<range>: the on-device
+ * history (tsdb.h) of one tracked metric, oldest point first. A null value
+ * is a bucket with no data -- the daemon was not running. Range defaults to
+ * an hour. */
+void web_server_handle_api_metrics_history(const struct http_request* request, struct http_response* response) {
+    struct tsdb_point points[HISTORY_MAX_POINTS];
+    char name[128];
+    char text[32];
+    long range = 3600;
+    long step = 0;
+    int count;
+    int i;
+    response->status_code = 200;
+    web_server_strcpy_safe(response->content_type, "application/json", sizeof(response->content_type));
+
+    web_server_request_query(request, "name", name, sizeof(name));
+    if (web_server_request_query(request, "range", text, sizeof(text))) {
+        range = parse_history_range(text);
+    }
+    if (!name[0] || range <= 0) {
+        response->status_code = 400;
+        web_server_response_puts(response, "{\"error\":\"Expected name=<metric> and an optional range such as 3600, 90m, 24h or 7d, up to 30d\"}");
+        return;
+    }
+
+    count = tsdb_query(name, range, time(NULL), points, HISTORY_MAX_POINTS, &step);
+    if (count < 0) {
+        response->status_code = 404;
+        web_server_response_puts(response, "{\"error\":\"No history is kept for that metric\"}");
+        return;
+    }
+
+    /* Tracked names are plain metric names, safe to echo without escaping */
+    web_server_response_printf(response, "{\"name\":\"%s\",\"range\":%ld,\"step\":%ld,\"points\":[",
+                               name, range, step);
+    for (i = 0; i < count; i++) {
+        if (points[i].value != points[i].value) {   /* NaN: no data */
+            web_server_response_printf(response, "%s[%ld,null]", i ? "," : "", (long)points[i].t);
+        } else {
+            web_server_response_printf(response, "%s[%ld,%.10g]", i ? "," : "",
+                                       (long)points[i].t, points[i].value);
+        }
+    }
+    web_server_response_puts(response, "]}");
+}
+
+void web_server_handle_api_health(const struct http_request* request, struct http_response* response) {
     health_status_t overall_status;
     health_check_t checks[32];
     int checks_count;
     char escaped_overall[32];
-    char json[2048];
-    char* ptr;
-    size_t remaining;
-    int written;
     int i;
-    int first = 1;
     (void)request; /* Suppress unused parameter warning */
-    memset(&response, 0, sizeof(response));
-    response.status_code = 200;
-    web_server_strcpy_safe(response.content_type, "application/json", sizeof(response.content_type));
+    response->status_code = 200;
+    web_server_strcpy_safe(response->content_type, "application/json", sizeof(response->content_type));
 
     overall_status = health_monitor_get_overall_status();
     checks_count = health_monitor_get_all_checks(checks, 32);
 
     /* Reflect health in the HTTP status so liveness/readiness probes and load
      * balancers can detect an unhealthy daemon without parsing the body. */
-    response.status_code = health_monitor_status_is_serving(overall_status) ? 200 : 503;
+    response->status_code = health_monitor_status_is_serving(overall_status) ? 200 : 503;
 
     web_server_json_escape(health_monitor_status_to_string(overall_status),
                           escaped_overall, sizeof(escaped_overall));
-    ptr = json;
-    remaining = sizeof(json);
-
-    written = snprintf(ptr, remaining, "{\"overall_status\":\"%s\",\"checks\":{",
-                          escaped_overall);
-    if (written > 0 && (size_t)written < remaining) {
-        ptr += written;
-        remaining -= written;
-    }
+    web_server_response_printf(response, "{\"overall_status\":\"%s\",\"checks\":{",
+                               escaped_overall);
 
-    for (i = 0; i < checks_count && remaining > 200; i++) {
+    for (i = 0; i < checks_count; i++) {
         char escaped_name[64];
         char escaped_status[32];
         char escaped_message[256];
@@ -1104,55 +2394,34 @@ struct http_response web_server_handle_api_health(const struct http_request* req
         web_server_json_escape(health_monitor_status_to_string(checks[i].last_status),
                               escaped_status, sizeof(escaped_status));
         web_server_json_escape(checks[i].last_message, escaped_message, sizeof(escaped_message));
-        if (!first) {
-            written = snprintf(ptr, remaining, ",");
-            if (written > 0 && (size_t)written < remaining) {
-                ptr += written;
-                remaining -= written;
-            }
-        }
-        written = snprintf(ptr, remaining,
-            "\"%s\":{\"status\":\"%s\",\"message\":\"%s\",\"last_check\":%ld}",
-            escaped_name, escaped_status, escaped_message, checks[i].last_check_time);
-        if (written > 0 && (size_t)written < remaining) {
-            ptr += written;
-            remaining -= written;
-        }
-        first = 0;
+        web_server_response_printf(response,
+            "%s\"%s\":{\"status\":\"%s\",\"message\":\"%s\",\"last_check\":%ld}",
+            i > 0 ? "," : "", escaped_name, escaped_status, escaped_message,
+            (long)checks[i].last_check_time);
     }
-    
-    written = snprintf(ptr, remaining, "}}");
-    if (written > 0 && (size_t)written < remaining) {
-        ptr += written;
-        remaining -= written;
-    }
-    
-    web_server_strcpy_safe(response.body, json, sizeof(response.body));
-    return response;
+
+    web_server_response_puts(response, "}}");
 }
 
-struct http_response web_server_handle_api_config(const struct http_request* request) {
-    struct http_response response;
+void web_server_handle_api_config(const struct http_request* request, struct http_response* response) {
     config_data_t* config;
     char escaped_device[128];
     char escaped_level[32];
     char escaped_file[256];
-    char json[2048];
     (void)request; /* Suppress unused parameter warning */
-    memset(&response, 0, sizeof(response));
-    response.status_code = 200;
-    web_server_strcpy_safe(response.content_type, "application/json", sizeof(response.content_type));
+    response->status_code = 200;
+    web_server_strcpy_safe(response->content_type, "application/json", sizeof(response->content_type));
 
     config = config_get_instance();
     if (!config) {
-        web_server_strcpy_safe(response.body, "{\"error\":\"Config not available\"}", sizeof(response.body));
-        return response;
+        web_server_response_puts(response, "{\"error\":\"Config not available\"}");
+        return;
     }
 
     web_server_json_escape(config_get_display_device(config), escaped_device, sizeof(escaped_device));
     web_server_json_escape(config_get_log_level(config), escaped_level, sizeof(escaped_level));
     web_server_json_escape(config_get_log_file(config), escaped_file, sizeof(escaped_file));
-    snprintf(json, sizeof(json),
+    web_server_response_printf(response,
         "{"
         "\"hardware\":{"
         "\"display_device\":\"%s\","
@@ -1193,23 +2462,17 @@ struct http_response web_server_handle_api_config(const struct http_request* req
         config_get_metrics_server_port(config),
         config_get_web_server_enabled(config) ? "true" : "false",
         config_get_web_server_port(config));
-    
-    web_server_strcpy_safe(response.body, json, sizeof(response.body));
-    return response;
 }
 
-struct http_response web_server_handle_api_state(const struct http_request* request) {
-    struct http_response response;
-    char json[1024];
+void web_server_handle_api_state(const struct http_request* request, struct http_response* response) {
     struct daemon_state_info state_info;
     char line1[64], line2[64];
     char escaped_line1[128], escaped_line2[128];
     char escaped_keypad[128];
     char escaped_error[256];
     (void)request; /* Suppress unused parameter warning */
-    memset(&response, 0, sizeof(response));
-    response.status_code = 200;
-    web_server_strcpy_safe(response.content_type, "application/json", sizeof(response.content_type));
+    response->status_code = 200;
+    web_server_strcpy_safe(response->content_type, "application/json", sizeof(response->content_type));
 
     state_info = get_daemon_state_info();
 
@@ -1223,7 +2486,7 @@ struct http_response web_server_handle_api_state(const struct http_request* requ
     web_server_json_escape(line1, escaped_line1, sizeof(escaped_line1));
     web_server_json_escape(line2, escaped_line2, sizeof(escaped_line2));
 
-    snprintf(json, sizeof(json),
+    web_server_response_printf(response,
         "{"
         "\"current_state\":%d,"
         "\"inserted_cents\":%d,"
@@ -1240,14 +2503,9 @@ struct http_response web_server_handle_api_state(const struct http_request* requ
         state_info.sip_registered,
         escaped_error,
         escaped_line1, escaped_line2);
-    
-    web_server_strcpy_safe(response.body, json, sizeof(response.body));
-    return response;
 }
 
-struct http_response web_server_handle_api_control(const struct http_request* request) {
-    struct http_response response;
-    char json[1024];
+void web_server_handle_api_control(const struct http_request* request, struct http_response* response) {
     char action[64] = "unknown";
     char key[16] = "";
     char plugin[64] = "";
@@ -1259,12 +2517,13 @@ struct http_response web_server_handle_api_control(const struct http_request* re
     char message[256] = "Unknown action";
     char escaped_action[128];
     char escaped_message[512];
-    memset(&response, 0, sizeof(response));
-    response.status_code = 200;
-    web_server_strcpy_safe(response.content_type, "application/json", sizeof(response.content_type));
+    /* The server ends the body with a '\0', so it can be searched in place */
+    const char* body = request->buf + request->body.offset;
+    response->status_code = 200;
+    web_server_strcpy_safe(response->content_type, "application/json", sizeof(response->content_type));
 
     /* Parse action from JSON body */
-    action_pos = strstr(request->body, "\"action\":\"");
+    action_pos = strstr(body, "\"action\":\"");
     if (action_pos) {
         char* start = action_pos + 10; /* Length of "action":" */
         char* end = strchr(start, '"');
@@ -1278,7 +2537,7 @@ struct http_response web_server_handle_api_control(const struct http_request* re
     }
     
     /* Parse key for keypad actions (supports "key" or "arg") */
-    key_pos = strstr(request->body, "\"key\":\"");
+    key_pos = strstr(body, "\"key\":\"");
     if (key_pos) {
         char* start = key_pos + 7; /* Length of "key":" */
         char* end = strchr(start, '"');
@@ -1290,7 +2549,7 @@ struct http_response web_server_handle_api_control(const struct http_request* re
             }
         }
     } else {
-        char* arg_pos = strstr(request->body, "\"arg\":\"");
+        char* arg_pos = strstr(body, "\"arg\":\"");
         if (arg_pos && key[0] == '\0') {
             char* start = arg_pos + 7; /* Length of "arg":" */
             char* end = strchr(start, '"');
@@ -1308,12 +2567,12 @@ struct http_response web_server_handle_api_control(const struct http_request* re
      * atoi overflow/undefined behavior (#129) */
     {
         char* parse_start = NULL;
-        char* cents_pos = strstr(request->body, "\"cents\":");
+        char* cents_pos = strstr(body, "\"cents\":");
         if (cents_pos) {
             parse_start = cents_pos + 8; /* Length of "cents": */
         } else {
-            char* arg_quoted = strstr(request->body, "\"arg\":\"");
-            char* arg_num = strstr(request->body, "\"arg\":");
+            char* arg_quoted = strstr(body, "\"arg\":\"");
+            char* arg_num = strstr(body, "\"arg\":");
             if (arg_quoted)
                 parse_start = arg_quoted + 7;
             else if (arg_num)
@@ -1329,7 +2588,7 @@ struct http_response web_server_handle_api_control(const struct http_request* re
     }
     
     /* Parse plugin for plugin actions */
-    plugin_pos = strstr(request->body, "\"plugin\":\"");
+    plugin_pos = strstr(body, "\"plugin\":\"");
     if (plugin_pos) {
         char* start = plugin_pos + 10; /* Length of "plugin":" */
         char* end = strchr(start, '"');
@@ -1398,7 +2657,7 @@ struct http_response web_server_handle_api_control(const struct http_request* re
     web_server_json_escape(action, escaped_action, sizeof(escaped_action));
     web_server_json_escape(message, escaped_message, sizeof(escaped_message));
     
-    snprintf(json, sizeof(json),
+    web_server_response_printf(response,
         "{"
         "\"success\":%s,"
         "\"action\":\"%s\","
@@ -1407,52 +2666,36 @@ struct http_response web_server_handle_api_control(const struct http_request* re
         success ? "true" : "false",
         escaped_action,
         escaped_message);
-    
-    web_server_strcpy_safe(response.body, json, sizeof(response.body));
-    return response;
 }
 
-struct http_response web_server_handle_api_logs(const struct http_request* request) {
-    struct http_response response;
+void web_server_handle_api_logs(const struct http_request* request, struct http_response* response) {
     char level[16] = "INFO";
     int i;
     int max_entries = 20;
-    char json[8192];
-    char* ptr = json;
-    size_t remaining = sizeof(json);
-    int written;
+    char text[16];
     log_level_t min_level = LOG_LEVEL_INFO;
-    char log_buffer[50][512];
+    char category[32] = "";
+    logger_entry_t* log_entries;
     int log_count;
     int first = 1;
     int total_count = 0;
-    memset(&response, 0, sizeof(response));
-    response.status_code = 200;
-    web_server_strcpy_safe(response.content_type, "application/json", sizeof(response.content_type));
+    response->status_code = 200;
+    web_server_strcpy_safe(response->content_type, "application/json", sizeof(response->content_type));
 
     /* Get log level parameter */
-    for (i = 0; i < request->query_count; i++) {
-        if (strcmp(request->query_keys[i], "level") == 0) {
-            web_server_strcpy_safe(level, request->query_values[i], sizeof(level));
-            break;
-        }
-    }
+    web_server_request_query(request, "level", level, sizeof(level));
+
+    /* Optional category, e.g. category=SIP */
+    web_server_request_query(request, "category", category, sizeof(category));
 
     /* Get max entries parameter (default to 20, max 50) */
-    for (i = 0; i < request->query_count; i++) {
-        if (strcmp(request->query_keys[i], "max_entries") == 0) {
-            max_entries = atoi(request->query_values[i]);
-            if (max_entries > 50) max_entries = 50;
-            if (max_entries < 1) max_entries = 1;
-            break;
-        }
+    if (web_server_request_query(request, "max_entries", text, sizeof(text))) {
+        max_entries = atoi(text);
+        if (max_entries > 50) max_entries = 50;
+        if (max_entries < 1) max_entries = 1;
     }
 
-    written = snprintf(ptr, remaining, "{\"logs\":[");
-    if (written > 0 && (size_t)written < remaining) {
-        ptr += written;
-        remaining -= written;
-    }
+    web_server_response_puts(response, "{\"logs\":[");
 
     /* Map requested level name -> minimum severity. This is a THRESHOLD, not an
      * exact match, so an INFO view still surfaces WARN/ERROR. */
@@ -1463,27 +2706,20 @@ struct http_response web_server_handle_api_logs(const struct http_request* reque
     else if (strcmp(level, "ERROR") == 0) min_level = LOG_LEVEL_ERROR;
 
     /* Get logs from memory, level-filtered across the whole ring buffer so
-     * INFO+ events appear even when DEBUG output dominates the recent window. */
-    log_count = logger_get_recent_logs_min_level(log_buffer, max_entries, min_level);
+     * INFO+ events appear even when DEBUG output dominates the recent window.
+     * The level and time come from the logger's index, not the text. */
+    log_entries = (logger_entry_t*)malloc(sizeof(logger_entry_t) * max_entries);
+    log_count = log_entries != NULL ?
+        logger_get_recent_entries(log_entries, max_entries, min_level,
+                                  category[0] != '\0' ? category : NULL) : 0;
 
     /* Process logs in reverse order (newest first) */
-    for (i = log_count - 1; i >= 0 && remaining > 200; i--) {
+    for (i = log_count - 1; i >= 0; i--) {
         char escaped_message[512];
-        time_t log_timestamp;
-        char log_level[16] = "INFO"; /* Default level */
-        char* timestamp_start;
-        char escaped_level[32];
-        if (!first) {
-            written = snprintf(ptr, remaining, ",");
-            if (written > 0 && (size_t)written < remaining) {
-                ptr += written;
-                remaining -= written;
-            }
-        }
         
         /* JSON-escape log message: ", \, and control chars (#112) */
         {
-            char *src = log_buffer[i];
+            char *src = log_entries[i].text;
             char *dst = escaped_message;
             size_t dst_remaining = sizeof(escaped_message) - 1;
             /* Skip the "[timestamp] [LEVEL] " prefix so the message field holds
@@ -1513,78 +2749,24 @@ struct http_response web_server_handle_api_logs(const struct http_request* reque
             }
         }
         
-        /* Extract timestamp and level from the log message */
-        log_timestamp = time(NULL); /* Default to current time */
-
-        /* Try to parse timestamp from log message format: [YYYY-MM-DD HH:MM:SS.mmm] [LEVEL] [CATEGORY] message */
-        timestamp_start = strstr(log_buffer[i], "[");
-        if (timestamp_start) {
-            char* timestamp_end = strstr(timestamp_start + 1, "]");
-            if (timestamp_end) {
-                /* Parse the timestamp - format: YYYY-MM-DD HH:MM:SS.mmm */
-                int year, month, day, hour, min, sec, msec;
-                char* level_start;
-                if (sscanf(timestamp_start + 1, "%d-%d-%d %d:%d:%d.%d",
-                          &year, &month, &day, &hour, &min, &sec, &msec) == 7) {
-                    /* Convert to time_t (approximate) */
-                    struct tm tm_time = {0};
-                    tm_time.tm_year = year - 1900;
-                    tm_time.tm_mon = month - 1;
-                    tm_time.tm_mday = day;
-                    tm_time.tm_hour = hour;
-                    tm_time.tm_min = min;
-                    tm_time.tm_sec = sec;
-                    log_timestamp = mktime(&tm_time);
-                }
-                
-                /* Try to parse log level from the next [LEVEL] section */
-                level_start = strstr(timestamp_end + 1, "[");
-                if (level_start) {
-                    char* level_end = strstr(level_start + 1, "]");
-                    if (level_end) {
-                        size_t level_len = level_end - level_start - 1;
-                        if (level_len > 0 && level_len < sizeof(log_level) - 1) {
-                            strncpy(log_level, level_start + 1, level_len);
-                            log_level[level_len] = '\0';
-                        }
-                    }
-                }
-            }
-        }
-        
-        /* Level filtering already applied by logger_get_recent_logs_min_level. */
-
-        /* Escape log_level for JSON (parsed from log, could have special chars) */
-        web_server_json_escape(log_level, escaped_level, sizeof(escaped_level));
-        written = snprintf(ptr, remaining,
-            "{\"timestamp\":%ld,\"level\":\"%s\",\"message\":\"%s\"}",
-            log_timestamp, escaped_level, escaped_message);
-        if (written > 0 && (size_t)written < remaining) {
-            ptr += written;
-            remaining -= written;
-        }
+        web_server_response_printf(response,
+            "%s{\"timestamp\":%ld,\"level\":\"%s\",\"message\":\"%s\"}",
+            first ? "" : ",", (long)(log_entries[i].time_ms / 1000),
+            logger_level_to_string(log_entries[i].level), escaped_message);
         
         first = 0;
         total_count++;
     }
+    free(log_entries);
     
-    written = snprintf(ptr, remaining, "],\"total\":%d}", total_count);
-    if (written > 0 && (size_t)written < remaining) {
-        ptr += written;
-        remaining -= written;
-    }
-    
-    web_server_strcpy_safe(response.body, json, sizeof(response.body));
-    return response;
+    web_server_response_printf(response, "],\"total\":%d}", total_count);
 }
 
-struct http_response web_server_handle_api_plugins(const struct http_request* request) {
-    struct http_response response;
+void web_server_handle_api_plugins(const struct http_request* request, struct http_response* response) {
     char json[2048];
     (void)request; /* Suppress unused parameter warning */
-    memset(&response, 0, sizeof(response));
-    response.status_code = 200;
-    web_server_strcpy_safe(response.content_type, "application/json", sizeof(response.content_type));
+    response->status_code = 200;
+    web_server_strcpy_safe(response->content_type, "application/json", sizeof(response->content_type));
 
     /* Enumerate the registry dynamically so newly added plugins appear in the
      * dashboard automatically (no hard-coded list to keep in sync). */
@@ -1593,39 +2775,51 @@ struct http_response web_server_handle_api_plugins(const struct http_request* re
                                sizeof(json));
     }
 
-    web_server_strcpy_safe(response.body, json, sizeof(response.body));
-    return response;
+    web_server_response_puts(response, json);
 }
 
-struct http_response web_server_handle_api_version(const struct http_request* request) {
-    struct http_response response;
-    char json[512];
+/* POST /api/plugins/<name>/activate: the control endpoint's activate_plugin
+ * action, with the plugin in the path */
+void web_server_handle_api_plugin_activate(const struct http_request* request, struct http_response* response) {
+    char name[64] = "";
+    char cmd[128];
+    char escaped_name[128];
+    int success;
+
+    response->status_code = 200;
+    web_server_strcpy_safe(response->content_type, "application/json", sizeof(response->content_type));
+
+    web_server_request_param(request, "name", name, sizeof(name));
+    snprintf(cmd, sizeof(cmd), "activate_plugin:%s", name);
+    success = send_control_command(cmd);
+
+    web_server_json_escape(name, escaped_name, sizeof(escaped_name));
+    web_server_response_printf(response,
+        "{\"success\":%s,\"plugin\":\"%s\"}",
+        success ? "true" : "false", escaped_name);
+}
+
+void web_server_handle_api_version(const struct http_request* request, struct http_response* response) {
     (void)request;
-    memset(&response, 0, sizeof(response));
-    web_server_strcpy_safe(response.content_type, "application/json", sizeof(response.content_type));
-    response.status_code = 200;
-    snprintf(json, sizeof(json),
+    web_server_strcpy_safe(response->content_type, "application/json", sizeof(response->content_type));
+    response->status_code = 200;
+    web_server_response_printf(response,
         "{\"version\":\"%s\",\"git_hash\":\"%s\",\"build_time\":\"%s\"}",
         version_get_string(), version_get_git_hash(), version_get_build_time());
-    web_server_strcpy_safe(response.body, json, sizeof(response.body));
-    return response;
 }
 
-struct http_response web_server_handle_api_check_update(const struct http_request* request) {
-    struct http_response response;
-    char json[512];
+void web_server_handle_api_check_update(const struct http_request* request, struct http_response* response) {
     char latest[64];
     int have_latest;
     (void)request;
-    memset(&response, 0, sizeof(response));
-    web_server_strcpy_safe(response.content_type, "application/json", sizeof(response.content_type));
-    response.status_code = 200;
+    web_server_strcpy_safe(response->content_type, "application/json", sizeof(response->content_type));
+    response->status_code = 200;
 
     /* #119: Non-blocking - don't block HTTP handler for curl timeout */
     updater_check_async();
     have_latest = updater_get_latest_version(latest, sizeof(latest));
 
-    snprintf(json, sizeof(json),
+    web_server_response_printf(response,
         "{\"current_version\":\"%s\",\"latest_version\":\"%s\","
         "\"update_available\":%s,\"checking\":%s,\"git_hash\":\"%s\"}",
         version_get_string(),
@@ -1633,19 +2827,14 @@ struct http_response web_server_handle_api_check_update(const struct http_reques
         updater_is_update_available() ? "true" : "false",
         updater_is_checking() ? "true" : "false",
         version_get_git_hash());
-    web_server_strcpy_safe(response.body, json, sizeof(response.body));
-    return response;
 }
 
-struct http_response web_server_handle_api_update(const struct http_request* request) {
-    struct http_response response;
-    char json[512];
+void web_server_handle_api_update(const struct http_request* request, struct http_response* response) {
     char apply_status[256];
     const char *source_dir;
     int rc;
     (void)request;
-    memset(&response, 0, sizeof(response));
-    web_server_strcpy_safe(response.content_type, "application/json", sizeof(response.content_type));
+    web_server_strcpy_safe(response->content_type, "application/json", sizeof(response->content_type));
 
     /* #225: never restart the daemon out from under a call. The apply ends in
      * `systemctl restart`, which kills the process and drops whatever call is
@@ -1660,13 +2849,12 @@ struct http_response web_server_handle_api_update(const struct http_request* req
      * every event, and the balance is restored on boot (verified by
      * tests/Updater.tla, NoCreditLostOnRestart). It is the call that is lost. */
     if (web_server_is_in_call()) {
-        snprintf(json, sizeof(json),
+        web_server_response_puts(response,
             "{\"success\":false,\"status\":\"Phone is in a call; update refused. Retry when the call ends.\",\"accepted\":false}");
-        response.status_code = 409;  /* Conflict */
-        web_server_strcpy_safe(response.body, json, sizeof(response.body));
+        response->status_code = 409;  /* Conflict */
         logger_warn_with_category("WebServer",
                 "Update requested during a call; refused with 409");
-        return response;
+        return;
     }
 
     /* #118: Non-blocking - don't block web server for minutes */
@@ -1674,29 +2862,25 @@ struct http_response web_server_handle_api_update(const struct http_request* req
     rc = updater_apply_async(source_dir);
 
     if (rc == 0 && updater_is_applying()) {
-        snprintf(json, sizeof(json),
+        web_server_response_puts(response,
             "{\"success\":true,\"status\":\"Applying update in background. Daemon will restart when complete.\",\"accepted\":true}");
-        response.status_code = 202;  /* Accepted */
+        response->status_code = 202;  /* Accepted */
     } else {
         updater_get_apply_status(apply_status, sizeof(apply_status));
-        snprintf(json, sizeof(json),
+        web_server_response_printf(response,
             "{\"success\":%s,\"status\":\"%s\"}",
             rc == 0 ? "true" : "false",
             apply_status);
-        response.status_code = rc == 0 ? 200 : 500;
+        response->status_code = rc == 0 ? 200 : 500;
     }
-    web_server_strcpy_safe(response.body, json, sizeof(response.body));
-    return response;
 }
 
-struct http_response web_server_handle_dashboard(const struct http_request* request) {
-    struct http_response response;
+void web_server_handle_dashboard(const struct http_request* request, struct http_response* response) {
     (void)request;
-    memset(&response, 0, sizeof(response));
-    response.status_code = 200;
-    web_server_strcpy_safe(response.content_type, "text/html", sizeof(response.content_type));
+    response->status_code = 200;
+    web_server_strcpy_safe(response->content_type, "text/html", sizeof(response->content_type));
 
-    snprintf(response.body, sizeof(response.body),
+    web_server_response_printf(response,
         "<!DOCTYPE html><html><head>"
         "<meta charset=\"utf-8\"><meta name=\"viewport\" content=\"width=device-width,initial-scale=1\">"
         "<title>Millennium Payphone</title>"
@@ -1839,7 +3023,6 @@ struct http_response web_server_handle_dashboard(const struct http_request* requ
         "</body></html>",
         version_get_string(), version_get_git_hash());
 
-    return response;
 }
 
 /* Utility functions */
@@ -1926,27 +3109,16 @@ int web_server_check_rate_limit(struct web_server* server, const char* client_ip
     return 1; /* Allowed - simplified rate limiting for C89 */
 }
 
-struct http_response web_server_create_rate_limit_response(void) {
-    struct http_response response;
-    const char* json;
-    memset(&response, 0, sizeof(response));
-    response.status_code = 429; /* Too Many Requests */
-    
-    web_server_strcpy_safe(response.header_keys[response.header_count], "Retry-After", sizeof(response.header_keys[response.header_count]));
-    web_server_strcpy_safe(response.header_values[response.header_count], "10", sizeof(response.header_values[response.header_count]));
-    response.header_count++;
-    
-    web_server_strcpy_safe(response.content_type, "application/json", sizeof(response.content_type));
-    
-    json =
+void web_server_create_rate_limit_response(struct http_response* response) {
+    response->status_code = 429; /* Too Many Requests */
+    web_server_response_header(response, "Retry-After", "10");
+    web_server_strcpy_safe(response->content_type, "application/json", sizeof(response->content_type));
+    web_server_response_puts(response,
         "{"
         "\"error\": \"Rate limit exceeded\","
         "\"message\": \"Too many requests. Please slow down, especially during calls.\","
         "\"retry_after\": 10"
-        "}";
-    
-    web_server_strcpy_safe(response.body, json, sizeof(response.body));
-    return response;
+        "}");
 }
 
 /* WebSocket support (simplified) */
@@ -1998,80 +3170,3 @@ void web_server_broadcast_to_websockets(struct web_server* server, const char* m
         }
     }
 }
-
-/* Streaming response implementation */
-int web_server_send_streaming_response(int client_fd, const struct http_response* response) {
-    char headers[1024];
-    char* ptr = headers;
-    size_t remaining = sizeof(headers);
-    int written;
-    int i;
-    FILE* file;
-    char buffer[8192];  /* 8KB buffer for efficient reading */
-    size_t bytes_read;
-    int total_sent = 0;
-    if (!response || !response->is_streaming) return -1;
-
-    /* Send HTTP headers first */
-
-    /* Status line */
-    written = snprintf(ptr, remaining, "HTTP/1.1 %d OK\r\n", response->status_code);
-    if (written > 0 && (size_t)written < remaining) {
-        ptr += written;
-        remaining -= written;
-    }
-    
-    /* Content-Type header */
-    written = snprintf(ptr, remaining, "Content-Type: %s\r\n", response->content_type);
-    if (written > 0 && (size_t)written < remaining) {
-        ptr += written;
-        remaining -= written;
-    }
-    
-    /* Content-Length header */
-    written = snprintf(ptr, remaining, "Content-Length: %lu\r\n", (unsigned long)response->content_length);
-    if (written > 0 && (size_t)written < remaining) {
-        ptr += written;
-        remaining -= written;
-    }
-    
-    /* Additional headers */
-    for (i = 0; i < response->header_count; i++) {
-        written = snprintf(ptr, remaining, "%s: %s\r\n", 
-                          response->header_keys[i], response->header_values[i]);
-        if (written > 0 && (size_t)written < remaining) {
-            ptr += written;
-            remaining -= written;
-        }
-    }
-    
-    /* Connection header */
-    written = snprintf(ptr, remaining, "Connection: close\r\n\r\n");
-    if (written > 0 && (size_t)written < remaining) {
-        ptr += written;
-        remaining -= written;
-    }
-    
-    /* Send headers */
-    if (send(client_fd, headers, strlen(headers), 0) < 0) {
-        return -1;
-    }
-    
-    /* Open and send file content */
-    file = fopen(response->file_path, "rb");
-    if (!file) {
-        return -1;
-    }
-
-    while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
-        ssize_t sent = send(client_fd, buffer, bytes_read, 0);
-        if (sent < 0) {
-            fclose(file);
-            return -1;
-        }
-        total_sent += sent;
-    }
-    
-    fclose(file);
-    return total_sent;
-}
@@ -7,18 +7,45 @@
 #include <pthread.h>
 
 #include "conn_queue.h"
+#include "web_router.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-/* Worker threads that service accepted connections in parallel, and the depth
- * of the backlog the accept loop will buffer before shedding load (#125). */
+/* One event-loop thread owns every connection: it accepts, reads requests as
+ * their bytes arrive, runs the handlers that answer from memory, and writes
+ * responses, all on non-blocking sockets, so an idle or slow client costs a
+ * table slot rather than a thread; file routes are sent from an open-file
+ * cache with sendfile(). Requests that may block -- a route added with
+ * web_server_add_blocking_route() -- go to the worker threads, and come back
+ * to the loop to be written. The queue depth is the backlog of such
+ * requests the loop will buffer before shedding load with a 503 (#125). */
 #define WEB_SERVER_WORKER_COUNT 4
 #define WEB_SERVER_QUEUE_DEPTH 32
 
+/* Connections open at once; past this new ones wait in the listen backlog. */
+#define WEB_SERVER_MAX_CONNS 64
+/* Largest request read, headers and body; a longer body is refused (413). */
+#define WEB_SERVER_REQUEST_MAX 4096
+/* A request must arrive whole within the read timeout of its first byte (of
+ * the accept, for a connection's first request), and a client reading our
+ * response must keep it moving: one that stalls that long is closed. */
+#define WEB_SERVER_READ_TIMEOUT_MS 2000
+#define WEB_SERVER_WRITE_TIMEOUT_MS 10000
+/* HTTP/1.1 connections stay open for the next request: the dashboard polls
+ * several endpoints a second, and each used to pay for a new TCP handshake.
+ * One is closed after sitting idle this long, or after this many requests,
+ * whichever comes first. When every slot is taken and a new client is
+ * waiting, the connection idle longest -- kept alive, or opened and never
+ * used -- is closed early to make room. */
+#define WEB_SERVER_KEEPALIVE_TIMEOUT_MS 5000
+#define WEB_SERVER_KEEPALIVE_MAX 100
+
 /* Forward declarations */
 struct web_server;
+struct web_conn;
+struct web_file;
 struct http_request;
 struct http_response;
 
@@ -32,43 +59,88 @@ struct daemon_state_info {
     char sip_last_error[128]; /* Last registration error if failed */
 };
 
-/* HTTP Request structure */
+/* A stretch of the request: where it starts in http_request.buf, and how
+ * many bytes it runs. The parser copies nothing; the slices point into the
+ * connection's receive buffer, which outlives the handler. */
+struct http_slice {
+    size_t offset;
+    size_t len;
+};
+
+/* HTTP Request structure. Read it through web_server_request_header(),
+ * web_server_request_query() and web_server_request_param(); while a
+ * handler runs, the byte after the body is a '\0', so the body may be
+ * searched as a string. */
 struct http_request {
-    char method[16];
-    char path[256];
-    char body[4096];
-    char client_ip[64];
-    /* Headers and query params stored as key-value pairs */
-    char header_keys[32][64];
-    char header_values[32][256];
+    const char* buf;
+    struct http_slice method;
+    struct http_slice path;    /* without the query string */
+    struct http_slice query;   /* after the '?', still URL-encoded */
+    struct http_slice body;
+    char client_ip[64];        /* filled in by the server, not the parser */
+    struct http_slice header_keys[32];
+    struct http_slice header_values[32];
     int header_count;
-    char query_keys[16][64];
-    char query_values[16][256];
+    struct http_slice query_keys[16];    /* URL-encoded, as sent */
+    struct http_slice query_values[16];
     int query_count;
+
+    /* Filled in by the server's router, not the parser: the route's index
+     * in web_server.routes (-1 if none), and the path parameters its
+     * pattern captured, names and values in step */
+    int route;
+    const char* param_names[WEB_ROUTER_MAX_PARAMS];
+    struct http_slice param_values[WEB_ROUTER_MAX_PARAMS];
+    int param_count;
 };
 
-/* HTTP Response structure */
+/* A growable buffer. A connection keeps its response's buffers from one
+ * request to the next, so a steady stream of dashboard polls allocates
+ * nothing; one that grew for a large body is let go afterwards. */
+struct http_buf {
+    char* data;
+    size_t len;
+    size_t cap;
+    int failed;                /* an append did not fit; the response is a 500 */
+};
+
+/* The largest response body a handler may build. Bodies are not cut short
+ * at a fixed size any more; past this one is refused rather than letting a
+ * runaway handler take the Pi's memory. */
+#define WEB_SERVER_RESPONSE_MAX (1024 * 1024)
+
+/* HTTP Response structure. A handler is given one with status 200 and an
+ * empty body, and builds its answer with the web_server_response_*()
+ * functions; the server adds Content-Length and Connection. */
 struct http_response {
     int status_code;
-    char body[8192];  /* For small responses */
     char content_type[64];
-    /* Headers stored as key-value pairs */
-    char header_keys[16][64];
-    char header_values[16][256];
-    int header_count;
-    
+    struct http_buf headers;   /* "Key: value\r\n" lines */
+    struct http_buf body;
+
     /* Streaming response support */
     int is_streaming;
-    char file_path[256];  /* Path to file for streaming */
     size_t content_length;  /* Total content length for streaming */
+    int file_fd;  /* Open file to send; the server's cache owns it */
+
+    /* Requests the connection may still carry after this one; 0 closes it.
+     * Set by the server, not the handlers. */
+    int keep_alive;
 };
 
 /* Route handler function type */
-typedef struct http_response (*route_handler_t)(const struct http_request* req);
+typedef void (*route_handler_t)(const struct http_request* req, struct http_response* res);
 
 /* WebSocket handler function type */
 typedef void (*websocket_handler_t)(int client_fd);
 
+/* A route the router leads to: a handler, or a static or file route */
+struct web_route {
+    route_handler_t handler;
+    int blocking;              /* run on a worker, not the event loop */
+    int static_idx;            /* index into the static arrays; -1 for a handler */
+};
+
 /* Rate limit info structure */
 struct rate_limit_info {
     time_t last_request;
@@ -82,29 +154,48 @@ struct web_server {
     int should_stop;
     int paused;
     int server_fd;
-    pthread_t server_thread;
+    pthread_t server_thread;   /* the event loop */
+
+    /* Event loop state, touched only by the loop thread (and by start/stop
+     * while it is not running). conns[] is indexed by the slot a connection
+     * is known by on the queues below. */
+    int loop_fd;               /* epoll set; -1 with the poll() fallback */
+    int wake_fd;               /* readable when a worker has finished */
+    int wake_wr_fd;
+    int files_fd;              /* inotify, for the file routes; -1 if none */
+    struct web_conn* conns[WEB_SERVER_MAX_CONNS];
+    int conn_count;
+    int accept_retry;          /* connections left in the backlog; try again */
+    /* Read by the daemon's metrics tick; see web_server_get_traffic() */
+    unsigned long long connections_total;
+    unsigned long long requests_total;
 
-    /* Worker pool: the accept thread enqueues client fds; workers handle them
-     * concurrently so one slow request can't stall the dashboard (#125). */
+    /* Worker pool: the loop enqueues the slots of requests that may block;
+     * workers handle them concurrently and put them on done_queue for the
+     * loop to write, so one slow request can't stall the dashboard (#125). */
     struct conn_queue conn_queue;
+    struct conn_queue done_queue;
     pthread_t worker_threads[WEB_SERVER_WORKER_COUNT];
     int worker_count;
     /* Guards the rate-limit table and the websocket connection list, both of
      * which are now mutated from multiple worker threads and the broadcaster. */
     pthread_mutex_t state_mutex;
 
-    /* Route storage - using arrays instead of maps */
-    char route_methods[32][16];
-    char route_paths[32][256];
-    route_handler_t route_handlers[32];
+    /* Routes. The router maps method and path to an index into routes[],
+     * which grows as routes are added; static and file routes are in it
+     * under method "*", pointing at their content below. */
+    struct web_router router;
+    struct web_route* routes;
     int route_count;
+    int route_capacity;
     
-    /* Static routes */
+    /* Static routes' content */
     char static_paths[16][256];
     char static_file_paths[16][256];  /* File paths for large files */
     char static_contents[16][8192];   /* Small content for inline responses */
     char static_content_types[16][64];
     int static_is_file[16];  /* 1 if using file path, 0 if using content */
+    struct web_file* static_files[16];  /* open file and ETag, for file routes */
     int static_count;
     
     /* WebSocket connections */
@@ -131,18 +222,34 @@ void web_server_resume(struct web_server* server);
 int web_server_is_running(const struct web_server* server);
 int web_server_is_paused(const struct web_server* server);
 
-/* Snapshot the worker pool's connection-queue health (depth, high-water mark,
- * connections accepted, connections shed under back-pressure). NULL-safe: zeroes
+/* Snapshot the worker pool's queue health (depth, high-water mark, requests
+ * handed to workers, requests shed under back-pressure). NULL-safe: zeroes
  * the output if the server isn't running. Lets the daemon publish worker-pool
  * saturation as metrics, the way #170 did for the async logger queue. */
 void web_server_get_conn_stats(struct web_server* server, struct conn_queue_stats* out);
 
+/* Connections accepted and requests served since start. Their ratio is how
+ * well keep-alive is working: requests - connections of the requests came
+ * in on a connection that was already open. NULL-safe like the above. */
+struct web_server_traffic {
+    unsigned long long connections;
+    unsigned long long requests;
+};
+void web_server_get_traffic(struct web_server* server, struct web_server_traffic* out);
+
 /* Configuration */
 void web_server_set_port(struct web_server* server, int port);
 int web_server_get_port(const struct web_server* server);
 
-/* Route management */
+/* Route management. A path may hold ":name" segments and end in a "*name"
+ * wildcard (see web_router.h); a handler reads what they matched with
+ * web_server_request_param(). Adding a method and path again replaces the
+ * route. */
 void web_server_add_route(struct web_server* server, const char* method, const char* path, route_handler_t handler);
+/* A route whose handler may block -- on a lock the engine holds, a child
+ * process, the disk -- and so runs on a worker thread instead of the event
+ * loop. */
+void web_server_add_blocking_route(struct web_server* server, const char* method, const char* path, route_handler_t handler);
 void web_server_add_static_route(struct web_server* server, const char* path, const char* content, const char* content_type);
 void web_server_add_file_route(struct web_server* server, const char* path, const char* file_path, const char* content_type);
 
@@ -153,35 +260,65 @@ void web_server_setup_api_routes(struct web_server* server);
 void web_server_add_websocket_route(struct web_server* server, const char* path, websocket_handler_t handler);
 void web_server_broadcast_to_websockets(struct web_server* server, const char* message);
 
-/* HTTP parsing and response functions */
-struct http_request web_server_parse_request(const char* raw_request);
-struct http_response web_server_process_request(struct web_server* server, const struct http_request* request);
-char* web_server_serialize_response(const struct http_response* response);
-int web_server_send_streaming_response(int client_fd, const struct http_response* response);
+/* HTTP parsing and response functions. The parser fills `request` with
+ * slices of buf[0, len); -1 if the request line is malformed. */
+int web_server_parse_request(const char* buf, size_t len, struct http_request* request);
+void web_server_process_request(struct web_server* server, const struct http_request* request,
+                                struct http_response* response);
+/* The status line and headers, ending in the blank line, into `out`. The
+ * body (or the file) follows them on the wire. 0, or -1 if out of memory. */
+int web_server_serialize_head(const struct http_response* response, struct http_buf* out);
+
+/* Request accessors. A header's value, and its length in *len, or NULL if
+ * the request has none by that (case-insensitive) name. */
+const char* web_server_request_header(const struct http_request* request, const char* name,
+                                      size_t* len);
+/* Decode query parameter `key` into value; 0, leaving value as it was, if
+ * it is absent */
+int web_server_request_query(const struct http_request* request, const char* key,
+                             char* value, size_t size);
+/* Decode path parameter `name` into value; 0, leaving value as it was, if
+ * the route has none by that name */
+int web_server_request_param(const struct http_request* request, const char* name,
+                             char* value, size_t size);
+/* Whether a slice of the request is exactly `text` */
+int web_server_slice_equals(const struct http_request* request, struct http_slice slice,
+                            const char* text);
+
+/* Response builder */
+void web_server_response_init(struct http_response* response);
+/* Back to a fresh 200, keeping the buffers' memory */
+void web_server_response_reset(struct http_response* response);
+void web_server_response_free(struct http_response* response);
+void web_server_response_header(struct http_response* response, const char* key, const char* value);
+void web_server_response_append(struct http_response* response, const char* data, size_t len);
+void web_server_response_puts(struct http_response* response, const char* text);
+void web_server_response_printf(struct http_response* response, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
 
 /* Internal server functions */
 void web_server_init_socket(struct web_server* server);
-void web_server_handle_client(struct web_server* server, int client_fd);
 
 /* Helper functions */
 char* web_server_url_decode(const char* str, char* result, size_t result_size);
-void web_server_parse_query_string(const char* query, struct http_request* request);
 int web_server_is_websocket_upgrade(const struct http_request* request);
 
 /* Default handlers */
-struct http_response web_server_handle_not_found(const struct http_request* request);
-struct http_response web_server_handle_api_status(const struct http_request* request);
-struct http_response web_server_handle_api_metrics(const struct http_request* request);
-struct http_response web_server_handle_api_health(const struct http_request* request);
-struct http_response web_server_handle_api_config(const struct http_request* request);
-struct http_response web_server_handle_api_state(const struct http_request* request);
-struct http_response web_server_handle_api_control(const struct http_request* request);
-struct http_response web_server_handle_api_logs(const struct http_request* request);
-struct http_response web_server_handle_api_plugins(const struct http_request* request);
-struct http_response web_server_handle_api_update(const struct http_request* request);
-struct http_response web_server_handle_api_version(const struct http_request* request);
-struct http_response web_server_handle_api_check_update(const struct http_request* request);
-struct http_response web_server_handle_dashboard(const struct http_request* request);
+void web_server_handle_not_found(const struct http_request* request, struct http_response* response);
+void web_server_handle_api_status(const struct http_request* request, struct http_response* response);
+void web_server_handle_api_metrics(const struct http_request* request, struct http_response* response);
+void web_server_handle_api_metrics_history(const struct http_request* request, struct http_response* response);
+void web_server_handle_api_health(const struct http_request* request, struct http_response* response);
+void web_server_handle_api_config(const struct http_request* request, struct http_response* response);
+void web_server_handle_api_state(const struct http_request* request, struct http_response* response);
+void web_server_handle_api_control(const struct http_request* request, struct http_response* response);
+void web_server_handle_api_logs(const struct http_request* request, struct http_response* response);
+void web_server_handle_api_plugins(const struct http_request* request, struct http_response* response);
+void web_server_handle_api_plugin_activate(const struct http_request* request, struct http_response* response);
+void web_server_handle_api_update(const struct http_request* request, struct http_response* response);
+void web_server_handle_api_version(const struct http_request* request, struct http_response* response);
+void web_server_handle_api_check_update(const struct http_request* request, struct http_response* response);
+void web_server_handle_dashboard(const struct http_request* request, struct http_response* response);
 
 /* Utility functions */
 int web_server_is_in_call(void);
@@ -189,7 +326,7 @@ int web_server_is_ringing(void);
 int web_server_is_high_priority_state(void);
 int web_server_is_audio_active(void);
 int web_server_check_rate_limit(struct web_server* server, const char* client_ip, const char* endpoint);
-struct http_response web_server_create_rate_limit_response(void);
+void web_server_create_rate_limit_response(struct http_response* response);
 
 /* String utility functions */
 void web_server_strcpy_safe(char* dest, const char* src, size_t dest_size);